@@ -0,0 +1,57 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   What the host tests and benchmarks share : running the NCI stateMachine against the PN7150Simulator for a while, and checking results.
+//   A test's main() ends with 'return testResult();' : exit code 0 when every CHECK() passed.
+
+#include <cstdio>
+#include "NCI.h"
+#include "PN7150Simulator.h"
+
+static unsigned nmbrOfChecks{0};
+static unsigned nmbrOfFailedChecks{0};
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        nmbrOfChecks++;                                                                   \
+        if (!(condition)) {                                                               \
+            nmbrOfFailedChecks++;                                                         \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);        \
+        }                                                                                 \
+    } while (0)
+
+static inline int testResult() {
+    printf("%u checks, %u failed\n", nmbrOfChecks, nmbrOfFailedChecks);
+    return (0 == nmbrOfFailedChecks) ? 0 : 1;
+}
+
+// Run the NCI for maxTime [ms], or until done() returns true. In between, sleep until the simulator has a message or the NCI a deadline
+static inline bool runNci(NCI &theNci, PN7150Simulator &theSimulator, unsigned long maxTime, bool (*done)() = nullptr) {
+    unsigned long startTime = millis();
+    while ((millis() - startTime) < maxTime) {
+        theNci.run();
+        if ((nullptr != done) && done()) {
+            return true;
+        }
+        long untilDeadline = static_cast<long>(theNci.nextDeadline() - millis());
+        long untilEnd      = static_cast<long>(maxTime - (millis() - startTime));
+        if (untilDeadline > untilEnd) {
+            untilDeadline = untilEnd;
+        }
+        if (untilDeadline > 0) {
+            theSimulator.waitForMessage(static_cast<unsigned long>(untilDeadline));
+        }
+    }
+    return false;
+}
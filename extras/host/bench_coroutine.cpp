@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   The C++20 coroutine layer against the simulator : a CORE_GET_CONFIG, waiting for a tag, T2T READ, WRITE and READ to verify, as one coroutine.
+//   Then what a resume costs, next to one step of the same 'one step per call' pattern written as a switch, and NCI::run() with nothing to do.
+//   Built with -std=c++20 and a 640 byte frame, see the Makefile.
+
+#include <chrono>
+#include <coroutine>
+#include "HostTest.h"
+#include "NciCoroutine.h"
+
+static uint64_t nanoSeconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+class SequenceResult {
+  public:
+    uint8_t commandStatus{0xFF};
+    bool arrived{false};
+    uint32_t readLength{0};
+    uint32_t writeLength{0};
+    uint32_t verifyLength{0};
+    uint8_t page[4]{};
+    bool done{false};
+};
+
+static NciTask readWriteVerify(NciCoroutines &nfc, SequenceResult &theResult) {
+    static const uint8_t getConfig[2] = {1, TOTAL_DURATION};
+    uint8_t response[8];
+    theResult.commandStatus = co_await nfc.command(GroupIdCore, CORE_GET_CONFIG_CMD, getConfig, sizeof(getConfig), response, sizeof(response));
+    theResult.arrived       = co_await nfc.event(NciEventType::tagArrived, 2000);
+    if (!theResult.arrived) {
+        theResult.done = true;
+        co_return;
+    }
+    static const uint8_t readCommand[2]  = {0x30, 0x04};
+    static const uint8_t writeCommand[6] = {0xA2, 0x04, 0xDE, 0xAD, 0xBE, 0xEF};
+    uint8_t answer[20];
+    uint8_t ack[4];
+    theResult.readLength   = co_await nfc.transceive(readCommand, sizeof(readCommand), answer, sizeof(answer), 50);
+    theResult.writeLength  = co_await nfc.transceive(writeCommand, sizeof(writeCommand), ack, sizeof(ack), 50);
+    theResult.verifyLength = co_await nfc.transceive(readCommand, sizeof(readCommand), answer, sizeof(answer), 50);
+    for (uint32_t index = 0; index < 4; index++) {
+        theResult.page[index] = answer[index];
+    }
+    theResult.done = true;
+}
+
+static volatile uint32_t sink;
+
+static NciTask spinner(NciCoroutines &nfc, uint32_t nmbrOfResumes) {
+    for (uint32_t index = 0; index < nmbrOfResumes; index++) {
+        co_await nfc.wait(0);
+        sink = sink + 1;
+    }
+}
+
+class SwitchMachine {        // the same pattern as the NCI stateMachine : one step per call
+  public:
+    volatile uint8_t state{0};
+    uint32_t count{0};
+    __attribute__((noinline)) void step() {
+        switch (state) {
+            case 0:
+                state = 1;
+                break;
+            case 1:
+                state = 2;
+                break;
+            default:
+                state = 0;
+                count++;
+                break;
+        }
+    }
+};
+
+class RawTask {        // a bare coroutine, without the NciCoroutines scheduler
+  public:
+    class promise_type {
+      public:
+        RawTask get_return_object() { return RawTask{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+    };
+    std::coroutine_handle<promise_type> theHandle;
+};
+
+static RawTask rawSpinner(uint32_t nmbrOfResumes) {
+    for (uint32_t index = 0; index < nmbrOfResumes; index++) {
+        co_await std::suspend_always{};
+        sink = sink + 1;
+    }
+}
+
+static void testSequence(PN7150Simulator &theSimulator, NCI &theNci, NciCoroutines &nfc) {
+    SequenceResult theResult;
+    NciTask theTask = readWriteVerify(nfc, theResult);
+    CHECK(theTask.isValid());
+    unsigned long startTime = millis();
+    bool tagAdded           = false;
+    while (((millis() - startTime) < 1500) && !theTask.isDone()) {
+        if (!tagAdded && ((millis() - startTime) > 300)) {
+            SimulatedTag theTag;
+            theTag.memory.assign(64, 0x11);
+            theSimulator.addTag(theTag);
+            tagAdded = true;
+        }
+        uint32_t resumesBefore = nfc.getNmbrOfResumes();
+        theNci.run();
+        nfc.run();
+        long untilNci        = static_cast<long>(theNci.nextDeadline() - millis());
+        long untilCoroutines = static_cast<long>(nfc.nextDeadline() - millis());
+        long untilDeadline   = (untilNci < untilCoroutines) ? untilNci : untilCoroutines;
+        if ((untilDeadline > 0) && (nfc.getNmbrOfResumes() == resumesBefore)) {
+            theSimulator.waitForMessage(static_cast<unsigned long>(untilDeadline));
+        }
+    }
+    CHECK(theResult.done);
+    CHECK(STATUS_INVALID_PARAM == theResult.commandStatus);        // the Response came : TOTAL_DURATION was never set, so the simulated NFCC does not know it
+    CHECK(theResult.arrived);
+    CHECK(17 == theResult.readLength);        // 4 pages, and the status byte the Frame RF Interface appends
+    CHECK(2 == theResult.writeLength);        // the 4 bit ACK, and the status byte
+    CHECK(17 == theResult.verifyLength);
+    CHECK((0xDE == theResult.page[0]) && (0xAD == theResult.page[1]) && (0xBE == theResult.page[2]) && (0xEF == theResult.page[3]));
+    printf("5 step sequence : %u resumes, largest frame %zu bytes, pool %u x %u\n", nfc.getNmbrOfResumes(), NciFramePool::getLargestRequest(), static_cast<unsigned>(NciFramePool::nmbrOfFrames), static_cast<unsigned>(NciFramePool::frameSize));
+}
+
+static void benchResume(NCI &theNci, NciCoroutines &nfc) {
+    const uint32_t nmbrOfSteps = 3000000;
+    {
+        NciTask theTask        = spinner(nfc, nmbrOfSteps);
+        uint32_t resumesBefore = nfc.getNmbrOfResumes();
+        uint64_t startTime     = nanoSeconds();
+        while (!theTask.isDone()) {
+            nfc.run();
+        }
+        uint32_t nmbrOfResumes = nfc.getNmbrOfResumes() - resumesBefore;
+        printf("resume through NciCoroutines::run() : %.1f ns\n", static_cast<double>(nanoSeconds() - startTime) / nmbrOfResumes);
+    }
+    {
+        RawTask theTask    = rawSpinner(nmbrOfSteps);
+        uint64_t startTime = nanoSeconds();
+        while (!theTask.theHandle.done()) {
+            theTask.theHandle.resume();
+        }
+        printf("bare coroutine_handle::resume() : %.2f ns\n", static_cast<double>(nanoSeconds() - startTime) / nmbrOfSteps);
+        theTask.theHandle.destroy();
+    }
+    {
+        SwitchMachine theMachine;
+        uint64_t startTime = nanoSeconds();
+        for (uint32_t index = 0; index < nmbrOfSteps; index++) {
+            theMachine.step();
+        }
+        printf("switch step : %.2f ns\n", static_cast<double>(nanoSeconds() - startTime) / nmbrOfSteps);
+    }
+    {
+        uint64_t startTime = nanoSeconds();
+        for (uint32_t index = 0; index < nmbrOfSteps; index++) {
+            sink = sink + millis();
+        }
+        printf("millis() : %.1f ns\n", static_cast<double>(nanoSeconds() - startTime) / nmbrOfSteps);
+    }
+    {
+        uint64_t startTime = nanoSeconds();
+        for (uint32_t index = 0; index < nmbrOfSteps; index++) {
+            theNci.run();
+        }
+        printf("NCI::run() with nothing pending (state %u) : %.1f ns\n", static_cast<unsigned>(theNci.getState()), static_cast<double>(nanoSeconds() - startTime) / nmbrOfSteps);
+    }
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    NciCoroutines nfc(theNci);
+    theNci.setPresenceCheckPeriod(100);
+    theNci.initialize();
+    testSequence(theSimulator, theNci, nfc);
+    benchResume(theNci, nfc);
+    return testResult();
+}
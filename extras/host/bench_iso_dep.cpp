@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Time per APDU with IsoDepTransceiver against the simulated APDU card, with the simulator's default 1 ms data latency, at 0 and 85 us per byte
+//   on the RF (106 kbit/s). The mix is SELECT, READ BINARY of 128 bytes and GET DATA.
+//   - one APDU per activation : the tag operation ends after each, so the card is deactivated and discovered again
+//   - batches of 10 : the next APDU goes to the NFCC in the run() which completed the last
+//   Reports the transceive time per APDU, as IsoDepStatistics measures it, and the wall time per APDU.
+
+#include "HostTest.h"
+#include "IsoDep.h"
+
+static constexpr uint32_t nmbrOfApdus  = 10;
+static constexpr uint32_t nmbrOfRounds = 10;
+
+static Apdu *script{nullptr};
+static uint32_t scriptLength{0};
+static bool isPending{false};
+static bool isStarted{false};
+static bool isLastOk{false};
+
+static bool runScript(NCI &, uint8_t, void *context) {
+    IsoDepTransceiver &theTransceiver = *static_cast<IsoDepTransceiver *>(context);
+    if (!isPending) {
+        return true;
+    }
+    if (!isStarted) {
+        isStarted = true;
+        if (!theTransceiver.transceive(script, scriptLength)) {
+            isPending = false;
+            isLastOk  = false;
+            return true;
+        }
+    }
+    bool isDone = theTransceiver.run();
+    if (isDone) {
+        isPending = false;
+        isLastOk  = theTransceiver.isOk();
+    }
+    return isDone;
+}
+
+static bool isScriptDone() {
+    return !isPending;
+}
+
+static bool transceive(NCI &theNci, PN7150Simulator &theSimulator, Apdu theApdus[], uint32_t nmbrOfApdusInScript) {
+    script       = theApdus;
+    scriptLength = nmbrOfApdusInScript;
+    isStarted    = false;
+    isPending    = true;
+    runNci(theNci, theSimulator, 5000, isScriptDone);
+    isPending = false;
+    return isLastOk;
+}
+
+static uint8_t commands[nmbrOfApdus][32];
+static uint8_t responses[nmbrOfApdus][300];
+
+static void benchApdus(unsigned long rfByteTime) {
+    PN7150Simulator theSimulator;
+    theSimulator.setRfByteTime(rfByteTime);
+    NCI theNci(theSimulator);
+    IsoDepTransceiver theTransceiver(theNci);
+    theSimulator.addTag(SimulatedTag::isoDepCard());
+    theNci.setTagOperation(runScript, &theTransceiver, 5000);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 300);
+
+    static const uint8_t aid[] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+    Apdu apdus[nmbrOfApdus];
+    for (uint32_t index = 0; index < nmbrOfApdus; index++) {
+        uint32_t length;
+        if (0 == (index % 3)) {
+            length = Apdu::encode(commands[index], 0x00, 0xA4, 0x04, 0x00, aid, sizeof(aid), 256);        // SELECT
+        } else if (1 == (index % 3)) {
+            length = Apdu::encode(commands[index], 0x00, 0xB0, 0x00, static_cast<uint8_t>(index * 16), nullptr, 0, 128);        // READ BINARY
+        } else {
+            length = Apdu::encode(commands[index], 0x00, 0xCA, 0x00, 0x00, nullptr, 0, 256);        // GET DATA
+        }
+        apdus[index].command       = commands[index];
+        apdus[index].commandLength = length;
+        apdus[index].response      = responses[index];
+        apdus[index].responseSize  = sizeof(responses[index]);
+    }
+    const IsoDepStatistics &theStatistics = theTransceiver.getStatistics();
+
+    theTransceiver.resetStatistics();
+    uint32_t nmbrOkSingle   = 0;
+    unsigned long startTime = micros();
+    for (uint32_t round = 0; round < nmbrOfRounds; round++) {
+        for (uint32_t index = 0; index < nmbrOfApdus; index++) {
+            nmbrOkSingle += transceive(theNci, theSimulator, &apdus[index], 1) ? 1 : 0;
+        }
+    }
+    double singleWall           = static_cast<double>(micros() - startTime) / (nmbrOfRounds * nmbrOfApdus);
+    unsigned long singleAverage = theStatistics.getAverageApduTime();
+    printf("RF %2lu us/byte, one APDU per activation : %3u ok, %6lu us/APDU transceive (max %6lu), %7.0f us/APDU wall, %u exchanges\n", rfByteTime, nmbrOkSingle, singleAverage, theStatistics.maxApduTime, singleWall, theStatistics.nmbrOfExchanges);
+    CHECK((nmbrOfRounds * nmbrOfApdus) == nmbrOkSingle);
+    CHECK((nmbrOfRounds * nmbrOfApdus) == theStatistics.nmbrOfExchanges);        // none needed chaining or GET RESPONSE
+
+    theTransceiver.resetStatistics();
+    uint32_t nmbrOkBatch = 0;
+    startTime            = micros();
+    for (uint32_t round = 0; round < nmbrOfRounds; round++) {
+        nmbrOkBatch += transceive(theNci, theSimulator, apdus, nmbrOfApdus) ? 1 : 0;
+    }
+    double batchWall = static_cast<double>(micros() - startTime) / (nmbrOfRounds * nmbrOfApdus);
+    bool isContentOk = (128 == apdus[1].responseLength) && (16 == apdus[1].response[0]) && (4 == apdus[2].responseLength) && (0x08 == apdus[2].response[0]);
+    printf("RF %2lu us/byte, batches of %u          : %3u ok, %6lu us/APDU transceive (max %6lu), %7.0f us/APDU wall, content %s\n", rfByteTime, nmbrOfApdus, nmbrOkBatch, theStatistics.getAverageApduTime(), theStatistics.maxApduTime, batchWall, isContentOk ? "ok" : "WRONG");
+    CHECK(nmbrOfRounds == nmbrOkBatch);
+    CHECK((nmbrOfRounds * nmbrOfApdus) == theStatistics.nmbrOfApdus);
+    CHECK(isContentOk);
+    CHECK((batchWall * 2) < singleWall);        // no deactivation and discovery in between
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    benchApdus(0);
+    benchApdus(85);
+    return testResult();
+}
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   NdefParser throughput on synthetic messages of about 860 bytes, what an NTAG216 holds : one long record, many short ones, a chunked record,
+//   and short ones inside the TLVs of a Type 2 Tag's Data Area. Then NdefBuilder, and end to end : a message built, written to a simulated NTAG216
+//   with Type2TagWriter, and parsed while Type2TagReader reads it back.
+
+#include <chrono>
+#include "HostTest.h"
+#include "Ndef.h"
+#include "Type2Tag.h"
+#include <vector>
+
+static uint64_t nanoSeconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static constexpr uint32_t nmbrOfIterations = 200000;
+static volatile uint32_t sink;
+
+class ParseCase {
+  public:
+    const char *name;
+    std::vector<uint8_t> buffer;
+    bool isTlv;
+    uint32_t nmbrOfRecords;        // expected
+};
+
+static uint32_t parseAll(const ParseCase &theCase) {        // the records, after the parser reached the end
+    NdefParser theParser;
+    if (theCase.isTlv) {
+        theParser.startTlv(theCase.buffer.data());
+    } else {
+        theParser.startMessage(theCase.buffer.data(), static_cast<uint32_t>(theCase.buffer.size()));
+    }
+    NdefRecord theRecord;
+    uint32_t payloadLength = 0;
+    NdefParseResult result;
+    while (NdefParseResult::record == (result = theParser.next(theRecord, static_cast<uint32_t>(theCase.buffer.size())))) {
+        payloadLength += theRecord.payloadLength;
+    }
+    sink = payloadLength;
+    return (NdefParseResult::end == result) ? theParser.getNmbrOfRecords() : 0;
+}
+
+static void benchParse(const ParseCase &theCase) {
+    uint32_t nmbrOfRecords = parseAll(theCase);
+    uint64_t startTime     = nanoSeconds();
+    for (uint32_t iteration = 0; iteration < nmbrOfIterations; iteration++) {
+        parseAll(theCase);
+    }
+    double perMessage = static_cast<double>(nanoSeconds() - startTime) / nmbrOfIterations;
+    printf("parse %-38s : %4zu bytes, %3u records, %6.1f ns/message, %5.1f ns/record, %5.0f MB/s\n", theCase.name, theCase.buffer.size(), nmbrOfRecords, perMessage, perMessage / nmbrOfRecords, theCase.buffer.size() / perMessage * 1000.0);
+    CHECK(theCase.nmbrOfRecords == nmbrOfRecords);
+}
+
+static std::vector<uint8_t> uriRecords(uint32_t maxLength) {
+    uint8_t buffer[1024];
+    NdefBuilder theBuilder(buffer, sizeof(buffer));
+    char uri[64];
+    for (uint32_t index = 0; theBuilder.getLength() < maxLength; index++) {
+        snprintf(uri, sizeof(uri), "https://example.com/r/%04u", index);
+        theBuilder.addUri(uri);
+    }
+    return std::vector<uint8_t>(buffer, buffer + theBuilder.getLength());
+}
+
+static void benchBuild() {
+    uint8_t buffer[1024];
+    uint32_t nmbrOfRecords = 0;
+    uint64_t startTime     = nanoSeconds();
+    for (uint32_t iteration = 0; iteration < nmbrOfIterations; iteration++) {
+        NdefBuilder theBuilder(buffer, sizeof(buffer));
+        for (uint32_t index = 0; index < 28; index++) {
+            theBuilder.addUri("https://example.com/r/0000");
+        }
+        nmbrOfRecords = theBuilder.getNmbrOfRecords();
+        sink          = theBuilder.getLength();
+    }
+    double perMessage = static_cast<double>(nanoSeconds() - startTime) / nmbrOfIterations;
+    printf("build %u URI records                          : %6.1f ns/message, %5.1f ns/record\n", nmbrOfRecords, perMessage, perMessage / nmbrOfRecords);
+    CHECK(28 == nmbrOfRecords);
+}
+
+class EndToEnd {
+  public:
+    Type2TagWriter *theWriter{nullptr};
+    Type2TagReader *theReader{nullptr};
+    NdefBuilder *theBuilder{nullptr};
+    uint8_t phase{0};        // 0 : writing, 1 : start reading, 2 : reading and parsing, 3 : done
+    NdefParser theParser;
+    uint32_t nmbrOfRecords{0};
+    unsigned long startTime{0};              // [us]
+    unsigned long firstRecordTime{0};        // [us] after startTime
+    unsigned long readTime{0};               // [us] after startTime
+};
+
+static constexpr uint16_t nmbrOfPagesToRead = 222;        // the Data Area of an NTAG216, from page 4
+static uint8_t writeBuffer[Type2TagWriter::getBufferSize(900)];
+static uint8_t readBuffer[Type2TagReader::getBufferSize(nmbrOfPagesToRead)];
+
+static bool writeThenRead(NCI &, uint8_t, void *context) {
+    EndToEnd &theTest = *static_cast<EndToEnd *>(context);
+    if (0 == theTest.phase) {
+        if (!theTest.theWriter->isBusy()) {
+            theTest.theWriter->write(writeBuffer, theTest.theBuilder->getMessage(), static_cast<uint16_t>(theTest.theBuilder->getLength()));
+        }
+        if (theTest.theWriter->run()) {
+            theTest.phase = 1;
+        }
+        return false;
+    }
+    if (1 == theTest.phase) {
+        theTest.theReader->read(readBuffer, 4, nmbrOfPagesToRead);
+        theTest.theParser.startTlv(readBuffer);
+        theTest.startTime = micros();
+        theTest.phase     = 2;
+    }
+    bool isDone = theTest.theReader->run();
+    NdefRecord theRecord;
+    while (NdefParseResult::record == theTest.theParser.next(theRecord, theTest.theReader->getNmbrOfBytesRead())) {
+        if (0 == theTest.nmbrOfRecords++) {
+            theTest.firstRecordTime = micros() - theTest.startTime;
+        }
+    }
+    if (isDone) {
+        theTest.readTime = micros() - theTest.startTime;
+        theTest.phase    = 3;
+    }
+    return isDone;
+}
+
+static EndToEnd *theEndToEnd;
+
+static bool isDone() {
+    return (3 == theEndToEnd->phase);
+}
+
+static void benchEndToEnd() {
+    PN7150Simulator theSimulator;
+    theSimulator.setRfByteTime(85);
+    theSimulator.setTagWriteTime(4100);
+    NCI theNci(theSimulator);
+    Type2TagWriter theWriter(theNci);
+    Type2TagReader theReader(theNci);
+    static uint8_t message[900];
+    NdefBuilder theBuilder(message, sizeof(message));
+    std::vector<uint8_t> json(300, 'q');
+    std::vector<uint8_t> fill(400, 'f');
+    theBuilder.addUri("https://www.example.com/first");
+    theBuilder.addRecord(NdefTnf::mimeMedia, "application/json", json.data(), static_cast<uint32_t>(json.size()));
+    theBuilder.addText("last record, at the end of the tag");
+    theBuilder.addRecord(NdefTnf::external, "example.com:fill", fill.data(), static_cast<uint32_t>(fill.size()));
+    theSimulator.addTag(SimulatedTag::ntag216());
+
+    EndToEnd theTest;
+    theTest.theWriter  = &theWriter;
+    theTest.theReader  = &theReader;
+    theTest.theBuilder = &theBuilder;
+    theEndToEnd        = &theTest;
+    theNci.setTagOperation(writeThenRead, &theTest, 10000);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 10000, isDone);
+    printf("NTAG216, a %u byte message of 4 records : written %s, %u records read back, the first after %.1f ms of a %.1f ms read\n", theBuilder.getLength(), theWriter.isOk() ? "ok" : "FAILED", theTest.nmbrOfRecords, theTest.firstRecordTime / 1000.0, theTest.readTime / 1000.0);
+    CHECK(theWriter.isOk());
+    CHECK(theReader.isOk());
+    CHECK(4 == theTest.nmbrOfRecords);
+    CHECK(theTest.firstRecordTime < (theTest.readTime / 2));        // used long before the whole tag is read
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    std::vector<ParseCase> cases;
+
+    uint8_t buffer[1024];
+    NdefBuilder theBuilder(buffer, sizeof(buffer));
+    std::vector<uint8_t> payload(870, 'x');
+    theBuilder.addRecord(NdefTnf::mimeMedia, "text/plain", payload.data(), static_cast<uint32_t>(payload.size()));
+    cases.push_back({"1 MIME record of 870 bytes (normal)", std::vector<uint8_t>(buffer, buffer + theBuilder.getLength()), false, 1});
+
+    std::vector<uint8_t> uris = uriRecords(840);
+    cases.push_back({"URI records of 30 bytes (SR)", uris, false, 37});
+
+    std::vector<uint8_t> chunked{NDEF_MB | NDEF_CF | NDEF_SR | 0x02, 10, 40, 't', 'e', 'x', 't', '/', 'p', 'l', 'a', 'i', 'n'};
+    chunked.insert(chunked.end(), 40, 'y');
+    for (uint32_t index = 1; index < 20; index++) {
+        chunked.insert(chunked.end(), {static_cast<uint8_t>(((index < 19) ? NDEF_CF : NDEF_ME) | NDEF_SR | 0x06), 0, 40});
+        chunked.insert(chunked.end(), 40, 'z');
+    }
+    cases.push_back({"chunked MIME, 20 chunks of 40 bytes", chunked, false, 20});
+
+    std::vector<uint8_t> area{TLV_NULL, TLV_NULL, TLV_NDEF_MESSAGE, 0xFF, static_cast<uint8_t>(uris.size() >> 8), static_cast<uint8_t>(uris.size())};
+    area.insert(area.end(), uris.begin(), uris.end());
+    area.push_back(TLV_TERMINATOR);
+    cases.push_back({"URI records in a T2T Data Area (TLV)", area, true, 37});
+
+    for (const ParseCase &theCase : cases) {
+        benchParse(theCase);
+    }
+    benchBuild();
+    benchEndToEnd();
+    return testResult();
+}
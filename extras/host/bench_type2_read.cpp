@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Type2TagReader reading a whole simulated NTAG216 (231 pages, 924 bytes, 85 us per byte on air), 20 times per mode :
+//   - FAST_READ, after GET_VERSION
+//   - READ only, with setDetectVersion(false)
+//   - a tag which does not answer GET_VERSION, so falls back to READ
+//   Reports bytes/s, time per tag and RF round trips per KB, and checks the contents read.
+
+#include "HostTest.h"
+#include "Type2Tag.h"
+#include <string.h>
+
+static constexpr uint16_t nmbrOfPages = 231;
+static constexpr uint32_t nmbrOfReads = 20;
+
+static uint8_t memory[Type2TagReader::getBufferSize(nmbrOfPages)];
+static uint32_t nmbrOfCompleted{0};
+
+static bool readTag(NCI &, uint8_t, void *context) {
+    Type2TagReader &theReader = *static_cast<Type2TagReader *>(context);
+    if (!theReader.isBusy() && !theReader.read(memory, 0, nmbrOfPages)) {
+        return true;
+    }
+    bool isDone = theReader.run();
+    if (isDone) {
+        nmbrOfCompleted++;
+    }
+    return isDone;
+}
+
+static bool isEnoughRead() {
+    return (nmbrOfCompleted >= nmbrOfReads);
+}
+
+enum class Mode : uint8_t {
+    fastRead,
+    readOnly,
+    noVersion
+};
+
+static void benchRead(Mode theMode) {
+    PN7150Simulator theSimulator;
+    theSimulator.setRfByteTime(85);
+    NCI theNci(theSimulator);
+    Type2TagReader theReader(theNci);
+    SimulatedTag theTag = SimulatedTag::ntag216();
+    for (size_t index = 16; index < theTag.memory.size(); index++) {
+        theTag.memory[index] = static_cast<uint8_t>((index * 7) + 3);
+    }
+    if (Mode::noVersion == theMode) {
+        theTag.version.clear();
+    }
+    theSimulator.addTag(theTag);
+    theReader.setDetectVersion(Mode::readOnly != theMode);
+    theNci.setTagOperation(readTag, &theReader, 2000);
+    nmbrOfCompleted = 0;
+    theNci.initialize();
+    runNci(theNci, theSimulator, 20000, isEnoughRead);
+
+    const Type2TagStatistics &theStatistics = theReader.getStatistics();
+    bool isIdentical                        = (0 == memcmp(memory, theTag.memory.data(), nmbrOfPages * Type2TagReader::pageSize));
+    uint32_t nmbrOfAttempts                 = theStatistics.nmbrOfReads + theStatistics.nmbrOfFailures;
+    double msPerTag                         = (theStatistics.nmbrOfReads > 0) ? (theStatistics.readTime / 1000.0 / theStatistics.nmbrOfReads) : 0.0;
+    double roundTripsPerKb                  = (theStatistics.nmbrOfBytes > 0) ? (theStatistics.nmbrOfRequests * 1024.0 / theStatistics.nmbrOfBytes) : 0.0;
+    printf("%-16s : %u reads ok %u failed, %lu bytes/s, %.1f ms per tag, %.2f round trips/KB (%.1f per tag), content %s\n", (Mode::fastRead == theMode) ? "FAST_READ" : (Mode::readOnly == theMode) ? "READ only" : "no GET_VERSION", theStatistics.nmbrOfReads, theStatistics.nmbrOfFailures, theStatistics.getBytesPerSecond(), msPerTag, roundTripsPerKb, (nmbrOfAttempts > 0) ? (theStatistics.nmbrOfRequests / static_cast<double>(nmbrOfAttempts)) : 0.0, isIdentical ? "identical" : "DIFFERS");
+
+    CHECK(theStatistics.nmbrOfReads >= nmbrOfReads);
+    CHECK(0 == theStatistics.nmbrOfFailures);
+    CHECK(isIdentical);
+    CHECK((Mode::fastRead == theMode) == (nmbrOfPages == theReader.getNmbrOfPages()));
+    if (Mode::fastRead == theMode) {
+        CHECK(roundTripsPerKb < 10.0);        // one FAST_READ per Data packet
+    } else {
+        CHECK(roundTripsPerKb > 60.0);        // one READ per 16 bytes
+    }
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    benchRead(Mode::fastRead);
+    benchRead(Mode::readOnly);
+    benchRead(Mode::noVersion);
+    return testResult();
+}
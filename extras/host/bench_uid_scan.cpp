@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   UID-only scan against full activation, for Type 2 Tags and ISO-DEP cards, NFC-A with the default 20 ms poll period.
+//   - taps : a new card each time, which leaves as soon as its UID is read. Time from entering the field to its UID, and commands per tap
+//   - a card held in the field : how often its UID is read, and the commands it takes each time
+
+#include "HostTest.h"
+
+static constexpr uint32_t nmbrOfTaps = 100;
+
+static NCI *theNciUnderTest;
+static uint32_t nmbrOfActivations{0};
+static unsigned long lastActivationTime{0};
+static uint8_t lastUid{0xFF};
+static uint8_t wantedUid{0};
+
+static void onActivated(const NciEvent &theEvent, void *) {
+    if (NciEventType::tagActivated == theEvent.type) {
+        nmbrOfActivations++;
+        lastActivationTime = micros();
+        lastUid            = theNciUnderTest->getTag(theNciUnderTest->getActiveTagIndex())->uniqueId[6];
+    }
+}
+
+static bool isWantedUidRead() {
+    return (wantedUid == lastUid);
+}
+
+static void addTag(PN7150Simulator &theSimulator, bool isIsoDep, uint8_t uid) {
+    SimulatedTag theTag;
+    theTag.protocol    = isIsoDep ? PROTOCOL_ISO_DEP : PROTOCOL_T2T;
+    theTag.selRes      = isIsoDep ? 0x20 : 0x00;
+    theTag.uniqueId[6] = uid;
+    theSimulator.addTag(theTag);
+}
+
+static void benchScan(bool isIsoDep, bool uidOnly) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theNciUnderTest   = &theNci;
+    nmbrOfActivations = 0;
+    lastUid           = 0xFF;
+    theNci.addEventHandler(onActivated);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setUidOnlyScan(uidOnly);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 100);
+
+    uint32_t nmbrRead       = 0;
+    double sumOfLatencies   = 0.0;
+    double maxLatency       = 0.0;
+    uint32_t commandsBefore = theSimulator.getNmbrOfCommands();
+    unsigned long startTime = micros();
+    for (uint32_t tap = 0; tap < nmbrOfTaps; tap++) {
+        wantedUid                 = static_cast<uint8_t>(tap);
+        unsigned long arrivalTime = micros();
+        addTag(theSimulator, isIsoDep, wantedUid);
+        if (runNci(theNci, theSimulator, 500, isWantedUidRead)) {
+            double latency = static_cast<double>(lastActivationTime - arrivalTime) / 1000.0;
+            sumOfLatencies += latency;
+            maxLatency = (latency > maxLatency) ? latency : maxLatency;
+            nmbrRead++;
+        }
+        theSimulator.removeAllTags();
+    }
+    double tapSeconds    = static_cast<double>(micros() - startTime) / 1e6;
+    double commandsByTap = static_cast<double>(theSimulator.getNmbrOfCommands() - commandsBefore) / nmbrOfTaps;
+
+    addTag(theSimulator, isIsoDep, 0);
+    runNci(theNci, theSimulator, 100);
+    uint32_t activationsBefore = nmbrOfActivations;
+    commandsBefore             = theSimulator.getNmbrOfCommands();
+    startTime                  = micros();
+    runNci(theNci, theSimulator, 2000);
+    double heldSeconds       = static_cast<double>(micros() - startTime) / 1e6;
+    uint32_t nmbrOfUids      = nmbrOfActivations - activationsBefore;
+    double commandsByUid     = (nmbrOfUids > 0) ? (static_cast<double>(theSimulator.getNmbrOfCommands() - commandsBefore) / nmbrOfUids) : 0.0;
+    uint8_t activationLength = theNci.getTag(0)->activationParametersLength;
+
+    printf("%-7s %-13s : %u/%u taps, time-to-UID avg %.2f ms max %.2f ms, %.1f taps/s, %.1f commands/tap | card held : %.1f UIDs/s, %.1f commands/UID | ATS %u bytes\n", isIsoDep ? "ISO-DEP" : "T2T", uidOnly ? "UID-only" : "full activate", nmbrRead, nmbrOfTaps, (nmbrRead > 0) ? (sumOfLatencies / nmbrRead) : 0.0, maxLatency, nmbrRead / tapSeconds, commandsByTap, nmbrOfUids / heldSeconds, commandsByUid, activationLength);
+
+    CHECK(nmbrOfTaps == nmbrRead);
+    CHECK(nmbrOfUids > 0);
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+    if (uidOnly) {
+        CHECK(commandsByUid < 1.5);        // only RF_DEACTIVATE to Discovery, the NFCC polls again by itself
+        CHECK(0 == activationLength);      // no RATS / ATS
+    } else {
+        CHECK(commandsByUid > 1.5);        // RF_DEACTIVATE and RF_DISCOVER
+        CHECK(isIsoDep == (activationLength > 0));
+    }
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    for (uint8_t protocol = 0; protocol < 2; protocol++) {
+        benchScan((1 == protocol), false);
+        benchScan((1 == protocol), true);
+    }
+    return testResult();
+}
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Booting the NFCC without blocking : initialize() only drives VEN LOW, run() ends the pulse, waits for the boot and goes through the NCI initialization.
+//   The NFCC boots twice, after initialize() and after a powerDown() and wakeUp(), with the Configuration Status in CORE_RESET_RSP (NCI 1.0) or CORE_RESET_NTF (NCI 2.0)
+//   - the NFCC keeps its configuration : LPCD and TOTAL_DURATION are written at the first boot only
+//   - the NFCC loses its configuration at VEN LOW : they are written again at the second boot
+//   - each phase takes at least what the NFCC needs for it, and the phases add up to the total
+
+#include "HostTest.h"
+
+static constexpr unsigned long responseLatency = 500;        // [us] the simulator's default
+
+class BootWatch {
+  public:
+    NCI *theNci{nullptr};
+    bool isBootSeen{false};        // HwResetBoot : VEN HIGH, waiting for the NFCC to boot
+};
+
+static BootWatch theWatch;
+
+static bool bootComplete() {
+    if (NciState::HwResetBoot == theWatch.theNci->getState()) {
+        theWatch.isBootSeen = true;
+    }
+    return theWatch.theNci->getBootStatistics().complete;
+}
+
+static unsigned long phase(const NciBootStatistics &theStatistics, NciBootPhase thePhase) {
+    return theStatistics.phaseDuration[static_cast<uint8_t>(thePhase)];
+}
+
+static void printBoot(const char *title, const NciBootStatistics &theStatistics) {
+    printf("%s : VEN LOW %lu, boot %lu, CORE_RESET %lu, CORE_INIT %lu, proprietary %lu, configure %lu, discovery %lu, total %lu us, configuration %s\n", title,
+           phase(theStatistics, NciBootPhase::venReset), phase(theStatistics, NciBootPhase::boot), phase(theStatistics, NciBootPhase::coreReset), phase(theStatistics, NciBootPhase::coreInit),
+           phase(theStatistics, NciBootPhase::enableProprietary), phase(theStatistics, NciBootPhase::configure), phase(theStatistics, NciBootPhase::startDiscovery), theStatistics.getTotal(),
+           theStatistics.configurationRetained ? "retained" : "reset");
+}
+
+static void checkPhases(const NciBootStatistics &theStatistics, bool coreResetNotification) {
+    CHECK(theStatistics.complete);
+    CHECK(phase(theStatistics, NciBootPhase::venReset) >= NciTransport::venLowTime);
+    CHECK(phase(theStatistics, NciBootPhase::boot) >= NciTransport::bootTime);
+    CHECK(phase(theStatistics, NciBootPhase::coreReset) >= (coreResetNotification ? 2 : 1) * responseLatency);        // NCI 2.0 : CORE_RESET_NTF comes after the response
+    CHECK(phase(theStatistics, NciBootPhase::coreInit) >= responseLatency);
+    CHECK(phase(theStatistics, NciBootPhase::enableProprietary) >= responseLatency);
+    CHECK(phase(theStatistics, NciBootPhase::startDiscovery) >= responseLatency);
+    unsigned long sum = 0;
+    for (uint8_t index = 0; index < static_cast<uint8_t>(NciBootPhase::nmbrOfBootPhases); index++) {
+        sum += theStatistics.phaseDuration[index];
+    }
+    CHECK(sum == theStatistics.getTotal());
+}
+
+static void testBoot(bool configRetention, bool coreResetNotification) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theSimulator.setConfigRetention(configRetention);
+    theSimulator.setCoreResetNotification(coreResetNotification);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    CHECK(theNci.setLowPowerCardDetection(true, 0x10, 3));
+    CHECK(theNci.setTotalDuration(300));
+    theWatch        = BootWatch();
+    theWatch.theNci = &theNci;
+    const char *title = configRetention ? (coreResetNotification ? "NCI 2.0, configuration kept" : "NCI 1.0, configuration kept") : (coreResetNotification ? "NCI 2.0, configuration lost" : "NCI 1.0, configuration lost");
+
+    // First boot : initialize() does not wait for the NFCC, and the configuration is written because the application set it
+    unsigned long startTime = micros();
+    theNci.initialize();
+    unsigned long initializeTime = micros() - startTime;
+    CHECK(initializeTime < NciTransport::venLowTime + NciTransport::bootTime);
+    CHECK(NciState::HwResetVenLow == theNci.getState());
+    CHECK(theSimulator.isPoweredDown());
+    CHECK(runNci(theNci, theSimulator, 100, bootComplete));
+    CHECK(theWatch.isBootSeen);
+    CHECK(NciState::RfDiscovery == theNci.getState());
+    NciBootStatistics firstBoot = theNci.getBootStatistics();
+    printBoot(title, firstBoot);
+    checkPhases(firstBoot, coreResetNotification);
+    CHECK(1 == theSimulator.getNmbrOfConfigWrites(TAG_DETECTOR_CFG));
+    CHECK(1 == theSimulator.getNmbrOfConfigWrites(TOTAL_DURATION));
+
+    // Second boot, after VEN was LOW : the configuration is written again only if CORE_RESET reported it was lost
+    theNci.powerDown();
+    runNci(theNci, theSimulator, 5);
+    theWatch.isBootSeen = false;
+    theNci.wakeUp();
+    CHECK(!theNci.getBootStatistics().complete);
+    CHECK(runNci(theNci, theSimulator, 100, bootComplete));
+    CHECK(theWatch.isBootSeen);
+    NciBootStatistics secondBoot = theNci.getBootStatistics();
+    printBoot(title, secondBoot);
+    checkPhases(secondBoot, coreResetNotification);
+    CHECK(configRetention == secondBoot.configurationRetained);
+    uint32_t expectedWrites = configRetention ? 1 : 2;
+    CHECK(expectedWrites == theSimulator.getNmbrOfConfigWrites(TAG_DETECTOR_CFG));
+    CHECK(expectedWrites == theSimulator.getNmbrOfConfigWrites(TOTAL_DURATION));
+    if (configRetention) {
+        CHECK(phase(secondBoot, NciBootPhase::configure) < phase(firstBoot, NciBootPhase::configure));        // nothing to write
+    } else {
+        CHECK(phase(secondBoot, NciBootPhase::configure) >= 2 * responseLatency);        // standby, and CORE_SET_CONFIG
+    }
+    CHECK(theSimulator.isStandbyEnabled());
+    CHECK(0 == theSimulator.getNmbrOfEarlyWrites());        // the stateMachine waited for the boot
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testBoot(true, false);
+    testBoot(false, false);
+    testBoot(true, true);
+    testBoot(false, true);
+    return testResult();
+}
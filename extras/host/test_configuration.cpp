@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   The NciConfiguration shadow, fed CORE_SET_CONFIG_RSP and CORE_GET_CONFIG_RSP payloads directly.
+//   - a parameter the NFCC rejects or does not know frees its entry, so a table full of them does not block new parameters
+//   - a CORE_SET_CONFIG_CMD which fails as a whole is written again, and given up on and counted after maxWriteAttempts
+
+#include "HostTest.h"
+#include "NciConfiguration.h"
+
+static void rejectAll(NciConfiguration &theConfiguration, uint16_t firstId) {
+    uint8_t payload[256];
+    uint32_t length = theConfiguration.buildSetConfig(payload, sizeof(payload));
+    CHECK(length > 0);
+    uint8_t response[2 + NciConfiguration::nmbrOfEntries] = {STATUS_INVALID_PARAM, NciConfiguration::nmbrOfEntries};
+    for (uint32_t index = 0; index < NciConfiguration::nmbrOfEntries; index++) {
+        response[2 + index] = static_cast<uint8_t>(firstId + index);
+    }
+    theConfiguration.setConfigDone(response, sizeof(response));
+}
+
+static void testRejectedSetFreesEntry() {
+    NciConfiguration theConfiguration;
+    static const uint8_t value[1] = {0x01};
+    for (uint32_t index = 0; index < NciConfiguration::nmbrOfEntries; index++) {
+        CHECK(theConfiguration.set(static_cast<uint16_t>(0x60 + index), value, sizeof(value)));
+    }
+    CHECK(!theConfiguration.set(0x50, value, sizeof(value)));        // full
+    rejectAll(theConfiguration, 0x60);
+    CHECK(!theConfiguration.hasWork());
+
+    for (uint32_t round = 0; round < 3; round++) {        // and again, the entries do not leak
+        for (uint32_t index = 0; index < NciConfiguration::nmbrOfEntries; index++) {
+            CHECK(theConfiguration.set(static_cast<uint16_t>(0x70 + index), value, sizeof(value)));
+        }
+        rejectAll(theConfiguration, 0x70);
+    }
+    CHECK(theConfiguration.set(0x50, value, sizeof(value)));
+    theConfiguration.configurationLost();
+    CHECK(theConfiguration.hasParametersToWrite());        // only 0x50 is written again
+    uint8_t payload[256];
+    CHECK((1 + 1 + 1 + sizeof(value)) == theConfiguration.buildSetConfig(payload, sizeof(payload)));
+    CHECK(0x50 == payload[1]);
+}
+
+static void testFailedSetIsRetried() {
+    NciConfiguration theConfiguration;
+    static const uint8_t value[2]    = {0x01, 0x02};
+    static const uint8_t rejected[2] = {STATUS_REJECTED, 0};
+    static const uint8_t accepted[2] = {STATUS_OK, 0};
+    uint8_t payload[256];
+    uint8_t readValue[NciConfiguration::maxValueLength];
+    uint8_t readLength = 0;
+
+    // Rejected as a whole, then accepted : the value is written again, and known once the NFCC took it
+    CHECK(theConfiguration.set(0x50, value, sizeof(value)));
+    CHECK(theConfiguration.buildSetConfig(payload, sizeof(payload)) > 0);
+    theConfiguration.setConfigDone(rejected, sizeof(rejected));
+    CHECK(theConfiguration.hasParametersToWrite());
+    CHECK(!theConfiguration.get(0x50, readValue, readLength));
+    CHECK((1 + 1 + 1 + sizeof(value)) == theConfiguration.buildSetConfig(payload, sizeof(payload)));
+    CHECK((0x50 == payload[1]) && (0x01 == payload[3]) && (0x02 == payload[4]));
+    theConfiguration.setConfigDone(accepted, sizeof(accepted));
+    CHECK(!theConfiguration.hasWork());
+    CHECK(theConfiguration.get(0x50, readValue, readLength) && (sizeof(value) == readLength) && (0x02 == readValue[1]));
+    CHECK(1 == theConfiguration.getCounters().writesRetried);
+    CHECK(0 == theConfiguration.getCounters().writesFailed);
+
+    // Failing every time, also without a payload : given up after maxWriteAttempts, and counted
+    static const uint8_t newValue[2] = {0x03, 0x04};
+    CHECK(theConfiguration.set(0x50, newValue, sizeof(newValue)));
+    uint32_t attempts = 0;
+    while (theConfiguration.hasParametersToWrite() && (attempts < 10)) {
+        CHECK(theConfiguration.buildSetConfig(payload, sizeof(payload)) > 0);
+        theConfiguration.setConfigDone(rejected, (0 == attempts) ? 0 : sizeof(rejected));
+        attempts++;
+    }
+    CHECK(NciConfiguration::maxWriteAttempts == attempts);
+    CHECK(!theConfiguration.get(0x50, readValue, readLength));        // not known : the NFCC may have either value
+    CHECK(NciConfiguration::maxWriteAttempts == theConfiguration.getCounters().writesRetried);        // 1 above, and all attempts but the last one here
+    CHECK(1 == theConfiguration.getCounters().writesFailed);
+
+    // Setting it again makes a new attempt
+    CHECK(theConfiguration.set(0x50, newValue, sizeof(newValue)));
+    CHECK(theConfiguration.hasParametersToWrite());
+    CHECK(theConfiguration.buildSetConfig(payload, sizeof(payload)) > 0);
+    theConfiguration.setConfigDone(accepted, sizeof(accepted));
+    CHECK(theConfiguration.get(0x50, readValue, readLength) && (0x04 == readValue[1]));
+}
+
+static void testUnknownGetFreesEntry() {
+    NciConfiguration theConfiguration;
+    uint8_t value[NciConfiguration::maxValueLength];
+    uint8_t valueLength = 0;
+    for (uint32_t index = 0; index < NciConfiguration::nmbrOfEntries; index++) {
+        CHECK(!theConfiguration.get(static_cast<uint16_t>(0x60 + index), value, valueLength));
+    }
+    uint8_t payload[256];
+    CHECK(theConfiguration.buildGetConfig(payload, sizeof(payload)) > 0);
+    uint8_t response[2 + (2 * NciConfiguration::nmbrOfEntries)] = {STATUS_INVALID_PARAM, NciConfiguration::nmbrOfEntries};
+    for (uint32_t index = 0; index < NciConfiguration::nmbrOfEntries; index++) {
+        response[2 + (2 * index)] = static_cast<uint8_t>(0x60 + index);
+        response[3 + (2 * index)] = 0;
+    }
+    theConfiguration.getConfigDone(response, sizeof(response));
+    static const uint8_t newValue[1] = {0x02};
+    CHECK(theConfiguration.set(0x50, newValue, sizeof(newValue)));
+}
+
+int main() {
+    testRejectedSetFreesEntry();
+    testFailedSetIsRetried();
+    testUnknownGetFreesEntry();
+    return testResult();
+}
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   The C++20 coroutine layer gives the NCI buffers in the coroutine's frame : the Response to a command, the tag's answer to a Data message.
+//   When the coroutine stops waiting for them, the NCI must not write there anymore : the frame goes back to the pool, and the next coroutine gets it.
+//   - a command times out, its Response comes later : the buffer stays as the coroutine left it
+//   - the NciTask is destroyed while its command waits for the Response : the next coroutine in the same frame is not written into
+//   - the same, while a transceive waits for the tag's answer
+//   Built with -std=c++20 and a 640 byte frame, see the Makefile.
+
+#include "HostTest.h"
+#include "NciCoroutine.h"
+
+static constexpr uint8_t untouched = 0xEE;
+
+enum class ProbeMode : uint8_t {
+    command,
+    transceive,
+    waitOnly        // the same frame layout, without giving the NCI anything
+};
+
+class Probe {
+  public:
+    ProbeMode mode{ProbeMode::waitOnly};
+    unsigned long timeOut{50};        // [ms] for the command or transceive
+    unsigned long waitTime{20};       // [ms] after it, while the late answer comes
+    uint8_t status{0xFF};
+    uint32_t length{0xFFFFFFFF};
+    const uint8_t *buffer{nullptr};        // the coroutine's buffer, in its frame
+    bool isUntouched{false};               // nobody wrote into the buffer while the coroutine waited after the command or transceive
+    bool done{false};
+};
+
+static NciTask probe(NciCoroutines &nfc, Probe &theProbe) {
+    uint8_t buffer[24];
+    for (uint32_t index = 0; index < sizeof(buffer); index++) {
+        buffer[index] = untouched;
+    }
+    theProbe.buffer = buffer;
+    if (ProbeMode::command == theProbe.mode) {
+        static const uint8_t getConfig[2] = {1, PA_BAIL_OUT};
+        theProbe.status                   = co_await nfc.command(GroupIdCore, CORE_GET_CONFIG_CMD, getConfig, sizeof(getConfig), buffer, sizeof(buffer), theProbe.timeOut);
+    } else if (ProbeMode::transceive == theProbe.mode) {
+        static const uint8_t readCommand[2] = {0x30, 0x04};
+        theProbe.length                     = co_await nfc.transceive(readCommand, sizeof(readCommand), buffer, sizeof(buffer), theProbe.timeOut);
+    }
+    for (uint32_t index = 0; index < sizeof(buffer); index++) {
+        buffer[index] = untouched;
+    }
+    co_await nfc.wait(theProbe.waitTime);
+    theProbe.isUntouched = true;
+    for (uint32_t index = 0; index < sizeof(buffer); index++) {
+        theProbe.isUntouched = theProbe.isUntouched && (untouched == buffer[index]);
+    }
+    theProbe.done = true;
+}
+
+static void runBoth(NCI &theNci, NciCoroutines &nfc, PN7150Simulator &theSimulator, unsigned long maxTime) {
+    unsigned long startTime = millis();
+    while ((millis() - startTime) < maxTime) {
+        theNci.run();
+        nfc.run();
+        long untilNci        = static_cast<long>(theNci.nextDeadline() - millis());
+        long untilCoroutines = static_cast<long>(nfc.nextDeadline() - millis());
+        long untilEnd        = static_cast<long>(maxTime - (millis() - startTime));
+        long untilDeadline   = (untilNci < untilCoroutines) ? untilNci : untilCoroutines;
+        if (untilDeadline > untilEnd) {
+            untilDeadline = untilEnd;
+        }
+        if (untilDeadline > 0) {
+            theSimulator.waitForMessage(static_cast<unsigned long>(untilDeadline));
+        }
+    }
+}
+
+static void boot(NCI &theNci, PN7150Simulator &theSimulator) {
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setPresenceCheckPeriod(100);        // an activated tag stays activated
+    theNci.initialize();
+    runNci(theNci, theSimulator, 50);
+}
+
+static void testCommandTimeOut() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    NciCoroutines nfc(theNci);
+    boot(theNci, theSimulator);
+    theSimulator.injectFault(GroupIdCore, CORE_GET_CONFIG_CMD, SimulatedFault::slowResponse);        // 6 ms
+
+    Probe theProbe;
+    theProbe.mode    = ProbeMode::command;
+    theProbe.timeOut = 2;
+    NciTask theTask  = probe(nfc, theProbe);
+    CHECK(theTask.isValid());
+    runBoth(theNci, nfc, theSimulator, 30);
+    printf("command timed out     : status %u, buffer %s\n", theProbe.status, theProbe.isUntouched ? "untouched" : "written after the time-out");
+    CHECK(theProbe.done);
+    CHECK(STATUS_FAILED == theProbe.status);
+    CHECK(theProbe.isUntouched);
+    CHECK(!theNci.isConnectionCommandPending());        // the NCI got the Response, but did not copy it
+    CHECK(0 == theNci.getLastResponseLength());
+    CHECK(0 == theSimulator.getNmbrOfOverlappingCommands());
+}
+
+static void testCommandDestroyed() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    NciCoroutines nfc(theNci);
+    boot(theNci, theSimulator);
+    theSimulator.injectFault(GroupIdCore, CORE_GET_CONFIG_CMD, SimulatedFault::slowResponse);        // 6 ms
+
+    Probe first;
+    first.mode = ProbeMode::command;
+    {
+        NciTask firstTask = probe(nfc, first);
+        runBoth(theNci, nfc, theSimulator, 1);
+        CHECK(theNci.isConnectionCommandPending());
+        CHECK(!firstTask.isDone());
+    }        // destroyed while it waits for the Response
+    Probe second;
+    NciTask theTask = probe(nfc, second);        // gets the frame the first had
+    CHECK(theTask.isValid());
+    CHECK(second.buffer == first.buffer);
+    CHECK(1 == NciFramePool::getNmbrInUse());
+    CHECK(theNci.isConnectionCommandPending());        // still one command at a time
+    runBoth(theNci, nfc, theSimulator, 30);
+    printf("command task destroyed : next coroutine's buffer %s\n", second.isUntouched ? "untouched" : "written by the late Response");
+    CHECK(second.done);
+    CHECK(second.isUntouched);
+    CHECK(!theNci.isConnectionCommandPending());
+    CHECK(0 == theSimulator.getNmbrOfOverlappingCommands());
+}
+
+static void testTransceiveDestroyed() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    NciCoroutines nfc(theNci);
+    theSimulator.setDataLatency(5000);
+    theSimulator.addTag(SimulatedTag::ntag216());
+    boot(theNci, theSimulator);
+    CHECK(1 == theNci.getNmbrOfTags());
+
+    Probe first;
+    first.mode = ProbeMode::transceive;
+    {
+        NciTask firstTask = probe(nfc, first);
+        runBoth(theNci, nfc, theSimulator, 1);
+        CHECK(!firstTask.isDone());
+    }        // destroyed while it waits for the tag's answer
+    Probe second;
+    NciTask theTask = probe(nfc, second);
+    CHECK(second.buffer == first.buffer);
+    runBoth(theNci, nfc, theSimulator, 30);
+    printf("transceive task destroyed : next coroutine's buffer %s\n", second.isUntouched ? "untouched" : "written by the tag's answer");
+    CHECK(second.done);
+    CHECK(second.isUntouched);
+    CHECK(1 == theNci.getNmbrOfTags());
+
+    // and the tag still answers the next coroutine
+    Probe third;
+    third.mode = ProbeMode::transceive;
+    theTask    = probe(nfc, third);
+    runBoth(theNci, nfc, theSimulator, 40);
+    CHECK(third.done);
+    CHECK(17 == third.length);        // 4 pages, and the status byte the Frame RF Interface appends
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testCommandTimeOut();
+    testCommandDestroyed();
+    testTransceiveDestroyed();
+    CHECK(0 == NciFramePool::getNmbrOfFailures());
+    return testResult();
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   An application which sleeps until nextDeadline(), or until the IRQ, and learns about tags from events instead of polling the NCI.
+//   - booting : nextDeadline() is never 'now' without a message from the NFCC, so the host sleeps through VEN LOW and the boot instead of spinning
+//   - a tag comes and goes, twice : tagArrived and tagDeparted are delivered once each time, in that order, and the host wakes up a bounded number of times
+//   - no tag : nextDeadline() is the discovery time-out, and the host wakes up a few times only
+//   - a removed handler is not called anymore
+
+#include "HostTest.h"
+
+class EventLog {
+  public:
+    uint32_t nmbrArrived{0};
+    uint32_t nmbrDeparted{0};
+    uint32_t nmbrOutOfOrder{0};        // tagArrived while a tag was there, or tagDeparted while none was
+    bool isTagPresent{false};
+};
+
+static void logEvent(const NciEvent &theEvent, void *context) {
+    EventLog &theLog = *static_cast<EventLog *>(context);
+    if (NciEventType::tagArrived == theEvent.type) {
+        theLog.nmbrArrived++;
+        if (theLog.isTagPresent || (1 != theEvent.nmbrOfTags)) {
+            theLog.nmbrOutOfOrder++;
+        }
+        theLog.isTagPresent = true;
+    } else if (NciEventType::tagDeparted == theEvent.type) {
+        theLog.nmbrDeparted++;
+        if (!theLog.isTagPresent) {
+            theLog.nmbrOutOfOrder++;
+        }
+        theLog.isTagPresent = false;
+    }
+}
+
+class WakeUpCount {
+  public:
+    uint32_t nmbrOfRuns{0};
+    uint32_t nmbrOfNowWithoutMessage{0};        // nextDeadline() was now, but the NFCC had no message : the NCI still has work of its own, or it spins
+};
+
+// Like runNci(), counting how often the host wakes up, and how often nextDeadline() asks for a run() right away, though the NFCC has nothing for us
+static void sleepUntilDeadline(NCI &theNci, PN7150Simulator &theSimulator, unsigned long maxTime, WakeUpCount &theCount, bool (*done)(NCI &theNci)) {
+    unsigned long startTime = millis();
+    while ((millis() - startTime) < maxTime) {
+        theNci.run();
+        theCount.nmbrOfRuns++;
+        if (done(theNci)) {
+            return;
+        }
+        long untilDeadline = static_cast<long>(theNci.nextDeadline() - millis());
+        if (untilDeadline <= 0) {
+            if (!theSimulator.hasMessage()) {
+                theCount.nmbrOfNowWithoutMessage++;
+            }
+            continue;
+        }
+        long untilEnd = static_cast<long>(maxTime - (millis() - startTime));
+        theSimulator.waitForMessage(static_cast<unsigned long>((untilDeadline < untilEnd) ? untilDeadline : untilEnd));
+    }
+}
+
+static bool bootComplete(NCI &theNci) {
+    return theNci.getBootStatistics().complete;
+}
+
+static bool tagPresent(NCI &theNci) {
+    return (1 == theNci.getNmbrOfTags());
+}
+
+static bool noTagPresent(NCI &theNci) {
+    return (TagsPresentStatus::noTagsPresent == theNci.getTagsPresentStatus());
+}
+
+static bool never(NCI &theNci) {
+    (void)theNci;
+    return false;
+}
+
+static void testBoot() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    WakeUpCount theCount;
+    theNci.initialize();
+    sleepUntilDeadline(theNci, theSimulator, 100, theCount, bootComplete);
+    printf("boot            : %u run()s, %u 'now' deadlines without a message, %lu us\n", theCount.nmbrOfRuns, theCount.nmbrOfNowWithoutMessage, theNci.getBootStatistics().getTotal());
+    CHECK(theNci.getBootStatistics().complete);
+    CHECK(0 == theCount.nmbrOfNowWithoutMessage);        // while booting, run() sends the next command right away, so what is left is waiting for VEN LOW, the boot or a response
+    CHECK(theCount.nmbrOfRuns < 20);                     // VEN LOW, boot, and one per response
+}
+
+static void testEvents() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    EventLog theLog;
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setPresenceCheckPeriod(10);
+    CHECK(theNci.addEventHandler(logEvent, &theLog));
+    WakeUpCount theCount;
+    theNci.initialize();
+    sleepUntilDeadline(theNci, theSimulator, 100, theCount, bootComplete);
+
+    for (uint32_t round = 0; round < 2; round++) {
+        theSimulator.addTag(SimulatedTag::ntag216());
+        theCount = WakeUpCount();
+        sleepUntilDeadline(theNci, theSimulator, 200, theCount, tagPresent);
+        CHECK(theLog.nmbrArrived == (round + 1));
+        sleepUntilDeadline(theNci, theSimulator, 100, theCount, never);        // presence checks keep it, no more events
+        CHECK(theLog.nmbrArrived == (round + 1));
+        CHECK(theLog.nmbrDeparted == round);
+
+        theSimulator.removeAllTags();
+        sleepUntilDeadline(theNci, theSimulator, 200, theCount, noTagPresent);
+        printf("tag %u came and went : %u arrived, %u departed, %u run()s, %u 'now' deadlines without a message\n", round + 1, theLog.nmbrArrived, theLog.nmbrDeparted, theCount.nmbrOfRuns, theCount.nmbrOfNowWithoutMessage);
+        CHECK(theLog.nmbrDeparted == (round + 1));
+        CHECK(theCount.nmbrOfRuns < 100);        // activation, 10 presence checks of a few run()s each, and the deactivation
+        CHECK(theCount.nmbrOfNowWithoutMessage < 10);
+    }
+    CHECK(0 == theLog.nmbrOutOfOrder);
+
+    // No tag : the host only wakes up for the discovery time-out
+    theCount = WakeUpCount();
+    sleepUntilDeadline(theNci, theSimulator, 1000, theCount, never);
+    printf("1 s without tag : %u run()s, %u 'now' deadlines without a message\n", theCount.nmbrOfRuns, theCount.nmbrOfNowWithoutMessage);
+    CHECK(theCount.nmbrOfRuns < 10);
+    CHECK(theLog.nmbrArrived == 2);
+
+    theNci.removeEventHandler(logEvent, &theLog);
+    theSimulator.addTag(SimulatedTag::ntag216());
+    sleepUntilDeadline(theNci, theSimulator, 200, theCount, tagPresent);
+    CHECK(1 == theNci.getNmbrOfTags());
+    CHECK(theLog.nmbrArrived == 2);        // removed : not called anymore
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testBoot();
+    testEvents();
+    return testResult();
+}
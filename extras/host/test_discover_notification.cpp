@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   RF_DISCOVER_NTFs without their Notification Type, while multiple tags are discovered.
+//   After the first one, the NCI can not tell if more are coming : it goes to Error, recovers, and reads the tags on the next discovery.
+
+#include "HostTest.h"
+
+static uint32_t nmbrOfMultipleTags{0};
+
+static void countMultipleTags(const NciEvent &theEvent, void *) {
+    if (NciEventType::multipleTags == theEvent.type) {
+        nmbrOfMultipleTags++;
+    }
+}
+
+static bool done(NCI &, uint8_t, void *) {
+    return true;
+}
+
+static void testTruncated(uint32_t nmbrToTruncate, uint32_t expectedFailures) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    nmbrOfMultipleTags = 0;
+    theNci.addEventHandler(countMultipleTags);
+    theNci.setTagOperation(done);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    for (uint8_t index = 0; index < 2; index++) {
+        SimulatedTag theTag;
+        theTag.uniqueId[6] = index;
+        theSimulator.addTag(theTag);
+    }
+    theSimulator.truncateDiscoverNotifications(nmbrToTruncate);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 1000);
+
+    const NciRecoveryStatistics &theStatistics = theNci.getRecoveryStatistics();
+    printf("%u RF_DISCOVER_NTFs truncated : %u failures, %u tag stacks read after, state %u\n", nmbrToTruncate, theStatistics.nmbrOfFailures, nmbrOfMultipleTags, static_cast<unsigned>(theNci.getState()));
+    CHECK(nmbrToTruncate == theSimulator.getNmbrOfInjectedFaults());
+    CHECK(expectedFailures == theStatistics.nmbrOfFailures);
+    CHECK(!theNci.isRecovering());
+    CHECK(nmbrOfMultipleTags > 0);
+    CHECK(theSimulator.getNmbrOfSelects() > 0);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testTruncated(1, 0);        // the first one always has more to come, it is only read for its tag
+    testTruncated(2, 1);        // the second one ends the discovery, or not
+    testTruncated(5, 2);        // and the ones of the discoveries after the recovery
+    return testResult();
+}
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Interrupt-driven reception : the simulator's delivery thread raises the IRQ edges, the NciTransport latch takes them, as the ISR does on target.
+//   - packets which are ready while the one before is being read give no edge : the latch has to re-arm itself on the IRQ level
+//   - no edge may get lost between the host clearing the latch and the next packet becoming ready
+//   - the NCI stateMachine runs on the latch alone, with Data messages arriving back-to-back
+
+#include <cstring>
+#include <thread>
+#include "HostTest.h"
+
+static const uint8_t coreResetHeader[3]  = {MsgTypeCommand | GroupIdCore, CORE_RESET_CMD, 1};
+static const uint8_t coreResetPayload[1] = {ResetKeepConfig};
+
+static void bootSimulator(PN7150Simulator &theSimulator) {
+    theSimulator.beginReset();
+    theSimulator.endReset();
+    std::this_thread::sleep_for(std::chrono::microseconds(NciTransport::bootTime));
+}
+
+static void testBackToBackPackets() {
+    PN7150Simulator theSimulator;
+    bootSimulator(theSimulator);
+    theSimulator.enableInterrupt();
+    CHECK(theSimulator.isInterruptMode());
+    CHECK(!theSimulator.hasMessage());
+
+    for (int index = 0; index < 3; index++) {
+        CHECK(0 == theSimulator.write(coreResetHeader, coreResetPayload, sizeof(coreResetPayload)));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));        // all 3 responses are ready, IRQ went HIGH only once
+    CHECK(1 == theSimulator.getNmbrOfIrqEdges());
+
+    uint8_t packet[MsgHeaderSize + MaxPayloadSize];
+    uint32_t nmbrOfPackets = 0;
+    while (theSimulator.hasMessage() && (nmbrOfPackets < 10)) {
+        if (theSimulator.read(packet) > 0) {
+            CHECK(CORE_RESET_RSP == (packet[1] & 0x3F));
+            nmbrOfPackets++;
+        }
+    }
+    CHECK(3 == nmbrOfPackets);        // the 2nd and 3rd were only seen because the latch re-armed on the level
+    CHECK(!theSimulator.hasMessage());
+}
+
+static void testNoLostEdges() {
+    // The next response becomes ready at any moment relative to the host reading and clearing the latch : none may be missed, none may be spurious
+    PN7150Simulator theSimulator;
+    theSimulator.setMaxTransactionLength(3);        // split reads, so the host spends longer on each packet
+    bootSimulator(theSimulator);
+    theSimulator.enableInterrupt();
+    uint8_t packet[MsgHeaderSize + MaxPayloadSize];
+    uint32_t nmbrOfLost     = 0;
+    uint32_t nmbrOfSpurious = 0;
+    for (unsigned long round = 0; round < 400; round++) {
+        theSimulator.setResponseLatency(round % 40);        // [us]
+        CHECK(0 == theSimulator.write(coreResetHeader, coreResetPayload, sizeof(coreResetPayload)));
+        CHECK(0 == theSimulator.write(coreResetHeader, coreResetPayload, sizeof(coreResetPayload)));
+        for (int index = 0; index < 2; index++) {
+            if (!theSimulator.waitForMessage(100)) {
+                nmbrOfLost++;
+            } else if (0 == theSimulator.read(packet)) {
+                nmbrOfSpurious++;
+            }
+        }
+    }
+    CHECK(0 == nmbrOfLost);
+    CHECK(0 == nmbrOfSpurious);
+    CHECK(!theSimulator.hasMessage());
+}
+
+static void testNciOnTheLatch() {
+    PN7150Simulator theSimulator;
+    theSimulator.setDataCredits(3);
+    theSimulator.setDataLatency(0);
+    NCI theNci(theSimulator);
+    theNci.initialize();
+    theSimulator.enableInterrupt();
+    runNci(theNci, theSimulator, 300);
+    CHECK(NciState::RfDiscovery == theNci.getState());
+
+    CHECK(theNci.createConnection(DestinationNfccLoopback, 0, nullptr, 0));
+    runNci(theNci, theSimulator, 100);
+    uint8_t connectionId = theNci.getLastCreatedConnectionId();
+    CHECK(nullptr != theNci.getConnection(connectionId));
+
+    static uint8_t messages[3][200];
+    static uint8_t received[3 * 200];
+    for (int index = 0; index < 3; index++) {
+        memset(messages[index], index + 1, sizeof(messages[index]));
+    }
+    uint32_t edgesBefore   = theSimulator.getNmbrOfIrqEdges();
+    uint32_t packetsBefore = theSimulator.getCounters().packetsRead;
+    theNci.setDataReceiveBuffer(connectionId, received, sizeof(received), 3);
+    for (int index = 0; index < 3; index++) {
+        CHECK(theNci.sendData(connectionId, messages[index], sizeof(messages[index])));
+    }
+    static NCI *theNciUnderTest;
+    static uint8_t theConnectionId;
+    theNciUnderTest = &theNci;
+    theConnectionId = connectionId;
+    CHECK(runNci(theNci, theSimulator, 500, [] { return theNciUnderTest->getConnection(theConnectionId)->isMessageReceived(); }));
+    CHECK((3 * 200) == theNci.getConnection(connectionId)->getReceivedLength());
+    for (int index = 0; index < 3; index++) {
+        CHECK(0 == memcmp(received + (index * 200), messages[index], 200));
+    }
+    uint32_t edges   = theSimulator.getNmbrOfIrqEdges() - edgesBefore;
+    uint32_t packets = theSimulator.getCounters().packetsRead - packetsBefore;
+    printf("loop-back on the latch : %u packets read on %u IRQ edges\n", packets, edges);
+    CHECK(packets > edges);        // data packets and credit notifications arrive back-to-back
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testBackToBackPackets();
+    testNoLostEdges();
+    testNciOnTheLatch();
+    return testResult();
+}
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   IsoDepTransceiver against the simulated APDU card, SimulatedTag::isoDepCard() with its 4 KB file.
+//   - UPDATE BINARY of 1000 bytes : command chaining, or one extended APDU, and the card's file after. READ BINARY with Ne 1000
+//   - a card which sends 64 bytes at once : 0x61XX and GET RESPONSE. Le beyond the end of the file : 0x6CXX and the resend
+//   - a status word other than 0x9000 stops the batch, or not. A response which does not fit, a card which leaves mid-batch, a Type 2 Tag
+//   - Apdu::encode(), short and extended, cases 1 to 4
+
+#include "HostTest.h"
+#include "IsoDep.h"
+#include <string.h>
+#include <vector>
+
+static Apdu *script{nullptr};
+static uint32_t scriptLength{0};
+static bool isPending{false};
+static bool isStarted{false};
+static bool isLastOk{false};
+
+static bool runScript(NCI &, uint8_t, void *context) {
+    IsoDepTransceiver &theTransceiver = *static_cast<IsoDepTransceiver *>(context);
+    if (!isPending) {
+        return true;
+    }
+    if (!isStarted) {
+        isStarted = true;
+        if (!theTransceiver.transceive(script, scriptLength)) {
+            isPending = false;
+            isLastOk  = false;
+            return true;
+        }
+    }
+    bool isDone = theTransceiver.run();
+    if (isDone) {
+        isPending = false;
+        isLastOk  = theTransceiver.isOk();
+    }
+    return isDone;
+}
+
+static bool isScriptDone() {
+    return !isPending;
+}
+
+static void startScript(Apdu theApdus[], uint32_t nmbrOfApdus) {
+    script       = theApdus;
+    scriptLength = nmbrOfApdus;
+    isStarted    = false;
+    isPending    = true;
+}
+
+static bool transceive(NCI &theNci, PN7150Simulator &theSimulator, Apdu theApdus[], uint32_t nmbrOfApdus) {
+    startScript(theApdus, nmbrOfApdus);
+    runNci(theNci, theSimulator, 5000, isScriptDone);
+    isPending = false;
+    return isLastOk;
+}
+
+static constexpr uint32_t maxApduLength = 1100;
+static uint8_t commands[4][maxApduLength];        // every APDU of a batch has its own, they stay valid until it is done
+static uint8_t responses[4][maxApduLength];
+
+static Apdu makeApdu(uint32_t index, uint32_t commandLength, uint32_t responseSize) {
+    Apdu theApdu;
+    theApdu.command       = commands[index];
+    theApdu.commandLength = commandLength;
+    theApdu.response      = responses[index];
+    theApdu.responseSize  = responseSize;
+    return theApdu;
+}
+
+static void presentCard(NCI &theNci, PN7150Simulator &theSimulator, const SimulatedTag &theCard) {
+    theSimulator.removeAllTags();
+    runNci(theNci, theSimulator, 100);
+    theSimulator.addTag(theCard);
+    runNci(theNci, theSimulator, 300);
+}
+
+static void testLongCommands(NCI &theNci, PN7150Simulator &theSimulator, IsoDepTransceiver &theTransceiver, SimulatedTag &theCard, bool isExtended) {
+    static uint8_t data[1000];
+    for (uint32_t index = 0; index < sizeof(data); index++) {
+        data[index] = static_cast<uint8_t>((index * 11) + (isExtended ? 5 : 6));
+    }
+    theCard.extendedLength = isExtended;
+    presentCard(theNci, theSimulator, theCard);
+    theTransceiver.setExtendedLength(isExtended);
+    const IsoDepStatistics &theStatistics = theTransceiver.getStatistics();
+
+    Apdu update = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xD6, 0x00, 0x20, data, sizeof(data)), 2);        // UPDATE BINARY at 0x0020
+    theTransceiver.resetStatistics();
+    bool isUpdated                = transceive(theNci, theSimulator, &update, 1);
+    uint32_t nmbrOfExchanges      = theStatistics.nmbrOfExchanges;
+    std::vector<uint8_t> cardFile = theSimulator.getTagMemory(0);
+    bool isFileOk                 = (cardFile.size() >= (0x20 + sizeof(data))) && (0 == memcmp(&cardFile[0x20], data, sizeof(data)));
+
+    Apdu read             = makeApdu(1, Apdu::encode(commands[1], 0x00, 0xB0, 0x00, 0x20, nullptr, 0, sizeof(data)), sizeof(data) + 2);        // READ BINARY, Ne 1000
+    bool isRead           = transceive(theNci, theSimulator, &read, 1);
+    uint32_t expectedRead = isExtended ? sizeof(data) : 256;        // a short READ BINARY has Le 256 at most : the card answers that much
+    printf("UPDATE BINARY of 1000 bytes, %s : ok %u, %u exchanges, %.1f ms, card file %s. READ BINARY Ne 1000 : ok %u, %u bytes\n", isExtended ? "extended" : "chained ", isUpdated, nmbrOfExchanges, update.duration / 1000.0, isFileOk ? "ok" : "WRONG", isRead, read.responseLength);
+    CHECK(isUpdated && (0x9000 == update.statusWord));
+    CHECK((isExtended ? 1U : 4U) == nmbrOfExchanges);        // 4 pieces of up to IsoDepChunkLength
+    CHECK(isFileOk);
+    CHECK(isRead && (expectedRead == read.responseLength) && (0 == memcmp(read.response, data, expectedRead)));
+}
+
+static void testResponseParts(NCI &theNci, PN7150Simulator &theSimulator, IsoDepTransceiver &theTransceiver, SimulatedTag &theCard) {
+    theCard.extendedLength = false;
+    theCard.responseLimit  = 64;
+    presentCard(theNci, theSimulator, theCard);
+    theTransceiver.setExtendedLength(false);
+    const IsoDepStatistics &theStatistics = theTransceiver.getStatistics();
+
+    Apdu read = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xB0, 0x01, 0x00, nullptr, 0, 256), 256 + 2);        // READ BINARY at 0x0100
+    theTransceiver.resetStatistics();
+    bool isRead                   = transceive(theNci, theSimulator, &read, 1);
+    std::vector<uint8_t> cardFile = theSimulator.getTagMemory(0);
+    printf("READ BINARY of 256 bytes, 64 bytes per response : ok %u, %u exchanges, %u bytes\n", isRead, theStatistics.nmbrOfExchanges, read.responseLength);
+    CHECK(isRead && (4 == theStatistics.nmbrOfExchanges));        // the READ BINARY, and 3 GET RESPONSEs
+    CHECK((256 == read.responseLength) && (0 == memcmp(read.response, &cardFile[0x100], 256)));
+
+    read = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xB0, 0x0F, 0xFA, nullptr, 0, 16), 16 + 2);        // 6 bytes before the end of the file
+    theTransceiver.resetStatistics();
+    isRead = transceive(theNci, theSimulator, &read, 1);
+    printf("READ BINARY with Le 16, 6 bytes left : ok %u, SW %04X, %u exchanges, %u bytes\n", isRead, read.statusWord, theStatistics.nmbrOfExchanges, read.responseLength);
+    CHECK(isRead && (0x9000 == read.statusWord));
+    CHECK(2 == theStatistics.nmbrOfExchanges);        // 0x6C06, and the resend with Le 6
+    CHECK((6 == read.responseLength) && (0 == memcmp(read.response, &cardFile[0x0FFA], 6)));
+    theCard.responseLimit = 256;
+}
+
+static void testErrors(NCI &theNci, PN7150Simulator &theSimulator, IsoDepTransceiver &theTransceiver, SimulatedTag &theCard) {
+    presentCard(theNci, theSimulator, theCard);
+    Apdu batch[3];
+    batch[0] = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xCA, 0x00, 0x00, nullptr, 0, 256), 20);        // GET DATA
+    batch[1] = makeApdu(1, Apdu::encode(commands[1], 0x00, 0x12, 0x00, 0x00), 20);                            // an instruction the card does not know
+    batch[2] = makeApdu(2, Apdu::encode(commands[2], 0x00, 0xCA, 0x00, 0x00, nullptr, 0, 256), 20);
+    bool isOk = transceive(theNci, theSimulator, batch, 3);
+    printf("unknown INS mid-batch : ok %u, %u done, SW %04X", isOk, theTransceiver.getNmbrOfApdusDone(), batch[1].statusWord);
+    CHECK(!isOk && (2 == theTransceiver.getNmbrOfApdusDone()) && (0x6D00 == batch[1].statusWord));
+    theTransceiver.setStopOnError(false);
+    isOk = transceive(theNci, theSimulator, batch, 3);
+    printf(", without stopping : ok %u, %u done, last SW %04X\n", isOk, theTransceiver.getNmbrOfApdusDone(), batch[2].statusWord);
+    CHECK(isOk && (3 == theTransceiver.getNmbrOfApdusDone()) && (0x9000 == batch[2].statusWord));
+    theTransceiver.setStopOnError(true);
+
+    Apdu read         = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xB0, 0x00, 0x00, nullptr, 0, 0x40), 20);        // 64 bytes asked, room for 18
+    uint32_t failures = theTransceiver.getStatistics().nmbrOfFailures;
+    isOk              = transceive(theNci, theSimulator, &read, 1);
+    printf("response buffer too small : ok %u, %u failures\n", isOk, theTransceiver.getStatistics().nmbrOfFailures - failures);
+    CHECK(!isOk && ((failures + 1) == theTransceiver.getStatistics().nmbrOfFailures));
+}
+
+static void testRemoved(NCI &theNci, PN7150Simulator &theSimulator, IsoDepTransceiver &theTransceiver, SimulatedTag &theCard) {
+    static const uint8_t aid[] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+    Apdu batch[4];
+    batch[0] = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xA4, 0x04, 0x00, aid, sizeof(aid), 256), 300);        // SELECT
+    batch[1] = makeApdu(1, Apdu::encode(commands[1], 0x00, 0xB0, 0x00, 0x00, nullptr, 0, 128), 300);
+    batch[2] = makeApdu(2, Apdu::encode(commands[2], 0x00, 0xB0, 0x00, 0x80, nullptr, 0, 128), 300);
+    batch[3] = makeApdu(3, Apdu::encode(commands[3], 0x00, 0xCA, 0x00, 0x00, nullptr, 0, 256), 300);
+    theSimulator.setRfByteTime(85);
+    uint32_t nmbrFailed  = 0;
+    uint32_t nmbrStopped = 0;
+    for (uint32_t round = 0; round < 10; round++) {
+        presentCard(theNci, theSimulator, theCard);
+        startScript(batch, 4);
+        runNci(theNci, theSimulator, 2 + round, isScriptDone);        // the card leaves somewhere in the batch
+        theSimulator.removeAllTags();
+        runNci(theNci, theSimulator, 3000, isScriptDone);
+        if (!isPending && !isLastOk) {
+            nmbrFailed++;
+        }
+        if (theTransceiver.getNmbrOfApdusDone() < 4) {
+            nmbrStopped++;
+        }
+        isPending = false;
+    }
+    theSimulator.addTag(theCard);
+    runNci(theNci, theSimulator, 300);
+    bool isOkAfter = transceive(theNci, theSimulator, batch, 4);
+    printf("card removed mid-batch, 10 times : %u reported failed, %u stopped early, the next batch on a new activation ok %u\n", nmbrFailed, nmbrStopped, isOkAfter);
+    CHECK(10 == nmbrFailed);
+    CHECK(10 == nmbrStopped);
+    CHECK(isOkAfter);
+    theSimulator.setRfByteTime(0);
+}
+
+static void testType2Tag() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    IsoDepTransceiver theTransceiver(theNci);
+    theSimulator.addTag(SimulatedTag::ntag216());
+    theNci.setTagOperation(runScript, &theTransceiver, 2000);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 300);
+    Apdu getData = makeApdu(0, Apdu::encode(commands[0], 0x00, 0xCA, 0x00, 0x00, nullptr, 0, 256), 20);
+    CHECK(!transceive(theNci, theSimulator, &getData, 1));
+    CHECK(0 == theSimulator.getNmbrOfEarlyWrites());
+}
+
+static void testEncode() {
+    uint8_t buffer[320];
+    uint8_t data[300] = {1, 2, 3};
+    CHECK(4 == Apdu::encode(buffer, 0x00, 0xA4, 0x04, 0x00));        // case 1
+    CHECK((5 == Apdu::encode(buffer, 0x00, 0xB0, 0x00, 0x00, nullptr, 0, 256)) && (0x00 == buffer[4]));        // case 2 short, Le 256 is 0x00
+    CHECK((8 == Apdu::encode(buffer, 0x00, 0xD6, 0x00, 0x00, data, 3)) && (3 == buffer[4]) && (3 == buffer[7]));        // case 3 short
+    CHECK((9 == Apdu::encode(buffer, 0x00, 0xD6, 0x00, 0x00, data, 3, 256)) && (0x00 == buffer[8]));        // case 4 short
+    CHECK((7 == Apdu::encode(buffer, 0x00, 0xB0, 0x00, 0x00, nullptr, 0, 1000)) && (0x00 == buffer[4]) && (0x03 == buffer[5]) && (0xE8 == buffer[6]));        // case 2 extended
+    CHECK((307 == Apdu::encode(buffer, 0x00, 0xD6, 0x00, 0x00, data, 300)) && (0x00 == buffer[4]) && (0x01 == buffer[5]) && (0x2C == buffer[6]));        // case 3 extended
+    CHECK((309 == Apdu::encode(buffer, 0x00, 0xD6, 0x00, 0x00, data, 300, 65536)) && (0x00 == buffer[307]) && (0x00 == buffer[308]));        // case 4 extended, Le 65536 is 0x0000
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    IsoDepTransceiver theTransceiver(theNci);
+    SimulatedTag theCard = SimulatedTag::isoDepCard();
+    theNci.setTagOperation(runScript, &theTransceiver, 5000);
+    theNci.initialize();
+
+    testLongCommands(theNci, theSimulator, theTransceiver, theCard, false);
+    testLongCommands(theNci, theSimulator, theTransceiver, theCard, true);
+    testResponseParts(theNci, theSimulator, theTransceiver, theCard);
+    testErrors(theNci, theSimulator, theTransceiver, theCard);
+    testRemoved(theNci, theSimulator, theTransceiver, theCard);
+    testType2Tag();
+    testEncode();
+    return testResult();
+}
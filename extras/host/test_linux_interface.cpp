@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   PN7150LinuxInterface without the hardware : devices which do not exist are reported, instead of giving a transport which never answers
+
+#include <cerrno>
+#include <cstring>
+#include "HostTest.h"
+#include "PN7150LinuxInterface.h"
+
+int main() {
+    {
+        PN7150LinuxInterface theInterface("/dev/i2c-no-such-bus", "/dev/no-such-gpiochip", 4, 5);
+        CHECK(!theInterface.isOpen());
+        CHECK(0 == theInterface.getLastError());
+        theInterface.beginReset();
+        CHECK(!theInterface.isOpen());
+        CHECK(ENOENT == theInterface.getLastError());
+        CHECK((nullptr != theInterface.getLastErrorSource()) && (0 == strcmp("/dev/i2c-no-such-bus", theInterface.getLastErrorSource())));        // the first failure is kept
+        CHECK(!theInterface.hasMessage());
+        theInterface.beginReset();        // tries again
+        CHECK(ENOENT == theInterface.getLastError());
+    }
+    {
+        PN7150LinuxInterface theInterface("/dev/null", "/dev/null", 4, 5);        // opens, but is neither an i2c-dev nor a GPIO chip
+        theInterface.beginReset();
+        CHECK(!theInterface.isOpen());
+        CHECK(0 != theInterface.getLastError());
+        CHECK((nullptr != theInterface.getLastErrorSource()) && (0 == strcmp("I2C_FUNCS", theInterface.getLastErrorSource())));
+    }
+    return testResult();
+}
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Stacked tags, selected in turn with RF_DISCOVER_SELECT_CMD, with a T2T READ as tag operation.
+//   - every tag of the stack is read, equally often, and the rates are reported
+//   - without an operation, stacked tags are only discovered, never activated
+//   - a tag which leaves before its select is skipped, without going to Error
+
+#include "HostTest.h"
+
+static constexpr uint8_t maxNmbrOfTags = 3;
+
+class ReadOperation {
+  public:
+    bool isSent{false};
+    uint8_t buffer[32];
+    uint32_t nmbrOfReads{0};
+    uint32_t readsPerTag[maxNmbrOfTags]{};
+};
+
+static bool readPage(NCI &theNci, uint8_t tagIndex, void *context) {
+    ReadOperation &theOperation         = *static_cast<ReadOperation *>(context);
+    static const uint8_t readCommand[2] = {0x30, 0x04};
+    if (!theOperation.isSent) {
+        theNci.setDataReceiveBuffer(theOperation.buffer, sizeof(theOperation.buffer));
+        theNci.sendData(readCommand, sizeof(readCommand));
+        theOperation.isSent = true;
+        return false;
+    }
+    if (theNci.getRfConnection().isMessageReceived()) {
+        theOperation.isSent = false;
+        theOperation.nmbrOfReads++;
+        uint8_t tagNumber = theNci.getTag(tagIndex)->uniqueId[6];
+        if ((tagNumber < maxNmbrOfTags) && ((0xA0 + tagNumber) == theOperation.buffer[0])) {        // the page comes from the tag which is selected
+            theOperation.readsPerTag[tagNumber]++;
+        }
+        return true;
+    }
+    return false;
+}
+
+class EventCounters {
+  public:
+    uint32_t activations{0};
+    uint32_t multipleTags{0};
+    uint32_t errors{0};
+};
+
+static void countEvent(const NciEvent &theEvent, void *context) {
+    EventCounters &theCounters = *static_cast<EventCounters *>(context);
+    if (NciEventType::tagActivated == theEvent.type) {
+        theCounters.activations++;
+    } else if (NciEventType::multipleTags == theEvent.type) {
+        theCounters.multipleTags++;
+    } else if (NciEventType::error == theEvent.type) {
+        theCounters.errors++;
+    }
+}
+
+static void testStack(uint8_t nmbrOfTags, bool withOperation) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    ReadOperation theOperation;
+    EventCounters theCounters;
+    theNci.addEventHandler(countEvent, &theCounters);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    if (withOperation) {
+        theNci.setTagOperation(readPage, &theOperation, 50);
+    }
+    for (uint8_t index = 0; index < nmbrOfTags; index++) {
+        SimulatedTag theTag;
+        theTag.uniqueId[6] = index;
+        theTag.memory.assign(64, static_cast<uint8_t>(0xA0 + index));
+        theSimulator.addTag(theTag);
+    }
+    theNci.initialize();
+    runNci(theNci, theSimulator, 200);
+
+    uint32_t activations  = theCounters.activations;
+    uint32_t multipleTags = theCounters.multipleTags;
+    uint32_t nmbrOfReads  = theOperation.nmbrOfReads;
+    uint32_t readsBefore[maxNmbrOfTags];
+    for (uint8_t index = 0; index < maxNmbrOfTags; index++) {
+        readsBefore[index] = theOperation.readsPerTag[index];
+    }
+    uint32_t commands       = theSimulator.getNmbrOfCommands();
+    unsigned long startTime = millis();
+    runNci(theNci, theSimulator, 2000);
+    double seconds = static_cast<double>(millis() - startTime) / 1000.0;
+
+    activations  = theCounters.activations - activations;
+    multipleTags = theCounters.multipleTags - multipleTags;
+    nmbrOfReads  = theOperation.nmbrOfReads - nmbrOfReads;
+    uint32_t cycles = (1 == nmbrOfTags) ? activations : multipleTags;
+    printf("%s, %u tag(s) : %.1f discovery cycles/s, %.1f activations/s, %.1f tags read/s (per tag :", withOperation ? "select + READ" : "UIDs only    ", nmbrOfTags, cycles / seconds, activations / seconds, nmbrOfReads / seconds);
+    uint32_t fewest = 0xFFFFFFFF;
+    uint32_t most   = 0;
+    for (uint8_t index = 0; index < nmbrOfTags; index++) {
+        uint32_t reads = theOperation.readsPerTag[index] - readsBefore[index];
+        printf(" %u", reads);
+        fewest = (reads < fewest) ? reads : fewest;
+        most   = (reads > most) ? reads : most;
+    }
+    printf("), %.0f commands/s\n", (theSimulator.getNmbrOfCommands() - commands) / seconds);
+
+    CHECK(0 == theCounters.errors);
+    CHECK(STATUS_OK == theNci.getLastGenericError());
+    CHECK(cycles > 0);
+    if (withOperation) {
+        CHECK(activations > 0);
+        CHECK(nmbrOfReads >= (activations - 1));        // the last one may still be busy
+        CHECK(fewest > 0);
+        CHECK((most - fewest) <= 1);        // each tag of the stack gets its turn
+    } else if (nmbrOfTags > 1) {
+        CHECK(0 == activations);
+        CHECK(0 == nmbrOfReads);
+    }
+}
+
+static PN7150Simulator *theSimulatorUnderTest;
+static uint32_t nmbrOfRemoved{0};
+
+static void removeBeforeSelect(const NciEvent &theEvent, void *) {
+    if ((NciEventType::multipleTags == theEvent.type) && (theSimulatorUnderTest->getNmbrOfTags() > 1)) {
+        theSimulatorUnderTest->removeTag(1);        // it leaves after it was discovered, before the NCI selects it
+        nmbrOfRemoved++;
+    }
+}
+
+static bool countOperation(NCI &, uint8_t, void *context) {
+    (*static_cast<uint32_t *>(context))++;
+    return true;
+}
+
+static void testTagGoneBeforeSelect() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    uint32_t nmbrOfOperations = 0;
+    theSimulatorUnderTest     = &theSimulator;
+    theNci.addEventHandler(removeBeforeSelect);
+    theNci.setTagOperation(countOperation, &nmbrOfOperations);
+    theSimulator.setActivationLatency(8000);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    SimulatedTag staying;
+    SimulatedTag leaving;
+    leaving.uniqueId[6] = 9;
+    theSimulator.addTag(staying);
+    theSimulator.addTag(leaving);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 200);
+    for (uint32_t round = 0; round < 20; round++) {
+        theSimulator.addTag(leaving);
+        runNci(theNci, theSimulator, 60);
+    }
+    printf("tag gone before its select : removed %u times, %u operations, %u selects, generic error 0x%02X\n", nmbrOfRemoved, nmbrOfOperations, theSimulator.getNmbrOfSelects(), theNci.getLastGenericError());
+    CHECK(nmbrOfRemoved > 0);
+    CHECK(nmbrOfOperations > 0);
+    CHECK(DISCOVERY_TARGET_ACTIVATION_FAILED == theNci.getLastGenericError());
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+    CHECK(!theNci.isRecovering());        // it stops anywhere in a discovery cycle, but not in Error
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    for (uint8_t withOperation = 0; withOperation < 2; withOperation++) {
+        for (uint8_t nmbrOfTags = 1; nmbrOfTags <= maxNmbrOfTags; nmbrOfTags++) {
+            testStack(nmbrOfTags, (1 == withOperation));
+        }
+    }
+    testTagGoneBeforeSelect();
+    return testResult();
+}
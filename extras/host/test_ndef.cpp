@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   NdefBuilder and NdefParser, round trip.
+//   - SR and normal records, with and without ID, reserve() and the URI and Text records, parsed back field by field
+//   - a chunked record, and chunk flags which are wrong
+//   - streaming : the buffer made valid 1, 3, 17, .. bytes at a time gives needMoreData, and then the same records. Also inside TLVs
+//   - fuzzed buffers, at every valid length : no record reaches outside its buffer
+
+#include "HostTest.h"
+#include "Ndef.h"
+#include <string.h>
+#include <random>
+#include <vector>
+
+static constexpr uint32_t parseError = 0xFFFFFFFF;
+
+static uint32_t parse(const std::vector<uint8_t> &buffer, bool isTlv, uint32_t step, std::vector<NdefRecord> *records = nullptr) {        // step 0 : all valid at once. The records, or parseError
+    NdefParser theParser;
+    if (isTlv) {
+        theParser.startTlv(buffer.data());
+    } else {
+        theParser.startMessage(buffer.data(), static_cast<uint32_t>(buffer.size()));
+    }
+    uint32_t length = (0 == step) ? static_cast<uint32_t>(buffer.size()) : 0;
+    uint32_t count  = 0;
+    NdefRecord theRecord;
+    while (true) {
+        NdefParseResult result = theParser.next(theRecord, length);
+        if (NdefParseResult::record == result) {
+            count++;
+            if (nullptr != records) {
+                records->push_back(theRecord);
+            }
+        } else if ((NdefParseResult::needMoreData == result) && (length < buffer.size())) {
+            length = ((length + step) < buffer.size()) ? (length + step) : static_cast<uint32_t>(buffer.size());
+        } else if (NdefParseResult::end == result) {
+            return count;
+        } else {
+            return parseError;        // an error, or more data wanted than there is
+        }
+    }
+}
+
+static bool isPayload(const NdefRecord &theRecord, const void *payload, uint32_t length) {
+    return (length == theRecord.payloadLength) && ((0 == length) || (0 == memcmp(theRecord.payload, payload, length)));
+}
+
+static void testRoundTrip() {
+    uint8_t buffer[2048];
+    NdefBuilder theBuilder(buffer, sizeof(buffer));
+    std::vector<uint8_t> large(700);        // normal record : 4 byte payload length
+    for (size_t index = 0; index < large.size(); index++) {
+        large[index] = static_cast<uint8_t>(index);
+    }
+    static const uint8_t id[] = {'i', 'd', '1'};
+    CHECK(theBuilder.addUri("https://www.example.com/a"));
+    CHECK(theBuilder.addText("hello", "nl"));
+    CHECK(theBuilder.addRecord(NdefTnf::mimeMedia, "application/octet-stream", large.data(), static_cast<uint32_t>(large.size()), id, sizeof(id)));
+    uint8_t *reserved = theBuilder.reserve(NdefTnf::external, "example.com:t", 4);
+    CHECK(nullptr != reserved);
+    if (nullptr != reserved) {
+        memcpy(reserved, "abcd", 4);
+    }
+    CHECK(theBuilder.addUri("ftp://x"));
+    CHECK(5 == theBuilder.getNmbrOfRecords());
+    CHECK(!theBuilder.isOverflow());
+
+    std::vector<uint8_t> message(buffer, buffer + theBuilder.getLength());
+    CHECK((NDEF_MB | NDEF_SR) == (message[0] & (NDEF_MB | NDEF_ME | NDEF_SR)));
+    std::vector<NdefRecord> records;
+    CHECK(5 == parse(message, false, 0, &records));
+    if (5 == records.size()) {
+        CHECK(records[0].hasType(NdefTnf::wellKnown, "U") && records[0].messageBegin && !records[0].messageEnd);
+        CHECK(isPayload(records[0], "\x02" "example.com/a", 14));        // "https://www." abbreviated
+        CHECK(records[1].hasType(NdefTnf::wellKnown, "T"));
+        CHECK(isPayload(records[1], "\x02" "nlhello", 8));
+        CHECK(records[2].hasType(NdefTnf::mimeMedia, "application/octet-stream"));
+        CHECK(isPayload(records[2], large.data(), static_cast<uint32_t>(large.size())));
+        CHECK((sizeof(id) == records[2].idLength) && (0 == memcmp(records[2].id, id, sizeof(id))));
+        CHECK(records[3].hasType(NdefTnf::external, "example.com:t") && isPayload(records[3], "abcd", 4));
+        CHECK(isPayload(records[4], "\x00" "ftp://x", 8) && records[4].messageEnd);
+        for (const NdefRecord &theRecord : records) {
+            CHECK((0 == theRecord.chunkIndex) && theRecord.lastChunk);
+        }
+    }
+    for (uint32_t step : {1U, 3U, 17U, 256U}) {
+        CHECK(5 == parse(message, false, step));
+    }
+
+    uint8_t small[20];
+    NdefBuilder smallBuilder(small, sizeof(small));
+    CHECK(smallBuilder.addUri("http://www.ab.cd"));
+    CHECK(!smallBuilder.addUri("http://www.toolongforthisbuffer"));
+    CHECK(smallBuilder.isOverflow() && (1 == smallBuilder.getNmbrOfRecords()));
+    CHECK(1 == parse(std::vector<uint8_t>(small, small + smallBuilder.getLength()), false, 0));
+}
+
+static void testShortAndNormal() {        // the same record with a 1 and a 4 byte payload length
+    for (uint32_t payloadLength : {0U, 1U, 255U, 256U, 1000U}) {
+        uint8_t buffer[1100];
+        NdefBuilder theBuilder(buffer, sizeof(buffer));
+        std::vector<uint8_t> payload(payloadLength, 0x5A);
+        CHECK(theBuilder.addRecord(NdefTnf::mimeMedia, "a/b", payload.data(), payloadLength));
+        bool isShortRecord = (0 != (buffer[0] & NDEF_SR));
+        CHECK(isShortRecord == (payloadLength < 256));
+        CHECK(theBuilder.getLength() == (1 + 1 + (isShortRecord ? 1U : 4U) + 3 + payloadLength));
+
+        std::vector<uint8_t> message(buffer, buffer + theBuilder.getLength());
+        std::vector<NdefRecord> records;
+        CHECK(1 == parse(message, false, 1, &records));
+        CHECK((1 == records.size()) && records[0].messageBegin && records[0].messageEnd && isPayload(records[0], payload.data(), payloadLength));
+
+        if (isShortRecord) {        // the NDEF specification allows a normal header for a short payload too
+            std::vector<uint8_t> normal{static_cast<uint8_t>(NDEF_MB | NDEF_ME | 0x02), 3, 0, 0, 0, static_cast<uint8_t>(payloadLength), 'a', '/', 'b'};
+            normal.insert(normal.end(), payload.begin(), payload.end());
+            records.clear();
+            CHECK(1 == parse(normal, false, 1, &records));
+            CHECK((1 == records.size()) && isPayload(records[0], payload.data(), payloadLength));
+        }
+    }
+}
+
+static const std::vector<uint8_t> chunkedMessage{NDEF_MB | NDEF_CF | NDEF_SR | 0x02, 4, 3, 't', '/', 'x', 'x', 'A', 'B', 'C',        // first chunk : the type
+                                                 NDEF_CF | NDEF_SR | 0x06, 0, 2, 'D', 'E',                                           // middle chunk : unchanged
+                                                 NDEF_SR | 0x06, 0, 1, 'F',                                                          // last chunk
+                                                 NDEF_ME | NDEF_SR | 0x01, 1, 1, 'U', 0x00};
+
+static void testChunked() {
+    std::vector<NdefRecord> records;
+    CHECK(4 == parse(chunkedMessage, false, 0, &records));
+    if (4 == records.size()) {
+        for (uint16_t index = 0; index < 3; index++) {
+            CHECK(index == records[index].chunkIndex);
+            CHECK((2 == index) == records[index].lastChunk);
+            CHECK(records[index].hasType(NdefTnf::mimeMedia, "t/xx"));        // every chunk has the type of the first
+        }
+        CHECK(isPayload(records[0], "ABC", 3) && isPayload(records[1], "DE", 2) && isPayload(records[2], "F", 1));
+        CHECK((0 == records[3].chunkIndex) && records[3].lastChunk && records[3].hasType(NdefTnf::wellKnown, "U"));
+    }
+    for (uint32_t step = 1; step <= 8; step++) {
+        CHECK(4 == parse(chunkedMessage, false, step));
+    }
+
+    std::vector<uint8_t> wrong = chunkedMessage;
+    wrong[10]                  = NDEF_SR | 0x06;        // ends the chunks
+    wrong[15]                  = NDEF_CF | NDEF_SR | 0x06;
+    CHECK(parseError == parse(wrong, false, 0));        // the Chunk Flag ends, then the chunks go on
+    wrong = chunkedMessage;
+    wrong[0] &= ~NDEF_MB;
+    CHECK(parseError == parse(wrong, false, 0));
+    wrong     = chunkedMessage;
+    wrong[19] = NDEF_SR | 0x01;        // no ME : the message runs on beyond its end
+    CHECK(parseError == parse(wrong, false, 0));
+    wrong    = chunkedMessage;
+    wrong[0] = NDEF_MB | NDEF_ME | NDEF_CF | NDEF_SR | 0x02;        // ME on a chunk which is not the last
+    CHECK(parseError == parse(wrong, false, 0));
+}
+
+static std::vector<uint8_t> tlvArea(const std::vector<uint8_t> &message, bool isLongLength) {        // NULL, Lock Control and NULL TLVs, the NDEF Message TLV and the Terminator TLV
+    std::vector<uint8_t> area{TLV_NULL, TLV_LOCK_CONTROL, 0x03, 0xA0, 0x10, 0x44, TLV_NULL, TLV_NDEF_MESSAGE};
+    if (isLongLength) {
+        area.insert(area.end(), {0xFF, static_cast<uint8_t>(message.size() >> 8), static_cast<uint8_t>(message.size())});
+    } else {
+        area.push_back(static_cast<uint8_t>(message.size()));
+    }
+    area.insert(area.end(), message.begin(), message.end());
+    area.push_back(TLV_TERMINATOR);
+    return area;
+}
+
+static void testStreamingTlv() {
+    uint8_t buffer[1024];
+    NdefBuilder theBuilder(buffer, sizeof(buffer));
+    std::vector<uint8_t> payload(400, 'p');
+    theBuilder.addUri("https://www.example.com/first");
+    theBuilder.addRecord(NdefTnf::mimeMedia, "application/json", payload.data(), static_cast<uint32_t>(payload.size()));
+    theBuilder.addText("last");
+    std::vector<uint8_t> message(buffer, buffer + theBuilder.getLength());
+    std::vector<uint8_t> area = tlvArea(message, true);
+    for (uint32_t step : {0U, 1U, 4U, 16U, 60U}) {        // as Type2TagReader fills it : 4 pages per READ, or a FAST_READ's Data packet
+        CHECK(3 == parse(area, true, step));
+    }
+
+    NdefParser theParser;        // records are complete only when their last byte is valid. The message is, at the record with ME : the Terminator TLV is not waited for
+    NdefRecord theRecord;
+    NdefParseResult result = NdefParseResult::needMoreData;
+    uint32_t length        = 0;
+    theParser.startTlv(area.data());
+    while (true) {
+        while (NdefParseResult::record == (result = theParser.next(theRecord, length))) {
+            CHECK((theRecord.payload + theRecord.payloadLength) <= (area.data() + length));
+        }
+        if ((NdefParseResult::needMoreData != result) || (length >= area.size())) {
+            break;
+        }
+        length++;
+    }
+    CHECK(NdefParseResult::end == result);
+    CHECK((area.size() - 1) == length);        // all but the Terminator TLV
+    CHECK(3 == theParser.getNmbrOfRecords());
+
+    std::vector<uint8_t> shortChunks = tlvArea(chunkedMessage, false);
+    CHECK(4 == parse(shortChunks, true, 1));
+    CHECK(0 == parse(std::vector<uint8_t>{TLV_NDEF_MESSAGE, 0x00, TLV_TERMINATOR}, true, 0));        // an empty message
+    CHECK(0 == parse(std::vector<uint8_t>{TLV_NULL, TLV_TERMINATOR}, true, 1));                      // none at all
+}
+
+static void testFuzzed() {
+    std::vector<uint8_t> area = tlvArea(chunkedMessage, true);
+    std::mt19937 random(7);
+    uint32_t nmbrToEnd           = 0;
+    uint32_t nmbrOutside         = 0;
+    const uint32_t nmbrOfBuffers = 50000;
+    for (uint32_t index = 0; index < nmbrOfBuffers; index++) {
+        std::vector<uint8_t> buffer;
+        if (index & 1) {        // a valid area, with 3 bytes changed, cut short anywhere
+            buffer = area;
+            for (uint32_t change = 0; change < 3; change++) {
+                buffer[random() % buffer.size()] = static_cast<uint8_t>(random());
+            }
+            buffer.resize((random() % buffer.size()) + 1);
+        } else {        // random bytes
+            buffer.resize((random() % 64) + 1);
+            for (uint8_t &value : buffer) {
+                value = static_cast<uint8_t>(random());
+            }
+        }
+        NdefParser theParser;
+        if (index & 2) {
+            theParser.startTlv(buffer.data());
+        } else {
+            theParser.startMessage(buffer.data(), static_cast<uint32_t>(buffer.size()));
+        }
+        NdefRecord theRecord;
+        uint32_t length = 0;
+        while (true) {
+            NdefParseResult result = theParser.next(theRecord, length);
+            if (NdefParseResult::record == result) {
+                if ((theRecord.payload + theRecord.payloadLength) > (buffer.data() + length)) {
+                    nmbrOutside++;
+                }
+            } else if ((NdefParseResult::needMoreData == result) && (length < buffer.size())) {
+                length++;
+            } else {
+                nmbrToEnd += (NdefParseResult::end == result) ? 1 : 0;
+                break;
+            }
+        }
+    }
+    printf("fuzzed : %u buffers, %u parsed to the end, %u records outside the valid part\n", nmbrOfBuffers, nmbrToEnd, nmbrOutside);
+    CHECK(0 == nmbrOutside);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testRoundTrip();
+    testShortAndNormal();
+    testChunked();
+    testStreamingTlv();
+    testFuzzed();
+    return testResult();
+}
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Low Power Card Detection and the power down cycle : after a while without tags VEN goes LOW, and after the power down time the NFCC boots again
+//   - the NFCC keeps its configuration : LPCD is written once, standby stays on, and the time in each power mode adds up
+//   - the NFCC loses its configuration at VEN LOW : LPCD is written again after every wake up
+//   - a tag which comes while powered down is found after the wake up
+//   - estimateAverageCurrent() weighs the current of each mode with its time
+
+#include "HostTest.h"
+
+static constexpr unsigned long noTagTime     = 20;        // [ms]
+static constexpr unsigned long powerDownTime = 50;        // [ms]
+
+class PowerDownWatch {
+  public:
+    NCI *theNci{nullptr};
+    PN7150Simulator *theSimulator{nullptr};
+    bool wasPoweredDown{false};
+    uint32_t nmbrOfPowerDowns{0};
+    uint32_t nmbrOfVenHighWhilePoweredDown{0};        // PowerDown state, while the simulated NFCC is powered : VEN was not LOW
+};
+
+static PowerDownWatch theWatch;
+
+static bool watchPowerDown() {        // runNci()'s done() : count the PowerDown periods, and check VEN is LOW in each
+    bool isPoweredDown = (NciState::PowerDown == theWatch.theNci->getState());
+    if (isPoweredDown && !theWatch.theSimulator->isPoweredDown()) {
+        theWatch.nmbrOfVenHighWhilePoweredDown++;
+    }
+    if (isPoweredDown && !theWatch.wasPoweredDown) {
+        theWatch.nmbrOfPowerDowns++;
+    }
+    theWatch.wasPoweredDown = isPoweredDown;
+    return false;
+}
+
+static bool tagFound() {
+    return (1 == theWatch.theNci->getNmbrOfTags());
+}
+
+static void startWatch(NCI &theNci, PN7150Simulator &theSimulator) {
+    theWatch              = PowerDownWatch();
+    theWatch.theNci       = &theNci;
+    theWatch.theSimulator = &theSimulator;
+}
+
+static void configure(NCI &theNci) {
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    CHECK(theNci.setLowPowerCardDetection(true, 0x10, 3));
+    theNci.setPowerDownCycle(noTagTime, powerDownTime);
+}
+
+static void testCycle(bool configRetention) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theSimulator.setConfigRetention(configRetention);
+    configure(theNci);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 10);
+    CHECK(NciState::RfDiscovery == theNci.getState());
+    CHECK(1 == theSimulator.getNmbrOfConfigWrites(TAG_DETECTOR_CFG));
+    CHECK(theSimulator.isStandbyEnabled());
+
+    startWatch(theNci, theSimulator);
+    theNci.resetPowerStatistics();
+    unsigned long startTime = millis();
+    runNci(theNci, theSimulator, 2000, watchPowerDown);
+    unsigned long elapsed            = millis() - startTime;
+    NciPowerStatistics theStatistics = theNci.getPowerStatistics();
+    unsigned long totalTime          = 0;
+    for (uint8_t index = 0; index < static_cast<uint8_t>(NciPowerMode::nmbrOfPowerModes); index++) {
+        totalTime += theStatistics.timeInMode[index];
+    }
+    unsigned long powerDownTotal = theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::powerDown)];
+    uint32_t lpcdWrites          = theSimulator.getNmbrOfConfigWrites(TAG_DETECTOR_CFG);
+    printf("configuration %s : %u power downs, %u wake ups, %u power ups, LPCD written %u times, time [ms] : power down %lu, idle %lu, polling %lu, low power polling %lu, active %lu, total %lu of %lu\n",
+           configRetention ? "retained" : "lost    ", theWatch.nmbrOfPowerDowns, theStatistics.nmbrOfWakeUps, theSimulator.getNmbrOfPowerUps(), lpcdWrites, powerDownTotal,
+           theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::idle)], theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::polling)],
+           theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::lowPowerPolling)], theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::active)], totalTime, elapsed);
+
+    CHECK(theWatch.nmbrOfPowerDowns >= 3);        // each cycle : discovery time-out (minDiscoveryTimeOut), noTagTime, powerDownTime, and a boot
+    CHECK(0 == theWatch.nmbrOfVenHighWhilePoweredDown);
+    CHECK((theStatistics.nmbrOfWakeUps == theWatch.nmbrOfPowerDowns) || ((theStatistics.nmbrOfWakeUps + 1) == theWatch.nmbrOfPowerDowns));        // the last one may still be powered down
+    CHECK(theSimulator.getNmbrOfPowerUps() == (1 + theStatistics.nmbrOfWakeUps));                                                                  // initialize(), then one per wake up
+    if (configRetention) {
+        CHECK(1 == lpcdWrites);        // the NFCC kept it, CORE_RESET_RSP said so
+    } else {
+        CHECK((1 + theStatistics.nmbrOfWakeUps) == lpcdWrites);        // written again after every wake up
+    }
+    CHECK(0 == theSimulator.getNmbrOfEarlyWrites());
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+
+    // Time accounting : the modes add up to the time the test ran, the NFCC was powered down for powerDownTime per power down, and it never polled at full power
+    CHECK((totalTime + 2 >= elapsed) && (totalTime <= elapsed + 2));
+    CHECK(powerDownTotal >= theStatistics.nmbrOfWakeUps * powerDownTime);
+    CHECK(powerDownTotal <= theWatch.nmbrOfPowerDowns * (powerDownTime + 5));
+    CHECK(theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::lowPowerPolling)] >= theStatistics.nmbrOfWakeUps * (500 + noTagTime));
+    CHECK(theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::idle)] > 0);        // booting
+    CHECK(0 == theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::polling)]);
+    CHECK(0 == theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::active)]);
+
+    // A tag which comes while powered down is found after the wake up, with LPCD and standby back on
+    runNci(theNci, theSimulator, 1000, [] { return (NciState::PowerDown == theWatch.theNci->getState()); });
+    CHECK(NciState::PowerDown == theNci.getState());
+    theSimulator.addTag(SimulatedTag::ntag216());
+    startTime  = millis();
+    bool found = runNci(theNci, theSimulator, 2 * powerDownTime, tagFound);
+    printf("configuration %s : tag found %lu ms after it came, while powered down\n", configRetention ? "retained" : "lost    ", millis() - startTime);
+    CHECK(found);
+    CHECK(!theSimulator.getConfigParameter(TAG_DETECTOR_CFG).empty() && (0x01 == theSimulator.getConfigParameter(TAG_DETECTOR_CFG)[0]));
+    CHECK(theSimulator.isStandbyEnabled());
+}
+
+static void testAverageCurrent() {
+    NciPowerStatistics theStatistics;
+    const uint32_t currentPerMode[static_cast<uint8_t>(NciPowerMode::nmbrOfPowerModes)] = {1, 2000, 60000, 150, 80000};        // [uA]
+    CHECK(0 == theStatistics.estimateAverageCurrent(currentPerMode));                                                              // no time accounted yet
+    theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::powerDown)]       = 900;
+    theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::lowPowerPolling)] = 100;
+    CHECK(15 == theStatistics.estimateAverageCurrent(currentPerMode));        // (900 * 1 + 100 * 150) / 1000, truncated
+    theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::active)] = 1000;
+    CHECK(40007 == theStatistics.estimateAverageCurrent(currentPerMode));        // (900 + 15000 + 80000000) / 2000
+    theStatistics.timeInMode[static_cast<uint8_t>(NciPowerMode::powerDown)] = 4000000000UL;
+    CHECK(1 == theStatistics.estimateAverageCurrent(currentPerMode));        // 64 bit intermediates : no overflow after weeks
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testCycle(true);
+    testCycle(false);
+    testAverageCurrent();
+    return testResult();
+}
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   A Type 2 Tag stays activated, and a READ every 5 ms checks it is still there. Only the NFCC telling the tag did not answer ends a presence check.
+//   - the application's sendCommand() times out, and its response comes while a presence check waits for the tag : the tag stays
+//   - the tag is removed : one tagDeparted
+
+#include "HostTest.h"
+
+class LateCommandLoad {
+  public:
+    NCI *theNci{nullptr};
+    PN7150Simulator *theSimulator{nullptr};
+    uint8_t response[8]{};
+    bool isSent{false};
+    unsigned long doneTime{0};        // millis()
+    uint32_t nmbrTimedOut{0};
+    uint32_t nmbrDeparted{0};
+};
+
+static LateCommandLoad theLoad;
+
+static void countDepartures(const NciEvent &theEvent, void *context) {
+    (void)context;
+    if (NciEventType::tagDeparted == theEvent.type) {
+        theLoad.nmbrDeparted++;
+    }
+}
+
+static bool sendLateCommands() {        // runNci()'s done() : the response comes 11 to 18 ms after the command, after connectionCommandTimeOut, so it lands anywhere in a presence check cycle
+    NCI &theNci = *theLoad.theNci;
+    if (theNci.isConnectionCommandPending()) {
+        return false;
+    }
+    if (theLoad.isSent) {
+        theLoad.isSent   = false;
+        theLoad.doneTime = millis();
+        if (STATUS_OK != theNci.getLastConnectionStatus()) {
+            theLoad.nmbrTimedOut++;
+        }
+    }
+    if ((millis() - theLoad.doneTime) >= 20) {        // the late response to the command before is surely in
+        theLoad.theSimulator->setSlowResponseLatency(11000 + (theLoad.nmbrTimedOut % 8) * 1000);
+        static const uint8_t payload[] = {1, PA_BAIL_OUT};
+        theLoad.isSent = theNci.sendCommand(GroupIdCore, CORE_GET_CONFIG_CMD, payload, sizeof(payload), theLoad.response, sizeof(theLoad.response));
+    }
+    return false;
+}
+
+static void testLateResponse() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theLoad              = LateCommandLoad();
+    theLoad.theNci       = &theNci;
+    theLoad.theSimulator = &theSimulator;
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setPresenceCheckPeriod(5);
+    theNci.addEventHandler(countDepartures);
+    theSimulator.setDataLatency(3000);        // a READ takes 3 ms : a good part of the time, a presence check is waiting for the tag
+    theSimulator.addTag(SimulatedTag::ntag216());
+    theNci.initialize();
+    runNci(theNci, theSimulator, 200);
+    CHECK(1 == theNci.getNmbrOfTags());
+
+    theSimulator.injectFault(GroupIdCore, CORE_GET_CONFIG_CMD, SimulatedFault::slowResponse, 0xFFFFFFFF);
+    uint32_t presenceChecks = theNci.getNmbrOfPresenceChecks();
+    uint32_t selects        = theSimulator.getNmbrOfSelects();
+    runNci(theNci, theSimulator, 1000, sendLateCommands);
+    presenceChecks = theNci.getNmbrOfPresenceChecks() - presenceChecks;
+    selects        = theSimulator.getNmbrOfSelects() - selects;
+    printf("T2T, late responses : %u commands timed out, %u presence checks, %u departures, %u selects\n", theLoad.nmbrTimedOut, presenceChecks, theLoad.nmbrDeparted, selects);
+    CHECK(theLoad.nmbrTimedOut > 20);
+    CHECK(presenceChecks > 50);
+    CHECK(0 == theLoad.nmbrDeparted);
+    CHECK(0 == selects);        // the tag was never rediscovered
+    CHECK(1 == theNci.getNmbrOfTags());
+
+    theSimulator.removeAllTags();
+    runNci(theNci, theSimulator, 100);
+    printf("T2T removed         : %u departures, state %u\n", theLoad.nmbrDeparted, static_cast<unsigned>(theNci.getState()));
+    CHECK(1 == theLoad.nmbrDeparted);
+    CHECK(TagsPresentStatus::noTagsPresent == theNci.getTagsPresentStatus());
+    CHECK(NciState::RfDiscovery == theNci.getState());
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testLateResponse();
+    return testResult();
+}
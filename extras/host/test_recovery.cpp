@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Recovery from Error, with faults injected in the simulated NFCC's responses.
+//   Each fault has to be solved at the lowest level of NciRecoveryLevel which can, escalating only when that level fails, and end in discovery again.
+
+#include "HostTest.h"
+
+class EventCounters {
+  public:
+    uint32_t arrived{0};
+    uint32_t departed{0};
+    uint32_t errors{0};
+};
+
+static void countEvent(const NciEvent &theEvent, void *context) {
+    EventCounters &theCounters = *static_cast<EventCounters *>(context);
+    switch (theEvent.type) {
+        case NciEventType::tagArrived:
+            theCounters.arrived++;
+            break;
+        case NciEventType::tagDeparted:
+            theCounters.departed++;
+            break;
+        case NciEventType::error:
+            theCounters.errors++;
+            break;
+        default:
+            break;
+    }
+}
+
+static const char *levelNames[] = {"retry", "rfDeactivate", "coreReset", "hardwareReset"};
+static constexpr uint8_t nmbrOfLevels = static_cast<uint8_t>(NciRecoveryLevel::nmbrOfRecoveryLevels);
+
+class Scenario {
+  public:
+    const char *title;
+    uint8_t groupId;
+    uint8_t opcodeId;
+    SimulatedFault theFault;
+    uint32_t count;
+    uint32_t failures;                     // times the stateMachine is expected to go to Error
+    NciRecoveryLevel solvedAt;             // the level expected to solve each of them
+    NciState endState;
+    uint32_t venResets;
+};
+
+static const Scenario scenarios[] = {
+    {"corrupt RF_DEACTIVATE_RSP once", GroupIdRfManagement, RF_DEACTIVATE_CMD, SimulatedFault::corruptResponse, 1, 1, NciRecoveryLevel::rfDeactivate, NciState::RfDiscovery, 0},
+    {"drop CORE_SET_CONFIG_RSP once", GroupIdCore, CORE_SET_CONFIG_CMD, SimulatedFault::dropResponse, 1, 1, NciRecoveryLevel::retry, NciState::RfDiscovery, 0},
+    {"fail RF_DISCOVER_RSP once", GroupIdRfManagement, RF_DISCOVER_CMD, SimulatedFault::failResponse, 1, 1, NciRecoveryLevel::rfDeactivate, NciState::RfDiscovery, 0},
+    {"hang until CORE_RESET at RF_DISCOVER", GroupIdRfManagement, RF_DISCOVER_CMD, SimulatedFault::hangUntilCoreReset, 1, 1, NciRecoveryLevel::coreReset, NciState::RfDiscovery, 0},
+    {"hang until VEN reset at RF_DISCOVER", GroupIdRfManagement, RF_DISCOVER_CMD, SimulatedFault::hangUntilVenReset, 1, 1, NciRecoveryLevel::hardwareReset, NciState::RfDiscovery, 1},
+    {"corrupt every RF_DEACTIVATE_RSP x20", GroupIdRfManagement, RF_DEACTIVATE_CMD, SimulatedFault::corruptResponse, 20, 10, NciRecoveryLevel::coreReset, NciState::RfDiscovery, 0},
+};
+
+static const NCI *theNciUnderTest;
+static NciState wantedState;
+
+static bool isInWantedState() {
+    return (wantedState == theNciUnderTest->getState());
+}
+
+static void runScenario(const Scenario &theScenario) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    EventCounters theCounters;
+    theNci.addEventHandler(countEvent, &theCounters);
+    SimulatedTag theTag;        // a Type 2 Tag, so discovery keeps going through RF_DEACTIVATE and RF_DISCOVER
+    theSimulator.addTag(theTag);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 300);
+    uint32_t powerUps = theSimulator.getNmbrOfPowerUps();
+    if ((GroupIdCore == theScenario.groupId) && (CORE_SET_CONFIG_CMD == theScenario.opcodeId)) {
+        theNci.setTotalDuration(50);        // something to write
+    }
+    theSimulator.injectFault(theScenario.groupId, theScenario.opcodeId, theScenario.theFault, theScenario.count);
+    runNci(theNci, theSimulator, 1500);
+    theNciUnderTest = &theNci;
+    wantedState     = theScenario.endState;
+    runNci(theNci, theSimulator, 200, isInWantedState);        // the tag keeps it cycling through discovery : stop where it is expected, not anywhere in the cycle
+
+    const NciRecoveryStatistics &theStatistics = theNci.getRecoveryStatistics();
+    printf("%-40s failures %u, faults %u, errors %u, VEN resets %u, state %u\n", theScenario.title, theStatistics.nmbrOfFailures, theSimulator.getNmbrOfInjectedFaults(), theCounters.errors, theSimulator.getNmbrOfPowerUps() - powerUps, static_cast<unsigned>(theNci.getState()));
+    for (uint8_t level = 0; level < nmbrOfLevels; level++) {
+        if (theStatistics.attempts[level] > 0) {
+            unsigned long average = (theStatistics.recoveries[level] > 0) ? (theStatistics.timeToRecover[level] / theStatistics.recoveries[level]) : 0;
+            printf("    %-14s attempts %u, recoveries %u, avg %lu us, max %lu us\n", levelNames[level], theStatistics.attempts[level], theStatistics.recoveries[level], average, theStatistics.maxTimeToRecover[level]);
+        }
+    }
+
+    uint8_t solvedAt       = static_cast<uint8_t>(theScenario.solvedAt);
+    uint32_t nmbrOfActions = 0;
+    CHECK(theScenario.count == theSimulator.getNmbrOfInjectedFaults());
+    CHECK(theScenario.failures == theStatistics.nmbrOfFailures);
+    CHECK(theScenario.failures == theStatistics.recoveries[solvedAt]);
+    for (uint8_t level = 0; level < nmbrOfLevels; level++) {
+        if (level > solvedAt) {
+            CHECK(0 == theStatistics.attempts[level]);        // no escalation beyond what was needed
+        }
+        if (level != solvedAt) {
+            CHECK(0 == theStatistics.recoveries[level]);
+        }
+        nmbrOfActions += theStatistics.attempts[level];
+    }
+    CHECK(nmbrOfActions == theCounters.errors);        // each level is tried once per failure, after the one below it went to Error again
+    CHECK(theScenario.endState == theNci.getState());
+    CHECK(!theNci.isRecovering());
+    CHECK(theScenario.venResets == (theSimulator.getNmbrOfPowerUps() - powerUps));
+}
+
+static void testPresenceCheckLost() {
+    // A lost presence check response is not an Error : the tag is taken as gone, and found again by the next discovery
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    EventCounters theCounters;
+    theNci.addEventHandler(countEvent, &theCounters);
+    SimulatedTag theTag;
+    theTag.protocol = PROTOCOL_ISO_DEP;
+    theTag.selRes   = 0x20;
+    theSimulator.addTag(theTag);
+    theNci.setPresenceCheckPeriod(50);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 300);
+    CHECK(NciState::RfPollActive == theNci.getState());
+    uint32_t arrived  = theCounters.arrived;
+    uint32_t departed = theCounters.departed;
+    theSimulator.injectFault(GroupIdProprietary, NCI_PROPRIETARY_PRESENCE_CHECK_CMD, SimulatedFault::dropResponse, 1);
+    runNci(theNci, theSimulator, 1500);
+    CHECK(1 == theSimulator.getNmbrOfInjectedFaults());
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+    CHECK(0 == theCounters.errors);
+    CHECK(1 == (theCounters.departed - departed));
+    CHECK(1 == (theCounters.arrived - arrived));
+    CHECK(NciState::RfPollActive == theNci.getState());
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    for (const Scenario &theScenario : scenarios) {
+        runScenario(theScenario);
+    }
+    testPresenceCheckLost();
+    return testResult();
+}
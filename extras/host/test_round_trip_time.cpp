@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   NciRoundTripTime, and the adaptive time-outs the NCI derives from it.
+//   - the first sample sets the mean, and half of it the deviation. Fewer than minNmbrOfSamples : the ceiling
+//   - steady samples : the deviation goes to 0, the mean follows a change within a few dozen samples
+//   - the time-out stays within floor and ceiling, and is rounded up to whole ms
+//   - an ISO-DEP card leaves, and the NFCC does not answer the presence check : adaptive time-outs detect it sooner than the fixed 10 ms
+//   - sendCommand() : with adaptive time-outs, a response much slower than the ones before times out. Without, the fixed 10 ms still waits for it
+
+#include "HostTest.h"
+
+static void testEstimator() {
+    NciRoundTripTime theTimes;
+    CHECK(0 == theTimes.getNmbrOfSamples());
+    CHECK(10 == theTimes.getTimeOut(4, 3, 10));        // nothing known : the ceiling
+
+    theTimes.addSample(2000);
+    printf("first sample   : mean %lu us, deviation %lu us\n", theTimes.getMean(), theTimes.getDeviation());
+    CHECK(2000 == theTimes.getMean());
+    CHECK(1000 == theTimes.getDeviation());        // half the first sample, RFC 6298 section 2.2
+    CHECK(2000 == theTimes.getMax());
+    CHECK(10 == theTimes.getTimeOut(4, 3, 10));
+
+    theTimes.addSample(2000);
+    theTimes.addSample(2000);
+    CHECK(3 == theTimes.getNmbrOfSamples());
+    CHECK(10 == theTimes.getTimeOut(4, 3, 10));        // still fewer than minNmbrOfSamples
+    theTimes.addSample(2000);
+    CHECK(NciRoundTripTime::minNmbrOfSamples == theTimes.getNmbrOfSamples());
+    CHECK(2000 == theTimes.getMean());
+    CHECK(422 == theTimes.getDeviation());              // 1000 x 3/4 x 3/4 x 3/4, in integer steps : 4000, 3000, 2250, 1688 scaled by 4
+    CHECK(4 == theTimes.getTimeOut(4, 3, 10));          // 2000 + 4 x 422 = 3688 us, rounded up
+
+    for (uint32_t index = 0; index < 50; index++) {
+        theTimes.addSample(2000);
+    }
+    printf("steady 2000 us : mean %lu us, deviation %lu us\n", theTimes.getMean(), theTimes.getDeviation());
+    CHECK(2000 == theTimes.getMean());
+    CHECK(0 == theTimes.getDeviation());
+    CHECK(3 == theTimes.getTimeOut(4, 3, 10));        // 2 ms, raised to the floor
+    CHECK(2 == theTimes.getTimeOut(4, 1, 10));
+
+    for (uint32_t index = 0; index < 50; index++) {
+        theTimes.addSample(5000);
+    }
+    printf("then 5000 us   : mean %lu us, deviation %lu us\n", theTimes.getMean(), theTimes.getDeviation());
+    CHECK(theTimes.getMean() > 4950);
+    CHECK(theTimes.getMean() <= 5000);
+    CHECK(theTimes.getDeviation() < 50);
+    CHECK(5000 == theTimes.getMax());
+    CHECK(6 == theTimes.getTimeOut(4, 3, 10));
+
+    for (uint32_t index = 0; index < 50; index++) {
+        theTimes.addSample(30000);
+    }
+    printf("then 30000 us  : mean %lu us, deviation %lu us\n", theTimes.getMean(), theTimes.getDeviation());
+    CHECK(10 == theTimes.getTimeOut(4, 3, 10));        // lowered to the ceiling
+    CHECK(theTimes.getTimeOut(4, 3, 100) >= 30);
+    CHECK(theTimes.getTimeOut(4, 3, 100) < 35);
+
+    NciRoundTripTime theHugeTimes;
+    for (uint32_t index = 0; index < 10; index++) {
+        theHugeTimes.addSample(0xFFFFFFFF);
+    }
+    CHECK(0x0FFFFFFF == theHugeTimes.getMean());        // clamped, so the scaled values do not overflow
+    CHECK(0x0FFFFFFF == theHugeTimes.getMax());
+}
+
+class DepartureTest {
+  public:
+    static NCI *theNci;
+};
+
+NCI *DepartureTest::theNci{nullptr};
+
+static bool tagPresent() {
+    return (1 == DepartureTest::theNci->getNmbrOfTags());
+}
+
+static bool tagGone() {
+    return (0 == DepartureTest::theNci->getNmbrOfTags());
+}
+
+static uint32_t nmbrOfPresenceChecksBefore{0};
+
+static bool presenceCheckStarted() {
+    return (DepartureTest::theNci->getNmbrOfPresenceChecks() > nmbrOfPresenceChecksBefore);
+}
+
+// [ms] from the start of the first presence check after the card left, until its removal is detected
+static unsigned long measureDeparture(bool adaptive, unsigned long &expectedTimeOut) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    DepartureTest::theNci = &theNci;
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setPresenceCheckPeriod(10);
+    theNci.setAdaptiveTimeOuts(adaptive, 3, 2);        // 2 deviations : a host which is late now and then does not push the time-out to the ceiling
+    theSimulator.addTag(SimulatedTag::isoDepCard());
+    theNci.initialize();
+    CHECK(runNci(theNci, theSimulator, 500, tagPresent));
+    runNci(theNci, theSimulator, 300);        // 30 presence checks
+    const NciRoundTripTime &theTimes = *theNci.getRoundTripTime(NciState::RfPresenceCheckWfr);
+    CHECK(theTimes.getNmbrOfSamples() >= NciRoundTripTime::minNmbrOfSamples);
+    expectedTimeOut = adaptive ? theTimes.getTimeOut(2, 3, 10) : 10;
+
+    theSimulator.removeAllTags();
+    theSimulator.injectFault(GroupIdProprietary, NCI_PROPRIETARY_PRESENCE_CHECK_CMD, SimulatedFault::hangUntilCoreReset);        // the NFCC does not tell, neither with the response nor the notification
+    nmbrOfPresenceChecksBefore = theNci.getNmbrOfPresenceChecks();
+    CHECK(runNci(theNci, theSimulator, 20, presenceCheckStarted));
+    unsigned long checkStartTime = millis();
+    CHECK(runNci(theNci, theSimulator, 100, tagGone));
+    return theNci.getRemovalDetectedTimestamp() - checkStartTime;
+}
+
+static void testDeparture() {
+    unsigned long fixedTimeOut{0};
+    unsigned long adaptiveTimeOut{0};
+    unsigned long fixedTime    = measureDeparture(false, fixedTimeOut);
+    unsigned long adaptiveTime = measureDeparture(true, adaptiveTimeOut);
+    printf("card left      : detected %lu ms after the presence check started with the fixed time-out, %lu ms with the adaptive one of %lu ms\n", fixedTime, adaptiveTime, adaptiveTimeOut);
+    CHECK(fixedTime >= 9);                          // the fixed 10 ms of PROPRIETARY_PRESENCE_CHECK_RSP, give or take a millis() tick
+    CHECK(adaptiveTimeOut < 6);                     // the floor of 3 ms, or a little more : the simulator answers within 1 ms
+    CHECK((adaptiveTime + 1) >= adaptiveTimeOut);
+    CHECK(adaptiveTime < fixedTime);
+}
+
+class CommandTest {
+  public:
+    static NCI *theNci;
+    static uint32_t nmbrSent;
+};
+
+NCI *CommandTest::theNci{nullptr};
+uint32_t CommandTest::nmbrSent{0};
+
+static bool sendCommands() {        // runNci()'s done() : 16 CORE_GET_CONFIGs, one after the other
+    if (CommandTest::theNci->isConnectionCommandPending()) {
+        return false;
+    }
+    if (CommandTest::nmbrSent >= 16) {
+        return true;
+    }
+    static const uint8_t getConfig[2] = {1, TOTAL_DURATION};
+    if (CommandTest::theNci->sendCommand(GroupIdCore, CORE_GET_CONFIG_CMD, getConfig, sizeof(getConfig))) {
+        CommandTest::nmbrSent++;
+    }
+    return false;
+}
+
+// Status of a CORE_GET_CONFIG whose response takes 8 ms, after 16 which took the simulator's usual 0.5 ms
+static uint8_t slowCommandStatus(bool adaptive) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    CommandTest::theNci   = &theNci;
+    CommandTest::nmbrSent = 0;
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setAdaptiveTimeOuts(adaptive, 3, 2);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 50);
+    CHECK(runNci(theNci, theSimulator, 200, sendCommands));
+    CHECK(16 == theNci.getConnectionCommandRoundTripTime().getNmbrOfSamples());
+
+    theSimulator.setSlowResponseLatency(8000);
+    theSimulator.injectFault(GroupIdCore, CORE_GET_CONFIG_CMD, SimulatedFault::slowResponse);
+    static const uint8_t getConfig[2] = {1, TOTAL_DURATION};
+    CHECK(theNci.sendCommand(GroupIdCore, CORE_GET_CONFIG_CMD, getConfig, sizeof(getConfig)));
+    runNci(theNci, theSimulator, 20);
+    CHECK(!theNci.isConnectionCommandPending());
+    return theNci.getLastConnectionStatus();
+}
+
+static void testConnectionCommand() {
+    uint8_t fixedStatus    = slowCommandStatus(false);
+    uint8_t adaptiveStatus = slowCommandStatus(true);
+    printf("slow response  : status 0x%02X with the fixed time-out, 0x%02X with the adaptive one\n", fixedStatus, adaptiveStatus);
+    CHECK(STATUS_FAILED != fixedStatus);
+    CHECK(STATUS_FAILED == adaptiveStatus);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testEstimator();
+    testDeparture();
+    testConnectionCommand();
+    return testResult();
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   NCI allows one command at a time. The application keeps a sendCommand() open most of the time, its response comes after 4 ms, while the stateMachine
+//   has commands of its own to send. The simulator counts commands which come before the response to the one before was read.
+//   - an ISO-DEP card with presence checks every 5 ms : the proprietary presence check waits for the response
+//   - the card is removed : RF_DEACTIVATE_CMD waits for the response
+//   - stacked tags, each selected and read in turn : RF_DISCOVER_SELECT_CMD and RF_DEACTIVATE_CMD wait for the response
+
+#include "HostTest.h"
+
+static constexpr uint8_t maxNmbrOfTags = 3;
+
+class CommandLoad {
+  public:
+    NCI *theNci{nullptr};
+    uint8_t response[8]{};
+    bool isSent{false};
+    unsigned long doneTime{0};        // millis()
+    uint32_t nmbrOk{0};
+    uint32_t nmbrFailed{0};
+};
+
+static CommandLoad theLoad;
+
+static bool keepCommandOpen() {        // runNci()'s done() : called after every run(), sends the next command 1 ms after the response to the last one
+    NCI &theNci = *theLoad.theNci;
+    if (theNci.isConnectionCommandPending()) {
+        return false;
+    }
+    if (theLoad.isSent) {
+        theLoad.isSent   = false;
+        theLoad.doneTime = millis();
+        bool isOk        = (STATUS_OK == theNci.getLastConnectionStatus()) && (5 == theNci.getLastResponseLength()) && (PA_BAIL_OUT == theLoad.response[2]) && (0x01 == theLoad.response[4]);        // Status, Number of Parameters, ID, Length, Value
+        (isOk ? theLoad.nmbrOk : theLoad.nmbrFailed)++;
+    }
+    if ((millis() - theLoad.doneTime) >= 1) {
+        static const uint8_t payload[] = {1, PA_BAIL_OUT};
+        theLoad.isSent = theNci.sendCommand(GroupIdCore, CORE_GET_CONFIG_CMD, payload, sizeof(payload), theLoad.response, sizeof(theLoad.response));
+    }
+    return false;
+}
+
+static void startLoad(NCI &theNci, PN7150Simulator &theSimulator) {
+    theLoad        = CommandLoad();
+    theLoad.theNci = &theNci;
+    theSimulator.setSlowResponseLatency(4000);
+    theSimulator.injectFault(GroupIdCore, CORE_GET_CONFIG_CMD, SimulatedFault::slowResponse, 0xFFFFFFFF);
+}
+
+static const uint8_t bailOut[] = {0x01};
+
+static void testPresenceCheck() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setConfigParameter(PA_BAIL_OUT, bailOut, sizeof(bailOut));
+    theNci.setPresenceCheckPeriod(5);
+    theSimulator.addTag(SimulatedTag::isoDepCard());
+    theNci.initialize();
+    runNci(theNci, theSimulator, 200);
+    CHECK(NciState::RfPollActive == theNci.getState());
+
+    startLoad(theNci, theSimulator);
+    uint32_t presenceChecks = theNci.getNmbrOfPresenceChecks();
+    runNci(theNci, theSimulator, 500, keepCommandOpen);
+    presenceChecks = theNci.getNmbrOfPresenceChecks() - presenceChecks;
+    printf("ISO-DEP card, presence check every 5 ms : %u commands ok, %u failed, %u presence checks, %u overlapping commands\n", theLoad.nmbrOk, theLoad.nmbrFailed, presenceChecks, theSimulator.getNmbrOfOverlappingCommands());
+    CHECK(0 == theSimulator.getNmbrOfOverlappingCommands());
+    CHECK(theLoad.nmbrOk > 40);
+    CHECK(0 == theLoad.nmbrFailed);
+    CHECK(presenceChecks > 10);        // they still run, in between the commands
+    CHECK(1 == theNci.getNmbrOfTags());
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+
+    theSimulator.removeAllTags();
+    runNci(theNci, theSimulator, 200, keepCommandOpen);
+    printf("ISO-DEP card removed                    : %u commands ok, %u failed, state %u, %u overlapping commands\n", theLoad.nmbrOk, theLoad.nmbrFailed, static_cast<unsigned>(theNci.getState()), theSimulator.getNmbrOfOverlappingCommands());
+    CHECK(0 == theSimulator.getNmbrOfOverlappingCommands());
+    CHECK(0 == theLoad.nmbrFailed);
+    CHECK(TagsPresentStatus::noTagsPresent == theNci.getTagsPresentStatus());
+    CHECK(NciState::RfDiscovery == theNci.getState());
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+}
+
+class ReadOperation {
+  public:
+    bool isSent{false};
+    uint8_t buffer[32];
+    uint32_t readsPerTag[maxNmbrOfTags]{};
+};
+
+static bool readPage(NCI &theNci, uint8_t tagIndex, void *context) {
+    ReadOperation &theOperation         = *static_cast<ReadOperation *>(context);
+    static const uint8_t readCommand[2] = {0x30, 0x04};
+    if (!theOperation.isSent) {
+        theNci.setDataReceiveBuffer(theOperation.buffer, sizeof(theOperation.buffer));
+        theNci.sendData(readCommand, sizeof(readCommand));
+        theOperation.isSent = true;
+        return false;
+    }
+    if (theNci.getRfConnection().isMessageReceived()) {
+        theOperation.isSent = false;
+        uint8_t tagNumber   = theNci.getTag(tagIndex)->uniqueId[6];
+        if ((tagNumber < maxNmbrOfTags) && ((0xA0 + tagNumber) == theOperation.buffer[0])) {
+            theOperation.readsPerTag[tagNumber]++;
+        }
+        return true;
+    }
+    return false;
+}
+
+static void testStackedTags() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    ReadOperation theOperation;
+    theNci.clearDiscoveryTechnologies();
+    theNci.addDiscoveryTechnology(NFC_A_PASSIVE_POLL_MODE);
+    theNci.setConfigParameter(PA_BAIL_OUT, bailOut, sizeof(bailOut));
+    theNci.setTagOperation(readPage, &theOperation, 50);
+    for (uint8_t index = 0; index < maxNmbrOfTags; index++) {
+        SimulatedTag theTag;
+        theTag.uniqueId[6] = index;
+        theTag.memory.assign(64, static_cast<uint8_t>(0xA0 + index));
+        theSimulator.addTag(theTag);
+    }
+    theNci.initialize();
+    runNci(theNci, theSimulator, 200);
+
+    startLoad(theNci, theSimulator);
+    uint32_t selects = theSimulator.getNmbrOfSelects();
+    runNci(theNci, theSimulator, 1000, keepCommandOpen);
+    selects = theSimulator.getNmbrOfSelects() - selects;
+    printf("%u stacked tags                          : %u commands ok, %u failed, %u selects, reads per tag %u %u %u, %u overlapping commands\n", maxNmbrOfTags, theLoad.nmbrOk, theLoad.nmbrFailed, selects, theOperation.readsPerTag[0], theOperation.readsPerTag[1], theOperation.readsPerTag[2], theSimulator.getNmbrOfOverlappingCommands());
+    CHECK(0 == theSimulator.getNmbrOfOverlappingCommands());
+    CHECK(theLoad.nmbrOk > 50);
+    CHECK(0 == theLoad.nmbrFailed);
+    CHECK(selects > 10);
+    for (uint8_t index = 0; index < maxNmbrOfTags; index++) {
+        CHECK(theOperation.readsPerTag[index] > 3);
+    }
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testPresenceCheck();
+    testStackedTags();
+    return testResult();
+}
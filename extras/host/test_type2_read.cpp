@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Type2TagReader on a simulated NTAG216.
+//   - short ranges, 1 to 9 pages, at the start, the middle and the end of the memory, with FAST_READ and with READ : 74 in all, each reads back correctly
+//   - a read cut short by the tag leaving is abandoned, and the next tap reads the whole tag
+
+#include "HostTest.h"
+#include "Type2Tag.h"
+#include <string.h>
+
+static constexpr uint16_t nmbrOfPages = 231;
+
+static uint8_t memory[Type2TagReader::getBufferSize(nmbrOfPages)];
+static uint8_t firstPage{0};
+static uint16_t nmbrToRead{nmbrOfPages};
+static uint32_t nmbrOfCompleted{0};
+static uint32_t wantedCompleted{0};
+static const uint8_t *expected{nullptr};        // the tag's contents : each completed read of the whole tag is compared with it
+static uint32_t nmbrIdentical{0};
+
+static bool readTag(NCI &, uint8_t, void *context) {
+    Type2TagReader &theReader = *static_cast<Type2TagReader *>(context);
+    if (!theReader.isBusy() && !theReader.read(memory, firstPage, nmbrToRead)) {
+        return true;
+    }
+    bool isDone = theReader.run();
+    if (isDone) {
+        nmbrOfCompleted++;
+        if ((nullptr != expected) && theReader.isOk() && (0 == memcmp(memory, expected, nmbrOfPages * Type2TagReader::pageSize))) {
+            nmbrIdentical++;
+        }
+    }
+    return isDone;
+}
+
+static bool isRangeRead() {
+    return (nmbrOfCompleted >= wantedCompleted);
+}
+
+static uint32_t testRanges(bool detectVersion) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    Type2TagReader theReader(theNci);
+    SimulatedTag theTag = SimulatedTag::ntag216();
+    for (size_t index = 0; index < theTag.memory.size(); index++) {
+        theTag.memory[index] = static_cast<uint8_t>((index * 13) + 1);
+    }
+    theSimulator.addTag(theTag);
+    theReader.setDetectVersion(detectVersion);
+    theNci.setTagOperation(readTag, &theReader, 2000);
+    theNci.initialize();
+
+    static const uint8_t firstPages[] = {0, 5, 100, 225, 227};
+    uint32_t nmbrOfRanges             = 0;
+    uint32_t nmbrWrong                = 0;
+    for (uint8_t first : firstPages) {
+        for (uint16_t count = 1; (count <= 9) && ((first + count) <= nmbrOfPages); count++) {
+            firstPage  = first;
+            nmbrToRead = count;
+            bool isRead = false;
+            for (uint32_t attempt = 0; (attempt < 2) && !isRead; attempt++) {        // a host which stalls past the request's time-out fails the read, but never fills it wrong
+                memset(memory, 0xEE, sizeof(memory));
+                wantedCompleted = nmbrOfCompleted + 1;
+                isRead          = runNci(theNci, theSimulator, 2000, isRangeRead) && theReader.isOk();
+            }
+            nmbrOfRanges++;
+            if (!isRead || (0 != memcmp(memory, theTag.memory.data() + (first * Type2TagReader::pageSize), count * Type2TagReader::pageSize))) {
+                printf("pages %u..%u read wrong, %s\n", first, first + count - 1, detectVersion ? "FAST_READ" : "READ");
+                nmbrWrong++;
+            }
+        }
+    }
+    printf("%s : %u of %u short ranges read wrong\n", detectVersion ? "FAST_READ" : "READ     ", nmbrWrong, nmbrOfRanges);
+    CHECK(0 == nmbrWrong);
+    firstPage  = 0;
+    nmbrToRead = nmbrOfPages;
+    return nmbrOfRanges;
+}
+
+static void testInterrupted() {
+    PN7150Simulator theSimulator;
+    theSimulator.setRfByteTime(85);
+    NCI theNci(theSimulator);
+    Type2TagReader theReader(theNci);
+    SimulatedTag theTag = SimulatedTag::ntag216();
+    for (size_t index = 16; index < theTag.memory.size(); index++) {
+        theTag.memory[index] = static_cast<uint8_t>((index * 7) + 3);
+    }
+    expected      = theTag.memory.data();
+    nmbrIdentical = 0;
+    theReader.setDetectVersion(false);
+    theNci.setTagOperation(readTag, &theReader, 2000);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 300);
+
+    uint32_t nmbrOfTaps    = 20;
+    uint32_t nmbrReadAfter = 0;
+    for (uint32_t tap = 0; tap < nmbrOfTaps; tap++) {
+        theSimulator.addTag(theTag);
+        runNci(theNci, theSimulator, 40 + (tap * 3));        // leaves somewhere in the read
+        theSimulator.removeAllTags();
+        runNci(theNci, theSimulator, 150);
+        uint32_t readsBefore = theReader.getStatistics().nmbrOfReads;
+        theSimulator.addTag(theTag);
+        runNci(theNci, theSimulator, 600);
+        theSimulator.removeAllTags();
+        runNci(theNci, theSimulator, 150);
+        if (theReader.getStatistics().nmbrOfReads > readsBefore) {
+            nmbrReadAfter++;
+        }
+    }
+    const Type2TagStatistics &theStatistics = theReader.getStatistics();
+    printf("interrupted, then a new tap : %u/%u read after, %u reads %u identical, %u failures\n", nmbrReadAfter, nmbrOfTaps, theStatistics.nmbrOfReads, nmbrIdentical, theStatistics.nmbrOfFailures);
+    CHECK(nmbrOfTaps == nmbrReadAfter);
+    CHECK(theStatistics.nmbrOfReads == nmbrIdentical);
+    CHECK(theStatistics.nmbrOfFailures >= nmbrOfTaps);        // each interrupted read, and maybe one more read of the tap which left
+    CHECK(!theReader.isBusy());
+    CHECK(!theNci.isRecovering());
+    expected = nullptr;
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    uint32_t nmbrOfRanges = testRanges(true) + testRanges(false);
+    CHECK(74 == nmbrOfRanges);
+    testInterrupted();
+    return testResult();
+}
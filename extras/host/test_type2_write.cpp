@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Type2TagWriter on a simulated NTAG216 (85 us per byte on air, 4.1 ms to program a page).
+//   - URIs with a new serial number each time : every tag holds the new message, after a few WRITEs. The same message again takes none
+//   - writes cut short by the tag leaving : the tag holds the old message, the new one, or an empty one
+//   - the NDEF TLV behind NULL TLVs : at up to controlLength bytes into the Data Area it is written, further the write() fails and the tag is untouched
+
+#include "HostTest.h"
+#include "Type2Tag.h"
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> buffer;        // of exactly getBufferSize(), so the sanitizers see a write() reaching beyond it
+static std::vector<uint8_t> message;
+static bool isPending{false};
+
+static bool writeTag(NCI &, uint8_t, void *context) {
+    Type2TagWriter &theWriter = *static_cast<Type2TagWriter *>(context);
+    if (!isPending) {
+        return true;
+    }
+    if (!theWriter.isBusy() && !theWriter.write(buffer.data(), message.data(), static_cast<uint16_t>(message.size()))) {
+        isPending = false;
+        return true;
+    }
+    bool isDone = theWriter.run();
+    if (isDone) {
+        isPending = false;
+    }
+    return isDone;
+}
+
+static bool isWritten() {
+    return !isPending;
+}
+
+static std::vector<uint8_t> uriMessage(unsigned serial, size_t padding) {        // one URI record, "https://example.com/..", short or long
+    char digits[8];
+    snprintf(digits, sizeof(digits), "%06u", serial);
+    std::string uri       = std::string("example.com/provisioning/") + std::string(padding, 'x') + "/device?serial=" + digits;
+    size_t payloadLength  = uri.size() + 1;
+    bool isShortRecord    = (payloadLength < 256);
+    std::vector<uint8_t> theMessage{static_cast<uint8_t>(isShortRecord ? 0xD1 : 0xC1), 0x01};
+    if (isShortRecord) {
+        theMessage.push_back(static_cast<uint8_t>(payloadLength));
+    } else {
+        theMessage.insert(theMessage.end(), {0x00, 0x00, static_cast<uint8_t>(payloadLength >> 8), static_cast<uint8_t>(payloadLength)});
+    }
+    theMessage.insert(theMessage.end(), {'U', 0x04});
+    theMessage.insert(theMessage.end(), uri.begin(), uri.end());
+    return theMessage;
+}
+
+static bool getTagMessage(const std::vector<uint8_t> &memory, std::vector<uint8_t> &theMessage) {        // false if the Data Area has no valid NDEF TLV
+    size_t offset = 16;
+    while ((offset < memory.size()) && (0x00 == memory[offset])) {
+        offset++;        // NULL TLVs
+    }
+    if ((offset + 2 > memory.size()) || (0x03 != memory[offset])) {
+        return false;
+    }
+    size_t length = memory[offset + 1];
+    offset += 2;
+    if (0xFF == length) {
+        length = (memory[offset] << 8) | memory[offset + 1];
+        offset += 2;
+    }
+    if (offset + length > memory.size()) {
+        return false;
+    }
+    theMessage.assign(memory.begin() + offset, memory.begin() + offset + length);
+    return true;
+}
+
+static void startWriter(PN7150Simulator &theSimulator, NCI &theNci, Type2TagWriter &theWriter, const SimulatedTag &theTag) {
+    theSimulator.setRfByteTime(85);
+    theSimulator.setTagWriteTime(4100);
+    theSimulator.addTag(theTag);
+    theNci.setTagOperation(writeTag, &theWriter, 3000);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 200);
+}
+
+static void startWrite(const std::vector<uint8_t> &theMessage) {
+    message   = theMessage;
+    buffer    = std::vector<uint8_t>(Type2TagWriter::getBufferSize(static_cast<uint32_t>(message.size())), 0xEE);        // a new one, not the capacity of the last
+    isPending = true;
+}
+
+static void write(NCI &theNci, PN7150Simulator &theSimulator, const std::vector<uint8_t> &theMessage) {
+    startWrite(theMessage);
+    runNci(theNci, theSimulator, 10000, isWritten);
+}
+
+static void testSerials(size_t padding) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    Type2TagWriter theWriter(theNci);
+    startWriter(theSimulator, theNci, theWriter, SimulatedTag::ntag216());
+    const Type2TagWriterStatistics &theStatistics = theWriter.getStatistics();
+
+    write(theNci, theSimulator, uriMessage(0, padding));        // a blank tag : every page of the NDEF TLV
+    uint32_t blankWrites = theStatistics.lastNmbrOfWrites;
+    CHECK(theWriter.isOk());
+    theWriter.resetStatistics();
+
+    uint32_t nmbrWrong = 0;
+    for (unsigned serial = 1; serial <= 20; serial++) {
+        write(theNci, theSimulator, uriMessage(serial * 7, padding));
+        std::vector<uint8_t> onTag;
+        if (!theWriter.isOk() || !getTagMessage(theSimulator.getTagMemory(0), onTag) || (onTag != message)) {
+            nmbrWrong++;
+        }
+    }
+    double writesPerTag = static_cast<double>(theStatistics.nmbrOfWrites) / 20;
+    printf("URI of %3zu bytes : blank tag %u WRITEs, new serial %.2f WRITEs/tag %.1f ms/tag, %u failed %u wrong", message.size(), blankWrites, writesPerTag, theStatistics.writeTime / 1000.0 / 20, theStatistics.nmbrOfFailures, nmbrWrong);
+    CHECK(0 == nmbrWrong);
+    CHECK(0 == theStatistics.nmbrOfFailures);
+    CHECK(writesPerTag < 5.0);        // the serial's page or two, and the length twice
+    CHECK(blankWrites > (message.size() / 4));
+
+    write(theNci, theSimulator, message);
+    printf(", same again %u WRITEs\n", theStatistics.lastNmbrOfWrites);
+    CHECK(theWriter.isOk());
+    CHECK(0 == theStatistics.lastNmbrOfWrites);
+}
+
+static void testInterrupted() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    Type2TagWriter theWriter(theNci);
+    SimulatedTag theTag = SimulatedTag::ntag216();
+    startWriter(theSimulator, theNci, theWriter, theTag);
+    std::vector<uint8_t> oldMessage = uriMessage(1, 300);
+    write(theNci, theSimulator, oldMessage);
+
+    uint32_t nmbrOld     = 0;
+    uint32_t nmbrNew     = 0;
+    uint32_t nmbrEmpty   = 0;
+    uint32_t nmbrInvalid = 0;
+    for (unsigned round = 0; round < 40; round++) {
+        std::vector<uint8_t> newMessage = (round & 1) ? uriMessage(1000 + round, 100 + (round * 5)) : uriMessage(2000 + round, 300);
+        startWrite(newMessage);
+        runNci(theNci, theSimulator, 3 + (round * 2), isWritten);        // the tag leaves somewhere in the write
+        theTag.memory = theSimulator.getTagMemory(0);
+        theSimulator.removeAllTags();
+        isPending = false;
+        std::vector<uint8_t> onTag;
+        if (!getTagMessage(theTag.memory, onTag)) {
+            nmbrInvalid++;
+        } else if (onTag == oldMessage) {
+            nmbrOld++;
+        } else if (onTag == newMessage) {
+            nmbrNew++;
+        } else if (onTag.empty()) {
+            nmbrEmpty++;
+        } else {
+            nmbrInvalid++;
+        }
+        runNci(theNci, theSimulator, 50);
+        theSimulator.addTag(theTag);
+        runNci(theNci, theSimulator, 50);
+        write(theNci, theSimulator, oldMessage);        // back to a known message
+    }
+    printf("40 writes cut short : the tag held the old message %u times, the new one %u, an empty one %u, an invalid one %u\n", nmbrOld, nmbrNew, nmbrEmpty, nmbrInvalid);
+    CHECK(0 == nmbrInvalid);
+    CHECK(nmbrEmpty > 0);        // some were cut short between invalidating and committing
+}
+
+static void testNdefOffset(uint32_t nmbrOfNullTlvs, bool isExpectedOk) {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    Type2TagWriter theWriter(theNci);
+    SimulatedTag theTag = SimulatedTag::ntag216();
+    for (uint32_t index = 0; index < (3 + nmbrOfNullTlvs); index++) {
+        theTag.memory[16 + index] = 0x00;        // NULL TLVs, then the empty NDEF TLV and the Terminator TLV
+    }
+    theTag.memory[16 + nmbrOfNullTlvs]     = 0x03;
+    theTag.memory[16 + nmbrOfNullTlvs + 2] = 0xFE;
+    startWriter(theSimulator, theNci, theWriter, theTag);
+    write(theNci, theSimulator, uriMessage(42, 0));
+
+    std::vector<uint8_t> onTag;
+    bool isOnTag = getTagMessage(theSimulator.getTagMemory(0), onTag);
+    printf("NDEF TLV behind %2u NULL TLVs : write %s, tag holds %s\n", nmbrOfNullTlvs, theWriter.isOk() ? "ok" : "failed", !isOnTag ? "no message" : (onTag == message) ? "the new message" : onTag.empty() ? "the empty message" : "another message");
+    CHECK(isExpectedOk == theWriter.isOk());
+    CHECK(isOnTag);
+    CHECK(isExpectedOk ? (onTag == message) : onTag.empty());
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testSerials(40);
+    testSerials(200);
+    testSerials(800);
+    testInterrupted();
+    testNdefOffset(0, true);
+    testNdefOffset(Type2TagWriter::controlLength, true);
+    testNdefOffset(Type2TagWriter::controlLength + 8, false);        // the new NDEF TLV would end beyond the buffer
+    testNdefOffset(100, false);
+    return testResult();
+}
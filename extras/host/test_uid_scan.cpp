@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Switching the UID-only scan on and off while an ISO-DEP card is in the field, and across a VEN reset.
+//   The RF Interface mapping follows each time : with the scan on, the card is found without RATS / ATS. And none of it goes through a recovery.
+
+#include "HostTest.h"
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    SimulatedTag theTag;
+    theTag.protocol = PROTOCOL_ISO_DEP;
+    theTag.selRes   = 0x20;
+    theSimulator.addTag(theTag);
+    theNci.initialize();
+
+    runNci(theNci, theSimulator, 300);
+    CHECK(theNci.getTag(0)->activationParametersLength > 0);        // ATS
+
+    theNci.setUidOnlyScan(true);
+    runNci(theNci, theSimulator, 300);
+    CHECK(0 == theNci.getTag(0)->activationParametersLength);
+
+    theNci.powerDown();
+    theNci.wakeUp();        // CORE_INIT restores the NFCC's default mapping, the scan maps again
+    runNci(theNci, theSimulator, 300);
+    CHECK(0 == theNci.getTag(0)->activationParametersLength);
+
+    theNci.setUidOnlyScan(false);
+    runNci(theNci, theSimulator, 300);
+    CHECK(theNci.getTag(0)->activationParametersLength > 0);
+    CHECK(0 == theNci.getRecoveryStatistics().nmbrOfFailures);
+    return testResult();
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Writes the NFCC does not ACK : the simulated NFCC NACKs everything while it is still booting.
+//   - a step whose command was not written fails right away, and the recovery gets the NCI to RfDiscovery once the NFCC is up
+//   - createConnection() and sendCommand() return false, and leave nothing pending
+
+#include <thread>
+#include "HostTest.h"
+
+static void testStepsRecover() {
+    PN7150Simulator theSimulator;
+    theSimulator.setBootLatency(2 * NciTransport::bootTime);        // the NCI's first writes after booting are NACKed
+    NCI theNci(theSimulator);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 500);
+    CHECK(NciState::RfDiscovery == theNci.getState());
+    CHECK(theSimulator.getNmbrOfEarlyWrites() > 0);
+    CHECK(theNci.getNmbrOfWriteFailures() == theSimulator.getNmbrOfEarlyWrites());
+    printf("booting %lu us : %u writes failed, %u power-ups\n", static_cast<unsigned long>(2 * NciTransport::bootTime), theNci.getNmbrOfWriteFailures(), theSimulator.getNmbrOfPowerUps());
+}
+
+static void testConnectionCommands() {
+    PN7150Simulator theSimulator;
+    NCI theNci(theSimulator);
+    theNci.initialize();
+    runNci(theNci, theSimulator, 300);
+    CHECK(NciState::RfDiscovery == theNci.getState());
+    uint32_t writeFailures = theNci.getNmbrOfWriteFailures();
+
+    theSimulator.setBootLatency(100000);        // the NFCC restarts behind the NCI's back, and NACKs for a while
+    theSimulator.beginReset();
+    theSimulator.endReset();
+    CHECK(!theNci.createConnection(DestinationNfccLoopback, 0, nullptr, 0));
+    CHECK(!theNci.isConnectionCommandPending());
+    static const uint8_t payload[1] = {0x00};
+    CHECK(!theNci.sendCommand(GroupIdCore, CORE_GET_CONFIG_CMD, payload, sizeof(payload)));
+    CHECK(!theNci.isConnectionCommandPending());
+    CHECK((writeFailures + 2) == theNci.getNmbrOfWriteFailures());
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    testStepsRecover();
+    testConnectionCommands();
+    return testResult();
+}
@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "IsoDep.h"
+
+constexpr uint32_t IsoDepTransceiver::chunkLength;
+
+bool Apdu::isOk() const {
+    return (0x9000 == statusWord);
+}
+
+uint32_t Apdu::encode(uint8_t buffer[], uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, const uint8_t data[], uint32_t dataLength, uint32_t expectedLength) {
+    // ISO/IEC 7816-4, section 5.1 : Lc and Le are 1 byte each, or extended : 3 bytes for Lc, and for Le 3 bytes without Lc, 2 bytes after it
+    bool extended   = (dataLength > 0xFF) || (expectedLength > 0x100);
+    uint32_t length = 0;
+    buffer[length++] = cla;
+    buffer[length++] = ins;
+    buffer[length++] = p1;
+    buffer[length++] = p2;
+    if (dataLength > 0) {
+        if (extended) {
+            buffer[length++] = 0x00;
+            buffer[length++] = static_cast<uint8_t>(dataLength >> 8);
+        }
+        buffer[length++] = static_cast<uint8_t>(dataLength);
+        for (uint32_t index = 0; index < dataLength; index++) {
+            buffer[length++] = data[index];
+        }
+    }
+    if (expectedLength > 0) {        // 256 short, and 65536 extended, are encoded as 0
+        if (extended) {
+            if (0 == dataLength) {
+                buffer[length++] = 0x00;
+            }
+            buffer[length++] = static_cast<uint8_t>(expectedLength >> 8);
+        }
+        buffer[length++] = static_cast<uint8_t>(expectedLength);
+    }
+    return length;
+}
+
+unsigned long IsoDepStatistics::getAverageApduTime() const {
+    if (0 == nmbrOfApdus) {
+        return 0;
+    }
+    return apduTime / nmbrOfApdus;
+}
+
+IsoDepTransceiver::IsoDepTransceiver(NCI &aNci) : theNci(aNci) {}
+
+bool IsoDepTransceiver::transceive(Apdu &theApdu) {
+    return transceive(&theApdu, 1);
+}
+
+bool IsoDepTransceiver::transceive(Apdu theApdus[], uint32_t theNmbrOfApdus) {
+    if (isRunning() && !isBusy()) {
+        finish(false);        // its card left, or its operation timed out, before it completed
+    }
+    if (isBusy() || (nullptr == theApdus) || (0 == theNmbrOfApdus) || !theNci.getRfConnection().isOpen()) {
+        return false;
+    }
+    const Tag *theTag = theNci.getTag(theNci.getActiveTagIndex());
+    if ((nullptr == theTag) || (PROTOCOL_ISO_DEP != theTag->protocol)) {
+        return false;
+    }
+    for (uint32_t index = 0; index < theNmbrOfApdus; index++) {
+        if ((nullptr == theApdus[index].command) || (theApdus[index].commandLength < 4) || (nullptr == theApdus[index].response) || (theApdus[index].responseSize < 2)) {
+            return false;
+        }
+    }
+    apdus       = theApdus;
+    nmbrOfApdus = theNmbrOfApdus;
+    current     = 0;
+    activation  = theNci.getRfConnection().getNmbrOfOpens();
+    theState    = State::exchanging;
+    if (!startApdu()) {
+        apduDone(false);
+    }
+    return true;
+}
+
+bool IsoDepTransceiver::run() {
+    if (!isRunning()) {
+        return true;
+    }
+    const NciConnection &theConnection = theNci.getRfConnection();
+    if (!isBusy()) {
+        finish(false);        // the connection was closed, and maybe opened again for another card
+        return true;
+    }
+    if (theConnection.isMessageReceived()) {
+        responseReceived();
+        return !isRunning();
+    }
+    if (!theConnection.isOpen() || (theNci.getNmbrOfInterfaceErrors() != interfaceErrors) || ((millis() - exchangeStartTime) >= timeOut)) {
+        apduDone(false);        // the card left, or did not answer
+        return !isRunning();
+    }
+    return false;
+}
+
+bool IsoDepTransceiver::isBusy() const {
+    return isRunning() && (activation == theNci.getRfConnection().getNmbrOfOpens());
+}
+
+bool IsoDepTransceiver::isRunning() const {
+    return (State::exchanging == theState);
+}
+
+bool IsoDepTransceiver::isOk() const {
+    return (State::done == theState);
+}
+
+uint32_t IsoDepTransceiver::getNmbrOfApdusDone() const {
+    return current;
+}
+
+void IsoDepTransceiver::setExtendedLength(bool supported) {
+    extendedLength = supported;
+}
+
+void IsoDepTransceiver::setStopOnError(bool stop) {
+    stopOnError = stop;
+}
+
+void IsoDepTransceiver::setTimeOut(unsigned long theTimeOut) {
+    timeOut = theTimeOut;
+}
+
+const IsoDepStatistics &IsoDepTransceiver::getStatistics() const {
+    return theStatistics;
+}
+
+void IsoDepTransceiver::resetStatistics() {
+    theStatistics = IsoDepStatistics();
+}
+
+bool IsoDepTransceiver::startApdu() {
+    Apdu &theApdu          = apdus[current];
+    const uint8_t *command = theApdu.command;
+    uint32_t length        = theApdu.commandLength;
+    theApdu.responseLength = 0;
+    theApdu.statusWord     = 0;
+    theApdu.duration       = 0;
+    apduStartTime          = micros();
+    retried                = false;
+    chainBusy              = false;
+
+    // The cases of ISO/IEC 7816-3, section 12.1 : what follows the header tells where the data is, and how long a response is expected
+    dataOffset     = 0;
+    dataLength     = 0;
+    expectedLength = 0;
+    bool extended  = false;
+    if (5 == length) {        // case 2 short : Le
+        expectedLength = (0 == command[4]) ? 0x100 : command[4];
+    } else if ((length > 5) && (0 != command[4]) && ((length == (5U + command[4])) || (length == (6U + command[4])))) {        // case 3 or 4 short : Lc, data, [Le]
+        dataOffset = 5;
+        dataLength = command[4];
+        if (length == (6U + command[4])) {
+            expectedLength = (0 == command[length - 1]) ? 0x100 : command[length - 1];
+        }
+    } else if ((length >= 7) && (0 == command[4])) {        // extended
+        uint32_t value = (static_cast<uint32_t>(command[5]) << 8) | command[6];
+        if (7 == length) {        // case 2 : Le
+            extended       = true;
+            expectedLength = (0 == value) ? 0x10000 : value;
+        } else if ((0 != value) && ((length == (7 + value)) || (length == (9 + value)))) {        // case 3 or 4 : Lc, data, [Le]
+            extended   = true;
+            dataOffset = 7;
+            dataLength = value;
+            if (length == (9 + value)) {
+                value          = (static_cast<uint32_t>(command[length - 2]) << 8) | command[length - 1];
+                expectedLength = (0 == value) ? 0x10000 : value;
+            }
+        }
+    }
+    chaining    = extended && !extendedLength;
+    chainOffset = 0;
+    if (chaining) {
+        return sendPiece();
+    }
+    return send(command, length);        // as it is, straight from the application's buffer
+}
+
+bool IsoDepTransceiver::sendPiece() {
+    const Apdu &theApdu = apdus[current];
+    uint32_t remaining  = dataLength - chainOffset;
+    uint32_t length     = (remaining < chunkLength) ? remaining : chunkLength;
+    bool isLast         = (length == remaining);
+    uint32_t position   = 0;
+    frame[position++]   = isLast ? theApdu.command[0] : static_cast<uint8_t>(theApdu.command[0] | chainingBit);
+    frame[position++]   = theApdu.command[1];
+    frame[position++]   = theApdu.command[2];
+    frame[position++]   = theApdu.command[3];
+    if (length > 0) {
+        frame[position++] = static_cast<uint8_t>(length);
+        for (uint32_t index = 0; index < length; index++) {
+            frame[position++] = theApdu.command[dataOffset + chainOffset + index];
+        }
+    }
+    if (isLast && (expectedLength > 0)) {
+        frame[position++] = (expectedLength >= 0x100) ? 0x00 : static_cast<uint8_t>(expectedLength);        // at most 256 now, GET RESPONSE collects the rest
+    }
+    chainOffset += length;
+    chainBusy = !isLast;
+    return send(frame, position);
+}
+
+bool IsoDepTransceiver::send(const uint8_t data[], uint32_t length) {
+    Apdu &theApdu = apdus[current];
+    theNci.setDataReceiveBuffer(theApdu.response + theApdu.responseLength, theApdu.responseSize - theApdu.responseLength);        // a response in parts is appended, over the status word of the part before
+    interfaceErrors   = theNci.getNmbrOfInterfaceErrors();
+    exchangeStartTime = millis();
+    theStatistics.nmbrOfExchanges++;
+    theStatistics.nmbrOfBytesSent += length;
+    return theNci.sendData(data, length);
+}
+
+void IsoDepTransceiver::responseReceived() {
+    const NciConnection &theConnection = theNci.getRfConnection();
+    Apdu &theApdu                      = apdus[current];
+    uint32_t length                    = theConnection.getReceivedLength();
+    theStatistics.nmbrOfBytesReceived += length;
+    if (theConnection.isOverflow() || (length < 2)) {
+        apduDone(false);        // the response does not fit in the application's buffer
+        return;
+    }
+    const uint8_t *received = theApdu.response + theApdu.responseLength;
+    uint8_t sw1             = received[length - 2];
+    uint8_t sw2             = received[length - 1];
+    if (chainBusy && (0x90 == sw1) && (0x00 == sw2)) {
+        if (!sendPiece()) {
+            apduDone(false);
+        }
+        return;
+    }
+    if (!chainBusy && (0x61 == sw1)) {        // more response data : GET RESPONSE, ISO/IEC 7816-4, section 11.4.3
+        theApdu.responseLength += length - 2;
+        frame[0] = (0 != (theApdu.command[0] & 0x80)) ? 0x00 : static_cast<uint8_t>(theApdu.command[0] & 0x03);        // interindustry class, on the same logical channel
+        frame[1] = getResponseCommand;
+        frame[2] = 0x00;
+        frame[3] = 0x00;
+        frame[4] = sw2;
+        if (!send(frame, 5)) {
+            apduDone(false);
+        }
+        return;
+    }
+    if (!chainBusy && !chaining && (0x6C == sw1) && !retried && (0 == dataOffset) && (5 == theApdu.commandLength)) {        // wrong Le, SW2 is the right one : send it again
+        retried = true;
+        for (uint32_t index = 0; index < 4; index++) {
+            frame[index] = theApdu.command[index];
+        }
+        frame[4] = sw2;
+        if (!send(frame, 5)) {
+            apduDone(false);
+        }
+        return;
+    }
+    theApdu.responseLength += length - 2;        // the final part. Also an error in the middle of a chain ends it here
+    theApdu.statusWord = static_cast<uint16_t>((sw1 << 8) | sw2);
+    apduDone(true);
+}
+
+void IsoDepTransceiver::apduDone(bool isAnswered) {
+    Apdu &theApdu = apdus[current];
+    current++;
+    if (!isAnswered) {
+        theStatistics.nmbrOfFailures++;
+        finish(false);
+        return;
+    }
+    theApdu.duration = micros() - apduStartTime;
+    theStatistics.nmbrOfApdus++;
+    theStatistics.apduTime += theApdu.duration;
+    if (theApdu.duration > theStatistics.maxApduTime) {
+        theStatistics.maxApduTime = theApdu.duration;
+    }
+    if (stopOnError && !theApdu.isOk()) {
+        finish(false);
+        return;
+    }
+    if (current >= nmbrOfApdus) {
+        finish(true);
+        return;
+    }
+    if (!startApdu()) {        // the next one right away, without going back to the application
+        apduDone(false);
+    }
+}
+
+void IsoDepTransceiver::finish(bool isOk) {
+    theNci.setDataReceiveBuffer(nullptr, 0);        // the buffers are the application's again
+    theState = isOk ? State::done : State::failed;
+}
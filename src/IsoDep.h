@@ -0,0 +1,126 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Exchanging APDUs, ISO/IEC 7816-4, with a card activated on the ISO-DEP RF Interface : DESFire, payment cards, passports, ..
+//   On this interface each Data message is one APDU, and its answer the complete response : the NFCC does the ISO-DEP block chaining and waiting
+//   time extensions on the RF. What is left for the DeviceHost :
+//   - a command with more data than the card takes in one APDU : command chaining, CLA bit 0x10, in pieces of IsoDepChunkLength bytes
+//   - a response in parts : SW1 0x61 asks for GET RESPONSE, and the parts are appended in the response buffer
+//   - SW1 0x6C : the card tells the right Le, the command is sent again with it
+//   - extended length APDUs, Nc > 255 or Ne > 256, when the card takes them. Otherwise they are sent chained, with Le 256 : a card which has more
+//     tells so with 0x61XX
+//
+//   A batch of APDUs runs without the application in between : as soon as one's response is complete, the next one goes to the NFCC, in the same
+//   run(). Commands go out straight from the application's buffers, responses are reassembled straight into them. Run it as the NciTagOperation, so
+//   the card stays activated until the batch is done :
+//
+//       bool runScript(NCI &theNci, uint8_t tagIndex, void *context) {
+//           IsoDepTransceiver &transceiver = *static_cast<IsoDepTransceiver *>(context);
+//           if (!transceiver.isBusy() && !transceiver.transceive(script, nmbrOfApdus)) {
+//               return true;        // no ISO-DEP card
+//           }
+//           return transceiver.run();
+//       }
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+#include "NCI.h"
+
+#ifndef IsoDepChunkLength
+#define IsoDepChunkLength 255
+#endif
+
+class Apdu {        // a command APDU, and where its response goes
+  public:
+    const uint8_t *command{nullptr};        // CLA INS P1 P2, [Lc data], [Le] : short or extended length, eg. from encode()
+    uint32_t commandLength{0};
+    uint8_t *response{nullptr};             // takes the response data, followed by SW1 SW2
+    uint32_t responseSize{0};               // [bytes] the expected response data + 2
+    uint32_t responseLength{0};             // [bytes] of response data, without SW1 SW2
+    uint16_t statusWord{0};                 // SW1 SW2, 0 as long as the card did not answer
+    unsigned long duration{0};              // [us] from sending the command until its response is complete, chaining included
+
+    bool isOk() const;        // 0x9000 : normal processing
+    static uint32_t encode(uint8_t buffer[], uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, const uint8_t data[] = nullptr, uint32_t dataLength = 0, uint32_t expectedLength = 0);        // returns the length. Short when Nc <= 255 and Ne <= 256, extended otherwise. Ne 0 : no Le
+};
+
+class IsoDepStatistics {
+  public:
+    uint32_t nmbrOfApdus{0};                // APDUs which got their response, whatever its status word
+    uint32_t nmbrOfFailures{0};             // APDUs which did not : the card left, did not answer, or the response did not fit
+    uint32_t nmbrOfExchanges{0};            // Data messages to the card, chained commands and GET RESPONSEs included
+    uint32_t nmbrOfBytesSent{0};
+    uint32_t nmbrOfBytesReceived{0};
+    unsigned long apduTime{0};              // [us] summed over the APDUs which got their response
+    unsigned long maxApduTime{0};           // [us]
+
+    unsigned long getAverageApduTime() const;        // [us]
+};
+
+class IsoDepTransceiver {
+  public:
+    static constexpr uint32_t chunkLength = IsoDepChunkLength;        // [bytes] of command data per APDU in a chain
+
+    explicit IsoDepTransceiver(NCI &theNci);
+    bool transceive(Apdu &theApdu);                                  // starts one APDU. false if busy, or no ISO-DEP card is activated
+    bool transceive(Apdu theApdus[], uint32_t nmbrOfApdus);         // starts a batch. The APDUs stay valid until it is done
+    bool run();                                                      // call after NCI::run() : true once the batch completed, or stopped
+    bool isBusy() const;                                             // a batch runs on the activated card. One on an earlier activation is abandoned by the next transceive()
+    bool isOk() const;                                               // every APDU of the last batch got its response. With setStopOnError(), all of them 0x9000
+    uint32_t getNmbrOfApdusDone() const;                             // of the last batch, the one which stopped it included
+    void setExtendedLength(bool supported);                          // the card takes extended length APDUs, eg. from its EF.ATR/INFO. Default false
+    void setStopOnError(bool stop);                                  // the batch stops at the first status word other than 0x9000. Default true
+    void setTimeOut(unsigned long timeOut);                          // [ms] per exchange. A card silent beyond its Frame Waiting Time is reported sooner, by CORE_INTERFACE_ERROR_NTF. Default 1000
+    const IsoDepStatistics &getStatistics() const;
+    void resetStatistics();
+
+  private:
+    enum class State : uint8_t {
+        idle,
+        exchanging,
+        done,
+        failed
+    };
+    static constexpr uint8_t chainingBit        = 0x10;        // in CLA : more commands of the chain follow
+    static constexpr uint8_t getResponseCommand = 0xC0;
+
+    NCI &theNci;
+    State theState{State::idle};
+    bool extendedLength{false};
+    bool stopOnError{true};
+    unsigned long timeOut{1000};
+    Apdu *apdus{nullptr};
+    uint32_t nmbrOfApdus{0};
+    uint32_t current{0};                                  // index of the APDU being exchanged
+    uint32_t dataOffset{0};                               // of the command data in the APDU
+    uint32_t dataLength{0};                               // Nc
+    uint32_t expectedLength{0};                           // Ne, 0 if none
+    bool chaining{false};                                 // an extended APDU the card does not take : sent as a chain of short ones
+    uint32_t chainOffset{0};                              // command data sent so far
+    bool chainBusy{false};                                // waiting for the answer to a command which is not the last of its chain
+    bool retried{false};                                  // resent after 0x6C already
+    uint8_t frame[5 + chunkLength + 1];                   // a command built here : a piece of a chain, GET RESPONSE or the resent one. It must stay valid until sent
+    uint32_t interfaceErrors{0};
+    uint32_t activation{0};
+    unsigned long exchangeStartTime{0};                   // [ms]
+    unsigned long apduStartTime{0};                       // [us]
+    IsoDepStatistics theStatistics;
+
+    bool isRunning() const;
+    bool startApdu();                                     // decode the current APDU and send it, or its first piece
+    bool sendPiece();                                     // the next piece of a chain
+    bool send(const uint8_t data[], uint32_t length);
+    void responseReceived();
+    void apduDone(bool isAnswered);                       // on to the next APDU, or the end of the batch
+    void finish(bool isOk);
+};
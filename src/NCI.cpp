@@ -1,90 +1,117 @@
-#include "nci.h"
+#include "NCI.h"
 
-NCI::NCI(PN7150Interface& aHardwareInterface) : theHardwareInterface(aHardwareInterface), theState(NciState::HwResetRfc), theTagsStatus(TagsPresentStatus::unknown) {
+NCI::NCI(NciTransport& aHardwareInterface) : theHardwareInterface(aHardwareInterface), theState(NciState::HwResetRfc), theTagsStatus(TagsPresentStatus::unknown) {
+    powerModeStartTime = millis();
 }
 
 void NCI::initialize() {
-    theHardwareInterface.initialize();
-    theState      = NciState::HwResetRfc;        // re-initializing the state, so we can re-initialize at anytime
+    theHardwareInterface.beginReset();        // VEN LOW, run() ends the pulse and waits for the boot, without blocking
+    booting            = true;
+    theBootPhase       = NciBootPhase::venReset;
+    bootPhaseStartTime = micros();
+    theBootStatistics  = NciBootStatistics();
+    discardNfccState();
+    theState      = NciState::HwResetVenLow;        // re-initializing the state, so we can re-initialize at anytime
     theTagsStatus = TagsPresentStatus::unknown;
-    nmbrOfTags    = 0;
+    setTimeOut((NciTransport::venLowTime + 999) / 1000);        // for hosts which sleep until getTimeUntilTimeOut()
+    updatePowerAccounting();
 }
 
-void NCI::run() {
-    switch (theState) {
-        case NciState::HwResetRfc:        // after Hardware reset / powerOn
-        {
-            uint8_t payloadData[] = {ResetKeepConfig};                                       // CORE_RESET-CMD with Keep Configuration
-            sendMessage(MsgTypeCommand, GroupIdCore, CORE_RESET_CMD, payloadData, 1);        //
-            setTimeOut(20);                                                                  // we should get a RESPONSE within 20 ms (it typically takes 2.3ms)
-            theState = NciState::HwResetWfr;                                                 // move to next state, waiting for the matching Response
-        } break;
-
-        case NciState::HwResetWfr:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                bool isOk = (6 == rxMessageLength);                                                     // Does the received Msg have the correct lenght ?
-                isOk      = isOk && isMessageType(MsgTypeResponse, GroupIdCore, CORE_RESET_RSP);        // Is the received Msg the correct type ?
-                isOk      = isOk && (STATUS_OK == rxBuffer[3]);                                         // Is the received Status code Status_OK ?
-
-                if (isOk) {
-                    theState = NciState::SwResetRfc;        // ..move to the next state
-                } else                                      // if not..
-                {
-                    theState = NciState::Error;        // goto error state
-                }
-            } else if (isTimeOut()) {
-                theState = NciState::Error;        // time out waiting for response..
-            }
-            break;
-
-        case NciState::SwResetRfc: {
-            sendMessage(MsgTypeCommand, GroupIdCore, CORE_INIT_CMD);        // CORE_INIT-CMD
-            setTimeOut(20);                                                 // we should get a RESPONSE within 20 ms, typically it takes 0.5ms
-            theState = NciState::SwResetWfr;                                // move to next state, waiting for response
-        } break;
+void NCI::discardNfccState() {
+    releaseMessage();
+    while (!rxQueue.isEmpty()) {        // after resetting the NFCC, whatever we still had from it is meaningless
+        rxQueue.pop();
+    }
+    nmbrOfTags          = 0;
+    tagOperationRunning = false;
+    for (uint8_t index = 0; index < maxNmbrConnections; index++) {
+        theConnections[index].close();
+    }
+    if (isConnectionCommandPending()) {
+        abortConnectionCommand();        // its response will not come anymore
+    }
+    theConfiguration.abort();
+}
 
-        case NciState::SwResetWfr:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                bool isOk = isMessageType(MsgTypeResponse, GroupIdCore, CORE_INIT_RSP);        // Is the received Msg the correct type ?
+void NCI::run() {
+    receiveMessages();        // first get everything the NFCC has for us, so bursts of notifications are off the NFCC as fast as the bus allows
+    handleConnectionMessages();
+    sendPendingData();        // credits may have come back
+    publishStateChange();        // initialize(), powerDown(), .. may have changed the state since the last run()
+    if (!hasPendingWork()) {
+        return;        // nothing to do : in interrupt mode this costs no I2C or GPIO access at all
+    }
+    if (isConnectionCommandPending()) {
+        if ((millis() - connectionCommandStartTime) >= connectionTimeOut) {
+            abortConnectionCommand();
+        } else if (!isWaitingState()) {
+            return;        // only one command at a time : states which would send one wait until the connection response is in. Waiting states run, but send nothing, see startPresenceCheck() and tagRemoved()
+        }
+    }
+    NciState previousState;
+    do {        // while booting, when a response moves us on to a state which sends the next command, send it right away instead of in the next run()
+        previousState = theState;
+        runStateMachine();
+        releaseMessage();
+        publishStateChange();
+    } while (booting && (theState != previousState) && !isWaitingState() && !isConnectionCommandPending());        // after booting, the application gets to see every state, eg. RfPollActive
+    updatePowerAccounting();
+}
 
-                if (isOk) {
-                    theState = NciState::EnableCustomCommandsRfc;        // ...move to the next state
-                } else                                                   // if not..
-                {
-                    theState = NciState::Error;        // .. goto error state
-                }
-            } else if (isTimeOut()) {
-                theState = NciState::Error;        // time out waiting for response..
+void NCI::runStateMachine() {
+    const NciStep* theStep = findStep(theState);
+    if (nullptr != theStep) {
+        runStep(*theStep);
+        return;
+    }
+    switch (theState) {
+        case NciState::HwResetVenLow:
+            if ((micros() - bootPhaseStartTime) >= NciTransport::venLowTime) {
+                theHardwareInterface.endReset();
+                enterBootPhase(NciBootPhase::boot);
+                setTimeOut((NciTransport::bootTime + 999) / 1000);
+                theState = NciState::HwResetBoot;
             }
             break;
 
-        case NciState::EnableCustomCommandsRfc:
-            sendMessage(MsgTypeCommand, GroupIdProprietary, NCI_PROPRIETARY_ACT_CMD);        // Send NCI_PROPRIETARY_ACT_CMD to activate extra PN7150-NCI features
-            setTimeOut(10);                                                                  // we should get a RESPONSE within 10 ms, typically it takes 0.5ms
-            theState = NciState::EnableCustomCommandsWfr;                                    // move to next state, waiting for response
-            break;
-
-        case NciState::EnableCustomCommandsWfr:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                bool isOk = isMessageType(MsgTypeResponse, GroupIdProprietary, NCI_PROPRIETARY_ACT_RSP);        // Is the received Msg the correct type ?
-                isOk      = isOk && (STATUS_OK == rxBuffer[3]);                                                 // Is the received Status code Status_OK ?
-
-                if (isOk) {                                // if everything is OK...
-                    theState = NciState::RfIdleCmd;        // ...move to the next state
-                } else {                                   // if not..
-                    theState = NciState::Error;        // .. goto error state
-                }
-            } else if (isTimeOut()) {
-                theState = NciState::Error;        // time out waiting for response..
+        case NciState::HwResetBoot:
+            if ((micros() - bootPhaseStartTime) >= NciTransport::bootTime) {
+                enterBootPhase(NciBootPhase::coreReset);
+                theState = NciState::HwResetRfc;
             }
             break;
 
         case NciState::RfIdleCmd: {
             // After configuring, we are ready to go into Discovery, but we wait for the readerWriter application to give us this trigger
             // Or we can proceed into polling right away
+            if (standbyChanged) {
+                uint8_t payloadData[] = {static_cast<uint8_t>(standbyEnabled ? 0x01 : 0x00)};
+                standbyChanged = false;
+                startCommand(GroupIdProprietary, NCI_PROPRIETARY_STANDBY_CMD, payloadData, 1, NciState::RfSetStandbyWfr);
+                break;
+            }
+            if (discoverMapChanged) {
+                uint8_t theIsoDepInterface = uidOnlyScan ? Frame_RF_interface : ISO_DEP_RF_interface;
+                uint8_t theNfcDepInterface = uidOnlyScan ? Frame_RF_interface : NFC_DEP_RF_interface;
+                uint8_t payloadData[]      = {2, PROTOCOL_ISO_DEP, 0x01, theIsoDepInterface, PROTOCOL_NFC_DEP, 0x01, theNfcDepInterface};        // RF Protocol, Mode (0x01 : Poll), RF Interface. NCI Specification V1.0 - Table 42
+                discoverMapChanged = false;
+                startCommand(GroupIdRfManagement, RF_DISCOVER_MAP_CMD, payloadData, sizeof(payloadData), NciState::RfDiscoverMapWfr);
+                break;
+            }
+            if (theConfiguration.hasWork()) {        // configuration changed or asked for since the last discovery, handle it first
+                uint8_t payloadData[MaxPayloadSize];
+                uint32_t payloadLength = theConfiguration.buildSetConfig(payloadData, maxControlPayloadSize);        // changed parameters, as many as fit in one packet
+                if (payloadLength > 0) {
+                    startCommand(GroupIdCore, CORE_SET_CONFIG_CMD, payloadData, payloadLength, NciState::RfSetConfigWfr);
+                    break;
+                }
+                payloadLength = theConfiguration.buildGetConfig(payloadData, maxControlPayloadSize);
+                if (payloadLength > 0) {
+                    startCommand(GroupIdCore, CORE_GET_CONFIG_CMD, payloadData, payloadLength, NciState::RfGetConfigWfr);
+                    break;
+                }
+            }
+            enterBootPhase(NciBootPhase::startDiscovery);
             activate();
             // uint8_t payloadData[] = {4, NFC_A_PASSIVE_POLL_MODE, 0x01, NFC_B_PASSIVE_POLL_MODE, 0x01, NFC_F_PASSIVE_POLL_MODE, 0x01, NFC_15693_PASSIVE_POLL_MODE, 0x01};
             // sendMessage(MsgTypeCommand, GroupIdRfManagement, RF_DISCOVER_CMD, payloadData, 9);        //
@@ -92,165 +119,497 @@ void NCI::run() {
             // theState = NciState::RfIdleWfr;                                                           // move to next state, waiting for Response
         } break;
 
-        case NciState::RfIdleWfr:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                bool isOk = (4 == rxMessageLength);                                                              // Does the received Msg have the correct lenght ?
-                isOk      = isOk && isMessageType(MsgTypeResponse, GroupIdRfManagement, RF_DISCOVER_RSP);        // Is the received Msg the correct type ?
-                isOk      = isOk && (STATUS_OK == rxBuffer[3]);                                                  // Is the received Status code Status_OK ?
-                if (isOk)                                                                                        // if everything is OK...
-                {
-                    theState = NciState::RfDiscovery;        // ...move to the next state
-                    setTimeOut(500);                         // set a timeout of 1 second. If it times out, it means no cards are present..
-                } else                                       // if not..
-                {
-                    theState = NciState::Error;        // .. goto error state
-                }
-            } else if (isTimeOut()) {
-                theState = NciState::Error;        // time out waiting for response..
-            }
-            break;
-
         case NciState::RfDiscovery:
             // TODO : if we have no NTF here, it means no cards are present and we can delete them from the list...
             // Here we don't check timeouts.. we can wait forever for a TAG/CARD to be presented..
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                if (isMessageType(MsgTypeNotification, GroupIdRfManagement, RF_INTF_ACTIVATED_NTF)) {
+            if (discoveryChanged && rxQueue.isEmpty()) {
+                deActivate(NciRfDeAcivationMode::IdleMode);        // back to RfIdleCmd, which applies the new technologies and configuration
+            } else if (getMessage()) {
+                if (isMessage(NciMessageId::RfIntfActivatedNtf)) {
                     // When a single tag/card is detected, the PN7150 will immediately activate it and send you this type of notification
+                    sampleDiscoveryTime(discoveryTimes, discoveryTimeOut());
                     saveTag(RF_INTF_ACTIVATED_NTF);        // save properties of this Tag in the Tags array
-                    if (TagsPresentStatus::noTagsPresent == theTagsStatus) {
-                        theTagsStatus = TagsPresentStatus::newTagPresent;
+                    activeTagIndex = 0;
+                    if (presenceCheckPeriod > 0) {
+                        setTimeOut(presenceCheckPeriod);        // first presence check
                     }
                     theState = NciState::RfPollActive;        // move to PollActive, and wait there for further commands..
-                } else if (isMessageType(MsgTypeNotification, GroupIdRfManagement, RF_DISCOVER_NTF)) {
+                    if ((TagsPresentStatus::noTagsPresent == theTagsStatus) || (TagsPresentStatus::unknown == theTagsStatus)) {
+                        setTagsStatus(TagsPresentStatus::newTagPresent);
+                    }
+                    tagActivated();
+                } else if (isMessage(NciMessageId::RfDiscoverNtf)) {
                     // When multiple tags/cards are detected, the PN7150 will notify them all and wait for the DH to select one
                     // The first card will have NotificationType == 2 and move the stateMachine to WaitForAllDiscoveries.
                     // More notifications will come in that state
+                    sampleDiscoveryTime(discoveryTimes, discoveryTimeOut());
                     saveTag(RF_DISCOVER_NTF);        // save properties of this Tag in the Tags array
-                    setTimeOut(25);                  // we should get more Notifications ubt set a timeout so we don't wait forever
-                    theTagsStatus = TagsPresentStatus::multipleTagsPresent;
-                    theState      = NciState::RfWaitForAllDiscoveries;
+                    setTimeOut(adaptTimeOut(moreDiscoveriesTimes, moreDiscoveriesTimeOut, moreDiscoveriesTimeOut));        // we should get more Notifications ubt set a timeout so we don't wait forever
+                    setTagsStatus(TagsPresentStatus::multipleTagsPresent);
+                    theState = NciState::RfWaitForAllDiscoveries;
                 }
             } else if (isTimeOut()) {
-                theTagsStatus = TagsPresentStatus::noTagsPresent;        // this means no card has been detected for xxx millisecond, so we can conclude that no cards are present
+                setTagsStatus(TagsPresentStatus::noTagsPresent);        // this means no card has been detected for xxx millisecond, so we can conclude that no cards are present
+                if (powerDownTime > 0) {
+                    startPowerDownCycle();
+                } else {
+                    clearTimeOut();        // keep waiting for a tag, but no need to wake up the host for this timeOut again
+                }
             }
 
             break;
 
         case NciState::RfWaitForAllDiscoveries:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                if (isMessageType(MsgTypeNotification, GroupIdRfManagement, RF_DISCOVER_NTF)) {
-                    notificationType theNotificationType = (notificationType)rxBuffer[rxBuffer[6] + 7];        // notificationType comes in rxBuffer at the end, = 7 bytes + length of RF Technology Specific parameters which are in rxBuffer[6]
-                    switch (theNotificationType) {
-                        case notificationType::lastNotification:
-                        case notificationType::lastNotificationNfccLimit:
-                            saveTag(RF_DISCOVER_NTF);        // save properties of this Tag in the Tags array
-                            theState = NciState::RfWaitForHostSelect;
-                            break;
-
-                        case notificationType::moreNotification:
-                            setTimeOut(25);                  // we should get more Notifications, so set a timeout so we don't wait forever
-                            saveTag(RF_DISCOVER_NTF);        // save properties of this Tag in the Tags array
-                            break;
-
-                        default:
-                            break;
+            if (getMessage()) {
+                if (isMessage(NciMessageId::RfDiscoverNtf)) {
+                    sampleDiscoveryTime(moreDiscoveriesTimes, moreDiscoveriesTimeOut);
+                    uint32_t typeOffset = (rxMessageLength > 6) ? (rxBuffer[6] + 7U) : rxMessageLength;        // notificationType comes in rxBuffer at the end, = 7 bytes + length of RF Technology Specific parameters which are in rxBuffer[6]
+                    if (typeOffset >= rxMessageLength) {
+                        enterState(NciState::Error);        // too short to hold its notificationType, so we don't know if more are coming
+                    } else {
+                        notificationType theNotificationType = (notificationType)rxBuffer[typeOffset];
+                        switch (theNotificationType) {
+                            case notificationType::lastNotification:
+                            case notificationType::lastNotificationNfccLimit:
+                                saveTag(RF_DISCOVER_NTF);        // save properties of this Tag in the Tags array
+                                activeTagIndex = 0;
+                                theState       = NciState::RfWaitForHostSelect;
+                                publishEvent(NciEventType::multipleTags);
+                                break;
+
+                            case notificationType::moreNotification:
+                                setTimeOut(adaptTimeOut(moreDiscoveriesTimes, moreDiscoveriesTimeOut, moreDiscoveriesTimeOut));        // we should get more Notifications, so set a timeout so we don't wait forever
+                                saveTag(RF_DISCOVER_NTF);        // save properties of this Tag in the Tags array
+                                break;
+
+                            default:
+                                break;
+                        }
                     }
                 }
             } else if (isTimeOut()) {
-                theState = NciState::Error;        // We need a timeout here, in case the final RF_DISCOVER_NTF with Notification Type == 0 or 1 never comes...
+                enterState(NciState::Error);        // We need a timeout here, in case the final RF_DISCOVER_NTF with Notification Type == 0 or 1 never comes...
             }
             break;
 
         case NciState::RfWaitForHostSelect:
-            // Multiple cards are present. We could select one and move into RfPollActive
-            deActivate(NciRfDeAcivationMode::IdleMode);        //
+            // Multiple cards are present. With an operation to run on them, select them one by one. Each goes to sleep after its operation, and we come back here
+            if ((nullptr != tagOperation) && (activeTagIndex < nmbrOfTags)) {
+                selectTag();
+            } else {
+                deActivate(NciRfDeAcivationMode::IdleMode);        // all done : rediscover
+            }
             break;
 
         case NciState::RfPollActive:
             // A card is present, so we can read/write data to it. We could also receive a notification that the card has been removed..
-            deActivate(NciRfDeAcivationMode::IdleMode);        //
-            break;
-
-        case NciState::RfDeActivate1Wfr:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                if (isMessageType(MsgTypeResponse, GroupIdRfManagement, RF_DEACTIVATE_RSP)) {
+            if (getMessage()) {
+                if (isMessage(NciMessageId::RfDeactivateNtf)) {        // the NFCC lost the tag by itself
+                    tagOperationRunning = false;
+                    nmbrOfTags          = 0;
+                    setTagsStatus(TagsPresentStatus::noTagsPresent);
+                    theConnections[0].close();
                     theState = NciState::RfIdleCmd;
-                } else {
                 }
+            } else if (tagOperationRunning) {
+                runTagOperation();        // getMessage() keeps notifications flowing while it runs, so Data packets do not queue up behind them
+            } else if ((activeTagIndex + 1U) < nmbrOfTags) {
+                deActivate(NciRfDeAcivationMode::SleepMode);        // more tags to select : this one goes to sleep, so it does not answer the next select
+            } else if (uidOnlyScan) {
+                deActivate(NciRfDeAcivationMode::Discovery);        // its UID is saved : the NFCC polls again right away, without RF_DISCOVER_CMD
+            } else if ((0 == presenceCheckPeriod) || (1 != nmbrOfTags)) {
+                deActivate(NciRfDeAcivationMode::IdleMode);        // no presence check : tear down and rediscover the tag every cycle. No tags : it was removed while a command was pending
             } else if (isTimeOut()) {
-                theState = NciState::Error;        // We need a timeout here, in case the RF_DEACTIVATE_RSP never comes...
+                startPresenceCheck();
             }
             break;
 
-        case NciState::RfDeActivate2Wfr:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                if (isMessageType(MsgTypeResponse, GroupIdRfManagement, RF_DEACTIVATE_RSP)) {
-                    setTimeOut(10);
-                    theState = NciState::RfDeActivate2Wfn;
+        case NciState::RfPresenceCheckWfd:
+            if (theConnections[0].isMessageReceived()) {        // any answer to the READ means the tag is still there
+                theConnections[0].setReceiveBuffer(nullptr, 0);
+                presenceConfirmed();
+            } else if (getMessage()) {
+                if (isMessage(NciMessageId::CoreInterfaceErrorNtf) || isMessage(NciMessageId::RfDeactivateNtf)) {
+                    tagRemoved();        // eg. RF_TIMEOUT_ERROR : the tag did not answer the READ
                 } else {
+                    handleNotification();        // eg. a response which came after its time-out : nothing to do with the tag, keep waiting for its answer
                 }
             } else if (isTimeOut()) {
-                theState = NciState::Error;        // We need a timeout here, in case the RF_DEACTIVATE_RSP never comes...
+                tagRemoved();
             }
             break;
 
-        case NciState::RfDeActivate2Wfn:
-            if (theHardwareInterface.hasMessage()) {
-                getMessage();
-                if (isMessageType(MsgTypeNotification, GroupIdRfManagement, RF_DEACTIVATE_NTF)) {
-                    theState = NciState::RfIdleCmd;
-                } else {
-                }
-            } else if (isTimeOut()) {
-                theState = NciState::Error;        // We need a timeout here, in case the RF_DEACTIVATE_RSP never comes...
+        case NciState::PowerDown:
+            if (isTimeOut()) {
+                wakeUp();
             }
             break;
 
         case NciState::Error:
             // Something went wrong, and we made an emergency landing by moving to this state...
-            // To get out of it, the parent application can call initialize(), or we could decide to do that ourselves, maybe after some time-out
-            initialize();
+            // We get out of it with the lightest recovery which can still help, see NciRecoveryLevel
+            recover();
+            break;
+
+        default:
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// Command / Response steps. Rows with a commandState send a fixed command from there, the others are entered after the
+// stateMachine sent a command with a variable payload. Timeouts are generous : the PN7150 answers within a few ms
+// ---------------------------------------------------------------------------------------------------------------------------
+
+constexpr NciStep NCI::stepTable[] = {
+    // commandState, groupId, opcodeId, payloadLength, payload, waitState, answer, timeOut, checkStatus, ignoreOthers, successState, failureState, retryState, onSuccess, onFailure
+    {NciState::HwResetRfc, GroupIdCore, CORE_RESET_CMD, 1, ResetKeepConfig, NciState::HwResetWfr, NciMessageId::CoreResetRsp, 20, true, false, NciState::SwResetRfc, NciState::Error, NciState::HwResetRfc, NciStepAction::coreResetResponse, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::HwResetWfn, NciMessageId::CoreResetNtf, 20, false, false, NciState::SwResetRfc, NciState::Error, NciState::HwResetRfc, NciStepAction::coreResetNotification, NciStepAction::none},
+    {NciState::SwResetRfc, GroupIdCore, CORE_INIT_CMD, 0, 0, NciState::SwResetWfr, NciMessageId::CoreInitRsp, 20, false, false, NciState::EnableCustomCommandsRfc, NciState::Error, NciState::SwResetRfc, NciStepAction::coreInitResponse, NciStepAction::none},
+    {NciState::EnableCustomCommandsRfc, GroupIdProprietary, NCI_PROPRIETARY_ACT_CMD, 0, 0, NciState::EnableCustomCommandsWfr, NciMessageId::ProprietaryActRsp, 10, true, false, NciState::RfIdleCmd, NciState::Error, NciState::EnableCustomCommandsRfc, NciStepAction::proprietaryEnabled, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::RfSetConfigWfr, NciMessageId::CoreSetConfigRsp, 10, false, false, NciState::RfIdleCmd, NciState::Error, NciState::RfIdleCmd, NciStepAction::setConfigResponse, NciStepAction::abortConfiguration},
+    {NciState::End, 0, 0, 0, 0, NciState::RfGetConfigWfr, NciMessageId::CoreGetConfigRsp, 10, false, false, NciState::RfIdleCmd, NciState::Error, NciState::RfIdleCmd, NciStepAction::getConfigResponse, NciStepAction::abortConfiguration},
+    {NciState::End, 0, 0, 0, 0, NciState::RfSetStandbyWfr, NciMessageId::ProprietaryStandbyRsp, 10, false, false, NciState::RfIdleCmd, NciState::Error, NciState::RfIdleCmd, NciStepAction::none, NciStepAction::standbyFailed},        // if the NFCC refuses, it just uses more power
+    {NciState::End, 0, 0, 0, 0, NciState::RfDiscoverMapWfr, NciMessageId::RfDiscoverMapRsp, 10, true, false, NciState::RfIdleCmd, NciState::RfIdleCmd, NciState::RfIdleCmd, NciStepAction::none, NciStepAction::none},        // if the NFCC refuses, tags are still found, only with their full activation
+    {NciState::End, 0, 0, 0, 0, NciState::RfIdleWfr, NciMessageId::RfDiscoverRsp, 10, true, false, NciState::RfDiscovery, NciState::Error, NciState::RfIdleCmd, NciStepAction::discoveryStarted, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::RfDiscoverSelectWfr, NciMessageId::RfDiscoverSelectRsp, 10, true, false, NciState::RfDiscoverSelectWfn, NciState::Error, NciState::RfWaitForHostSelect, NciStepAction::none, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::RfDiscoverSelectWfn, NciMessageId::RfIntfActivatedNtf, activationTimeOut, false, false, NciState::RfPollActive, NciState::RfWaitForHostSelect, NciState::End, NciStepAction::tagSelected, NciStepAction::selectFailed},        // a tag which left is reported with CORE_GENERIC_ERROR_NTF, the NFCC stays in RFST_W4_HOST_SELECT
+    {NciState::End, 0, 0, 0, 0, NciState::RfDeActivate1Wfr, NciMessageId::RfDeactivateRsp, 10, false, true, NciState::RfIdleCmd, NciState::Error, NciState::End, NciStepAction::none, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::RfDeActivate2Wfr, NciMessageId::RfDeactivateRsp, 10, false, true, NciState::RfDeActivate2Wfn, NciState::Error, NciState::End, NciStepAction::none, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::RfDeActivate2Wfn, NciMessageId::RfDeactivateNtf, 10, false, true, NciState::RfIdleCmd, NciState::Error, NciState::End, NciStepAction::deactivated, NciStepAction::none},
+    {NciState::End, 0, 0, 0, 0, NciState::RfPresenceCheckWfr, NciMessageId::ProprietaryPresenceCheckRsp, 10, true, false, NciState::RfPresenceCheckWfn, NciState::Error, NciState::End, NciStepAction::none, NciStepAction::tagRemoved},
+    {NciState::End, 0, 0, 0, 0, NciState::RfPresenceCheckWfn, NciMessageId::ProprietaryPresenceCheckNtf, presenceCheckTimeOut, true, false, NciState::RfPollActive, NciState::Error, NciState::End, NciStepAction::presenceConfirmed, NciStepAction::tagRemoved},
+};
+
+constexpr uint8_t NCI::nmbrOfSteps;
+
+const NciStep* NCI::findStep(NciState theState) {
+    static_assert((sizeof(stepTable) / sizeof(stepTable[0])) == nmbrOfSteps, "nmbrOfSteps must match the stepTable");
+    for (uint8_t index = 0; index < nmbrOfSteps; index++) {
+        if ((theState == stepTable[index].waitState) || (theState == stepTable[index].commandState)) {
+            return &stepTable[index];
+        }
+    }
+    return nullptr;
+}
+
+void NCI::runStep(const NciStep& theStep) {
+    if (theState == theStep.commandState) {
+        startCommand(theStep.groupId, theStep.opcodeId, &theStep.payload, theStep.payloadLength, theStep.waitState);        // move to next state, waiting for the answer
+        return;
+    }
+    bool isOk;
+    if (commandNotSent) {
+        commandNotSent = false;
+        isOk           = false;        // no use waiting for the time-out : failing now lets the recovery resend it
+    } else if (getMessage()) {
+        if (theStep.ignoreOthers && !isMessage(theStep.answer)) {
+            return;        // eg. a notification which crossed our command
+        }
+        isOk = isMessage(theStep.answer) && (!theStep.checkStatus || ((rxMessageLength > MsgHeaderSize) && (STATUS_OK == rxBuffer[MsgHeaderSize])));
+    } else if (isTimeOut()) {
+        isOk = false;        // time out waiting for the answer..
+    } else {
+        return;
+    }
+    if (isOk) {
+        theRoundTripTimes[&theStep - stepTable].addSample(micros() - stepStartTime);
+        enterState(theStep.successState);
+        isOk = runStepAction(theStep.onSuccess);
+    }
+    if (!isOk) {
+        enterState(theStep.failureState);
+        (void)runStepAction(theStep.onFailure);
+    } else if (recovering && (theStep.waitState == failedState)) {
+        recovered();
+    }
+}
+
+bool NCI::runStepAction(NciStepAction theAction) {
+    switch (theAction) {
+        case NciStepAction::coreResetResponse:
+            if (6 == rxMessageLength) {        // NCI 1.0 : Status, NCI Version, Configuration Status. NCI Specification V1.0 - Table 5
+                theBootStatistics.configurationRetained = (ConfigurationKept == rxBuffer[5]);
+                enterBootPhase(NciBootPhase::coreInit);
+                return true;
+            }
+            if (4 == rxMessageLength) {        // NCI 2.0 : only the Status, the rest follows in CORE_RESET_NTF
+                enterState(NciState::HwResetWfn);
+                return true;
+            }
+            return false;
+
+        case NciStepAction::coreResetNotification:
+            if (rxMessageLength > 4) {        // Reset Trigger, Configuration Status, ..
+                theBootStatistics.configurationRetained = (ConfigurationKept == rxBuffer[4]);
+                enterBootPhase(NciBootPhase::coreInit);
+                return true;
+            }
+            return false;
+
+        case NciStepAction::coreInitResponse:
+            parseCoreInitResponse();
+            discoverMapChanged = uidOnlyScan;        // CORE_INIT_CMD brings back the default RF Interface mapping
+            enterBootPhase(NciBootPhase::enableProprietary);
+            return true;
+
+        case NciStepAction::proprietaryEnabled:
+            enterBootPhase(NciBootPhase::configure);
+            if (!theBootStatistics.configurationRetained) {
+                restoreConfiguration();
+            }
+            return true;
+
+        case NciStepAction::setConfigResponse:
+            lastSetConfigStatus = (rxMessageLength > 3) ? rxBuffer[3] : STATUS_FAILED;        // a rejected parameter is not fatal, the NFCC keeps its previous value
+            theConfiguration.setConfigDone(rxBuffer + MsgHeaderSize, rxMessageLength - MsgHeaderSize);
+            return true;        // more parameters may be waiting for the next CORE_SET_CONFIG_CMD
+
+        case NciStepAction::getConfigResponse:
+            theConfiguration.getConfigDone(rxBuffer + MsgHeaderSize, rxMessageLength - MsgHeaderSize);
+            return true;
+
+        case NciStepAction::discoveryStarted:
+            if (4 != rxMessageLength) {
+                return false;
+            }
+            enterBootPhase(NciBootPhase::nmbrOfBootPhases);        // discovery runs : booting is done
+            noTagWindowRunning = false;
+            discoveryStartTime = micros();
+            setTimeOut(adaptTimeOut(discoveryTimes, discoveryTimeOut(), discoveryTimeOut()));        // If it times out, it means no cards are present.. Wait for at least one discovery period
+            if (recovering) {
+                recovered();
+            }
+            return true;
+
+        case NciStepAction::deactivated:
+            theConnections[0].close();
+            if ((rxMessageLength > 3) && ((static_cast<uint8_t>(NciRfDeAcivationMode::SleepMode) == rxBuffer[3]) || (static_cast<uint8_t>(NciRfDeAcivationMode::Sleep_AFMode) == rxBuffer[3]))) {
+                activeTagIndex++;
+                enterState(NciState::RfWaitForHostSelect);        // the NFCC waits for the next select
+            } else if ((rxMessageLength > 3) && (static_cast<uint8_t>(NciRfDeAcivationMode::Discovery) == rxBuffer[3])) {
+                enterState(NciState::RfDiscovery);        // the NFCC is polling again
+                discoveryStartTime = micros();
+                setTimeOut(adaptTimeOut(discoveryTimes, discoveryTimeOut(), discoveryTimeOut()));
+            }
+            return true;
+
+        case NciStepAction::presenceConfirmed:
+            presenceConfirmed();
+            return true;
+
+        case NciStepAction::abortConfiguration:
+            theConfiguration.abort();
+            return true;
+
+        case NciStepAction::tagRemoved:
+            tagRemoved();
+            return true;
+
+        case NciStepAction::standbyFailed:
+            standbyChanged = true;
+            return true;
+
+        case NciStepAction::tagSelected:
+            (void)theTags[activeTagIndex].parseActivatedNotification(rxBuffer + MsgHeaderSize, rxMessageLength - MsgHeaderSize);        // adds the bit rates and ATS to what RF_DISCOVER_NTF told
+            tagActivated();
+            return true;
+
+        case NciStepAction::selectFailed:
+            if (isMessage(NciMessageId::CoreGenericErrorNtf) && (rxMessageLength > 3)) {
+                lastGenericError = rxBuffer[3];        // DISCOVERY_TARGET_ACTIVATION_FAILED
+            }
+            activeTagIndex++;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+void NCI::enterState(NciState nextState) {
+    if ((NciState::Error == nextState) && !recovering) {
+        failedState = theState;
+    }
+    theState               = nextState;
+    commandNotSent         = false;
+    const NciStep* theStep = findStep(nextState);
+    if ((nullptr != theStep) && (nextState == theStep->waitState)) {
+        stepStartTime = micros();
+        setTimeOut(adaptTimeOut(theRoundTripTimes[theStep - stepTable], theStep->timeOut, (timeOutCeiling > 0) ? timeOutCeiling : theStep->timeOut));
+    }
+}
+
+void NCI::recover() {
+    if (!recovering) {
+        recovering        = true;
+        recoveryStartTime = micros();
+        theRecoveryLevel  = NciRecoveryLevel::retry;
+        theRecoveryStatistics.nmbrOfFailures++;
+    } else if (NciRecoveryLevel::hardwareReset != theRecoveryLevel) {
+        theRecoveryLevel = static_cast<NciRecoveryLevel>(static_cast<uint8_t>(theRecoveryLevel) + 1);        // what we tried did not help
+    }
+    while (!canRecover(theRecoveryLevel)) {
+        theRecoveryLevel = static_cast<NciRecoveryLevel>(static_cast<uint8_t>(theRecoveryLevel) + 1);        // hardwareReset always can
+    }
+    theRecoveryStatistics.attempts[static_cast<uint8_t>(theRecoveryLevel)]++;
+    switch (theRecoveryLevel) {
+        case NciRecoveryLevel::retry:
+            enterState(findStep(failedState)->retryState);
+            break;
+
+        case NciRecoveryLevel::rfDeactivate: {
+            uint8_t payloadData[] = {(uint8_t)NciRfDeAcivationMode::IdleMode};        // allowed in any RF state. In RfIdle the NFCC refuses it, which is fine as well
+            nmbrOfTags            = 0;
+            theConnections[0].close();
+            startCommand(GroupIdRfManagement, RF_DEACTIVATE_CMD, payloadData, 1, NciState::RfDeActivate1Wfr);        // RfIdleCmd next, which restarts discovery
+        } break;
+
+        case NciRecoveryLevel::coreReset:
+            discardNfccState();
+            booting            = true;
+            theBootPhase       = NciBootPhase::coreReset;
+            bootPhaseStartTime = micros();
+            theBootStatistics  = NciBootStatistics();
+            theState           = NciState::HwResetRfc;        // CORE_RESET_CMD keeps the configuration, so the shadow stays valid
             break;
 
         default:
+            initialize();
             break;
     }
 }
 
+bool NCI::canRecover(NciRecoveryLevel theLevel) const {
+    switch (theLevel) {
+        case NciRecoveryLevel::retry: {
+            const NciStep* theStep = findStep(failedState);
+            return (nullptr != theStep) && (failedState == theStep->waitState) && (NciState::End != theStep->retryState);
+        }
+
+        case NciRecoveryLevel::rfDeactivate:
+            switch (failedState) {
+                case NciState::HwResetVenLow:
+                case NciState::HwResetBoot:
+                case NciState::HwResetRfc:
+                case NciState::HwResetWfr:
+                case NciState::HwResetWfn:
+                case NciState::SwResetRfc:
+                case NciState::SwResetWfr:
+                case NciState::EnableCustomCommandsRfc:
+                case NciState::EnableCustomCommandsWfr:
+                    return false;        // the NFCC is not initialized, it does not accept RF commands
+
+                default:
+                    return true;
+            }
+
+        default:
+            return true;
+    }
+}
+
+void NCI::recovered() {
+    uint8_t level         = static_cast<uint8_t>(theRecoveryLevel);
+    unsigned long theTime = micros() - recoveryStartTime;
+    theRecoveryStatistics.recoveries[level]++;
+    theRecoveryStatistics.timeToRecover[level] += theTime;
+    if (theTime > theRecoveryStatistics.maxTimeToRecover[level]) {
+        theRecoveryStatistics.maxTimeToRecover[level] = theTime;
+    }
+    recovering = false;
+}
+
+const NciRecoveryStatistics& NCI::getRecoveryStatistics() const {
+    return theRecoveryStatistics;
+}
+
+void NCI::resetRecoveryStatistics() {
+    theRecoveryStatistics = NciRecoveryStatistics();
+}
+
+bool NCI::isRecovering() const {
+    return recovering;
+}
+
+unsigned long NCI::adaptTimeOut(const NciRoundTripTime& theStatistics, unsigned long fixedTimeOut, unsigned long ceiling) const {
+    if (!adaptiveTimeOuts) {
+        return fixedTimeOut;
+    }
+    return theStatistics.getTimeOut(timeOutDeviations, timeOutFloor, ceiling);
+}
+
+void NCI::sampleDiscoveryTime(NciRoundTripTime& theStatistics, unsigned long fixedTimeOut) {
+    unsigned long now = micros();
+    if ((now - discoveryStartTime) <= (fixedTimeOut * 1000)) {        // later ones would only have been seen with the fixed time-out : counting them all keeps the adaptive one from shrinking on itself
+        theStatistics.addSample(now - discoveryStartTime);
+    }
+    discoveryStartTime = now;
+}
+
+unsigned long NCI::discoveryTimeOut() const {
+    return ((scanPeriod + 10) > minDiscoveryTimeOut) ? (scanPeriod + 10) : minDiscoveryTimeOut;
+}
+
+void NCI::setAdaptiveTimeOuts(bool enable, unsigned long floor, uint8_t nmbrOfDeviations, unsigned long ceiling) {
+    adaptiveTimeOuts  = enable;
+    timeOutFloor      = floor;
+    timeOutDeviations = nmbrOfDeviations;
+    timeOutCeiling    = ceiling;
+}
+
+const NciRoundTripTime& NCI::getConnectionCommandRoundTripTime() const {
+    return connectionCommandTimes;
+}
+
+const NciRoundTripTime* NCI::getRoundTripTime(NciState theState) const {
+    if (NciState::RfDiscovery == theState) {
+        return &discoveryTimes;
+    }
+    if (NciState::RfWaitForAllDiscoveries == theState) {
+        return &moreDiscoveriesTimes;
+    }
+    const NciStep* theStep = findStep(theState);
+    if ((nullptr == theStep) || (theState != theStep->waitState)) {
+        return nullptr;
+    }
+    return &theRoundTripTimes[theStep - stepTable];
+}
+
 void NCI::activate() {
     NciState tmpState = getState();
-    if (tmpState == NciState::RfIdleCmd) {
-        uint8_t payloadData[] = {4, NFC_A_PASSIVE_POLL_MODE, 0x01, NFC_B_PASSIVE_POLL_MODE, 0x01, NFC_F_PASSIVE_POLL_MODE, 0x01, NFC_15693_PASSIVE_POLL_MODE, 0x01};
-        // TODO : instead of setting a fixed scanning for these 4 types, we should pass the to be scanned for types as parameters from the ReaderWriter... https://github.com/Strooom/PN7150/issues/1
-        sendMessage(MsgTypeCommand, GroupIdRfManagement, RF_DISCOVER_CMD, payloadData, 9);        //
-        setTimeOut(10);                                                                           // we should get a RESPONSE within 10 ms
-        theState = NciState::RfIdleWfr;                                                           // move to next state, waiting for Response
+    if ((tmpState == NciState::RfIdleCmd) && (nmbrOfDiscoveryEntries > 0) && !isConnectionCommandPending()) {        // one command at a time
+        uint8_t payloadData[1 + (2 * maxNmbrDiscoveryEntries)];        // Number of Configurations, followed by RF Technology and Mode + Frequency for each. NCI Specification V1.0 - Table 52
+        payloadData[0] = nmbrOfDiscoveryEntries;
+        for (uint8_t index = 0; index < nmbrOfDiscoveryEntries; index++) {
+            payloadData[1 + (2 * index)] = discoveryEntries[index][0];
+            payloadData[2 + (2 * index)] = discoveryEntries[index][1];
+        }
+        discoveryChanged = false;
+        startCommand(GroupIdRfManagement, RF_DISCOVER_CMD, payloadData, 1U + (2U * nmbrOfDiscoveryEntries), NciState::RfIdleWfr);        // move to next state, waiting for Response
     } else {
         // Error : we can only activate polling when in Idle...
     }
 }
 
 void NCI::deActivate(NciRfDeAcivationMode theMode) {
-    nmbrOfTags        = 0;
+    if (isConnectionCommandPending()) {
+        return;        // one command at a time : call again once its response is in
+    }
+    if ((NciRfDeAcivationMode::SleepMode != theMode) && (NciRfDeAcivationMode::Sleep_AFMode != theMode)) {
+        nmbrOfTags = 0;        // sleeping tags can still be selected
+    }
     NciState tmpState = getState();
     switch (tmpState) {
+        case NciState::RfDiscovery:
         case NciState::RfWaitForHostSelect: {
-            uint8_t payloadData[] = {(uint8_t)NciRfDeAcivationMode::IdleMode};                          // in RfWaitForHostSelect, the deactivation type is ignored by the NFCC
-            sendMessage(MsgTypeCommand, GroupIdRfManagement, RF_DEACTIVATE_CMD, payloadData, 1);        //
-            setTimeOut(10);                                                                             // we should get a RESPONSE within 10 ms
-            theState = NciState::RfDeActivate1Wfr;                                                      // move to next state, waiting for response
+            uint8_t payloadData[] = {(uint8_t)NciRfDeAcivationMode::IdleMode};                          // in RfDiscovery and RfWaitForHostSelect, only IdleMode is allowed, and no notification follows
+            startCommand(GroupIdRfManagement, RF_DEACTIVATE_CMD, payloadData, 1, NciState::RfDeActivate1Wfr);        // move to next state, waiting for response
         } break;
 
         case NciState::RfPollActive: {
             uint8_t payloadData[] = {(uint8_t)theMode};
-            sendMessage(MsgTypeCommand, GroupIdRfManagement, RF_DEACTIVATE_CMD, payloadData, 1);        //
-            setTimeOut(10);                                                                             // we should get a RESPONSE within 10 ms
-            theState = NciState::RfDeActivate2Wfr;                                                      // move to next state, waiting for response
+            startCommand(GroupIdRfManagement, RF_DEACTIVATE_CMD, payloadData, 1, NciState::RfDeActivate2Wfr);        // move to next state, waiting for response
         } break;
 
         default:
@@ -275,74 +634,1020 @@ Tag* NCI::getTag(uint8_t index) {
     return &theTags[index];
 }
 
-void NCI::sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId) {
-    txBuffer[0] = (messageType | groupId) & 0xEF;         // put messageType and groupId in first byte, Packet Boundary Flag is always 0
-    txBuffer[1] = opcodeId & 0x3F;                        // put opcodeId in second byte, clear Reserved for Future Use (RFU) bits
-    txBuffer[2] = 0x00;                                   // payloadLength goes in third byte
-    (void)theHardwareInterface.write(txBuffer, 3);        // TODO :  could make this more robust by checking the return value and go into error is write did not succees
+void NCI::clearDiscoveryTechnologies() {
+    nmbrOfDiscoveryEntries = 0;
+    discoveryChanged       = true;
 }
 
-void NCI::sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId, uint8_t payloadData[], uint8_t payloadLength) {
-    txBuffer[0] = (messageType | groupId) & 0xEF;                   // put messageType and groupId in first byte, Packet Boundary Flag is always 0
-    txBuffer[1] = opcodeId & 0x3F;                                  // put opcodeId in second byte, clear Reserved for Future Use (RFU) bits
-    txBuffer[2] = payloadLength;                                    // payloadLength goes in third byte
-    for (uint32_t index = 0; index < payloadLength; index++)        // copy the payload
-    {
-        txBuffer[index + 3] = payloadData[index];
+bool NCI::addDiscoveryTechnology(uint8_t technologyAndMode, uint8_t frequency) {
+    for (uint8_t index = 0; index < nmbrOfDiscoveryEntries; index++) {
+        if (technologyAndMode == discoveryEntries[index][0]) {
+            discoveryEntries[index][1] = frequency;        // already in the list, only update how often
+            discoveryChanged           = true;
+            return true;
+        }
+    }
+    if ((nmbrOfDiscoveryEntries >= maxNmbrDiscoveryEntries) || (0 == frequency)) {
+        return false;
+    }
+    discoveryEntries[nmbrOfDiscoveryEntries][0] = technologyAndMode;
+    discoveryEntries[nmbrOfDiscoveryEntries][1] = frequency;
+    nmbrOfDiscoveryEntries++;
+    discoveryChanged = true;
+    return true;
+}
+
+bool NCI::setConfigParameter(uint16_t parameterId, const uint8_t value[], uint8_t valueLength) {
+    if (!theConfiguration.set(parameterId, value, valueLength)) {
+        return false;
+    }
+    if (theConfiguration.hasParametersToWrite()) {
+        discoveryChanged = true;        // the value differs from what the NFCC has
+    }
+    return true;
+}
+
+bool NCI::getConfigParameter(uint16_t parameterId, uint8_t value[], uint8_t& valueLength) {
+    if (theConfiguration.get(parameterId, value, valueLength)) {
+        return true;
+    }
+    if (theConfiguration.hasParametersToRead()) {
+        discoveryChanged = true;        // restart discovery, reading the parameter on the way
+    }
+    return false;
+}
+
+const NciConfigCounters& NCI::getConfigCounters() const {
+    return theConfiguration.getCounters();
+}
+
+bool NCI::setTotalDuration(uint16_t duration) {
+    uint8_t value[2] = {static_cast<uint8_t>(duration & 0xFF), static_cast<uint8_t>(duration >> 8)};
+    if (!setConfigParameter(TOTAL_DURATION, value, 2)) {
+        return false;
+    }
+    scanPeriod = duration;
+    return true;
+}
+
+uint8_t NCI::getLastSetConfigStatus() const {
+    return lastSetConfigStatus;
+}
+
+void NCI::setStandby(bool enable) {
+    if (enable != standbyEnabled) {
+        standbyEnabled   = enable;
+        standbyChanged   = true;
+        discoveryChanged = true;
+    }
+}
+
+bool NCI::setLowPowerCardDetection(bool enable, uint8_t threshold, uint8_t fallbackCount) {
+    uint8_t enableValue[] = {static_cast<uint8_t>(enable ? 0x01 : 0x00)};
+    bool isOk             = setConfigParameter(TAG_DETECTOR_CFG, enableValue, 1);
+    if (enable) {
+        isOk = isOk && setConfigParameter(TAG_DETECTOR_THRESHOLD_CFG, &threshold, 1);
+        isOk = isOk && setConfigParameter(TAG_DETECTOR_FALLBACK_CNT_CFG, &fallbackCount, 1);
+        setStandby(true);        // LPCD runs while the NFCC is in standby between polls
+    }
+    lowPowerCardDetection = enable && isOk;
+    return isOk;
+}
+
+void NCI::setPowerDownCycle(unsigned long theNoTagTime, unsigned long thePowerDownTime) {
+    noTagTime     = theNoTagTime;
+    powerDownTime = thePowerDownTime;
+}
+
+void NCI::startPowerDownCycle() {
+    if (!noTagWindowRunning && (noTagTime > 0)) {
+        noTagWindowRunning = true;
+        setTimeOut(noTagTime);        // tags may still come in this window
+        return;
+    }
+    powerDown();
+    setTimeOut(powerDownTime);        // PowerDown wakes up when this expires
+}
+
+void NCI::powerDown() {
+    theHardwareInterface.powerDown();
+    releaseMessage();
+    while (!rxQueue.isEmpty()) {
+        rxQueue.pop();
+    }
+    for (uint8_t index = 0; index < maxNmbrConnections; index++) {
+        theConnections[index].close();
+    }
+    if (isConnectionCommandPending()) {
+        abortConnectionCommand();
+    }
+    nmbrOfTags = 0;
+    clearTimeOut();        // only wakeUp() ends this, unless the power down cycle sets a timeOut
+    theState = NciState::PowerDown;
+    updatePowerAccounting();
+}
+
+void NCI::wakeUp() {
+    thePowerStatistics.nmbrOfWakeUps++;
+    initialize();        // VEN reset, the stateMachine boots the NFCC and restarts discovery
+}
+
+void NCI::restoreConfiguration() {
+    if (standbyEnabled) {
+        standbyChanged = true;
+    }
+    theConfiguration.configurationLost();        // parameters the application set are written again, what we read is forgotten
+}
+
+void NCI::enterBootPhase(NciBootPhase nextPhase) {
+    if (!booting) {
+        return;        // eg. restarting discovery after a deactivation
+    }
+    unsigned long now = micros();
+    theBootStatistics.phaseDuration[static_cast<uint8_t>(theBootPhase)] += now - bootPhaseStartTime;
+    bootPhaseStartTime = now;
+    theBootPhase       = nextPhase;
+    if (NciBootPhase::nmbrOfBootPhases == nextPhase) {
+        booting                    = false;
+        theBootStatistics.complete = true;
+    }
+}
+
+const NciBootStatistics& NCI::getBootStatistics() const {
+    return theBootStatistics;
+}
+
+unsigned long NciBootStatistics::getTotal() const {
+    unsigned long total = 0;
+    for (uint8_t index = 0; index < static_cast<uint8_t>(NciBootPhase::nmbrOfBootPhases); index++) {
+        total += phaseDuration[index];
+    }
+    return total;
+}
+
+NciPowerMode NCI::getPowerMode() const {
+    switch (theState) {
+        case NciState::PowerDown:
+            return NciPowerMode::powerDown;
+
+        case NciState::RfDiscovery:
+        case NciState::RfWaitForAllDiscoveries:
+            return lowPowerCardDetection ? NciPowerMode::lowPowerPolling : NciPowerMode::polling;
+
+        case NciState::RfWaitForHostSelect:
+        case NciState::RfDiscoverSelectWfr:
+        case NciState::RfDiscoverSelectWfn:
+        case NciState::RfPollActive:
+        case NciState::RfPresenceCheckWfr:
+        case NciState::RfPresenceCheckWfn:
+        case NciState::RfPresenceCheckWfd:
+        case NciState::RfDeActivate1Wfr:
+        case NciState::RfDeActivate2Wfr:
+        case NciState::RfDeActivate2Wfn:
+            return NciPowerMode::active;
+
+        default:
+            return NciPowerMode::idle;
+    }
+}
+
+void NCI::updatePowerAccounting() {
+    NciPowerMode newMode = getPowerMode();
+    if (newMode != thePowerMode) {
+        unsigned long now = millis();
+        thePowerStatistics.timeInMode[static_cast<uint8_t>(thePowerMode)] += now - powerModeStartTime;
+        powerModeStartTime = now;
+        thePowerMode       = newMode;
+    }
+}
+
+NciPowerStatistics NCI::getPowerStatistics() const {
+    NciPowerStatistics theStatistics = thePowerStatistics;
+    theStatistics.timeInMode[static_cast<uint8_t>(thePowerMode)] += millis() - powerModeStartTime;        // include the mode we are in now
+    return theStatistics;
+}
+
+void NCI::resetPowerStatistics() {
+    thePowerStatistics = NciPowerStatistics();
+    powerModeStartTime = millis();
+}
+
+uint32_t NciPowerStatistics::estimateAverageCurrent(const uint32_t currentPerMode[]) const {
+    uint64_t charge    = 0;
+    uint64_t totalTime = 0;
+    for (uint8_t index = 0; index < static_cast<uint8_t>(NciPowerMode::nmbrOfPowerModes); index++) {
+        charge += static_cast<uint64_t>(timeInMode[index]) * currentPerMode[index];
+        totalTime += timeInMode[index];
+    }
+    if (0 == totalTime) {
+        return 0;
+    }
+    return static_cast<uint32_t>(charge / totalTime);
+}
+
+void NCI::setPresenceCheckPeriod(unsigned long period) {
+    presenceCheckPeriod = period;
+}
+
+uint32_t NCI::getNmbrOfPresenceChecks() const {
+    return nmbrOfPresenceChecks;
+}
+
+void NCI::setUidOnlyScan(bool enable) {
+    if (enable != uidOnlyScan) {
+        uidOnlyScan        = enable;
+        discoverMapChanged = true;
+        discoveryChanged   = true;        // the mapping can only change in RFST_IDLE
+    }
+}
+
+unsigned long NCI::getRemovalDetectedTimestamp() const {
+    return removalDetectedTimestamp;
+}
+
+void NCI::startPresenceCheck() {
+    if (isConnectionCommandPending()) {
+        setTimeOut(connectionTimeOut);        // one command at a time : check once the response to sendCommand() is in, or timed out
+        return;
+    }
+    if (!theConnections[0].isTransmitDone() || theConnections[0].isReceiving()) {
+        setTimeOut(presenceCheckPeriod);        // the application is exchanging data with the tag, which proves it is there
+        return;
+    }
+    if (ISO_DEP_RF_interface == activeInterface) {
+        nmbrOfPresenceChecks++;
+        startCommand(GroupIdProprietary, NCI_PROPRIETARY_PRESENCE_CHECK_CMD, nullptr, 0, NciState::RfPresenceCheckWfr);
+    } else if ((Frame_RF_interface == activeInterface) && (PROTOCOL_T2T == activeProtocol)) {
+        static const uint8_t readBlock0[] = {0x30, 0x00};        // Type 2 Tag READ of block 0. NFC Forum Type 2 Tag Operation specification, section 5.1
+        nmbrOfPresenceChecks++;
+        theConnections[0].setReceiveBuffer(presenceCheckBuffer, sizeof(presenceCheckBuffer));
+        (void)sendData(readBlock0, sizeof(readBlock0));
+        setTimeOut(presenceCheckTimeOut);
+        theState = NciState::RfPresenceCheckWfd;
+    } else {
+        deActivate(NciRfDeAcivationMode::IdleMode);        // no lightweight check for this protocol : rediscover it
+    }
+}
+
+void NCI::presenceConfirmed() {
+    setTimeOut(presenceCheckPeriod);
+    theState = NciState::RfPollActive;
+}
+
+void NCI::tagActivated() {
+    if (rxMessageLength > 8) {
+        activeInterface = rxBuffer[4];
+        activeProtocol  = rxBuffer[5];
+        theConnections[0].open(NciConnection::staticRfConnection, rxBuffer[7], rxBuffer[8]);        // Max Data Packet Payload Size and Initial Number of Credits, NCI Specification V1.0 - Table 61
+    }
+    tagOperationRunning = (nullptr != tagOperation);
+    if (tagOperationRunning) {
+        setTimeOut(tagOperationTimeOut);        // a presence check only starts after the operation
+    }
+    publishEvent(NciEventType::tagActivated);
+}
+
+void NCI::runTagOperation() {
+    if (tagOperation(*this, activeTagIndex, tagOperationContext) || isTimeOut()) {
+        tagOperationRunning = false;
+        if (presenceCheckPeriod > 0) {
+            setTimeOut(presenceCheckPeriod);
+        }
+    }
+}
+
+void NCI::selectTag() {
+    const Tag& theTag    = theTags[activeTagIndex];
+    uint8_t theInterface = Frame_RF_interface;        // the NFCC does the protocol's activation itself for ISO-DEP and NFC-DEP, all others are driven frame by frame
+    if (uidOnlyScan) {
+        theInterface = Frame_RF_interface;        // like the RF_DISCOVER_MAP_CMD we sent : no protocol activation
+    } else if (PROTOCOL_ISO_DEP == theTag.protocol) {
+        theInterface = ISO_DEP_RF_interface;
+    } else if (PROTOCOL_NFC_DEP == theTag.protocol) {
+        theInterface = NFC_DEP_RF_interface;
+    }
+    uint8_t payloadData[] = {theTag.discoveryId, theTag.protocol, theInterface};        // RF Discovery ID, RF Protocol, RF Interface
+    startCommand(GroupIdRfManagement, RF_DISCOVER_SELECT_CMD, payloadData, 3, NciState::RfDiscoverSelectWfr);
+}
+
+uint8_t NCI::getActiveTagIndex() const {
+    return activeTagIndex;
+}
+
+void NCI::setTagOperation(NciTagOperation theOperation, void* theContext, unsigned long timeOut) {
+    tagOperation        = theOperation;
+    tagOperationContext = theContext;
+    tagOperationTimeOut = timeOut;
+}
+
+void NCI::tagRemoved() {
+    removalDetectedTimestamp = millis();
+    setTagsStatus(TagsPresentStatus::noTagsPresent);
+    theConnections[0].setReceiveBuffer(nullptr, 0);
+    if (rxMessageTaken && isMessage(NciMessageId::RfDeactivateNtf)) {        // the NFCC already deactivated
+        nmbrOfTags = 0;
+        theConnections[0].close();
+        theState = NciState::RfIdleCmd;
+    } else {
+        nmbrOfTags = 0;
+        theState   = NciState::RfPollActive;        // deActivate() starts from here. With a command pending, RfPollActive deactivates once its response is in
+        deActivate(NciRfDeAcivationMode::IdleMode);
+    }
+}
+
+bool NCI::sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId) {
+    return sendMessage(messageType, groupId, opcodeId, nullptr, 0);
+}
+
+void NCI::startCommand(uint8_t groupId, uint8_t opcodeId, const uint8_t payloadData[], uint32_t payloadLength, NciState waitState) {
+    bool isSent = sendMessage(MsgTypeCommand, groupId, opcodeId, payloadData, payloadLength);
+    enterState(waitState);        // also when it was not sent : the step fails from there, with its own failure action, and the recovery knows what to retry
+    commandNotSent = !isSent;
+}
+
+bool NCI::sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId, const uint8_t payloadData[], uint32_t payloadLength) {
+    // Messages with a payload longer than the NFCC accepts are sent as several segments, all but the last one with the Packet Boundary Flag set. NCI Specification V1.0 - section 3.3
+    uint32_t offset = 0;
+    do {
+        uint32_t segmentLength = payloadLength - offset;
+        uint8_t header[MsgHeaderSize];
+        header[0] = (messageType | groupId) & 0xEF;        // put messageType and groupId in first byte
+        if (segmentLength > maxControlPayloadSize) {
+            segmentLength = maxControlPayloadSize;
+            header[0] |= PacketBoundaryFlagNotLastSegment;
+        }
+        header[1] = opcodeId & 0x3F;                                                                  // put opcodeId in second byte, clear Reserved for Future Use (RFU) bits
+        header[2] = static_cast<uint8_t>(segmentLength);                                              // payloadLength goes in third byte
+        if (0 != theHardwareInterface.write(header, payloadData + offset, segmentLength)) {
+            nmbrOfWriteFailures++;
+            return false;        // the segments after it are not sent either : the NFCC would take them for a malformed message
+        }
+        offset += segmentLength;
+    } while (offset < payloadLength);
+    return true;
+}
+
+bool NCI::sendData(const uint8_t data[], uint32_t dataLength) {
+    return sendData(NciConnection::staticRfConnection, data, dataLength);
+}
+
+bool NCI::sendData(uint8_t connectionId, const uint8_t data[], uint32_t dataLength) {
+    NciConnection *theConnection = findConnection(connectionId);
+    if ((nullptr == theConnection) || !theConnection->queueTransmit(data, dataLength)) {
+        return false;
+    }
+    sendPendingData();        // if there are credits, it goes out right away
+    return true;
+}
+
+void NCI::sendPendingData() {
+    for (uint8_t index = 0; index < maxNmbrConnections; index++) {
+        NciConnection &theConnection = theConnections[index];
+        while (theConnection.isOpen() && theConnection.hasSegmentToSend()) {
+            uint32_t segmentLength;
+            bool isLastSegment;
+            const uint8_t *segment = theConnection.getNextSegment(segmentLength, isLastSegment);
+            uint8_t header[MsgHeaderSize];
+            header[0] = MsgTypeData | (isLastSegment ? PacketBoundaryFlagLastSegment : PacketBoundaryFlagNotLastSegment) | (theConnection.getConnectionId() & 0x0F);
+            header[1] = 0x00;        // RFU
+            header[2] = static_cast<uint8_t>(segmentLength);
+            if (0 != theHardwareInterface.write(header, segment, segmentLength)) {
+                break;        // try again on the next run()
+            }
+            theConnection.segmentSent(segmentLength);
+        }
+    }
+}
+
+void NCI::setDataReceiveBuffer(uint8_t buffer[], uint32_t bufferSize, uint32_t nmbrOfMessages) {
+    setDataReceiveBuffer(NciConnection::staticRfConnection, buffer, bufferSize, nmbrOfMessages);
+}
+
+void NCI::setDataReceiveBuffer(uint8_t connectionId, uint8_t buffer[], uint32_t bufferSize, uint32_t nmbrOfMessages) {
+    NciConnection *theConnection = findConnection(connectionId);
+    if (nullptr != theConnection) {
+        theConnection->setReceiveBuffer(buffer, bufferSize, nmbrOfMessages);
+    }
+}
+
+const NciConnection& NCI::getRfConnection() const {
+    return theConnections[0];
+}
+
+const NciConnection* NCI::getConnection(uint8_t connectionId) const {
+    for (uint8_t index = 0; index < maxNmbrConnections; index++) {
+        if (theConnections[index].isOpen() && (connectionId == theConnections[index].getConnectionId())) {
+            return &theConnections[index];
+        }
+    }
+    return nullptr;
+}
+
+NciConnection* NCI::findConnection(uint8_t connectionId) {
+    return const_cast<NciConnection*>(static_cast<const NCI*>(this)->getConnection(connectionId));
+}
+
+bool NCI::createConnection(uint8_t destinationType, uint8_t nmbrOfParameters, const uint8_t parameters[], uint8_t parametersLength) {
+    if (isResponsePending() || (theState < NciState::RfIdleCmd) || (theState >= NciState::PowerDown)) {
+        return false;        // the NFCC must be initialized, and can only handle one command at a time
+    }
+    uint8_t nmbrOpen = 0;
+    for (uint8_t index = 1; index < maxNmbrConnections; index++) {
+        if (theConnections[index].isOpen()) {
+            nmbrOpen++;
+        }
+    }
+    if ((nmbrOpen >= (maxNmbrConnections - 1)) || (nmbrOpen >= maxLogicalConnections) || (parametersLength > (MaxPayloadSize - 2))) {
+        return false;
+    }
+    uint8_t payloadData[MaxPayloadSize];
+    payloadData[0] = destinationType;
+    payloadData[1] = nmbrOfParameters;
+    for (uint8_t index = 0; index < parametersLength; index++) {
+        payloadData[2 + index] = parameters[index];
+    }
+    if (!sendMessage(MsgTypeCommand, GroupIdCore, CORE_CONN_CREATE_CMD, payloadData, 2U + parametersLength)) {
+        return false;
+    }
+    connectionCommandSent(NciMessageId::CoreConnCreateRsp);
+    commandResponse = nullptr;
+    return true;
+}
+
+bool NCI::closeConnection(uint8_t connectionId) {
+    if (isResponsePending() || (NciConnection::staticRfConnection == connectionId) || (nullptr == findConnection(connectionId))) {
+        return false;        // the Static RF Connection can not be closed, it follows RF activation
+    }
+    uint8_t payloadData[] = {connectionId};
+    if (!sendMessage(MsgTypeCommand, GroupIdCore, CORE_CONN_CLOSE_CMD, payloadData, 1)) {
+        return false;
+    }
+    connectionCommandSent(NciMessageId::CoreConnCloseRsp);
+    commandResponse     = nullptr;
+    closingConnectionId = connectionId;
+    return true;
+}
+
+bool NCI::sendCommand(uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint8_t payloadLength, uint8_t response[], uint8_t responseSize) {
+    if (isResponsePending() || (theState < NciState::RfIdleCmd) || (theState >= NciState::PowerDown)) {
+        return false;        // the NFCC must be initialized, and can only handle one command at a time
+    }
+    const uint8_t responseHeader[MsgHeaderSize] = {static_cast<uint8_t>(MsgTypeResponse | (groupId & 0x0F)), static_cast<uint8_t>(opcodeId & 0x3F), 0};
+    NciMessageId theResponse                    = classifyMessage(responseHeader);
+    if ((NciMessageId::Unknown == theResponse) || (payloadLength > maxControlPayloadSize)) {
+        return false;        // we would not recognize its Response
+    }
+    if (!sendMessage(MsgTypeCommand, groupId, opcodeId, payload, payloadLength)) {
+        return false;
+    }
+    connectionCommandSent(theResponse);
+    commandResponse       = response;
+    commandResponseSize   = responseSize;
+    commandResponseLength = 0;
+    return true;
+}
+
+void NCI::connectionCommandSent(NciMessageId theResponse) {
+    awaitedConnectionResponse    = theResponse;
+    connectionCommandStartTime   = millis();
+    connectionCommandStartMicros = micros();
+    connectionTimeOut            = adaptTimeOut(connectionCommandTimes, connectionCommandTimeOut, (timeOutCeiling > 0) ? timeOutCeiling : connectionCommandTimeOut);
+}
+
+bool NCI::isConnectionCommandPending() const {
+    return (NciMessageId::Unknown != awaitedConnectionResponse);
+}
+
+void NCI::abortConnectionCommand() {
+    awaitedConnectionResponse = NciMessageId::Unknown;
+    lastConnectionStatus      = STATUS_FAILED;
+    commandResponse           = nullptr;        // a late response does not go there anymore
+    commandResponseLength     = 0;
+}
+
+uint8_t NCI::getLastConnectionStatus() const {
+    return lastConnectionStatus;
+}
+
+uint8_t NCI::getLastCreatedConnectionId() const {
+    return lastCreatedConnectionId;
+}
+
+void NCI::releaseCommandResponse(const uint8_t response[]) {
+    if ((nullptr != response) && (response == commandResponse)) {        // only if it is still the one given to the pending sendCommand()
+        commandResponse = nullptr;
+    }
+}
+
+uint8_t NCI::getLastResponseLength() const {
+    return commandResponseLength;
+}
+
+void NCI::handleConnectionResponse() {
+    connectionCommandTimes.addSample(micros() - connectionCommandStartMicros);
+    lastConnectionStatus = (rxMessageLength > 3) ? rxBuffer[3] : STATUS_FAILED;
+    if (nullptr != commandResponse) {
+        uint32_t payloadLength = rxMessageLength - MsgHeaderSize;
+        commandResponseLength  = static_cast<uint8_t>((payloadLength > commandResponseSize) ? commandResponseSize : payloadLength);
+        for (uint8_t index = 0; index < commandResponseLength; index++) {
+            commandResponse[index] = rxBuffer[MsgHeaderSize + index];
+        }
+        commandResponse = nullptr;
+    }
+    if (NciMessageId::CoreConnCreateRsp == rxMessageId) {
+        // Status, Max Data Packet Payload Size, Initial Number of Credits, Conn ID. NCI Specification V1.0 - Table 14
+        if ((STATUS_OK == lastConnectionStatus) && (rxMessageLength > 6)) {
+            for (uint8_t index = 1; index < maxNmbrConnections; index++) {
+                if (!theConnections[index].isOpen()) {
+                    theConnections[index].open(rxBuffer[6] & 0x0F, rxBuffer[4], rxBuffer[5]);
+                    lastCreatedConnectionId = rxBuffer[6] & 0x0F;
+                    break;
+                }
+            }
+        }
+    } else if (NciMessageId::CoreConnCloseRsp == rxMessageId) {
+        NciConnection *theConnection = findConnection(closingConnectionId);
+        if ((STATUS_OK == lastConnectionStatus) && (nullptr != theConnection)) {
+            theConnection->close();
+        }
+    }
+    awaitedConnectionResponse = NciMessageId::Unknown;
+}
+
+void NCI::handleCredits() {
+    // Number of Entries, followed by Conn ID and Credits for each. NCI Specification V1.0 - Table 19
+    if (rxMessageLength > 3) {
+        uint32_t nmbrOfEntries = rxBuffer[3];
+        for (uint32_t entry = 0; (entry < nmbrOfEntries) && ((5 + (2 * entry)) < rxMessageLength); entry++) {
+            NciConnection *theConnection = findConnection(rxBuffer[4 + (2 * entry)] & 0x0F);
+            if (nullptr != theConnection) {
+                theConnection->addCredits(rxBuffer[5 + (2 * entry)]);
+            }
+        }
+    }
+}
+
+void NCI::handleConnectionMessages() {
+    // Data packets, credits and the response to a connection command are not part of the stateMachine's flow, so they are handled as soon as they are
+    // at the head of the rxQueue. Anything else stops this, so the order of messages stays as the NFCC sent them
+    while (!rxQueue.isEmpty()) {
+        rxBuffer        = rxQueue.getFirst().data;
+        rxMessageLength = rxQueue.getFirst().length;
+        rxMessageId     = classifyMessage(rxBuffer);
+        if (0 == rxMessageLength) {
+            // handled already, see below
+        } else if (NciMessageId::Data == rxMessageId) {
+            handleDataPacket();
+        } else if (NciMessageId::CoreConnCreditsNtf == rxMessageId) {
+            handleCredits();
+        } else if (isConnectionCommandPending() && (awaitedConnectionResponse == rxMessageId)) {
+            handleConnectionResponse();
+        } else {
+            break;
+        }
+        rxQueue.pop();
+    }
+    // The stateMachine does not send its next command before the connection response is in, so that response can not wait behind a notification the stateMachine
+    // has not taken yet. It is handled in its slot, which is released when it gets to the head, as length 0
+    for (uint32_t index = 1; isConnectionCommandPending() && (index < rxQueue.getLevel()); index++) {
+        NciPacket &thePacket = rxQueue.get(index);
+        if ((thePacket.length >= MsgHeaderSize) && (awaitedConnectionResponse == classifyMessage(thePacket.data))) {
+            rxBuffer        = thePacket.data;
+            rxMessageLength = thePacket.length;
+            rxMessageId     = awaitedConnectionResponse;
+            handleConnectionResponse();
+            thePacket.length = 0;
+        }
+    }
+}
+
+bool NCI::isResponsePending() const {
+    const NciStep* theStep = findStep(theState);
+    if ((nullptr != theStep) && (theState == theStep->waitState) && (theStep->answer < NciMessageId::CoreResetNtf)) {        // NciMessageId lists the Responses first
+        return true;
+    }
+    return isConnectionCommandPending();
+}
+
+uint8_t NCI::getMaxControlPayloadSize() const {
+    return maxControlPayloadSize;
+}
+
+void NCI::parseCoreInitResponse() {
+    // NCI Specification V1.0 - Table 6 : Status, NFCC Features (4), Number of Supported RF Interfaces (n), Supported RF Interfaces (n), Max Logical Connections,
+    // Max Routing Table Size (2), Max Control Packet Payload Size, ...
+    if (rxMessageLength > 8) {
+        uint32_t offset = 9 + rxBuffer[8];
+        if (offset < rxMessageLength) {
+            maxLogicalConnections = rxBuffer[offset];
+        }
+        offset += 3;
+        if ((offset < rxMessageLength) && (rxBuffer[offset] > 0)) {
+            maxControlPayloadSize = rxBuffer[offset];
+        }
+    }
+}
+
+void NCI::receiveMessages() {
+    while (theHardwareInterface.hasMessage()) {
+        if (rxQueue.isFull()) {
+            rxQueue.countFull();        // the NFCC keeps it until we have room, nothing gets lost
+            return;
+        }
+        NciPacket &thePacket = rxQueue.getFreeSlot();
+        if (isReceivingData()) {
+            // An application buffer is waiting for data : read the header first, so the payload of a Data packet can go straight into that buffer
+            if (theHardwareInterface.readHeader(thePacket.data)) {
+                NciConnection *theConnection = (MsgTypeData == (thePacket.data[0] & 0xE0)) ? findConnection(thePacket.data[0] & 0x0F) : nullptr;
+                if ((nullptr != theConnection) && theConnection->isReceiving() && rxQueue.isEmpty()) {        // with packets still queued, it waits its turn so segments stay in order
+                    receiveDataSegment(*theConnection, thePacket);
+                } else {
+                    thePacket.length = MsgHeaderSize + theHardwareInterface.readPayload(thePacket.data + MsgHeaderSize, thePacket.data[2]);
+                    rxQueue.push();
+                }
+            } else {
+                (void)theHardwareInterface.readPayload(thePacket.data + MsgHeaderSize, 0);
+            }
+        } else {
+            thePacket.length = theHardwareInterface.read(thePacket.data);
+            if (thePacket.length >= MsgHeaderSize) {
+                rxQueue.push();
+            }
+        }
+    }
+}
+
+void NCI::receiveDataSegment(NciConnection& theConnection, NciPacket& thePacket) {
+    uint32_t payloadLength = thePacket.data[2];
+    bool isLastSegment     = (PacketBoundaryFlagLastSegment == (thePacket.data[0] & PacketBoundaryFlagNotLastSegment));
+    uint8_t* destination   = theConnection.getReceiveDestination(payloadLength);
+    if (nullptr == destination) {
+        destination = thePacket.data + MsgHeaderSize;        // does not fit : read it anyway so the NFCC can continue, the connection flags the overflow
+    }
+    (void)theHardwareInterface.readPayload(destination, payloadLength);
+    theConnection.segmentReceived(payloadLength, isLastSegment);
+}
+
+bool NCI::isReceivingData() const {
+    for (uint8_t index = 0; index < maxNmbrConnections; index++) {
+        if (theConnections[index].isReceiving()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NCI::handleDataPacket() {
+    // Data packet which arrived while no receive buffer was waiting, or which arrived in one read together with others. Still reassemble it, if there is a buffer now
+    NciConnection* theConnection = findConnection(rxBuffer[0] & 0x0F);
+    if ((nullptr != theConnection) && theConnection->isReceiving()) {
+        uint32_t payloadLength = rxMessageLength - MsgHeaderSize;
+        uint8_t* destination   = theConnection->getReceiveDestination(payloadLength);
+        if (nullptr != destination) {
+            for (uint32_t index = 0; index < payloadLength; index++) {
+                destination[index] = rxBuffer[MsgHeaderSize + index];
+            }
+        }
+        theConnection->segmentReceived(payloadLength, (PacketBoundaryFlagLastSegment == (rxBuffer[0] & PacketBoundaryFlagNotLastSegment)));
+    } else {
+        nmbrOfUnhandledNotifications++;
+    }
+}
+
+bool NCI::getMessage() {
+    releaseMessage();
+    while (!rxQueue.isEmpty()) {
+        rxBuffer        = rxQueue.getFirst().data;
+        rxMessageLength = rxQueue.getFirst().length;
+        rxMessageId     = classifyMessage(rxBuffer);
+        if (0 == rxMessageLength) {
+            rxQueue.pop();        // a connection response, handled already by handleConnectionMessages()
+        } else if (NciMessageId::Data == rxMessageId) {
+            handleDataPacket();        // Data packets belong to a connection, not to the stateMachine
+            rxQueue.pop();
+        } else if ((MsgTypeNotification == (rxBuffer[0] & 0xE0)) && !isExpectedNotification()) {
+            handleNotification();        // the stateMachine does not wait for this one, but it is not lost either
+            rxQueue.pop();
+        } else {
+            rxMessageTaken = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void NCI::releaseMessage() {
+    if (rxMessageTaken) {
+        rxQueue.pop();
+        rxMessageTaken = false;
+    }
+}
+
+bool NCI::isExpectedNotification() const {
+    switch (theState) {
+        case NciState::RfDiscovery:
+            return isMessage(NciMessageId::RfIntfActivatedNtf) || isMessage(NciMessageId::RfDiscoverNtf);
+
+        case NciState::RfWaitForAllDiscoveries:
+            return isMessage(NciMessageId::RfDiscoverNtf);
+
+        case NciState::RfPollActive:
+        case NciState::RfPresenceCheckWfr:
+            return isMessage(NciMessageId::RfDeactivateNtf);
+
+        case NciState::RfPresenceCheckWfn:
+            return isMessage(NciMessageId::ProprietaryPresenceCheckNtf) || isMessage(NciMessageId::RfDeactivateNtf);
+
+        case NciState::RfPresenceCheckWfd:
+            return isMessage(NciMessageId::CoreInterfaceErrorNtf) || isMessage(NciMessageId::RfDeactivateNtf);
+
+        case NciState::RfDiscoverSelectWfn:
+            return isMessage(NciMessageId::RfIntfActivatedNtf) || isMessage(NciMessageId::CoreGenericErrorNtf);
+
+        default: {
+            const NciStep* theStep = findStep(theState);
+            return (nullptr != theStep) && (theState == theStep->waitState) && isMessage(theStep->answer);
+        }
+    }
+}
+
+void NCI::handleNotification() {
+    publishEvent(NciEventType::notification);
+    switch (rxMessageId) {
+        case NciMessageId::CoreGenericErrorNtf:
+            if (rxMessageLength > 3) {
+                lastGenericError = rxBuffer[3];
+            }
+            break;
+
+        case NciMessageId::CoreInterfaceErrorNtf:
+            if (rxMessageLength > 3) {
+                lastInterfaceError = rxBuffer[3];
+            }
+            nmbrOfInterfaceErrors++;
+            break;
+
+        case NciMessageId::CoreConnCreditsNtf:
+            handleCredits();
+            break;
+
+        case NciMessageId::RfFieldInfoNtf:
+            if (rxMessageLength > 3) {
+                rfFieldPresent = (0x01 == (rxBuffer[3] & 0x01));        // RF Field Status, NCI Specification V1.0 - Table 68
+            }
+            break;
+
+        default:
+            nmbrOfUnhandledNotifications++;        // default handler for anything nobody expects
+            break;
     }
-    (void)theHardwareInterface.write(txBuffer, 3 + payloadLength);        // TODO :  could make this more robust by checking the return value and go into error is write did not succees
 }
 
-void NCI::getMessage() {
-    rxMessageLength = theHardwareInterface.read(rxBuffer);
+const NciPacketQueue& NCI::getRxQueue() const {
+    return rxQueue;
 }
 
-bool NCI::isMessageType(uint8_t messageType, uint8_t groupId, uint8_t opcodeId) const {
-    return (((messageType | groupId) & 0xEF) == rxBuffer[0]) && ((opcodeId & 0x3F) == rxBuffer[1]);
+uint8_t NCI::getLastGenericError() const {
+    return lastGenericError;
+}
+
+uint8_t NCI::getLastInterfaceError() const {
+    return lastInterfaceError;
+}
+
+uint32_t NCI::getNmbrOfInterfaceErrors() const {
+    return nmbrOfInterfaceErrors;
+}
+
+uint32_t NCI::getNmbrOfWriteFailures() const {
+    return nmbrOfWriteFailures;
+}
+
+bool NCI::isRfFieldPresent() const {
+    return rfFieldPresent;
+}
+
+uint32_t NCI::getNmbrOfUnhandledNotifications() const {
+    return nmbrOfUnhandledNotifications;
+}
+
+bool NCI::isMessage(NciMessageId theMessageId) const {
+    return (theMessageId == rxMessageId);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// Dispatch table : maps every received Control packet to an NciMessageId in a single lookup, indexed by (MT, GID, OID).
+// Only Responses and Notifications come from the NFCC. GIDs are compacted to Core, RF Management, NFCEE Management and Proprietary
+// All OIDs defined by NCI V1.0 and the PN7150 are < 16, except the proprietary presence check (OID 0x11), which classifyMessage() tests before the lookup.
+// Anything else outside the table is Unknown
+// ---------------------------------------------------------------------------------------------------------------------------
+
+namespace {
+constexpr uint8_t unknownGroup = 0xFF;
+constexpr uint8_t groupIndex[16] = {0, 1, 2, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, unknownGroup, 3};
+
+#define UNK NciMessageId::Unknown
+constexpr NciMessageId dispatchTable[2][4][16] = {
+    {
+        // Responses
+        {NciMessageId::CoreResetRsp, NciMessageId::CoreInitRsp, NciMessageId::CoreSetConfigRsp, NciMessageId::CoreGetConfigRsp, NciMessageId::CoreConnCreateRsp, NciMessageId::CoreConnCloseRsp, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK},
+        {NciMessageId::RfDiscoverMapRsp, NciMessageId::RfSetListenModeRoutingRsp, NciMessageId::RfGetListenModeRoutingRsp, NciMessageId::RfDiscoverRsp, NciMessageId::RfDiscoverSelectRsp, UNK, NciMessageId::RfDeactivateRsp, UNK, NciMessageId::RfT3tPollingRsp, UNK, UNK, NciMessageId::RfParameterUpdateRsp, UNK, UNK, UNK, UNK},
+        {NciMessageId::NfceeDiscoverRsp, NciMessageId::NfceeModeSetRsp, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK},
+        {NciMessageId::ProprietaryStandbyRsp, UNK, NciMessageId::ProprietaryActRsp, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK},
+    },
+    {
+        // Notifications
+        {NciMessageId::CoreResetNtf, UNK, UNK, UNK, UNK, UNK, NciMessageId::CoreConnCreditsNtf, NciMessageId::CoreGenericErrorNtf, NciMessageId::CoreInterfaceErrorNtf, UNK, UNK, UNK, UNK, UNK, UNK, UNK},
+        {UNK, UNK, NciMessageId::RfGetListenModeRoutingNtf, NciMessageId::RfDiscoverNtf, UNK, NciMessageId::RfIntfActivatedNtf, NciMessageId::RfDeactivateNtf, NciMessageId::RfFieldInfoNtf, NciMessageId::RfT3tPollingNtf, NciMessageId::RfNfceeActionNtf, NciMessageId::RfNfceeDiscoveryReqNtf, UNK, UNK, UNK, UNK, UNK},
+        {NciMessageId::NfceeDiscoverNtf, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK},
+        {UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK, UNK},
+    }};
+#undef UNK
+}        // namespace
+
+NciMessageId NCI::classifyMessage(const uint8_t header[]) {
+    uint8_t messageType = header[0] & 0xE0;
+    if (MsgTypeData == messageType) {
+        return NciMessageId::Data;
+    }
+    uint8_t theGroup = groupIndex[header[0] & 0x0F];
+    uint8_t opcodeId = header[1] & 0x3F;
+    if ((GroupIdProprietary == (header[0] & 0x0F)) && (NCI_PROPRIETARY_PRESENCE_CHECK_RSP == opcodeId) && (MsgTypeCommand != messageType)) {
+        return (MsgTypeNotification == messageType) ? NciMessageId::ProprietaryPresenceCheckNtf : NciMessageId::ProprietaryPresenceCheckRsp;        // beyond the table's 16 opcodes
+    }
+    if ((MsgTypeCommand == messageType) || (unknownGroup == theGroup) || (opcodeId > 0x0F)) {
+        return NciMessageId::Unknown;        // the NFCC never sends commands
+    }
+    return dispatchTable[(MsgTypeNotification == messageType) ? 1 : 0][theGroup][opcodeId];
 }
 
 bool NCI::isTimeOut() const {
-    return ((millis() - timeOutStartTime) >= timeOut);
+    return timeOutArmed && ((millis() - timeOutStartTime) >= timeOut);
 }
 
 void NCI::setTimeOut(unsigned long theTimeOut) {
     timeOutStartTime = millis();
     timeOut          = theTimeOut;
+    timeOutArmed     = true;
+}
+
+void NCI::clearTimeOut() {
+    timeOutArmed = false;
+}
+
+bool NCI::addEventHandler(NciEventHandler theHandler, void* theContext) {
+    for (uint8_t index = 0; index < maxNmbrEventHandlers; index++) {
+        if (nullptr == eventHandlers[index].handler) {
+            eventHandlers[index].handler = theHandler;
+            eventHandlers[index].context = theContext;
+            return true;
+        }
+    }
+    return false;
+}
+
+void NCI::removeEventHandler(NciEventHandler theHandler, void* theContext) {
+    for (uint8_t index = 0; index < maxNmbrEventHandlers; index++) {
+        if ((theHandler == eventHandlers[index].handler) && (theContext == eventHandlers[index].context)) {
+            eventHandlers[index].handler = nullptr;
+        }
+    }
+}
+
+void NCI::publishEvent(NciEventType theType) {
+    NciEvent theEvent;
+    theEvent.type          = theType;
+    theEvent.state         = theState;
+    theEvent.previousState = publishedState;
+    theEvent.nmbrOfTags    = nmbrOfTags;
+    theEvent.messageId     = (NciEventType::notification == theType) ? rxMessageId : NciMessageId::Unknown;
+    theEvent.payload       = (NciEventType::notification == theType) ? (rxBuffer + MsgHeaderSize) : nullptr;
+    theEvent.payloadLength = (NciEventType::notification == theType) ? (rxMessageLength - MsgHeaderSize) : 0;
+    for (uint8_t index = 0; index < maxNmbrEventHandlers; index++) {
+        if (nullptr != eventHandlers[index].handler) {
+            eventHandlers[index].handler(theEvent, eventHandlers[index].context);
+        }
+    }
+}
+
+void NCI::publishStateChange() {
+    if (theState == publishedState) {
+        return;
+    }
+    publishEvent(NciEventType::stateChanged);
+    if (NciState::Error == theState) {
+        publishEvent(NciEventType::error);        // previousState tells where it went wrong
+    }
+    publishedState = theState;
+}
+
+void NCI::setTagsStatus(TagsPresentStatus newStatus) {
+    bool wasPresent = (TagsPresentStatus::newTagPresent == theTagsStatus) || (TagsPresentStatus::oldTagPresent == theTagsStatus) || (TagsPresentStatus::multipleTagsPresent == theTagsStatus);
+    theTagsStatus   = newStatus;
+    if (!wasPresent && (TagsPresentStatus::newTagPresent == newStatus)) {
+        publishEvent(NciEventType::tagArrived);
+    } else if (wasPresent && (TagsPresentStatus::noTagsPresent == newStatus)) {
+        publishEvent(NciEventType::tagDeparted);
+    }
+}
+
+unsigned long NCI::nextDeadline() const {
+    unsigned long now = millis();
+    if (hasPendingWork()) {
+        return now;
+    }
+    unsigned long timeToWait = getTimeUntilTimeOut();
+    if (isConnectionCommandPending()) {
+        unsigned long connectionTimeToWait = connectionTimeOut - (now - connectionCommandStartTime);
+        if ((connectionTimeToWait < timeToWait) || !isWaitingState()) {        // a state which would send a command waits for the response, whatever its own timeOut
+            timeToWait = connectionTimeToWait;
+        }
+    }
+    if (timeToWait > maxTimeToWait) {
+        timeToWait = maxTimeToWait;        // nothing scheduled : only the IRQ can give us work
+    }
+    return now + timeToWait;
+}
+
+unsigned long NCI::getTimeUntilTimeOut() const {
+    if (!timeOutArmed) {
+        return 0xFFFFFFFF;        // no timeOut running, only the IRQ can wake us up
+    }
+    unsigned long elapsed = millis() - timeOutStartTime;
+    if (elapsed >= timeOut) {
+        return 0;
+    }
+    return timeOut - elapsed;
+}
+
+bool NCI::isWaitingState() const {
+    const NciStep* theStep = findStep(theState);
+    if (nullptr != theStep) {
+        return (theState == theStep->waitState);        // commandStates send their command
+    }
+    switch (theState) {
+        case NciState::HwResetVenLow:
+        case NciState::HwResetBoot:
+        case NciState::RfWaitForAllDiscoveries:
+        case NciState::RfPresenceCheckWfd:
+        case NciState::PowerDown:
+            return true;
+
+        case NciState::RfPollActive:
+            return !tagOperationRunning && !uidOnlyScan && (1 == nmbrOfTags) && (presenceCheckPeriod > 0);        // the operation is called on every run(). With presence checks, a single tag waits for the next one
+
+        case NciState::RfDiscovery:
+            return !discoveryChanged;        // changed technologies or configuration : it needs to restart discovery
+
+        case NciState::RfIdleCmd:
+            return (0 == nmbrOfDiscoveryEntries) && !theConfiguration.hasWork() && !standbyChanged && !discoverMapChanged;        // nothing to poll for : wait until the application adds technologies
+
+        default:
+            return false;        // all other states send a command or take a decision, so they need to run
+    }
+}
+
+bool NCI::hasPendingWork() const {
+    if (isConnectionCommandPending() && !isWaitingState()) {
+        return ((millis() - connectionCommandStartTime) >= connectionTimeOut) || (theHardwareInterface.hasMessage() && !rxQueue.isFull());        // only the response, or its time-out, lets this state send its command
+    }
+    if (!isWaitingState()) {
+        return true;
+    }
+    if ((NciState::RfPresenceCheckWfd == theState) && theConnections[0].isMessageReceived()) {
+        return true;        // the answer was read straight into the presenceCheckBuffer
+    }
+    if (((NciState::HwResetVenLow == theState) && ((micros() - bootPhaseStartTime) >= NciTransport::venLowTime)) || ((NciState::HwResetBoot == theState) && ((micros() - bootPhaseStartTime) >= NciTransport::bootTime))) {
+        return true;        // the timeOut only has millisecond resolution
+    }
+    if (isConnectionCommandPending() && ((millis() - connectionCommandStartTime) >= connectionTimeOut)) {
+        return true;
+    }
+    return (!rxQueue.isEmpty() || theHardwareInterface.hasMessage() || isTimeOut());
 }
 
 void NCI::saveTag(uint8_t msgType) {
     // Store the properties of detected TAGs in the Tag array.
-    // Tag info can come in two different NCI messages : RF_DISCOVER_NTF and RF_INTF_ACTIVATED_NTF and the Tag properties are in slightly different location inside these messages
+    // Tag info can come in two different NCI messages : RF_DISCOVER_NTF and RF_INTF_ACTIVATED_NTF, the Tag parses both
+    // A malformed one is kept with what could be parsed, so its RF Discovery ID can still be selected
 
     if (nmbrOfTags < maxNmbrTags) {
-        uint8_t offSet;        // Offset in the NCI message where we can find the UniqueID
+        Tag &newTag = theTags[nmbrOfTags];
+        newTag.clear();
         switch (msgType) {
             case RF_INTF_ACTIVATED_NTF:
-                offSet = 12;
+                (void)newTag.parseActivatedNotification(rxBuffer + MsgHeaderSize, rxMessageLength - MsgHeaderSize);
                 break;
 
             case RF_DISCOVER_NTF:
-                offSet = 9;
+                (void)newTag.parseDiscoverNotification(rxBuffer + MsgHeaderSize, rxMessageLength - MsgHeaderSize);
                 break;
 
             default:
                 return;        // unknown type of msg sent here ?? we just ignore it..
                 break;
         }
-
-        uint8_t NfcId1Length = rxBuffer[offSet];
-        if (NfcId1Length > 10) {
-            NfcId1Length = 10;        // limit the length to 10, so in case of whatever error we don't write beyond the boundaries of the array
-        }
-        uint8_t newTagIndex = nmbrOfTags;        // index to the array item where we will store the info
-
-        theTags[newTagIndex].uniqueIdLength = NfcId1Length;           // copy the length of the unique ID, is 4, 7 or 10
-        for (uint8_t index = 0; index < NfcId1Length; index++)        // copy all bytes of the unique ID
-        {
-            theTags[newTagIndex].uniqueId[index] = rxBuffer[offSet + 1 + index];
-        }
-        theTags[newTagIndex].detectionTimestamp = millis();
-
+        newTag.detectionTimestamp = millis();
         nmbrOfTags++;        // one more tag in the array now
     }
 }
@@ -24,14 +24,19 @@
 //
 
 #include <stdint.h>                 // Gives us access to uint8_t types etc
-#include "tag.h"                    //
-#include "PN7150Interface.h"        // NCI protocol runs over a hardware interface.
+#include "Tag.h"                    //
+#include "NciTransport.h"           // NCI protocol runs over a hardware interface, any implementation of NciTransport will do
+#include "NciPacketQueue.h"         // received packets wait here until they are handled
+#include "NciConnection.h"          // Logical Connections for Data packets
+#include "NciConfiguration.h"       // shadow of the NFCC's configuration parameters
+#include "NciRoundTripTime.h"       // how long the NFCC takes to answer
+#include "PN7150Interface.h"        // The Arduino implementation of NciTransport
 
 // ---------------------------------------------------------------------
 // NCI Packet Header Definitions. NCI Specification V1.0 - section 3.4.1
 // ---------------------------------------------------------------------
 
-#define MaxPayloadSize 255        // See NCI specification V1.0, section 3.1
+#define MaxPayloadSize 255        // See NCI specification V1.0, section 3.1. Messages with a longer payload are segmented, see section 3.3
 #define MsgHeaderSize 3
 
 #define MsgTypeData 0x00
@@ -112,6 +117,11 @@
 #define RF_PARAMETER_UPDATE_RSP 0x0B
 // 1100b -  1111b RFU
 
+// Destination Types for CORE_CONN_CREATE_CMD. NCI Specification V1.0 - Table 16
+#define DestinationNfccLoopback 0x01
+#define DestinationRemoteNfcEndpoint 0x02
+#define DestinationNfcee 0x03
+
 #define NFCEE_DISCOVER_CMD 0x00
 #define NFCEE_DISCOVER_RSP 0x00
 #define NFCEE_DISCOVER_NTF 0x00
@@ -122,9 +132,48 @@
 #define NCI_PROPRIETARY_ACT_CMD 0x02        // See PN7150 Datasheet, section 5.4
 #define NCI_PROPRIETARY_ACT_RSP 0x02        // See PN7150 Datasheet, section 5.4, Table 23 and 24
 
+#define NCI_PROPRIETARY_STANDBY_CMD 0x00        // NXP extension : 0x01 enables standby mode, the NFCC saves power whenever it is idle
+#define NCI_PROPRIETARY_STANDBY_RSP 0x00
+
+#define NCI_PROPRIETARY_PRESENCE_CHECK_CMD 0x11        // NXP extension : ISO-DEP presence check, the NFCC sends an R(NAK) and checks the tag answers
+#define NCI_PROPRIETARY_PRESENCE_CHECK_RSP 0x11
+#define NCI_PROPRIETARY_PRESENCE_CHECK_NTF 0x11        // Status 0x00 : tag present, anything else : tag gone
+
+// ------------------------------------------------------------------------
+// Configuration Parameters for CORE_SET_CONFIG. NCI Specification V1.0 - Table 101
+// ------------------------------------------------------------------------
+
+#define TOTAL_DURATION 0x00              // 2 bytes, LSB first : duration of one discovery period in ms
+#define CON_DEVICES_LIMIT 0x01           // maximum number of remote NFC endpoints the NFCC reports in one discovery
+#define PA_BAIL_OUT 0x08                 // NFC-A : stop polling after the first tag is found
+#define PB_AFI 0x10
+#define PB_BAIL_OUT 0x11                 // NFC-B : stop polling after the first tag is found
+#define PB_ATTRIB_PARAM1 0x12
+#define PB_DATA_EXCHANGE_LEN 0x13
+#define PF_BIT_RATE 0x18
+#define PB_H_INFO 0x20
+#define PI_BIT_RATE 0x21
+#define PA_ADV_FEAT 0x22
+#define PN_NFC_DEP_SPEED 0x28
+#define PN_ATR_REQ_GEN_BYTES 0x29
+#define PN_ATR_REQ_CONFIG 0x2A
+#define RF_FIELD_INFO 0x80               // 1 : NFCC sends RF_FIELD_INFO_NTF
+#define RF_NFCEE_ACTION 0x81
+#define NFCDEP_OP 0x82
+
+// PN7150 proprietary Configuration Parameters have a 2-byte ID : 0xA0 followed by the ID below. See PN7150 User Manual UM10936, section 11
+#define ProprietaryConfigPrefix 0xA0
+#define TAG_DETECTOR_CFG 0xA040                     // Low Power Card Detection : 0x00 disabled, 0x01 enabled
+#define TAG_DETECTOR_THRESHOLD_CFG 0xA041           // how much the antenna's load must change to wake up for a full poll
+#define TAG_DETECTOR_FALLBACK_CNT_CFG 0xA043        // after this many LPCD cycles without detection, do a full poll anyway. 0 : never
+
 #define ResetKeepConfig 0x00
 #define ResetClearConfig 0x01
 
+// Configuration Status in CORE_RESET_RSP (NCI 1.0) or CORE_RESET_NTF (NCI 2.0). NCI Specification V1.0 - Table 7
+#define ConfigurationKept 0x00
+#define ConfigurationReset 0x01
+
 // ---------------------------------------------------
 // NCI Status Codes. NCI Specification V1.0 - Table 94
 // ---------------------------------------------------
@@ -208,8 +257,10 @@
 #define PROTOCOL_T3T 0x03
 #define PROTOCOL_ISO_DEP 0x04
 #define PROTOCOL_NFC_DEP 0x05
-// 0x06 � 0x7F RFU
+#define PROTOCOL_T5T 0x06        // ISO 15693 : RFU in NCI 1.0, the PN7150 uses the NCI 2.0 value
+// 0x07 � 0x7F RFU
 // 0x80-0xFE For proprietary use
+#define PROTOCOL_MIFARE 0x80        // PN7150 proprietary : MIFARE Classic
 // 0xFF RFU
 
 // -----------------------------------------------------
@@ -281,6 +332,49 @@ enum class NciRfDeAcivationMode : uint8_t {
 #define NCI_DISCOVERY_TYPE_POLL_F_ACTIVE 0x05
 #define NCI_DISCOVERY_TYPE_POLL_ISO15693 0x06
 
+// ------------------------------------------------------------------------------------------
+// Every Response and Notification the NFCC can send, as a dense enum. Received packets are
+// mapped onto this with a single table lookup, see NCI::classifyMessage()
+// ------------------------------------------------------------------------------------------
+
+enum class NciMessageId : uint8_t {
+    Unknown,        // anything not in the table : handled by the default handler
+    Data,           // Data packets, MT = 000b
+    CoreResetRsp,
+    CoreInitRsp,
+    CoreSetConfigRsp,
+    CoreGetConfigRsp,
+    CoreConnCreateRsp,
+    CoreConnCloseRsp,
+    RfDiscoverMapRsp,
+    RfSetListenModeRoutingRsp,
+    RfGetListenModeRoutingRsp,
+    RfDiscoverRsp,
+    RfDiscoverSelectRsp,
+    RfDeactivateRsp,
+    RfT3tPollingRsp,
+    RfParameterUpdateRsp,
+    NfceeDiscoverRsp,
+    NfceeModeSetRsp,
+    ProprietaryActRsp,
+    ProprietaryStandbyRsp,
+    ProprietaryPresenceCheckRsp,
+    CoreResetNtf,
+    CoreConnCreditsNtf,
+    CoreGenericErrorNtf,
+    CoreInterfaceErrorNtf,
+    RfGetListenModeRoutingNtf,
+    RfDiscoverNtf,
+    RfIntfActivatedNtf,
+    RfDeactivateNtf,
+    RfFieldInfoNtf,
+    RfT3tPollingNtf,
+    RfNfceeActionNtf,
+    RfNfceeDiscoveryReqNtf,
+    NfceeDiscoverNtf,
+    ProprietaryPresenceCheckNtf
+};
+
 enum class notificationType : uint8_t {
     lastNotification          = 0x00,
     lastNotificationNfccLimit = 0x01,
@@ -320,33 +414,158 @@ enum class NciState : uint8_t
 //			Wfr means "Waiting For Response" : a state where you would wait for a response from the NFC to the DH
 //			Wfn means "Waiting For Notification" : a state where you would wait for a notification from the NFC to the DH
 {
+    HwResetVenLow,                  // VEN is LOW, resetting the PN7150
+    HwResetBoot,                    // VEN is HIGH again, waiting for the PN7150 to boot
     HwResetRfc,                     // you start in this state after a hardware reset of the PN7150, then you send the CORE_RESET_CMD
     HwResetWfr,                     // waiting for CORE_RESET_RSP
+    HwResetWfn,                     // waiting for CORE_RESET_NTF, NCI 2.0 NFCCs report the Configuration Status in it
     SwResetRfc,                     // send CORE_INIT_CMD
     SwResetWfr,                     // waiting for CORE_INIT_RSP
     EnableCustomCommandsRfc,        // Enabling PN7150-extensions
     EnableCustomCommandsWfr,        // waiting for response/confirmation
     RfIdleCmd,                      // Core initialized, now waiting for RF configuration commands
+    RfSetConfigWfr,                 // waiting for CORE_SET_CONFIG_RSP, after sending changed configuration parameters
+    RfGetConfigWfr,                 // waiting for CORE_GET_CONFIG_RSP, with the parameters the application asked for
+    RfSetStandbyWfr,                // waiting for the response to the proprietary standby command
+    RfDiscoverMapWfr,               // waiting for RF_DISCOVER_MAP_RSP, after changing the RF Interface ISO-DEP and NFC-DEP tags are activated on
     RfIdleWfr,
     RfGoToDiscoveryWfr,
     RfDiscovery,                    // polling / detecting cards/tags
     RfWaitForAllDiscoveries,        // busy enumerating multiple cards/tags being detected
     RfWaitForHostSelect,            // done detecting multiple cards/tags, waiting for the DH to select one
+    RfDiscoverSelectWfr,            // waiting for RF_DISCOVER_SELECT_RSP
+    RfDiscoverSelectWfn,            // waiting for RF_INTF_ACTIVATED_NTF of the selected card/tag
     RfPollActive,                   // detected 1 card/tag, and activated it for reading/writing
+    RfPresenceCheckWfr,             // waiting for the response to the proprietary ISO-DEP presence check
+    RfPresenceCheckWfn,             // waiting for the result of the proprietary ISO-DEP presence check
+    RfPresenceCheckWfd,             // waiting for the tag to answer a READ command, used as presence check for Type 2 Tags
 
     RfDeActivate1Wfr,        // waiting for deactivation response, no notification will come (dactivation in RfWaitForHostSelect)
     RfDeActivate2Wfr,        // waiting for deactivation response, additionally a notification will come (deactivation in RfPollActive)
     RfDeActivate2Wfn,        // waiting for deactivation notifiation
+    PowerDown,               // VEN is LOW, waiting until it is time to wake up, or the application calls wakeUp()
     Error,
     End
 };
 
+// ------------------------------------------------------------------------------------------
+// Command / Response steps : the states which send a command and wait for its answer are not
+// coded one by one, but are rows of NCI::stepTable. NCI::runStep() executes any row, so the
+// cost of a step does not depend on which one it is, and a new command sequence is a few rows
+// ------------------------------------------------------------------------------------------
+
+enum class NciStepAction : uint8_t {
+    none,
+    coreResetResponse,            // NCI 1.0 : Configuration Status. NCI 2.0 : wait for CORE_RESET_NTF
+    coreResetNotification,        // Configuration Status
+    coreInitResponse,             // the NFCC's capabilities
+    proprietaryEnabled,           // restore the configuration if the NFCC lost it
+    setConfigResponse,            // which parameters the NFCC accepted
+    getConfigResponse,            // the values the NFCC returned
+    discoveryStarted,             // booting is done, wait for tags
+    deactivated,                  // the Static RF Connection closes
+    presenceConfirmed,            // next presence check after presenceCheckPeriod
+    abortConfiguration,           // parameters in flight go in the next command
+    tagRemoved,                   // presence check failed
+    standbyFailed,                // send the standby command again before the next discovery
+    tagSelected,                  // the selected tag is activated, its operation runs
+    selectFailed                  // the selected tag did not activate, go on with the next one
+};
+
+class NciStep {
+  public:
+    NciState commandState;         // sends the command and goes to waitState. End : the command has a variable payload, the stateMachine sends it and calls enterState(waitState)
+    uint8_t groupId;
+    uint8_t opcodeId;
+    uint8_t payloadLength;         // 0 or 1
+    uint8_t payload;
+    NciState waitState;            // waiting for the answer, with the timeOut running
+    NciMessageId answer;           // Response or Notification which ends the step
+    uint8_t timeOut;               // [ms]
+    bool checkStatus;              // the answer's Status must be STATUS_OK
+    bool ignoreOthers;             // other messages are dropped, instead of failing the step
+    NciState successState;
+    NciState failureState;         // wrong answer, Status not OK, or no answer within timeOut
+    NciState retryState;           // sends the command again, the first level of recovery from Error. End : it cannot be sent again on its own
+    NciStepAction onSuccess;       // extra checks and bookkeeping : can still fail the step, or go to another state than successState
+    NciStepAction onFailure;       // cleaning up : can go to another state than failureState
+};
+
 enum class NciError : uint8_t {
     responseNOK,            // we received a response with somethin wrong in it, eg Status_NOK
     responseTimeout,        // we did not receive a response in time
     none
 };
 
+// ------------------------------------------------------------------------------------------
+// Power modes, as far as the DeviceHost can tell from the stateMachine. Time spent in each is
+// accounted, so configurations can be compared on their average current
+// ------------------------------------------------------------------------------------------
+
+enum class NciPowerMode : uint8_t {
+    powerDown,              // VEN LOW
+    idle,                   // NFCC powered, RF field off : booting, configuring
+    polling,                // discovery, polling all configured technologies every period
+    lowPowerPolling,        // discovery with standby and Low Power Card Detection : a full poll only when the antenna sees something
+    active,                 // a tag is activated, RF field on
+    nmbrOfPowerModes
+};
+
+class NciPowerStatistics {
+  public:
+    unsigned long timeInMode[static_cast<uint8_t>(NciPowerMode::nmbrOfPowerModes)]{};        // [ms]
+    uint32_t nmbrOfWakeUps{0};                                                                  // power ups after a powerDown
+
+    uint32_t estimateAverageCurrent(const uint32_t currentPerMode[]) const;        // time weighted average, in the unit of currentPerMode, eg. uA from the datasheet
+};
+
+// ------------------------------------------------------------------------------------------
+// Phases of booting the NFCC, from VEN LOW until discovery runs. Each is timed, so the time
+// to the first scan can be tracked
+// ------------------------------------------------------------------------------------------
+
+enum class NciBootPhase : uint8_t {
+    venReset,                 // VEN LOW
+    boot,                     // VEN HIGH until the NFCC accepts commands
+    coreReset,                // CORE_RESET_CMD until CORE_RESET_RSP, and CORE_RESET_NTF for NCI 2.0
+    coreInit,                 // CORE_INIT_CMD until CORE_INIT_RSP
+    enableProprietary,        // NCI_PROPRIETARY_ACT_CMD until its response
+    configure,                // standby and CORE_SET_CONFIG, skipped when the NFCC kept its configuration
+    startDiscovery,           // RF_DISCOVER_CMD until RF_DISCOVER_RSP
+    nmbrOfBootPhases
+};
+
+class NciBootStatistics {
+  public:
+    unsigned long phaseDuration[static_cast<uint8_t>(NciBootPhase::nmbrOfBootPhases)]{};        // [us]
+    bool configurationRetained{false};        // CORE_RESET reported the NFCC kept its configuration, so it was not sent again
+    bool complete{false};                     // discovery is running, all phases are measured
+
+    unsigned long getTotal() const;        // [us] from VEN LOW until discovery runs
+};
+
+// ------------------------------------------------------------------------------------------
+// Recovery from Error, escalating : each time the recovery itself fails, the next level is
+// tried. Levels which cannot help for the state where it went wrong are skipped
+// ------------------------------------------------------------------------------------------
+
+enum class NciRecoveryLevel : uint8_t {
+    retry,                   // send the failed command again
+    rfDeactivate,            // RF_DEACTIVATE_CMD to Idle, then discovery restarts. Only once the NFCC is initialized
+    coreReset,               // CORE_RESET_CMD keeping the configuration, and boot from there
+    hardwareReset,           // VEN reset, see initialize()
+    nmbrOfRecoveryLevels
+};
+
+class NciRecoveryStatistics {
+  public:
+    uint32_t nmbrOfFailures{0};                                                                       // times the stateMachine went to Error, not counting failures of the recovery itself
+    uint32_t attempts[static_cast<uint8_t>(NciRecoveryLevel::nmbrOfRecoveryLevels)]{};                 // recovery actions taken at each level
+    uint32_t recoveries[static_cast<uint8_t>(NciRecoveryLevel::nmbrOfRecoveryLevels)]{};               // failures solved at each level, ie. the highest level it took
+    unsigned long timeToRecover[static_cast<uint8_t>(NciRecoveryLevel::nmbrOfRecoveryLevels)]{};       // [us] summed, divide by recoveries for the average. From the failure until the failed step succeeds, or discovery runs again
+    unsigned long maxTimeToRecover[static_cast<uint8_t>(NciRecoveryLevel::nmbrOfRecoveryLevels)]{};    // [us]
+};
+
 enum class TagsPresentStatus : uint8_t {
     unknown,
     noTagsPresent,
@@ -355,43 +574,269 @@ enum class TagsPresentStatus : uint8_t {
     multipleTagsPresent
 };
 
+// ------------------------------------------------------------------------------------------
+// Events : instead of polling getTagsPresentStatus() after every run(), the application can
+// register handlers, which run() calls when something happens
+// ------------------------------------------------------------------------------------------
+
+enum class NciEventType : uint8_t {
+    tagArrived,          // a tag was activated while none was present. getTag(0) has its properties
+    tagDeparted,         // the tag(s) left the RF field
+    multipleTags,        // several tags were discovered, getNmbrOfTags() tells how many
+    error,               // the stateMachine went to Error, previousState is where it went wrong. It recovers by itself, see NciRecoveryLevel
+    stateChanged,        // any change of state
+    notification,        // a notification the stateMachine does not handle itself, messageId and payload tell which
+    tagActivated         // a tag is activated, getActiveTagIndex() tells which. Data can be exchanged with it now
+};
+
+class NciEvent {
+  public:
+    NciEventType type;
+    NciState state;                // state when the event was published
+    NciState previousState;        // state before the last stateChanged
+    uint8_t nmbrOfTags;
+    NciMessageId messageId;        // notification only, Unknown for the other events
+    const uint8_t *payload;        // notification only, valid during the call
+    uint32_t payloadLength;
+};
+
+typedef void (*NciEventHandler)(const NciEvent &theEvent, void *context);        // called from run(). Can call anything on the NCI, except run()
+
+class NCI;
+typedef bool (*NciTagOperation)(NCI &theNci, uint8_t tagIndex, void *context);        // called from run() while the tag is activated, returns true when done with it. Can call anything on the NCI, except run()
+
 class NCI {
   public:
-    NCI(PN7150Interface &theHardwareInterface);            // Constructor, with mode default set to CardReadwrite
-    void initialize();                                     // See NCI specification V1.0, section 4.1 & 4.2
+    NCI(NciTransport &theHardwareInterface);               // Constructor, with mode default set to CardReadwrite
+    void initialize();                                     // Resets the NFCC and boots it from run(), without blocking. See NCI specification V1.0, section 4.1 & 4.2
     void run();                                            // runs the NCI stateMachine
     void activate();                                       // moves the StateMachine from Idle to Discover and starts the polling
-    void deActivate(NciRfDeAcivationMode theMode);         // moves the StateMachine from PollActive or WaitingForHostSelect back into Idle
+    void deActivate(NciRfDeAcivationMode theMode);         // moves the StateMachine from PollActive or WaitingForHostSelect back into Idle, or to WaitingForHostSelect with SleepMode
     NciState getState() const;                             // find out in which state the NCI stateMachine is
     TagsPresentStatus getTagsPresentStatus() const;        // read-only get function for the (private) property
     uint8_t getNmbrOfTags() const;
     bool newTagPresent() const;
     Tag *getTag(uint8_t index);        // TODO : improve this with 'const' so the Tag properties are read-only
+    uint8_t getActiveTagIndex() const;                     // getTag() index of the activated tag, or the one being selected
+    void setTagOperation(NciTagOperation theOperation, void *theContext = nullptr, unsigned long timeOut = 100);        // [ms] runs on every activated tag, until it returns true or timeOut passes. With multiple tags, each is selected in turn. nullptr : only collect their properties
+    bool hasPendingWork() const;                           // false when run() would do nothing : no message pending, no time-out expired and no command to send
+    const NciPacketQueue &getRxQueue() const;              // read-only access to the receive queue, for its statistics
+    uint8_t getLastGenericError() const;                   // status of the last CORE_GENERIC_ERROR_NTF, STATUS_OK if none
+    uint8_t getLastInterfaceError() const;                 // status of the last CORE_INTERFACE_ERROR_NTF, STATUS_OK if none
+    uint32_t getNmbrOfInterfaceErrors() const;             // CORE_INTERFACE_ERROR_NTFs received, eg. the tag did not answer a Data message
+    uint32_t getNmbrOfWriteFailures() const;               // Control packets the transport could not write, eg. the NFCC NACKed its address
+    bool isRfFieldPresent() const;                         // as reported by the last RF_FIELD_INFO_NTF
+    uint32_t getNmbrOfUnhandledNotifications() const;      // notifications, and Data packets without a receive buffer, which nobody handles
+    bool sendData(const uint8_t data[], uint32_t dataLength);              // queue a Data message to the activated tag, data must stay valid until getRfConnection().isTransmitDone()
+    bool sendData(uint8_t connectionId, const uint8_t data[], uint32_t dataLength);        // same, on any open Logical Connection
+    void setDataReceiveBuffer(uint8_t buffer[], uint32_t bufferSize, uint32_t nmbrOfMessages = 1);        // the next Data message(s) from the activated tag are reassembled into this buffer, one after the other
+    void setDataReceiveBuffer(uint8_t connectionId, uint8_t buffer[], uint32_t bufferSize, uint32_t nmbrOfMessages = 1);
+    const NciConnection &getRfConnection() const;                          // read-only access to the Static RF Connection : is a message received, its length, ..
+    const NciConnection *getConnection(uint8_t connectionId) const;        // nullptr if there is no open connection with this ID
+    bool createConnection(uint8_t destinationType, uint8_t nmbrOfParameters, const uint8_t parameters[], uint8_t parametersLength);        // CORE_CONN_CREATE_CMD, parameters are TLVs. NCI Specification V1.0 - Table 14
+    bool closeConnection(uint8_t connectionId);                            // CORE_CONN_CLOSE_CMD
+    bool sendCommand(uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint8_t payloadLength, uint8_t response[] = nullptr, uint8_t responseSize = 0);        // any other command, same rules as createConnection(). The payload of its Response goes in response
+    bool isConnectionCommandPending() const;                               // waiting for CORE_CONN_CREATE_RSP, CORE_CONN_CLOSE_RSP or the Response to sendCommand()
+    void releaseCommandResponse(const uint8_t response[]);                 // response goes away before the Response came : it is not copied there, the command stays pending
+    uint8_t getLastConnectionStatus() const;                               // status of the last of those responses, or STATUS_FAILED on a time-out
+    uint8_t getLastResponseLength() const;                                 // payload length of the Response to the last sendCommand(), as far as it fit in response. 0 on a time-out
+    uint8_t getLastCreatedConnectionId() const;                            // Conn ID the NFCC assigned in the last successful CORE_CONN_CREATE_RSP
+    uint8_t getMaxControlPayloadSize() const;                              // as reported by the NFCC in CORE_INIT_RSP
+    void clearDiscoveryTechnologies();                                                           // poll for nothing, until technologies are added again
+    bool addDiscoveryTechnology(uint8_t technologyAndMode, uint8_t frequency = 1);               // eg. NFC_A_PASSIVE_POLL_MODE. Frequency 1 : every discovery period, n : every n-th. NCI Specification V1.0 - Table 52
+    bool setConfigParameter(uint16_t parameterId, const uint8_t value[], uint8_t valueLength);        // sent with CORE_SET_CONFIG_CMD before the next discovery, unless the NFCC has this value already. IDs above 0xFF are the 2-byte proprietary ones
+    bool setTotalDuration(uint16_t duration);                                                    // [ms] TOTAL_DURATION : length of a discovery period, including the idle time between polling
+    bool getConfigParameter(uint16_t parameterId, uint8_t value[], uint8_t &valueLength);       // true if the value is known. If not, it is read before the next discovery : ask again later
+    const NciConfigCounters &getConfigCounters() const;                                          // how many parameters were written and read, and how many of those were not needed
+    uint8_t getLastSetConfigStatus() const;                                                      // status of the last CORE_SET_CONFIG_RSP
+    void setStandby(bool enable);                                                                // NFCC goes into standby whenever it is idle, eg. between discovery periods
+    bool setLowPowerCardDetection(bool enable, uint8_t threshold, uint8_t fallbackCount);        // only do a full poll when the antenna detects a change. Enables standby
+    void setPowerDownCycle(unsigned long noTagTime, unsigned long powerDownTime);                // [ms] after noTagTime without tags, power down (VEN LOW) for powerDownTime. 0 : never
+    void powerDown();                                                                            // VEN LOW now, until wakeUp()
+    void wakeUp();                                                                               // VEN reset and boot, discovery restarts with the same configuration
+    NciPowerMode getPowerMode() const;
+    NciPowerStatistics getPowerStatistics() const;
+    void resetPowerStatistics();
+    const NciBootStatistics &getBootStatistics() const;    // duration of each phase of the last boot
+    const NciRecoveryStatistics &getRecoveryStatistics() const;
+    void resetRecoveryStatistics();
+    bool isRecovering() const;                             // went to Error, and did not get back to where it went wrong or to discovery yet
+    void setPresenceCheckPeriod(unsigned long period);     // [ms] keep an activated tag activated and check it is still there every period. 0 (default) : deactivate and rediscover instead
+    uint32_t getNmbrOfPresenceChecks() const;
+    void setUidOnlyScan(bool enable);                      // ISO-DEP and NFC-DEP tags are activated on the Frame RF Interface, so the NFCC stops after anticollision, and each tag is deactivated to Discovery as soon as its properties are saved
+    unsigned long getRemovalDetectedTimestamp() const;     // millis() at which the last removal of a tag was detected
+    unsigned long getTimeUntilTimeOut() const;             // milliseconds until the running time-out expires, so the host can sleep until then or until the IRQ, whichever comes first
+    unsigned long nextDeadline() const;                    // millis() at which run() needs to be called if no IRQ comes first. Now if there is work pending. Compare as (long)(deadline - millis()) for wrap-around
+    void setAdaptiveTimeOuts(bool enable, unsigned long floor = 3, uint8_t nmbrOfDeviations = 4, unsigned long ceiling = 0);        // [ms] time-outs follow the measured times : mean + nmbrOfDeviations x deviation, within floor and ceiling. Ceiling 0 : each response's fixed time-out
+    const NciRoundTripTime *getRoundTripTime(NciState theState) const;        // statistics of what is awaited in this state : a response, a notification, or a tag in RfDiscovery. nullptr if nothing is measured there
+    const NciRoundTripTime &getConnectionCommandRoundTripTime() const;        // statistics of the responses to createConnection(), closeConnection() and sendCommand()
+    bool addEventHandler(NciEventHandler theHandler, void *theContext = nullptr);        // false if all maxNmbrEventHandlers are taken
+    void removeEventHandler(NciEventHandler theHandler, void *theContext = nullptr);
 
   private:
-    PN7150Interface &theHardwareInterface;        // reference to the object handling the hardware interface
+    NciTransport &theHardwareInterface;        // reference to the object handling the hardware interface
 
     NciState theState;                      // keeps track of the state of the NCI stateMachine - FSM
     TagsPresentStatus theTagsStatus;        // how many Tag/Cards are currently present
 
     unsigned long timeOut;                 // keeps track of time-outs when waiting for responses from the NFC device
     unsigned long timeOutStartTime;        // keeps track of time-outs when waiting for responses from the NFC device
-
-    uint8_t rxBuffer[MaxPayloadSize + MsgHeaderSize];        // buffer where we store bytes received until they form a complete message
-    uint32_t rxMessageLength;                                // length of the last message received. As these are not 0x00 terminated, we need to remember the length
-    uint8_t txBuffer[MaxPayloadSize + MsgHeaderSize];        // buffer where we store the message to be transmitted
-
-    void sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId, uint8_t payloadData[], uint8_t payloadLength);
-    void sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId);                // Variant for msg with no payload
-    void getMessage();                                                                       // read message from I2C into rxBuffer
-    bool isMessageType(uint8_t messageType, uint8_t groupId, uint8_t opcodeId) const;        // Is the msg in the rxBuffer of this type ?
+    bool timeOutArmed{false};              // false once an expired time-out has been handled, so it does not keep the host awake
+
+    NciPacketQueue rxQueue;                  // packets read from the NFCC, waiting to be handled
+    const uint8_t *rxBuffer{nullptr};        // the message being handled, pointing into its slot in the rxQueue
+    uint32_t rxMessageLength{0};             // length of the message being handled. As these are not 0x00 terminated, we need to remember the length
+    NciMessageId rxMessageId{NciMessageId::Unknown};        // what the message being handled is, looked up once when taking it from the rxQueue
+    bool rxMessageTaken{false};              // the first packet in the rxQueue is being handled by the stateMachine, and can be released at the end of run()
+
+    bool sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId, const uint8_t payloadData[], uint32_t payloadLength);        // header is built on the stack, payload goes to the transport straight from payloadData, segmented if needed. false if a segment could not be written
+    bool sendMessage(uint8_t messageType, uint8_t groupId, uint8_t opcodeId);                // Variant for msg with no payload
+    void startCommand(uint8_t groupId, uint8_t opcodeId, const uint8_t payloadData[], uint32_t payloadLength, NciState waitState);        // send a command of the stateMachine and wait for its answer. If it could not be written, the step fails on the next run()
+    void receiveMessages();                                                                  // read all messages the NFCC has waiting into the rxQueue
+    bool getMessage();                                                                       // take the next message for the stateMachine from the rxQueue, notifications it does not expect go to handleNotification()
+    void releaseMessage();                                                                   // free the slot of the message the stateMachine has handled
+    bool isExpectedNotification() const;                                                     // does the current state wait for the notification in rxBuffer
+    void handleNotification();                                                               // handles notifications which can come at any time, independent of the state
+    void handleDataPacket();                                                                 // Data packet which was not read straight into a receive buffer
+    void receiveDataSegment(NciConnection &theConnection, NciPacket &thePacket);             // read a Data packet's payload straight into the connection's receive buffer
+    void handleConnectionMessages();                                                         // Data, credits and connection responses at the head of the rxQueue, independent of the state
+    void handleConnectionResponse();                                                         // CORE_CONN_CREATE_RSP or CORE_CONN_CLOSE_RSP
+    void handleCredits();                                                                    // CORE_CONN_CREDITS_NTF
+    void sendPendingData();                                                                  // send queued Data segments for which there are credits
+    NciConnection *findConnection(uint8_t connectionId);                                     // the open connection with this ID, or nullptr
+    void updatePowerAccounting();                                                            // add the time since the last change to the power mode we were in
+    void startPowerDownCycle();                                                              // no tags for a while : power down, and wake up after powerDownTime
+    void runStateMachine();                                                                  // one step of the stateMachine, run() repeats it as long as it moves on to states with something to send
+    static const NciStep stepTable[];                                                        // the Command / Response steps, see NCI.cpp
+    static constexpr uint8_t nmbrOfSteps = 16;
+    static const NciStep *findStep(NciState theState);                                       // the step which sends its command or waits for its answer in this state, nullptr if none
+    void runStep(const NciStep &theStep);                                                    // send the command, or handle the answer or the timeOut
+    bool runStepAction(NciStepAction theAction);                                             // false if the answer is not acceptable after all
+    void enterState(NciState nextState);                                                     // starts the step's timeOut when it is a waitState
+    unsigned long adaptTimeOut(const NciRoundTripTime &theStatistics, unsigned long fixedTimeOut, unsigned long ceiling) const;        // fixedTimeOut, or the measured one with adaptive time-outs
+    void sampleDiscoveryTime(NciRoundTripTime &theStatistics, unsigned long fixedTimeOut);   // time since discoveryStartTime, unless it was longer than the fixed time-out
+    unsigned long discoveryTimeOut() const;                                                  // [ms] fixed time-out for finding a tag : at least one discovery period
+    void recover();                                                                          // in Error : take the next level of recovery which can help
+    bool canRecover(NciRecoveryLevel theLevel) const;                                        // does this level apply to the failedState
+    void recovered();                                                                        // back to normal operation, account the time it took
+    void discardNfccState();                                                                 // the NFCC is reset : forget messages, tags and connections we had from it
+    void publishEvent(NciEventType theType);                                                 // call all registered handlers
+    void publishStateChange();                                                               // stateChanged, and error when it went to Error, if the state changed since the last call
+    void setTagsStatus(TagsPresentStatus newStatus);                                         // publishes tagArrived or tagDeparted when tags come or go
+    void enterBootPhase(NciBootPhase nextPhase);                                             // the current boot phase is done, account its duration
+    void restoreConfiguration();                                                             // the NFCC lost its configuration in the reset, write ours again
+    void startPresenceCheck();                                                               // check the activated tag is still there, with the lightest exchange its protocol allows
+    void presenceConfirmed();
+    void tagRemoved();                                                                       // presence check failed : deactivate, and go back to discovery
+    void tagActivated();                                                                     // RF_INTF_ACTIVATED_NTF in rxBuffer : open the Static RF Connection, start the tag's operation
+    void runTagOperation();                                                                  // one call of the application's operation on the activated tag
+    void selectTag();                                                                        // RF_DISCOVER_SELECT_CMD for the tag at activeTagIndex
+    bool isReceivingData() const;                                                            // is any connection waiting for a Data message
+    bool isResponsePending() const;                                                          // is a command sent for which the response did not come yet
+    void connectionCommandSent(NciMessageId theResponse);                                    // start waiting for its response, with a fixed or adaptive time-out
+    void abortConnectionCommand();                                                           // the response to createConnection(), closeConnection() or sendCommand() will not come : fail it
+    void parseCoreInitResponse();                                                            // get the NFCC's capabilities we need from CORE_INIT_RSP
+    bool isMessage(NciMessageId theMessageId) const;                                         // Is the msg in the rxBuffer of this type ?
+    static NciMessageId classifyMessage(const uint8_t header[]);                             // dispatch table lookup for a received packet
     void setTimeOut(unsigned long);                                                          // set a timeOut for an expected next event, eg reception of Response after sending a Command
     bool isTimeOut() const;                                                                  // Chech if we have exceeded the timeOut
-
-    static constexpr unsigned long scanPeriod = 1000;        // lenght of a scan for tags cycle, in milliseconds. Note : setting this to very short times, eg. < 100 ms will not work, because the NFC discovery loop has a certain minumum constrained by the HW protocols
+    void clearTimeOut();                                                                     // disarm the timeOut after handling it, without leaving the state
+    bool isWaitingState() const;                                                             // is the stateMachine in a state where it only reacts to a message or a timeOut
+
+    unsigned long scanPeriod{0};        // lenght of a scan for tags cycle (TOTAL_DURATION), in milliseconds, 0 : NFCC default. Note : setting this to very short times, eg. < 100 ms will not work, because the NFC discovery loop has a certain minumum constrained by the HW protocols
+    static constexpr uint8_t maxNmbrDiscoveryEntries = 8;          // RF_DISCOVER_CMD entries
+    uint8_t discoveryEntries[maxNmbrDiscoveryEntries][2]{{NFC_A_PASSIVE_POLL_MODE, 0x01}, {NFC_B_PASSIVE_POLL_MODE, 0x01}, {NFC_F_PASSIVE_POLL_MODE, 0x01}, {NFC_15693_PASSIVE_POLL_MODE, 0x01}};        // RF Technology and Mode, Frequency
+    uint8_t nmbrOfDiscoveryEntries{4};
+    bool discoveryChanged{false};                                 // technologies or configuration changed : restart discovery to apply them
+    NciConfiguration theConfiguration;                            // what we know of the NFCC's configuration parameters, and what is to be written or read
+    uint8_t lastSetConfigStatus{STATUS_OK};
     static constexpr uint8_t maxNmbrTags      = 3;           // maximum number of (simultaneously present) tags we can keep track of. PN7150 is limited to 3
     Tag theTags[maxNmbrTags];                                // array to store the data of a number of currently present tags. When uniqueIdLenght == 0 it means invalid data in this position of the array
     uint8_t nmbrOfTags = 0;                                  // how many tags are actually in the array
+
+    static constexpr uint8_t maxNmbrConnections = 2;         // Static RF Connection + one created with CORE_CONN_CREATE_CMD
+    NciConnection theConnections[maxNmbrConnections];        // [0] is the Static RF Connection, open while a tag is activated
+    uint8_t maxControlPayloadSize{MaxPayloadSize};           // Max Control Packet Payload Size, from CORE_INIT_RSP
+    uint8_t maxLogicalConnections{0};                        // Max Logical Connections, from CORE_INIT_RSP. The Static RF Connection does not count
+
+    NciMessageId awaitedConnectionResponse{NciMessageId::Unknown};        // CORE_CONN_CREATE_RSP or CORE_CONN_CLOSE_RSP while waiting for it
+    unsigned long connectionCommandStartTime{0};
+    unsigned long connectionCommandStartMicros{0};
+    static constexpr unsigned long connectionCommandTimeOut = 10;        // [ms] fixed, and the ceiling of the adaptive one unless setAdaptiveTimeOuts() sets another
+    unsigned long connectionTimeOut{connectionCommandTimeOut};           // [ms] of the pending one
+    uint8_t closingConnectionId{0};
+    uint8_t lastConnectionStatus{STATUS_OK};
+    uint8_t lastCreatedConnectionId{0};
+    uint8_t *commandResponse{nullptr};        // where the Response to sendCommand() goes
+    uint8_t commandResponseSize{0};
+    uint8_t commandResponseLength{0};
+
+    uint8_t activeInterface{0};                              // RF Interface of the activated tag, from RF_INTF_ACTIVATED_NTF
+    uint8_t activeProtocol{PROTOCOL_UNDETERMINED};           // RF Protocol of the activated tag, from RF_INTF_ACTIVATED_NTF
+    uint8_t activeTagIndex{0};                               // theTags index of the activated tag, or the next one to select
+    NciTagOperation tagOperation{nullptr};
+    void *tagOperationContext{nullptr};
+    unsigned long tagOperationTimeOut{100};                  // [ms]
+    bool tagOperationRunning{false};                         // from the activation of a tag until its operation returns true or times out
+    static constexpr uint8_t activationTimeOut = 50;         // [ms] from RF_DISCOVER_SELECT_RSP until RF_INTF_ACTIVATED_NTF, ISO-DEP activation takes a few RF round trips
+    unsigned long presenceCheckPeriod{0};                    // [ms], 0 : no presence check
+    static constexpr unsigned long presenceCheckTimeOut = 20;        // [ms] the NFCC reports a missing tag after a few ms, this is the safety net
+    static constexpr unsigned long moreDiscoveriesTimeOut = 25;      // [ms] between RF_DISCOVER_NTFs, when multiple tags are found
+    static constexpr unsigned long minDiscoveryTimeOut = 500;        // [ms] no tag within this time, or one discovery period if that is longer : no tags are present
+
+    NciRoundTripTime theRoundTripTimes[nmbrOfSteps];        // per step, from the command until its answer
+    NciRoundTripTime discoveryTimes;                        // from the start of discovery until a tag is found
+    NciRoundTripTime moreDiscoveriesTimes;                  // between RF_DISCOVER_NTFs
+    NciRoundTripTime connectionCommandTimes;                // from createConnection(), closeConnection() or sendCommand() until the response
+    unsigned long stepStartTime{0};                         // micros()
+    unsigned long discoveryStartTime{0};                    // micros()
+    bool adaptiveTimeOuts{false};
+    unsigned long timeOutFloor{3};                          // [ms] millis() ticks, so shorter would time out early
+    uint8_t timeOutDeviations{4};
+    unsigned long timeOutCeiling{0};                        // [ms] 0 : each response's fixed time-out
+    uint8_t presenceCheckBuffer[MsgHeaderSize + 16 + 1];     // answer of the tag to the READ presence check : 16 bytes + status
+    uint32_t nmbrOfPresenceChecks{0};
+    unsigned long removalDetectedTimestamp{0};
+    bool uidOnlyScan{false};
+    bool discoverMapChanged{false};                           // send RF_DISCOVER_MAP_CMD before the next discovery
+
+    bool standbyEnabled{false};
+    bool standbyChanged{false};                               // send the proprietary standby command before the next discovery
+    bool lowPowerCardDetection{false};
+    unsigned long noTagTime{0};                               // [ms]
+    unsigned long powerDownTime{0};                           // [ms], 0 : no power down cycle
+    bool noTagWindowRunning{false};                           // counting down noTagTime
+    NciPowerMode thePowerMode{NciPowerMode::idle};
+    unsigned long powerModeStartTime{0};
+    NciPowerStatistics thePowerStatistics;
+
+    bool booting{false};                                      // from initialize() until discovery runs
+    NciBootPhase theBootPhase{NciBootPhase::venReset};
+    unsigned long bootPhaseStartTime{0};                      // micros()
+    NciBootStatistics theBootStatistics;
+    bool recovering{false};
+    NciRecoveryLevel theRecoveryLevel{NciRecoveryLevel::retry};        // last level tried, while recovering
+    NciState failedState{NciState::End};                              // where it went wrong first, while recovering
+    unsigned long recoveryStartTime{0};                               // micros()
+    NciRecoveryStatistics theRecoveryStatistics;
+
+    static constexpr uint8_t maxNmbrEventHandlers = 4;
+    class EventHandler {
+      public:
+        NciEventHandler handler{nullptr};
+        void *context{nullptr};
+    };
+    EventHandler eventHandlers[maxNmbrEventHandlers];
+    NciState publishedState{NciState::HwResetRfc};                   // state in the last stateChanged event
+    static constexpr unsigned long maxTimeToWait = 0x7FFFFFFF;        // [ms] nextDeadline() when only the IRQ can give us work
+
+    uint8_t lastGenericError{STATUS_OK};
+    uint8_t lastInterfaceError{STATUS_OK};
+    uint32_t nmbrOfInterfaceErrors{0};
+    uint32_t nmbrOfWriteFailures{0};
+    bool commandNotSent{false};        // the command of the step we wait in could not be written, so no answer will come
+    bool rfFieldPresent{false};
+    uint32_t nmbrOfUnhandledNotifications{0};
     void saveTag(uint8_t msgType);
 };
 
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "NciConfiguration.h"
+#include "NCI.h"        // status codes and ProprietaryConfigPrefix
+
+bool NciConfiguration::set(uint16_t parameterId, const uint8_t value[], uint8_t valueLength) {
+    if (valueLength > maxValueLength) {
+        return false;
+    }
+    Entry *theEntry = allocate(parameterId);
+    if (nullptr == theEntry) {
+        return false;
+    }
+    theEntry->setByApplication = true;
+    bool isSame                = (theEntry->valid || theEntry->toWrite) && (theEntry->length == valueLength);
+    for (uint8_t index = 0; isSame && (index < valueLength); index++) {
+        isSame = (theEntry->value[index] == value[index]);
+    }
+    if (isSame) {
+        if (theEntry->valid && !theEntry->toWrite) {
+            theCounters.writesElided++;        // the NFCC has it already
+        }
+        return true;
+    }
+    theEntry->length = valueLength;
+    for (uint8_t index = 0; index < valueLength; index++) {
+        theEntry->value[index] = value[index];
+    }
+    theEntry->valid         = false;
+    theEntry->toWrite       = true;
+    theEntry->toRead        = false;
+    theEntry->writeAttempts = 0;
+    return true;
+}
+
+bool NciConfiguration::get(uint16_t parameterId, uint8_t value[], uint8_t &valueLength) {
+    Entry *theEntry = find(parameterId);
+    if ((nullptr != theEntry) && theEntry->valid) {
+        for (uint8_t index = 0; index < theEntry->length; index++) {
+            value[index] = theEntry->value[index];
+        }
+        valueLength = theEntry->length;
+        theCounters.readsFromCache++;
+        return true;
+    }
+    if (nullptr == theEntry) {
+        theEntry = allocate(parameterId);
+    }
+    if ((nullptr != theEntry) && !theEntry->toWrite) {        // a value being written is known once its write is confirmed
+        theEntry->toRead = true;
+    }
+    return false;
+}
+
+bool NciConfiguration::hasWork() const {
+    return hasParametersToWrite() || hasParametersToRead();
+}
+
+bool NciConfiguration::hasParametersToWrite() const {
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        if (theEntries[index].toWrite && !theEntries[index].inFlight) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NciConfiguration::hasParametersToRead() const {
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        if (theEntries[index].toRead && !theEntries[index].inFlight) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t NciConfiguration::buildSetConfig(uint8_t payload[], uint32_t maxPayloadLength) {
+    // Number of Parameters, then ID, Length, Value for each. NCI Specification V1.0 - Table 8
+    uint32_t length          = 1;
+    uint8_t nmbrOfParameters = 0;
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        Entry &theEntry = theEntries[index];
+        if (!theEntry.toWrite || theEntry.inFlight) {
+            continue;
+        }
+        uint32_t tlvLength = idLength(theEntry.parameterId) + 1U + theEntry.length;
+        if ((length + tlvLength) > maxPayloadLength) {
+            continue;        // goes in the next command, but a smaller one may still fit in this one
+        }
+        if (theEntry.parameterId > 0xFF) {
+            payload[length++] = static_cast<uint8_t>(theEntry.parameterId >> 8);
+        }
+        payload[length++] = static_cast<uint8_t>(theEntry.parameterId & 0xFF);
+        payload[length++] = theEntry.length;
+        for (uint8_t valueIndex = 0; valueIndex < theEntry.length; valueIndex++) {
+            payload[length++] = theEntry.value[valueIndex];
+        }
+        theEntry.inFlight = true;
+        nmbrOfParameters++;
+    }
+    if (0 == nmbrOfParameters) {
+        return 0;
+    }
+    payload[0] = nmbrOfParameters;
+    theCounters.setCommands++;
+    theCounters.parametersWritten += nmbrOfParameters;
+    return length;
+}
+
+void NciConfiguration::setConfigDone(const uint8_t payload[], uint32_t payloadLength) {
+    // Status, Number of Parameters, then the IDs of the parameters which were not accepted. NCI Specification V1.0 - Table 9
+    uint8_t status = (payloadLength > 0) ? payload[0] : STATUS_FAILED;
+    bool isDone    = (STATUS_OK == status) || (STATUS_INVALID_PARAM == status);        // any other status, eg. STATUS_REJECTED : the NFCC did not take any of them
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        Entry &theEntry = theEntries[index];
+        if (theEntry.toWrite && theEntry.inFlight) {
+            theEntry.inFlight = false;
+            theEntry.valid    = isDone;
+            if (isDone) {
+                theEntry.toWrite       = false;
+                theEntry.writeAttempts = 0;
+            } else if (++theEntry.writeAttempts < maxWriteAttempts) {
+                theCounters.writesRetried++;        // stays toWrite, so it goes in the next CORE_SET_CONFIG_CMD
+            } else {
+                theEntry.toWrite       = false;        // give up, we don't know what the NFCC has now. Setting it again makes a new attempt
+                theEntry.writeAttempts = 0;
+                theCounters.writesFailed++;
+            }
+        }
+    }
+    if ((STATUS_INVALID_PARAM == status) && (payloadLength > 1)) {
+        uint32_t offset = 2;
+        for (uint8_t parameter = 0; parameter < payload[1]; parameter++) {
+            uint32_t parameterId = parseId(payload, payloadLength, offset);
+            if (noParameterId == parameterId) {
+                break;
+            }
+            Entry *theEntry = find(static_cast<uint16_t>(parameterId));
+            if (nullptr != theEntry) {
+                theEntry->valid            = false;
+                theEntry->setByApplication = false;        // the NFCC does not accept it, so don't write it again after a reset
+                theEntry->used             = false;        // and free its slot, as getConfigDone() does for a parameter the NFCC does not know
+            }
+        }
+    }
+}
+
+uint32_t NciConfiguration::buildGetConfig(uint8_t payload[], uint32_t maxPayloadLength) {
+    // Number of Parameters, then the IDs. NCI Specification V1.0 - Table 10. The response must fit in a single packet as well, so count the values too
+    uint32_t length          = 1;
+    uint32_t responseLength  = 2;
+    uint8_t nmbrOfParameters = 0;
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        Entry &theEntry = theEntries[index];
+        if (!theEntry.toRead || theEntry.inFlight) {
+            continue;
+        }
+        uint32_t thisIdLength = idLength(theEntry.parameterId);
+        if (((length + thisIdLength) > maxPayloadLength) || ((responseLength + thisIdLength + 1U + maxValueLength) > maxPayloadLength)) {
+            continue;
+        }
+        if (theEntry.parameterId > 0xFF) {
+            payload[length++] = static_cast<uint8_t>(theEntry.parameterId >> 8);
+        }
+        payload[length++] = static_cast<uint8_t>(theEntry.parameterId & 0xFF);
+        responseLength += thisIdLength + 1U + maxValueLength;
+        theEntry.inFlight = true;
+        nmbrOfParameters++;
+    }
+    if (0 == nmbrOfParameters) {
+        return 0;
+    }
+    payload[0] = nmbrOfParameters;
+    theCounters.getCommands++;
+    return length;
+}
+
+void NciConfiguration::getConfigDone(const uint8_t payload[], uint32_t payloadLength) {
+    // Status, Number of Parameters, then ID, Length, Value for each. NCI Specification V1.0 - Table 11
+    // With STATUS_INVALID_PARAM, only the parameters the NFCC does not know are listed, with Length 0
+    uint8_t status = (payloadLength > 0) ? payload[0] : STATUS_FAILED;
+    if (((STATUS_OK == status) || (STATUS_INVALID_PARAM == status)) && (payloadLength > 1)) {
+        uint32_t offset = 2;
+        for (uint8_t parameter = 0; parameter < payload[1]; parameter++) {
+            uint32_t parameterId = parseId(payload, payloadLength, offset);
+            if ((noParameterId == parameterId) || (offset >= payloadLength) || ((offset + 1U + payload[offset]) > payloadLength)) {
+                break;
+            }
+            uint8_t valueLength = payload[offset++];
+            Entry *theEntry     = find(static_cast<uint16_t>(parameterId));
+            if ((nullptr != theEntry) && theEntry->toRead && theEntry->inFlight) {
+                theEntry->toRead   = false;
+                theEntry->inFlight = false;
+                if ((STATUS_OK == status) && (valueLength <= maxValueLength)) {
+                    theEntry->length = valueLength;
+                    for (uint8_t index = 0; index < valueLength; index++) {
+                        theEntry->value[index] = payload[offset + index];
+                    }
+                    theEntry->valid = true;
+                    theCounters.parametersRead++;
+                } else {
+                    theEntry->used = theEntry->setByApplication;        // unknown to the NFCC, or too long for us : give up on it
+                }
+            }
+            offset += valueLength;
+        }
+    }
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        Entry &theEntry = theEntries[index];
+        if (theEntry.toRead && theEntry.inFlight) {
+            theEntry.inFlight = false;        // with STATUS_INVALID_PARAM, the ones not listed are fine : they go in the next CORE_GET_CONFIG_CMD
+            if (STATUS_INVALID_PARAM != status) {
+                theEntry.toRead = false;
+                theEntry.used   = theEntry.setByApplication;
+            }
+        }
+    }
+}
+
+void NciConfiguration::abort() {
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        theEntries[index].inFlight = false;
+    }
+}
+
+void NciConfiguration::configurationLost() {
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        Entry &theEntry   = theEntries[index];
+        theEntry.inFlight = false;
+        if (theEntry.setByApplication && (theEntry.valid || theEntry.toWrite)) {
+            theEntry.valid   = false;
+            theEntry.toWrite = true;
+        } else if (theEntry.toRead) {
+            theEntry.valid = false;
+        } else {
+            theEntry.used = false;
+        }
+    }
+}
+
+const NciConfigCounters &NciConfiguration::getCounters() const {
+    return theCounters;
+}
+
+void NciConfiguration::resetCounters() {
+    theCounters = NciConfigCounters();
+}
+
+NciConfiguration::Entry *NciConfiguration::find(uint16_t parameterId) {
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        if (theEntries[index].used && (parameterId == theEntries[index].parameterId)) {
+            return &theEntries[index];
+        }
+    }
+    return nullptr;
+}
+
+NciConfiguration::Entry *NciConfiguration::allocate(uint16_t parameterId) {
+    Entry *theEntry = find(parameterId);
+    if (nullptr != theEntry) {
+        return theEntry;
+    }
+    for (uint32_t index = 0; index < nmbrOfEntries; index++) {
+        if (!theEntries[index].used) {
+            theEntry              = &theEntries[index];
+            *theEntry             = Entry();
+            theEntry->used        = true;
+            theEntry->parameterId = parameterId;
+            return theEntry;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t NciConfiguration::idLength(uint16_t parameterId) {
+    return (parameterId > 0xFF) ? 2U : 1U;
+}
+
+uint32_t NciConfiguration::parseId(const uint8_t payload[], uint32_t payloadLength, uint32_t &offset) {
+    if (offset >= payloadLength) {
+        return noParameterId;
+    }
+    uint32_t parameterId = payload[offset++];
+    if (ProprietaryConfigPrefix == parameterId) {
+        if (offset >= payloadLength) {
+            return noParameterId;
+        }
+        parameterId = (parameterId << 8) | payload[offset++];
+    }
+    return parameterId;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Shadow of the NFCC's Configuration Parameters (CORE_SET_CONFIG / CORE_GET_CONFIG, NCI Specification V1.0 - section 4.3), kept at the DeviceHost.
+//   * Setting a parameter to the value the NFCC already has costs nothing. Changed parameters are written together, packed into as few
+//     CORE_SET_CONFIG_CMDs as the Max Control Packet Payload Size allows
+//   * Reading a parameter whose value is known comes from the shadow. Unknown ones are read together with CORE_GET_CONFIG_CMD
+//   * When the NFCC keeps its configuration through a reset, so does the shadow. When it loses it, the parameters set by the application are written again
+//   * A CORE_SET_CONFIG_CMD which fails as a whole is sent again, up to maxWriteAttempts times, then its parameters are counted as failed
+//
+//   Parameter IDs above 0xFF are the 2-byte PN7150 proprietary ones, see ProprietaryConfigPrefix.
+//   The number of parameters and their maximum length can be set at build time with -D NciConfigEntries=<n> and -D NciConfigMaxValueLength=<n>
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+
+#ifndef NciConfigEntries
+#if defined(__AVR__)
+#define NciConfigEntries 8
+#else
+#define NciConfigEntries 16
+#endif
+#endif
+
+#ifndef NciConfigMaxValueLength
+#define NciConfigMaxValueLength 8
+#endif
+
+class NciConfigCounters {
+  public:
+    uint32_t setCommands{0};              // CORE_SET_CONFIG_CMDs sent
+    uint32_t parametersWritten{0};        // TLVs in them
+    uint32_t writesElided{0};             // parameters set to the value the NFCC already had, so not sent
+    uint32_t getCommands{0};              // CORE_GET_CONFIG_CMDs sent
+    uint32_t parametersRead{0};           // parameters the NFCC returned in them
+    uint32_t readsFromCache{0};           // reads answered from the shadow, without asking the NFCC
+    uint32_t writesRetried{0};            // parameters written again, after CORE_SET_CONFIG_RSP failed without saying which ones
+    uint32_t writesFailed{0};             // parameters given up on after maxWriteAttempts failed writes. The NFCC keeps what it had
+};
+
+class NciConfiguration {
+  public:
+    static constexpr uint32_t nmbrOfEntries   = NciConfigEntries;
+    static constexpr uint8_t maxValueLength   = NciConfigMaxValueLength;
+    static constexpr uint8_t maxWriteAttempts = 3;        // writes of a parameter before giving up, when each CORE_SET_CONFIG_RSP fails as a whole, eg. STATUS_REJECTED
+
+    bool set(uint16_t parameterId, const uint8_t value[], uint8_t valueLength);        // false if it does not fit. Written with the next CORE_SET_CONFIG, unless the NFCC has this value already
+    bool get(uint16_t parameterId, uint8_t value[], uint8_t &valueLength);             // true if the value is known. If not, it is read with the next CORE_GET_CONFIG
+    bool hasWork() const;                                                               // are there parameters to write or to read
+    bool hasParametersToWrite() const;
+    bool hasParametersToRead() const;
+
+    uint32_t buildSetConfig(uint8_t payload[], uint32_t maxPayloadLength);        // CORE_SET_CONFIG_CMD payload with as many parameters to write as fit, returns its length
+    void setConfigDone(const uint8_t payload[], uint32_t payloadLength);          // CORE_SET_CONFIG_RSP payload : rejected parameters are no longer known, after any other failure they are written again
+    uint32_t buildGetConfig(uint8_t payload[], uint32_t maxPayloadLength);        // CORE_GET_CONFIG_CMD payload with as many parameters to read as fit, returns its length
+    void getConfigDone(const uint8_t payload[], uint32_t payloadLength);          // CORE_GET_CONFIG_RSP payload : the returned values are known
+    void abort();                                                                 // the command in progress got no response, try again later
+    void configurationLost();                                                     // the NFCC reset its configuration : write what the application set again, forget the rest
+
+    const NciConfigCounters &getCounters() const;
+    void resetCounters();
+
+  private:
+    class Entry {
+      public:
+        uint16_t parameterId{0};
+        uint8_t length{0};
+        uint8_t value[maxValueLength];
+        bool used{false};
+        bool valid{false};           // value is what the NFCC has
+        bool toWrite{false};         // value is what the application wants, the NFCC does not have it yet
+        bool toRead{false};          // the application asked for the value, the NFCC has not told us yet
+        bool inFlight{false};        // part of the CORE_SET_CONFIG_CMD or CORE_GET_CONFIG_CMD waiting for its response
+        bool setByApplication{false};        // written again when the NFCC loses its configuration
+        uint8_t writeAttempts{0};            // failed writes of this value so far
+    };
+    Entry theEntries[nmbrOfEntries];
+    NciConfigCounters theCounters;
+
+    Entry *find(uint16_t parameterId);
+    Entry *allocate(uint16_t parameterId);        // the existing entry, or a free one. nullptr if all are used
+    static uint32_t idLength(uint16_t parameterId);        // 1, or 2 for proprietary parameters
+    static constexpr uint32_t noParameterId = 0xFFFF;
+    static uint32_t parseId(const uint8_t payload[], uint32_t payloadLength, uint32_t &offset);        // reads a 1 or 2 byte Parameter ID, noParameterId if the payload ends
+};
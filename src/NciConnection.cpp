@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "NciConnection.h"
+
+void NciConnection::open(uint8_t theConnectionId, uint8_t theMaxPayloadSize, uint8_t initialCredits) {
+    opened         = true;
+    nmbrOfOpens++;
+    connectionId   = theConnectionId;
+    maxPayloadSize = theMaxPayloadSize;
+    flowControl    = (noFlowControl != initialCredits);
+    credits        = flowControl ? initialCredits : 0;
+    txLevel        = 0;
+    txOffset       = 0;
+}
+
+void NciConnection::close() {
+    opened        = false;
+    receiveBuffer = nullptr;        // the application's buffers are no longer ours
+    txLevel       = 0;
+    txOffset      = 0;
+}
+
+bool NciConnection::isOpen() const {
+    return opened;
+}
+
+uint32_t NciConnection::getNmbrOfOpens() const {
+    return nmbrOfOpens;
+}
+
+uint8_t NciConnection::getConnectionId() const {
+    return connectionId;
+}
+
+uint8_t NciConnection::getMaxPayloadSize() const {
+    return maxPayloadSize;
+}
+
+bool NciConnection::queueTransmit(const uint8_t data[], uint32_t dataLength) {
+    if (!opened || (0 == maxPayloadSize) || (txLevel >= txQueueDepth)) {
+        return false;
+    }
+    TxMessage &theMessage = txQueue[(txHead + txLevel) % txQueueDepth];
+    theMessage.data       = data;
+    theMessage.length     = dataLength;
+    txLevel++;
+    if ((1 == txLevel) && flowControl && (0 == credits)) {
+        nmbrOfCreditStalls++;
+    }
+    return true;
+}
+
+bool NciConnection::hasSegmentToSend() const {
+    return (txLevel > 0) && (!flowControl || (credits > 0));
+}
+
+const uint8_t *NciConnection::getNextSegment(uint32_t &segmentLength, bool &isLastSegment) const {
+    const TxMessage &theMessage = txQueue[txHead];
+    segmentLength               = theMessage.length - txOffset;
+    isLastSegment               = (segmentLength <= maxPayloadSize);
+    if (!isLastSegment) {
+        segmentLength = maxPayloadSize;
+    }
+    return theMessage.data + txOffset;
+}
+
+void NciConnection::segmentSent(uint32_t segmentLength) {
+    nmbrOfSegmentsSent++;
+    if (flowControl) {
+        credits--;
+    }
+    txOffset += segmentLength;
+    if (txOffset >= txQueue[txHead].length) {        // whole message sent, next one
+        txHead   = (txHead + 1) % txQueueDepth;
+        txLevel--;
+        txOffset = 0;
+    }
+    if ((txLevel > 0) && flowControl && (0 == credits)) {
+        nmbrOfCreditStalls++;
+    }
+}
+
+void NciConnection::addCredits(uint8_t nmbrOfCredits) {
+    uint32_t total = credits + nmbrOfCredits;
+    credits        = (total > 0xFE) ? 0xFE : static_cast<uint8_t>(total);
+}
+
+uint8_t NciConnection::getCredits() const {
+    return credits;
+}
+
+bool NciConnection::isTransmitDone() const {
+    return (0 == txLevel);
+}
+
+uint32_t NciConnection::getNmbrOfSegmentsSent() const {
+    return nmbrOfSegmentsSent;
+}
+
+uint32_t NciConnection::getNmbrOfCreditStalls() const {
+    return nmbrOfCreditStalls;
+}
+
+void NciConnection::setReceiveBuffer(uint8_t buffer[], uint32_t bufferSize, uint32_t nmbrOfMessages) {
+    receiveBuffer          = buffer;
+    receiveBufferSize      = bufferSize;
+    receivedLength         = 0;
+    nmbrOfMessagesExpected = nmbrOfMessages;
+    nmbrOfMessagesReceived = 0;
+    messageReceived        = false;
+    overflow               = false;
+}
+
+bool NciConnection::isReceiving() const {
+    return opened && (nullptr != receiveBuffer) && !messageReceived;
+}
+
+uint8_t *NciConnection::getReceiveDestination(uint32_t payloadLength) {
+    if (!isReceiving() || ((receivedLength + payloadLength) > receiveBufferSize)) {
+        return nullptr;
+    }
+    return receiveBuffer + receivedLength;
+}
+
+void NciConnection::segmentReceived(uint32_t payloadLength, bool isLastSegment) {
+    if ((receivedLength + payloadLength) <= receiveBufferSize) {
+        receivedLength += payloadLength;
+    } else {
+        overflow = true;
+    }
+    if (isLastSegment) {
+        nmbrOfMessagesReceived++;
+        messageReceived = (nmbrOfMessagesReceived >= nmbrOfMessagesExpected);
+    }
+}
+
+bool NciConnection::isMessageReceived() const {
+    return messageReceived;
+}
+
+uint32_t NciConnection::getNmbrOfMessagesReceived() const {
+    return nmbrOfMessagesReceived;
+}
+
+uint32_t NciConnection::getReceivedLength() const {
+    return receivedLength;
+}
+
+bool NciConnection::isOverflow() const {
+    return overflow;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   An NCI Logical Connection, over which Data packets are exchanged. See NCI specification V1.0, section 4.4
+//   Connection 0 is the Static RF Connection, which opens when a tag is activated (RF_INTF_ACTIVATED_NTF)
+//
+//   Data messages longer than the Max Data Packet Payload Size are segmented using the Packet Boundary Flag. On reception, the segments are
+//   reassembled straight into a buffer supplied by the application : the payload of each segment is read from the bus into its final place.
+//
+//   Sending is credit based (NCI specification V1.0, section 4.4.4) : every Data packet takes one credit, and the NFCC gives credits back with
+//   CORE_CONN_CREDITS_NTF. Messages to send are queued as references to the application's buffers, and their segments go out as soon as there
+//   are credits, so the NFCC's buffers can be kept full instead of waiting for each exchange to complete.
+//   The queue depth can be set at build time with -D NciTxQueueDepth=<n>. The application keeps its buffers unchanged until isTransmitDone()
+//
+//   A receive buffer can also take several Data messages in a row, each appended to the previous one : the answers to a burst of queued messages
+//   are then all collected, without the application having to supply a new buffer between them.
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+
+#ifndef NciTxQueueDepth
+#define NciTxQueueDepth 2
+#endif
+
+class NciConnection {
+  public:
+    static constexpr uint8_t staticRfConnection = 0x00;        // connection ID of the Static RF Connection
+    static constexpr uint8_t noFlowControl      = 0xFF;        // Initial Number of Credits value meaning the NFCC does not use flow control. NCI Specification V1.0 - Table 61
+    static constexpr uint32_t txQueueDepth      = NciTxQueueDepth;
+
+    void open(uint8_t connectionId, uint8_t maxPayloadSize, uint8_t initialCredits);        // connection established, with the Max Data Packet Payload Size and credits the NFCC reported
+    void close();                                                                           // connection closed, or RF deactivated : queued messages are dropped
+    bool isOpen() const;
+    uint8_t getConnectionId() const;
+    uint8_t getMaxPayloadSize() const;                              // largest payload of a single Data packet on this connection
+    uint32_t getNmbrOfOpens() const;                                // changes each time it opens, eg. to tell a new activation from the previous one
+
+    // Credit based sending of Data messages
+    bool queueTransmit(const uint8_t data[], uint32_t dataLength);        // false if the connection is closed or the queue is full
+    bool hasSegmentToSend() const;                                        // is there data queued, and a credit to send it with
+    const uint8_t *getNextSegment(uint32_t &segmentLength, bool &isLastSegment) const;        // the next segment to send, only valid if hasSegmentToSend()
+    void segmentSent(uint32_t segmentLength);                             // the segment has been written to the NFCC, it took one credit
+    void addCredits(uint8_t nmbrOfCredits);                               // from CORE_CONN_CREDITS_NTF
+    uint8_t getCredits() const;
+    bool isTransmitDone() const;                                          // all queued messages have been written to the NFCC, their buffers can be reused
+    uint32_t getNmbrOfSegmentsSent() const;
+    uint32_t getNmbrOfCreditStalls() const;                               // how many times data was waiting for a credit from the NFCC
+
+    // Reassembly of received Data messages
+    void setReceiveBuffer(uint8_t buffer[], uint32_t bufferSize, uint32_t nmbrOfMessages = 1);        // the next Data message(s) received go here, one after the other
+    bool isReceiving() const;                                            // is there a buffer waiting for (more) data
+    uint8_t *getReceiveDestination(uint32_t payloadLength);              // where the next segment's payload goes, nullptr if it does not fit
+    void segmentReceived(uint32_t payloadLength, bool isLastSegment);    // a segment's payload has been read into the receive buffer
+    bool isMessageReceived() const;                                      // has the last segment of the message, or of all nmbrOfMessages, arrived
+    uint32_t getNmbrOfMessagesReceived() const;                          // complete messages in the buffer so far
+    uint32_t getReceivedLength() const;                                  // length of the reassembled message
+    bool isOverflow() const;                                             // the message was longer than the buffer, the excess is lost
+
+  private:
+    bool opened{false};
+    uint8_t connectionId{staticRfConnection};
+    uint8_t maxPayloadSize{0};
+    uint8_t credits{0};
+    bool flowControl{true};
+    uint32_t nmbrOfOpens{0};
+
+    class TxMessage {
+      public:
+        const uint8_t *data;
+        uint32_t length;
+    };
+    TxMessage txQueue[txQueueDepth];        // messages waiting to be sent, as a ring
+    uint32_t txHead{0};                     // index of the message being sent
+    uint32_t txLevel{0};                    // number of messages in the queue
+    uint32_t txOffset{0};                   // how much of the first message has been sent already
+    uint32_t nmbrOfSegmentsSent{0};
+    uint32_t nmbrOfCreditStalls{0};
+
+    uint8_t *receiveBuffer{nullptr};
+    uint32_t receiveBufferSize{0};
+    uint32_t receivedLength{0};
+    uint32_t nmbrOfMessagesExpected{1};
+    uint32_t nmbrOfMessagesReceived{0};
+    bool messageReceived{false};
+    bool overflow{false};
+};
@@ -0,0 +1,372 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "NciCoroutine.h"
+
+#if defined(NciCoroutinesAvailable)
+
+alignas(max_align_t) uint8_t NciFramePool::theFrames[nmbrOfFrames][frameSize];
+bool NciFramePool::inUse[nmbrOfFrames];
+uint32_t NciFramePool::nmbrOfFailures;
+size_t NciFramePool::largestRequest;
+
+void *NciFramePool::allocate(size_t size) {
+    if (size > largestRequest) {
+        largestRequest = size;
+    }
+    if (size <= frameSize) {
+        for (uint32_t index = 0; index < nmbrOfFrames; index++) {
+            if (!inUse[index]) {
+                inUse[index] = true;
+                return theFrames[index];
+            }
+        }
+    }
+    nmbrOfFailures++;
+    return nullptr;
+}
+
+void NciFramePool::release(void *frame) {
+    for (uint32_t index = 0; index < nmbrOfFrames; index++) {
+        if (frame == theFrames[index]) {
+            inUse[index] = false;
+        }
+    }
+}
+
+uint32_t NciFramePool::getNmbrInUse() {
+    uint32_t nmbrInUse = 0;
+    for (uint32_t index = 0; index < nmbrOfFrames; index++) {
+        if (inUse[index]) {
+            nmbrInUse++;
+        }
+    }
+    return nmbrInUse;
+}
+
+uint32_t NciFramePool::getNmbrOfFailures() {
+    return nmbrOfFailures;
+}
+
+size_t NciFramePool::getLargestRequest() {
+    return largestRequest;
+}
+
+void *NciTask::promise_type::operator new(size_t size) noexcept {
+    return NciFramePool::allocate(size);
+}
+
+void NciTask::promise_type::operator delete(void *frame) noexcept {
+    NciFramePool::release(frame);
+}
+
+NciTask NciTask::promise_type::get_return_object_on_allocation_failure() noexcept {
+    return NciTask(nullptr);
+}
+
+NciTask NciTask::promise_type::get_return_object() noexcept {
+    return NciTask(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+std::suspend_never NciTask::promise_type::initial_suspend() noexcept {
+    return {};
+}
+
+std::suspend_always NciTask::promise_type::final_suspend() noexcept {
+    return {};
+}
+
+void NciTask::promise_type::return_void() noexcept {}
+
+void NciTask::promise_type::unhandled_exception() noexcept {}
+
+NciTask::NciTask(std::coroutine_handle<promise_type> aHandle) : theHandle(aHandle) {}
+
+NciTask::NciTask(NciTask &&other) noexcept : theHandle(other.theHandle) {
+    other.theHandle = nullptr;
+}
+
+NciTask &NciTask::operator=(NciTask &&other) noexcept {
+    if (this != &other) {
+        if (theHandle) {
+            theHandle.destroy();
+        }
+        theHandle       = other.theHandle;
+        other.theHandle = nullptr;
+    }
+    return *this;
+}
+
+NciTask::~NciTask() {
+    if (theHandle) {
+        theHandle.destroy();        // destroys the awaiter it waits on as well, which stops the waiting
+    }
+}
+
+bool NciTask::isValid() const {
+    return static_cast<bool>(theHandle);
+}
+
+bool NciTask::isDone() const {
+    return !theHandle || theHandle.done();
+}
+
+NciAwaiter::NciAwaiter(NciCoroutines &aScheduler, unsigned long theTimeOut) : theScheduler(aScheduler), startTime(millis()), timeOut(theTimeOut) {}
+
+NciAwaiter::~NciAwaiter() {
+    theScheduler.remove(this);
+}
+
+bool NciAwaiter::await_ready() noexcept {
+    return poll();
+}
+
+bool NciAwaiter::await_suspend(std::coroutine_handle<> aHandle) noexcept {
+    theHandle = aHandle;
+    if (!theScheduler.add(this)) {
+        onTimeOut();
+        expired = true;
+        return false;        // nowhere to wait : it fails right away, as if it timed out
+    }
+    return true;
+}
+
+void NciAwaiter::onEvent(const NciEvent &theEvent) {
+    (void)theEvent;
+}
+
+void NciAwaiter::onTimeOut() {}
+
+NciCommandAwaiter::NciCommandAwaiter(NciCoroutines &aScheduler, uint8_t theGroupId, uint8_t theOpcodeId, const uint8_t thePayload[], uint8_t thePayloadLength, uint8_t theResponse[], uint8_t theResponseSize, unsigned long theTimeOut) : NciAwaiter(aScheduler, theTimeOut), groupId(theGroupId), opcodeId(theOpcodeId), payload(thePayload), payloadLength(thePayloadLength), response(theResponse), responseSize(theResponseSize) {}
+
+NciCommandAwaiter::~NciCommandAwaiter() {
+    if (responsePending) {
+        onTimeOut();
+    }
+}
+
+bool NciCommandAwaiter::poll() {
+    NCI &theNci = theScheduler.getNci();
+    if (!sent) {
+        sent            = theNci.sendCommand(groupId, opcodeId, payload, payloadLength, response, responseSize);
+        responsePending = sent;
+        return false;
+    }
+    if (theNci.isConnectionCommandPending()) {
+        return false;
+    }
+    responsePending = false;
+    status          = theNci.getLastConnectionStatus();
+    return true;
+}
+
+void NciCommandAwaiter::onTimeOut() {
+    if (responsePending) {
+        theScheduler.getNci().releaseCommandResponse(response);        // the response buffer goes when the coroutine does. The NCI still waits for the Response, so nobody sends a command before it
+        responsePending = false;
+    }
+}
+
+uint8_t NciCommandAwaiter::await_resume() const noexcept {
+    return expired ? STATUS_FAILED : status;
+}
+
+NciNotificationAwaiter::NciNotificationAwaiter(NciCoroutines &aScheduler, NciMessageId aNotification, uint8_t thePayload[], uint8_t thePayloadSize, unsigned long theTimeOut) : NciAwaiter(aScheduler, theTimeOut), theNotification(aNotification), payload(thePayload), payloadSize(thePayloadSize) {}
+
+bool NciNotificationAwaiter::poll() {
+    return ready;
+}
+
+void NciNotificationAwaiter::onEvent(const NciEvent &theEvent) {
+    if (ready || (NciEventType::notification != theEvent.type) || (theNotification != theEvent.messageId)) {
+        return;
+    }
+    for (uint32_t index = 0; (index < theEvent.payloadLength) && (index < payloadSize); index++) {
+        payload[index] = theEvent.payload[index];
+    }
+    ready = true;
+}
+
+bool NciNotificationAwaiter::await_resume() const noexcept {
+    return !expired;
+}
+
+NciEventAwaiter::NciEventAwaiter(NciCoroutines &aScheduler, NciEventType aType, unsigned long theTimeOut) : NciAwaiter(aScheduler, theTimeOut), theType(aType) {}
+
+bool NciEventAwaiter::poll() {
+    return ready;
+}
+
+void NciEventAwaiter::onEvent(const NciEvent &theEvent) {
+    if (theType == theEvent.type) {
+        ready = true;
+    }
+}
+
+bool NciEventAwaiter::await_resume() const noexcept {
+    return !expired;
+}
+
+NciTransceiveAwaiter::NciTransceiveAwaiter(NciCoroutines &aScheduler, const uint8_t theData[], uint32_t theDataLength, uint8_t theResponse[], uint32_t theResponseSize, unsigned long theTimeOut) : NciAwaiter(aScheduler, theTimeOut), data(theData), dataLength(theDataLength), response(theResponse), responseSize(theResponseSize) {}
+
+NciTransceiveAwaiter::~NciTransceiveAwaiter() {
+    if (started) {
+        onTimeOut();
+    }
+}
+
+bool NciTransceiveAwaiter::poll() {
+    NCI &theNci                         = theScheduler.getNci();
+    const NciConnection &theConnection = theNci.getRfConnection();
+    if (!started) {
+        if (!theConnection.isOpen()) {
+            return true;        // no tag activated
+        }
+        theNci.setDataReceiveBuffer(response, responseSize);
+        if (!theNci.sendData(data, dataLength)) {
+            theNci.setDataReceiveBuffer(nullptr, 0);
+            return true;
+        }
+        started = true;
+        return false;
+    }
+    if (theConnection.isMessageReceived()) {
+        responseLength = theConnection.getReceivedLength();
+        theNci.setDataReceiveBuffer(nullptr, 0);
+        started = false;
+        return true;
+    }
+    if (!theConnection.isOpen()) {
+        started = false;
+        return true;        // the tag left, and the connection closed with it
+    }
+    return false;
+}
+
+void NciTransceiveAwaiter::onTimeOut() {
+    if (started) {
+        theScheduler.getNci().setDataReceiveBuffer(nullptr, 0);        // the response buffer goes when the coroutine does
+        started = false;
+    }
+}
+
+uint32_t NciTransceiveAwaiter::await_resume() const noexcept {
+    return expired ? 0 : responseLength;
+}
+
+NciWaitAwaiter::NciWaitAwaiter(NciCoroutines &aScheduler, unsigned long theTime) : NciAwaiter(aScheduler, theTime) {}
+
+bool NciWaitAwaiter::poll() {
+    return false;        // only the timeOut ends it
+}
+
+NciCoroutines::NciCoroutines(NCI &aNci) : theNci(aNci) {
+    (void)theNci.addEventHandler(handleEvent, this);
+}
+
+NciCoroutines::~NciCoroutines() {
+    theNci.removeEventHandler(handleEvent, this);
+}
+
+void NciCoroutines::run() {
+    for (uint32_t index = 0; index < maxNmbrWaiting; index++) {
+        NciAwaiter *theAwaiter = waiting[index];
+        if (nullptr == theAwaiter) {
+            continue;
+        }
+        bool isDone = theAwaiter->poll();
+        if (!isDone && ((millis() - theAwaiter->startTime) >= theAwaiter->timeOut)) {
+            theAwaiter->onTimeOut();
+            theAwaiter->expired = true;
+            isDone              = true;
+        }
+        if (isDone) {
+            waiting[index] = nullptr;        // the coroutine may wait again, in this slot
+            nmbrOfResumes++;
+            theAwaiter->theHandle.resume();
+        }
+    }
+}
+
+unsigned long NciCoroutines::nextDeadline() const {
+    unsigned long now        = millis();
+    unsigned long timeToWait = 0x7FFFFFFF;        // nobody waiting : only the NCI can give us work
+    for (uint32_t index = 0; index < maxNmbrWaiting; index++) {
+        const NciAwaiter *theAwaiter = waiting[index];
+        if (nullptr == theAwaiter) {
+            continue;
+        }
+        unsigned long elapsed = now - theAwaiter->startTime;
+        if (theAwaiter->ready || (elapsed >= theAwaiter->timeOut)) {
+            return now;
+        }
+        if ((theAwaiter->timeOut - elapsed) < timeToWait) {
+            timeToWait = theAwaiter->timeOut - elapsed;
+        }
+    }
+    return now + timeToWait;
+}
+
+NCI &NciCoroutines::getNci() {
+    return theNci;
+}
+
+uint32_t NciCoroutines::getNmbrOfResumes() const {
+    return nmbrOfResumes;
+}
+
+NciCommandAwaiter NciCoroutines::command(uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint8_t payloadLength, uint8_t response[], uint8_t responseSize, unsigned long timeOut) {
+    return NciCommandAwaiter(*this, groupId, opcodeId, payload, payloadLength, response, responseSize, timeOut);
+}
+
+NciNotificationAwaiter NciCoroutines::notification(NciMessageId theNotification, uint8_t payload[], uint8_t payloadSize, unsigned long timeOut) {
+    return NciNotificationAwaiter(*this, theNotification, payload, payloadSize, timeOut);
+}
+
+NciEventAwaiter NciCoroutines::event(NciEventType theType, unsigned long timeOut) {
+    return NciEventAwaiter(*this, theType, timeOut);
+}
+
+NciTransceiveAwaiter NciCoroutines::transceive(const uint8_t data[], uint32_t dataLength, uint8_t response[], uint32_t responseSize, unsigned long timeOut) {
+    return NciTransceiveAwaiter(*this, data, dataLength, response, responseSize, timeOut);
+}
+
+NciWaitAwaiter NciCoroutines::wait(unsigned long time) {
+    return NciWaitAwaiter(*this, time);
+}
+
+bool NciCoroutines::add(NciAwaiter *theAwaiter) {
+    for (uint32_t index = 0; index < maxNmbrWaiting; index++) {
+        if (nullptr == waiting[index]) {
+            waiting[index] = theAwaiter;
+            return true;
+        }
+    }
+    return false;
+}
+
+void NciCoroutines::remove(NciAwaiter *theAwaiter) {
+    for (uint32_t index = 0; index < maxNmbrWaiting; index++) {
+        if (theAwaiter == waiting[index]) {
+            waiting[index] = nullptr;
+        }
+    }
+}
+
+void NciCoroutines::handleEvent(const NciEvent &theEvent, void *context) {
+    NciCoroutines *theScheduler = static_cast<NciCoroutines *>(context);
+    for (uint32_t index = 0; index < maxNmbrWaiting; index++) {
+        if (nullptr != theScheduler->waiting[index]) {
+            theScheduler->waiting[index]->onEvent(theEvent);
+        }
+    }
+}
+#endif
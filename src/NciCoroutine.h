@@ -0,0 +1,224 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Optional C++20 coroutine layer on top of the NCI stateMachine. A sequence of commands, notifications and Data exchanges is written as one function,
+//   instead of being spread over NciStates :
+//
+//       NciTask readBlock(NciCoroutines &nfc) {
+//           if (!co_await nfc.event(NciEventType::tagArrived, 5000)) {
+//               co_return;
+//           }
+//           static const uint8_t read[] = {0x30, 0x04};
+//           uint8_t answer[17];
+//           uint32_t length = co_await nfc.transceive(read, sizeof(read), answer, sizeof(answer), 20);
+//           ...
+//       }
+//
+//   The application calls NciCoroutines::run() right after NCI::run(). It resumes the coroutines whose answer has come, or whose timeOut expired.
+//   Commands go to the NFCC with NCI::sendCommand(), so the stateMachine keeps running : discovery, presence checks, .. go on while a coroutine waits.
+//
+//   Coroutine frames come from a fixed pool, nothing is allocated from the heap. The pool can be sized at build time with -D NciCoroutineFrames=<n> and
+//   -D NciCoroutineFrameSize=<bytes>. When no frame is free, or the coroutine needs a larger one, the NciTask is not valid and the coroutine does not run.
+//   A coroutine waits for one thing at a time, so there are as many waiting slots as frames.
+//
+//   Only compiled when the compiler supports C++20 coroutines, eg. -std=c++20. Otherwise this header is empty, nothing else in the library depends on it.
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define NciCoroutinesAvailable
+#endif
+#endif
+
+#if defined(NciCoroutinesAvailable)
+#include <stdint.h>        // Gives us access to uint8_t types etc
+#include <stddef.h>        // size_t, max_align_t
+#include <coroutine>
+#include "NCI.h"
+
+#ifndef NciCoroutineFrames
+#define NciCoroutineFrames 2
+#endif
+
+#ifndef NciCoroutineFrameSize
+#define NciCoroutineFrameSize 256
+#endif
+
+class NciFramePool {
+  public:
+    static constexpr uint32_t nmbrOfFrames = NciCoroutineFrames;
+    static constexpr uint32_t frameSize    = NciCoroutineFrameSize;
+
+    static void *allocate(size_t size);        // nullptr if it does not fit in a frame, or all frames are in use
+    static void release(void *frame);
+    static uint32_t getNmbrInUse();
+    static uint32_t getNmbrOfFailures();        // coroutines which could not start
+    static size_t getLargestRequest();          // largest frame a coroutine asked for, to tune NciCoroutineFrameSize
+
+  private:
+    alignas(max_align_t) static uint8_t theFrames[nmbrOfFrames][frameSize];
+    static bool inUse[nmbrOfFrames];
+    static uint32_t nmbrOfFailures;
+    static size_t largestRequest;
+};
+
+class NciTask {
+  public:
+    class promise_type {
+      public:
+        static void *operator new(size_t size) noexcept;        // from the NciFramePool
+        static void operator delete(void *frame) noexcept;
+        static NciTask get_return_object_on_allocation_failure() noexcept;
+        NciTask get_return_object() noexcept;
+        std::suspend_never initial_suspend() noexcept;         // runs until its first co_await
+        std::suspend_always final_suspend() noexcept;          // the frame stays until the NciTask goes, so isDone() can be asked
+        void return_void() noexcept;
+        void unhandled_exception() noexcept;
+    };
+
+    NciTask(NciTask &&other) noexcept;
+    NciTask &operator=(NciTask &&other) noexcept;
+    NciTask(const NciTask &)            = delete;
+    NciTask &operator=(const NciTask &) = delete;
+    ~NciTask();                 // destroys the coroutine, also when it did not finish : it stops waiting
+    bool isValid() const;        // false if there was no frame for it
+    bool isDone() const;         // it ran to its end, or never started
+
+  private:
+    explicit NciTask(std::coroutine_handle<promise_type> theHandle);
+    std::coroutine_handle<promise_type> theHandle;
+};
+
+class NciCoroutines;
+
+class NciAwaiter {
+  public:
+    bool await_ready() noexcept;                                    // true if it completed right away
+    bool await_suspend(std::coroutine_handle<> theHandle) noexcept;        // waits in NciCoroutines::run(). Resumes right away if all waiting slots are taken
+
+  protected:
+    NciAwaiter(NciCoroutines &theScheduler, unsigned long theTimeOut);
+    NciAwaiter(const NciAwaiter &) = default;
+    ~NciAwaiter();                                         // stops the waiting. Derived awaiters give back what the NCI still has of them in their own destructor : here, they are gone already
+    virtual bool poll() = 0;                              // start or check the operation, true once it completed
+    virtual void onEvent(const NciEvent &theEvent);        // an NCI event while waiting
+    virtual void onTimeOut();                              // give back what the operation still uses
+    NciCoroutines &theScheduler;
+    unsigned long startTime;
+    unsigned long timeOut;        // [ms]
+    bool expired{false};          // completed by the timeOut
+    bool ready{false};            // an event completed it, resume in the next run()
+    std::coroutine_handle<> theHandle;
+    friend class NciCoroutines;
+};
+
+class NciCommandAwaiter : public NciAwaiter {
+  public:
+    NciCommandAwaiter(NciCoroutines &theScheduler, uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint8_t payloadLength, uint8_t response[], uint8_t responseSize, unsigned long theTimeOut);
+    NciCommandAwaiter(const NciCommandAwaiter &) = default;
+    ~NciCommandAwaiter();                         // eg. the NciTask is destroyed while it waits : the Response does not go into the frame anymore
+    uint8_t await_resume() const noexcept;        // Status of the Response, STATUS_FAILED if it could not be sent or did not come
+
+  private:
+    bool poll() override;
+    void onTimeOut() override;
+    uint8_t groupId;
+    uint8_t opcodeId;
+    const uint8_t *payload;
+    uint8_t payloadLength;
+    uint8_t *response;
+    uint8_t responseSize;
+    bool sent{false};                   // the NCI sends one command at a time : until then it keeps trying
+    bool responsePending{false};        // the NCI copies the Response into response when it comes
+    uint8_t status{STATUS_FAILED};
+};
+
+class NciNotificationAwaiter : public NciAwaiter {
+  public:
+    NciNotificationAwaiter(NciCoroutines &theScheduler, NciMessageId theNotification, uint8_t payload[], uint8_t payloadSize, unsigned long theTimeOut);
+    bool await_resume() const noexcept;        // false on a timeOut
+
+  private:
+    bool poll() override;
+    void onEvent(const NciEvent &theEvent) override;        // copies the payload, as it is only valid during the event
+    NciMessageId theNotification;
+    uint8_t *payload;
+    uint8_t payloadSize;
+};
+
+class NciEventAwaiter : public NciAwaiter {
+  public:
+    NciEventAwaiter(NciCoroutines &theScheduler, NciEventType theType, unsigned long theTimeOut);
+    bool await_resume() const noexcept;        // false on a timeOut
+
+  private:
+    bool poll() override;
+    void onEvent(const NciEvent &theEvent) override;
+    NciEventType theType;
+};
+
+class NciTransceiveAwaiter : public NciAwaiter {
+  public:
+    NciTransceiveAwaiter(NciCoroutines &theScheduler, const uint8_t data[], uint32_t dataLength, uint8_t response[], uint32_t responseSize, unsigned long theTimeOut);
+    NciTransceiveAwaiter(const NciTransceiveAwaiter &) = default;
+    ~NciTransceiveAwaiter();                       // eg. the NciTask is destroyed while it waits : the tag's answer does not go into the frame anymore
+    uint32_t await_resume() const noexcept;        // length of the tag's answer, 0 if it did not answer or left
+
+  private:
+    bool poll() override;
+    void onTimeOut() override;
+    const uint8_t *data;
+    uint32_t dataLength;
+    uint8_t *response;
+    uint32_t responseSize;
+    bool started{false};        // the NCI reassembles the tag's answer into response
+    uint32_t responseLength{0};
+};
+
+class NciWaitAwaiter : public NciAwaiter {
+  public:
+    NciWaitAwaiter(NciCoroutines &theScheduler, unsigned long theTime);
+    void await_resume() const noexcept {}
+
+  private:
+    bool poll() override;
+};
+
+class NciCoroutines {
+  public:
+    static constexpr unsigned long defaultTimeOut = 20;        // [ms]
+
+    explicit NciCoroutines(NCI &theNci);        // registers as event handler of the NCI
+    ~NciCoroutines();
+    void run();                                  // call after NCI::run() : resumes the coroutines which can continue
+    unsigned long nextDeadline() const;          // millis() at which run() has work, if no IRQ comes first. Sleep until the earliest of this and NCI::nextDeadline()
+    NCI &getNci();
+    uint32_t getNmbrOfResumes() const;
+
+    NciCommandAwaiter command(uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint8_t payloadLength, uint8_t response[] = nullptr, uint8_t responseSize = 0, unsigned long timeOut = defaultTimeOut);        // any NCI command, see NCI::sendCommand()
+    NciNotificationAwaiter notification(NciMessageId theNotification, uint8_t payload[], uint8_t payloadSize, unsigned long timeOut);        // the next one the stateMachine does not handle itself
+    NciEventAwaiter event(NciEventType theType, unsigned long timeOut);                                                                      // the next event of this type, eg. tagArrived
+    NciTransceiveAwaiter transceive(const uint8_t data[], uint32_t dataLength, uint8_t response[], uint32_t responseSize, unsigned long timeOut = defaultTimeOut);        // Data message to the activated tag and its answer
+    NciWaitAwaiter wait(unsigned long time);                                                                                                // [ms]
+
+  private:
+    static constexpr uint32_t maxNmbrWaiting = NciFramePool::nmbrOfFrames;
+    NCI &theNci;
+    NciAwaiter *waiting[maxNmbrWaiting]{};
+    uint32_t nmbrOfResumes{0};
+    bool add(NciAwaiter *theAwaiter);
+    void remove(NciAwaiter *theAwaiter);
+    static void handleEvent(const NciEvent &theEvent, void *context);
+    friend class NciAwaiter;
+};
+#endif
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "NciPacketQueue.h"
+
+bool NciPacketQueue::isEmpty() const {
+    return (0 == level);
+}
+
+bool NciPacketQueue::isFull() const {
+    return (depth == level);
+}
+
+uint32_t NciPacketQueue::getLevel() const {
+    return level;
+}
+
+NciPacket &NciPacketQueue::getFreeSlot() {
+    return thePackets[(head + level) % depth];
+}
+
+void NciPacketQueue::push() {
+    if (level < depth) {
+        level++;
+        nmbrReceived++;
+        if (level > highWaterMark) {
+            highWaterMark = level;
+        }
+    }
+}
+
+const NciPacket &NciPacketQueue::getFirst() const {
+    return thePackets[head];
+}
+
+NciPacket &NciPacketQueue::get(uint32_t index) {
+    return thePackets[(head + index) % depth];
+}
+
+void NciPacketQueue::pop() {
+    if (level > 0) {
+        head = (head + 1) % depth;
+        level--;
+    }
+}
+
+uint32_t NciPacketQueue::getHighWaterMark() const {
+    return highWaterMark;
+}
+
+uint32_t NciPacketQueue::getNmbrReceived() const {
+    return nmbrReceived;
+}
+
+uint32_t NciPacketQueue::getNmbrFull() const {
+    return nmbrFull;
+}
+
+void NciPacketQueue::countFull() {
+    nmbrFull++;
+}
+
+void NciPacketQueue::resetStatistics() {
+    highWaterMark = level;
+    nmbrReceived  = 0;
+    nmbrFull      = 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Fixed capacity queue of received NCI packets. Packets are read from the NFCC directly into a free slot, and stay there until the NCI stateMachine
+//   or a notification handler is done with them, so no copying and no dynamic memory.
+//   The depth can be set at build time with -D NciRxQueueDepth=<n>. Every slot takes 258 bytes of RAM, so keep it small on small MCUs
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+
+#ifndef NciRxQueueDepth
+#if defined(__AVR__)
+#define NciRxQueueDepth 2
+#else
+#define NciRxQueueDepth 4
+#endif
+#endif
+
+class NciPacket {
+  public:
+    static constexpr uint32_t maxLength = 3 + 255;        // header + maximum payload, see NCI specification V1.0, section 3.1
+    uint8_t data[maxLength];                              // header + payload, as received
+    uint32_t length{0};                                   // how many bytes of data are valid
+};
+
+class NciPacketQueue {
+  public:
+    static constexpr uint32_t depth = NciRxQueueDepth;
+
+    bool isEmpty() const;
+    bool isFull() const;
+    uint32_t getLevel() const;                   // how many packets are waiting
+    NciPacket &getFreeSlot();                    // the slot to receive the next packet into. Only valid if !isFull()
+    void push();                                 // the free slot now holds a received packet, append it to the queue
+    const NciPacket &getFirst() const;           // oldest packet in the queue. Only valid if !isEmpty()
+    NciPacket &get(uint32_t index);              // index-th oldest packet, 0 is the first. Only valid if index < getLevel()
+    void pop();                                  // done with the oldest packet, its slot becomes free
+
+    uint32_t getHighWaterMark() const;           // highest level reached since the last resetStatistics()
+    uint32_t getNmbrReceived() const;            // total packets pushed since the last resetStatistics()
+    uint32_t getNmbrFull() const;                // how many times the NFCC had more packets while the queue was full, so they had to wait in the NFCC
+    void countFull();
+    void resetStatistics();
+
+  private:
+    NciPacket thePackets[depth];        // the pool of slots, used as a ring
+    uint32_t head{0};                   // index of the oldest packet
+    uint32_t level{0};                  // number of packets in the queue
+
+    uint32_t highWaterMark{0};
+    uint32_t nmbrReceived{0};
+    uint32_t nmbrFull{0};
+};
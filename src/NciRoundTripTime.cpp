@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "NciRoundTripTime.h"
+
+void NciRoundTripTime::addSample(unsigned long roundTripTime) {
+    uint32_t sample = (roundTripTime > 0x0FFFFFFF) ? 0x0FFFFFFF : static_cast<uint32_t>(roundTripTime);        // keeps the scaled values within 32 bits
+    if (sample > maxSample) {
+        maxSample = sample;
+    }
+    if (0 == nmbrOfSamples) {
+        scaledMean      = sample << 3;
+        scaledDeviation = sample << 1;        // deviation starts at half the first sample. RFC 6298, section 2.2
+    } else {
+        uint32_t mean       = scaledMean >> 3;
+        uint32_t difference = (sample > mean) ? (sample - mean) : (mean - sample);
+        scaledDeviation     = scaledDeviation - (scaledDeviation >> 2) + difference;        // 3/4 of the old deviation + 1/4 of the new difference, section 2.3
+        scaledMean          = scaledMean - (scaledMean >> 3) + sample;                      // 7/8 of the old mean + 1/8 of the new sample
+    }
+    if (nmbrOfSamples < 0xFFFFFFFF) {
+        nmbrOfSamples++;
+    }
+}
+
+unsigned long NciRoundTripTime::getTimeOut(uint8_t nmbrOfDeviations, unsigned long floor, unsigned long ceiling) const {
+    if (nmbrOfSamples < minNmbrOfSamples) {
+        return ceiling;        // not enough known yet, be safe
+    }
+    unsigned long timeOut = (getMean() + (nmbrOfDeviations * getDeviation()) + 999) / 1000;        // [us] to [ms], rounded up
+    if (timeOut < floor) {
+        timeOut = floor;
+    }
+    if (timeOut > ceiling) {
+        timeOut = ceiling;
+    }
+    return timeOut;
+}
+
+unsigned long NciRoundTripTime::getMean() const {
+    return scaledMean >> 3;
+}
+
+unsigned long NciRoundTripTime::getDeviation() const {
+    return scaledDeviation >> 2;
+}
+
+unsigned long NciRoundTripTime::getMax() const {
+    return maxSample;
+}
+
+uint32_t NciRoundTripTime::getNmbrOfSamples() const {
+    return nmbrOfSamples;
+}
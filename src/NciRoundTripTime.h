@@ -0,0 +1,39 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Running statistics of how long the NFCC takes to answer, from which a time-out follows that adapts to the actual NFCC, host and bus speed.
+//   Smoothed mean and mean deviation as TCP does for its retransmission time-out (RFC 6298), in integer arithmetic :
+//   each sample moves the mean 1/8 and the deviation 1/4 of the way. The time-out is the mean plus a number of deviations, which sets how
+//   far out in the distribution an answer still counts as on time : for a normal distribution 2 deviations is about the 95th percentile,
+//   4 deviations about the 99.9th.
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+
+class NciRoundTripTime {
+  public:
+    static constexpr uint32_t minNmbrOfSamples = 4;        // before this, getTimeOut() gives the ceiling
+
+    void addSample(unsigned long roundTripTime);        // [us]
+    unsigned long getTimeOut(uint8_t nmbrOfDeviations, unsigned long floor, unsigned long ceiling) const;        // [ms] mean + nmbrOfDeviations x deviation, rounded up and kept within floor and ceiling
+    unsigned long getMean() const;             // [us]
+    unsigned long getDeviation() const;        // [us] mean deviation
+    unsigned long getMax() const;              // [us] longest sample
+    uint32_t getNmbrOfSamples() const;
+
+  private:
+    uint32_t scaledMean{0};             // [us] x 8
+    uint32_t scaledDeviation{0};        // [us] x 4
+    uint32_t maxSample{0};
+    uint32_t nmbrOfSamples{0};
+};
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "NciTransport.h"
+
+uint32_t NciTransportCounters::estimateBusTime(uint32_t clockFrequency) const {
+    // every byte is 8 bits + ACK, every transaction adds the address byte and START/STOP, counted as 1 extra bit time
+    uint64_t bitTimes = (static_cast<uint64_t>(bytesRead + bytesWritten + readTransactions + writeTransactions) * 9U) + readTransactions + writeTransactions;
+    return static_cast<uint32_t>((bitTimes * 1000000U) / clockFrequency);
+}
+
+void NciTransport::initialize() {
+    // PN7150 Reset procedure : see PN7150 datasheet 12.6.1, 12.6.2.2, Fig 18 and 16.2.2
+    beginReset();
+    delayMicroseconds(venLowTime);
+    endReset();
+    delayMicroseconds(bootTime);
+}
+
+void NciTransport::powerDown() {
+    beginReset();        // hard power down : see PN7150 datasheet 12.6.1. The next reset boots it again
+}
+
+uint8_t NciTransport::write(const uint8_t data[], uint32_t dataLength) {
+    theCounters.packetsWritten++;
+    theCounters.writeTransactions++;
+    theCounters.bytesWritten += dataLength;
+    return writeTransaction(data, dataLength, nullptr, 0);
+}
+
+uint8_t NciTransport::write(const uint8_t header[], const uint8_t payload[], uint32_t payloadLength) {
+    theCounters.packetsWritten++;
+    theCounters.writeTransactions++;
+    theCounters.bytesWritten += 3 + payloadLength;
+    return writeTransaction(header, 3, payload, payloadLength);
+}
+
+uint32_t NciTransport::read(uint8_t data[]) {
+    if (!hasMessage()) {        // only try to read something if the NFCC indicates it has something
+        return 0;
+    }
+
+    uint32_t bytesReceived = 0;
+    if ((NciReadMode::singleTransaction == theReadMode) && ((3U + readAheadLength) <= getMaxTransactionLength())) {
+        theCounters.readTransactions++;
+        theCounters.bytesRead += 3U + readAheadLength;
+        if (readTransaction(data, 3U + readAheadLength) == (3U + readAheadLength)) {
+            uint32_t payloadLength = data[2];
+            bytesReceived          = 3 + payloadLength;
+            if (payloadLength > readAheadLength) {        // longer than expected, the remainder follows in a second transaction
+                theCounters.readTransactions++;
+                theCounters.bytesRead += payloadLength - readAheadLength;
+                (void)readTransaction(data + 3U + readAheadLength, payloadLength - readAheadLength);
+            }
+        }
+        packetDone();
+    } else {
+        // using 'Split mode' I2C read. See UM10936 section 3.5
+        if (readHeader(data)) {                                       // first reading the header, as this contains how long the payload will be
+            bytesReceived = 3 + readPayload(data + 3, data[2]);        // then reading the payload, if any
+        } else {
+            packetDone();
+        }
+    }
+    return bytesReceived;
+}
+
+bool NciTransport::readHeader(uint8_t header[]) {
+    if (!hasMessage()) {
+        return false;
+    }
+    theCounters.readTransactions++;
+    theCounters.bytesRead += 3;
+    return (readTransaction(header, 3) == 3);
+}
+
+uint32_t NciTransport::readPayload(uint8_t payload[], uint32_t payloadLength) {
+    uint32_t bytesReceived = 0;
+    if (payloadLength > 0) {
+        theCounters.readTransactions++;
+        theCounters.bytesRead += payloadLength;
+        bytesReceived = readTransaction(payload, payloadLength);
+    }
+    packetDone();
+    return bytesReceived;
+}
+
+void NciTransport::packetDone() {
+    theCounters.packetsRead++;
+    if (interruptMode) {
+        irqPending = false;        // the message is read, so clear the latch..
+        if (isIrqHigh()) {         // ..but if IRQ is still HIGH, the NFCC has a next message and there will be no new rising edge
+            irqHandler();
+        }
+    }
+}
+
+bool NciTransport::hasMessage() const {
+    if (interruptMode) {
+        return irqPending;        // latched, no need to read the IRQ line
+    }
+    return isIrqHigh();
+}
+
+void NciTransport::setReadMode(NciReadMode theMode, uint8_t theReadAheadLength) {
+    theReadMode     = theMode;
+    readAheadLength = theReadAheadLength;
+}
+
+const NciTransportCounters &NciTransport::getCounters() const {
+    return theCounters;
+}
+
+void NciTransport::resetCounters() {
+    theCounters = NciTransportCounters();
+}
+
+bool NciTransport::waitForMessage(unsigned long maxWaitTime) {
+    // Default implementation just polls. Transports which can really sleep (GPIO events, simulator) override this
+    unsigned long startTime = millis();
+    while (!hasMessage()) {
+        if ((millis() - startTime) >= maxWaitTime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NciTransport::enableInterrupt() {
+    irqPending    = false;
+    interruptMode = true;
+    if (isIrqHigh()) {        // IRQ may already be HIGH, in which case there will be no rising edge. An edge from here on latches by itself
+        irqHandler();
+    }
+}
+
+bool NciTransport::isInterruptMode() const {
+    return interruptMode;
+}
+
+void NciTransport::irqHandler() {
+    irqTimestamp = millis();
+    irqPending   = true;
+}
+
+unsigned long NciTransport::getIrqTimestamp() const {
+    return irqTimestamp;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   The NCI protocol does not care how its packets travel between DeviceHost and NFCC. This class is the interface the NCI class talks to.
+//   Implementations :
+//   * PN7150Interface : Arduino, Wire or i2c_t3 + IRQ and VEN on digital pins
+//   * PN7150LinuxInterface : Linux, /dev/i2c-N + IRQ and VEN on a GPIO character device
+//   * PN7150Simulator : in-process simulated PN7150, to run the NCI stateMachine off-target
+//
+//   The IRQ latch lives here, so every implementation can be used in interrupt-driven mode : whoever sees the IRQ edge (ISR, GPIO event, simulator thread) calls irqHandler()
+//
+//   Reading a packet is done here as well, on top of the single bus transactions the implementations provide. Two read modes are supported :
+//   * split : first a transaction reading the 3 byte header, then a second one reading the payload. See UM10936 section 3.5
+//   * singleTransaction : header + readAheadLength bytes of payload in one transaction. When the payload turns out to be longer, the remainder is read in a second
+//     transaction, the same way split mode reads the payload. This saves a START + address phase for every packet which fits in the readAheadLength.
+//     When header + readAheadLength does not fit in the buffer of the transport (eg. 32 bytes for the AVR Wire library), it falls back to split mode.
+
+#include <stdint.h>                // Gives us access to uint8_t types etc
+#include "PN7150Platform.h"        // millis() and friends, also when not running on Arduino
+#if !defined(ARDUINO)
+#include <atomic>
+#endif
+
+enum class NciReadMode : uint8_t {
+    split,                   // header and payload in separate transactions
+    singleTransaction        // header and expected payload in one transaction
+};
+
+class NciTransportCounters {
+  public:
+    uint32_t packetsRead{0};              // complete NCI packets read
+    uint32_t readTransactions{0};         // I2C read transactions, each costing a START + address phase
+    uint32_t bytesRead{0};                // bytes clocked in from the bus, including read-ahead bytes beyond the end of the packet
+    uint32_t packetsWritten{0};           // complete NCI packets written
+    uint32_t writeTransactions{0};        // I2C write transactions
+    uint32_t bytesWritten{0};             // bytes clocked out to the bus
+
+    uint32_t estimateBusTime(uint32_t clockFrequency) const;        // estimated time [us] the bus was busy for these transactions, at a given I2C clock [Hz]
+};
+
+class NciTransport {
+  public:
+    virtual void initialize();                                                   // Reset the NFCC and initialize the HW interface at the Device Host. Blocks for venLowTime + bootTime, the NCI stateMachine does the same without blocking
+    virtual void beginReset() = 0;                                               // initialize the HW interface at the Device Host and drive VEN LOW : the NFCC is in hard power down until endReset()
+    virtual void endReset() = 0;                                                 // drive VEN HIGH : the NFCC boots, and accepts commands bootTime later
+    void powerDown();                                                            // VEN LOW : the NFCC consumes almost nothing until the next reset
+    uint8_t write(const uint8_t data[], uint32_t dataLength);                    // write data from DeviceHost to NFCC. Returns success (0) or Fail (> 0)
+    uint8_t write(const uint8_t header[], const uint8_t payload[], uint32_t payloadLength);        // same, but header and payload come from separate buffers, without copying them together
+    uint32_t read(uint8_t data[]);                                               // read a packet from NFCC, returns the amount of bytes read
+    bool readHeader(uint8_t header[]);                                           // split mode, step 1 : read only the 3 byte header of the next packet
+    uint32_t readPayload(uint8_t payload[], uint32_t payloadLength);             // split mode, step 2 : read the payload, to wherever the caller decides after seeing the header
+    virtual bool hasMessage() const;                                             // does the NFCC indicate it has data for the DeviceHost to be read
+    virtual bool waitForMessage(unsigned long maxWaitTime);                      // sleep until the NFCC has a message, or maxWaitTime [ms] has passed. Returns hasMessage()
+    virtual void enableInterrupt();                                              // switch from reading the IRQ line to the latch. Implementations hook up whatever sees the IRQ edge, then call this
+    bool isInterruptMode() const;
+    void irqHandler();                                                           // latches a pending message. Called from whatever detects the rising edge of IRQ
+    unsigned long getIrqTimestamp() const;                                       // time (millis) at which the last pending message was latched
+    void setReadMode(NciReadMode theMode, uint8_t readAheadLength);              // select split or single transaction reads, readAheadLength = largest payload expected
+    const NciTransportCounters &getCounters() const;                             // read-only access to the bus traffic counters
+    void resetCounters();
+
+    static constexpr unsigned long venLowTime = 100;         // [us] VEN LOW pulse resetting the NFCC, at least 10 us. See PN7150 datasheet 16.2.2
+    static constexpr unsigned long bootTime   = 3000;        // [us] after VEN HIGH, the PN7150 needs 2.5 ms before it allows communication
+
+  protected:
+    virtual uint8_t writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength) = 0;        // one I2C write transaction of header followed by payload. Returns success (0) or Fail (> 0)
+    virtual uint32_t readTransaction(uint8_t data[], uint32_t dataLength) = 0;              // one I2C read transaction, continuing the packet where the previous one stopped
+    virtual uint32_t getMaxTransactionLength() const = 0;                                   // size of the transport's buffer : longest possible single transaction
+    virtual bool isIrqHigh() const = 0;                                                     // level of the IRQ line
+
+    bool interruptMode{false};                     // false : hasMessage() reads the IRQ line, true : hasMessage() checks the latched flag
+#if defined(ARDUINO)
+    volatile bool irqPending{false};               // set by irqHandler(), cleared after reading the message
+    volatile unsigned long irqTimestamp{0};        // set by irqHandler()
+#else
+    std::atomic<bool> irqPending{false};               // same, but irqHandler() runs on another thread : the GPIO event thread, or the simulator's delivery thread
+    std::atomic<unsigned long> irqTimestamp{0};
+#endif
+
+  private:
+    void packetDone();        // count the packet, and re-arm the IRQ latch
+
+    NciReadMode theReadMode{NciReadMode::split};
+    uint8_t readAheadLength{0};
+    NciTransportCounters theCounters;
+};
@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "Ndef.h"
+
+namespace {
+uint32_t textLength(const char *text) {
+    uint32_t length = 0;
+    if (nullptr != text) {
+        while (0 != text[length]) {
+            length++;
+        }
+    }
+    return length;
+}
+
+const char *const uriPrefixes[] = {"http://www.", "https://www.", "http://", "https://", "tel:", "mailto:"};        // Identifier Codes 0x01 .. 0x06. URIs with the other, rarer, prefixes are stored in full, which is just as valid
+}        // namespace
+
+bool NdefRecord::hasType(NdefTnf theTnf, const char *theType) const {
+    if ((theTnf != tnf) || (textLength(theType) != typeLength)) {
+        return false;
+    }
+    for (uint32_t index = 0; index < typeLength; index++) {
+        if (static_cast<uint8_t>(theType[index]) != type[index]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NdefParser::startMessage(const uint8_t message[], uint32_t messageLength) {
+    *this      = NdefParser();
+    buffer     = message;
+    messageEnd = messageLength;
+    theState   = (0 == messageLength) ? State::done : State::records;
+}
+
+void NdefParser::startTlv(const uint8_t dataArea[]) {
+    *this    = NdefParser();
+    buffer   = dataArea;
+    theState = State::tlv;
+}
+
+NdefParseResult NdefParser::next(NdefRecord &theRecord, uint32_t availableLength) {
+    if (State::tlv == theState) {
+        NdefParseResult result = findMessage(availableLength);
+        if (NdefParseResult::record != result) {
+            return result;
+        }
+    }
+    switch (theState) {
+        case State::records:
+            return parseRecord(theRecord, availableLength);
+        case State::done:
+            return NdefParseResult::end;
+        default:
+            return NdefParseResult::error;
+    }
+}
+
+uint32_t NdefParser::getOffset() const {
+    return offset;
+}
+
+uint32_t NdefParser::getNmbrOfRecords() const {
+    return nmbrOfRecords;
+}
+
+NdefParseResult NdefParser::findMessage(uint32_t availableLength) {
+    // TLV blocks. NFC Forum Type 2 Tag Operation specification, section 2.3
+    while (offset < availableLength) {
+        uint8_t type = buffer[offset];
+        if (TLV_NULL == type) {
+            offset++;
+            continue;
+        }
+        if (TLV_TERMINATOR == type) {
+            theState = State::done;        // no NDEF message on this tag
+            return NdefParseResult::end;
+        }
+        if ((offset + 1) >= availableLength) {
+            break;
+        }
+        uint32_t headerLength = 2;
+        uint32_t length       = buffer[offset + 1];
+        if (0xFF == length) {        // 3 byte length format
+            if ((offset + 3) >= availableLength) {
+                break;
+            }
+            headerLength = 4;
+            length       = (static_cast<uint32_t>(buffer[offset + 2]) << 8) | buffer[offset + 3];
+        }
+        offset += headerLength;
+        if (TLV_NDEF_MESSAGE == type) {
+            messageEnd = offset + length;
+            theState   = (0 == length) ? State::done : State::records;        // length 0 : an empty tag
+            return NdefParseResult::record;
+        }
+        offset += length;        // Lock Control, Memory Control or proprietary TLV
+    }
+    return NdefParseResult::needMoreData;
+}
+
+NdefParseResult NdefParser::parseRecord(NdefRecord &theRecord, uint32_t availableLength) {
+    // Record layout. NFC Forum NDEF Technical Specification, section 3.2
+    uint32_t limit                  = (availableLength < messageEnd) ? availableLength : messageEnd;
+    const NdefParseResult truncated = (limit < messageEnd) ? NdefParseResult::needMoreData : NdefParseResult::error;        // with the whole message there, a record running beyond it is an error
+    if (offset >= messageEnd) {
+        theState = State::failed;        // the message ended without a record with ME
+        return NdefParseResult::error;
+    }
+    if ((offset + 3) > limit) {
+        return truncated;
+    }
+    uint8_t flags         = buffer[offset];
+    bool shortRecord      = (0 != (flags & NDEF_SR));
+    bool hasId            = (0 != (flags & NDEF_IL));
+    uint32_t headerLength = 2 + (shortRecord ? 1 : 4) + (hasId ? 1 : 0);
+    if ((offset + headerLength) > limit) {
+        return truncated;
+    }
+    uint8_t typeLength     = buffer[offset + 1];
+    uint32_t payloadLength = buffer[offset + 2];
+    if (!shortRecord) {
+        payloadLength = (payloadLength << 24) | (static_cast<uint32_t>(buffer[offset + 3]) << 16) | (static_cast<uint32_t>(buffer[offset + 4]) << 8) | buffer[offset + 5];
+    }
+    uint8_t idLength = hasId ? buffer[offset + headerLength - 1] : 0;
+    if (payloadLength > (messageEnd - offset)) {
+        theState = State::failed;        // also keeps the sum below from overflowing
+        return NdefParseResult::error;
+    }
+    uint32_t recordLength = headerLength + typeLength + idLength + payloadLength;
+    if ((offset + recordLength) > limit) {
+        return ((offset + recordLength) > messageEnd) ? NdefParseResult::error : truncated;
+    }
+
+    NdefTnf tnf       = static_cast<NdefTnf>(flags & NDEF_TNF_MASK);
+    bool chunkFlag    = (0 != (flags & NDEF_CF));
+    bool messageBegin = (0 != (flags & NDEF_MB));
+    bool isChunk      = (NdefTnf::unchanged == tnf);
+    if ((messageBegin != firstRecord) || (isChunk != inChunkedRecord) || (isChunk && ((0 != typeLength) || hasId)) || (chunkFlag && (0 != (flags & NDEF_ME)))) {
+        theState = State::failed;        // MB only on the first record, and the chunks after the first are unchanged, without type and id
+        return NdefParseResult::error;
+    }
+
+    const uint8_t *fields = buffer + offset + headerLength;
+    if (isChunk) {
+        chunkIndex++;
+        theRecord.tnf        = chunkTnf;
+        theRecord.type       = chunkType;
+        theRecord.typeLength = chunkTypeLength;
+        theRecord.id         = chunkId;
+        theRecord.idLength   = chunkIdLength;
+    } else {
+        chunkIndex           = 0;
+        theRecord.tnf        = tnf;
+        theRecord.type       = fields;
+        theRecord.typeLength = typeLength;
+        theRecord.id         = fields + typeLength;
+        theRecord.idLength   = idLength;
+        if (chunkFlag) {        // the first chunk : the others get its type and id
+            chunkTnf        = tnf;
+            chunkType       = theRecord.type;
+            chunkTypeLength = typeLength;
+            chunkId         = theRecord.id;
+            chunkIdLength   = idLength;
+        }
+    }
+    theRecord.messageBegin  = messageBegin;
+    theRecord.messageEnd    = (0 != (flags & NDEF_ME));
+    theRecord.payload       = fields + typeLength + idLength;
+    theRecord.payloadLength = payloadLength;
+    theRecord.chunkIndex    = chunkIndex;
+    theRecord.lastChunk     = !chunkFlag;
+
+    inChunkedRecord = chunkFlag;
+    firstRecord     = false;
+    offset += recordLength;
+    nmbrOfRecords++;
+    if (theRecord.messageEnd) {
+        theState = State::done;
+    }
+    return NdefParseResult::record;
+}
+
+NdefBuilder::NdefBuilder(uint8_t theBuffer[], uint32_t theBufferSize) : buffer(theBuffer), bufferSize(theBufferSize) {}
+
+bool NdefBuilder::addRecord(NdefTnf tnf, const char *type, const uint8_t payload[], uint32_t payloadLength, const uint8_t id[], uint8_t idLength) {
+    uint8_t *destination = reserve(tnf, type, payloadLength, id, idLength);
+    if (nullptr == destination) {
+        return false;
+    }
+    for (uint32_t index = 0; index < payloadLength; index++) {
+        destination[index] = payload[index];
+    }
+    return true;
+}
+
+uint8_t *NdefBuilder::reserve(NdefTnf tnf, const char *type, uint32_t payloadLength, const uint8_t id[], uint8_t idLength) {
+    uint32_t typeLength   = textLength(type);
+    bool shortRecord      = (payloadLength <= 0xFF);
+    bool hasId            = (nullptr != id) && (idLength > 0);
+    uint32_t headerLength = 2 + (shortRecord ? 1 : 4) + (hasId ? 1 : 0);
+    uint32_t room         = bufferSize - length;
+    if ((typeLength > 0xFF) || (room < headerLength) || ((room - headerLength) < typeLength) || ((room - headerLength - typeLength) < (hasId ? idLength : 0U)) || ((room - headerLength - typeLength - (hasId ? idLength : 0U)) < payloadLength)) {
+        overflow = true;
+        return nullptr;
+    }
+    if (nmbrOfRecords > 0) {
+        buffer[lastHeader] &= static_cast<uint8_t>(~NDEF_ME);        // it is not the last record anymore
+    }
+    lastHeader        = length;
+    uint8_t *header   = buffer + length;
+    header[0]         = static_cast<uint8_t>(NDEF_ME | (0 == nmbrOfRecords ? NDEF_MB : 0) | (shortRecord ? NDEF_SR : 0) | (hasId ? NDEF_IL : 0) | (static_cast<uint8_t>(tnf) & NDEF_TNF_MASK));
+    header[1]         = static_cast<uint8_t>(typeLength);
+    uint32_t position = 2;
+    if (shortRecord) {
+        header[position++] = static_cast<uint8_t>(payloadLength);
+    } else {
+        header[position++] = static_cast<uint8_t>(payloadLength >> 24);
+        header[position++] = static_cast<uint8_t>(payloadLength >> 16);
+        header[position++] = static_cast<uint8_t>(payloadLength >> 8);
+        header[position++] = static_cast<uint8_t>(payloadLength);
+    }
+    if (hasId) {
+        header[position++] = idLength;
+    }
+    for (uint32_t index = 0; index < typeLength; index++) {
+        header[position++] = static_cast<uint8_t>(type[index]);
+    }
+    for (uint32_t index = 0; hasId && (index < idLength); index++) {
+        header[position++] = id[index];
+    }
+    length += position + payloadLength;
+    nmbrOfRecords++;
+    return header + position;
+}
+
+bool NdefBuilder::addUri(const char *uri) {
+    uint8_t identifierCode = 0x00;        // no abbreviation
+    uint32_t prefixLength  = 0;
+    for (uint32_t code = 0; code < (sizeof(uriPrefixes) / sizeof(uriPrefixes[0])); code++) {
+        uint32_t index = 0;
+        while ((0 != uriPrefixes[code][index]) && (uri[index] == uriPrefixes[code][index])) {
+            index++;
+        }
+        if ((0 == uriPrefixes[code][index]) && (index > prefixLength)) {        // the longest prefix which matches
+            identifierCode = static_cast<uint8_t>(code + 1);
+            prefixLength   = index;
+        }
+    }
+    uint32_t uriLength   = textLength(uri) - prefixLength;
+    uint8_t *destination = reserve(NdefTnf::wellKnown, "U", 1 + uriLength);
+    if (nullptr == destination) {
+        return false;
+    }
+    destination[0] = identifierCode;
+    for (uint32_t index = 0; index < uriLength; index++) {
+        destination[1 + index] = static_cast<uint8_t>(uri[prefixLength + index]);
+    }
+    return true;
+}
+
+bool NdefBuilder::addText(const char *text, const char *language) {
+    uint32_t languageLength = textLength(language);
+    uint32_t nmbrOfBytes    = textLength(text);        // UTF-8 bytes, not characters
+    if (languageLength > 0x3F) {
+        overflow = true;
+        return false;
+    }
+    uint8_t *destination = reserve(NdefTnf::wellKnown, "T", 1 + languageLength + nmbrOfBytes);
+    if (nullptr == destination) {
+        return false;
+    }
+    destination[0] = static_cast<uint8_t>(languageLength);        // status byte : UTF-8, and the length of the IANA language code
+    for (uint32_t index = 0; index < languageLength; index++) {
+        destination[1 + index] = static_cast<uint8_t>(language[index]);
+    }
+    for (uint32_t index = 0; index < nmbrOfBytes; index++) {
+        destination[1 + languageLength + index] = static_cast<uint8_t>(text[index]);
+    }
+    return true;
+}
+
+void NdefBuilder::clear() {
+    length        = 0;
+    lastHeader    = 0;
+    nmbrOfRecords = 0;
+    overflow      = false;
+}
+
+const uint8_t *NdefBuilder::getMessage() const {
+    return buffer;
+}
+
+uint32_t NdefBuilder::getLength() const {
+    return length;
+}
+
+uint32_t NdefBuilder::getNmbrOfRecords() const {
+    return nmbrOfRecords;
+}
+
+bool NdefBuilder::isOverflow() const {
+    return overflow;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   NDEF messages, NFC Forum NDEF Technical Specification, parsed and built in place, without copies and without allocating.
+//
+//   NdefParser walks a buffer holding a message, or a Type 2 Tag's Data Area with its TLVs, and yields each record as an NdefRecord : a view whose
+//   type, id and payload point into that buffer. It streams : next() gets how much of the buffer is valid so far, and a record which is not
+//   complete yet gives needMoreData, so records can be used while the rest of the tag is still being read :
+//
+//       parser.startTlv(memory);                                  // Type2TagReader reading into memory, from page 4
+//       while (NdefParseResult::record == parser.next(record, reader.getNmbrOfBytesRead())) { ... }
+//
+//   Chunked records (CF flag) come as one NdefRecord per chunk, each with the type and id of the first chunk, so a long payload can be consumed
+//   chunk by chunk. Short (SR) and normal records, with 1 and 4 byte payload lengths, are both handled.
+//
+//   NdefBuilder serialises records straight into the buffer which is then written to the tag, eg. by Type2TagWriter. A payload is either copied
+//   in from the application, or written by the application into the place reserve() returns.
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+
+#define NDEF_MB 0x80        // Message Begin
+#define NDEF_ME 0x40        // Message End
+#define NDEF_CF 0x20        // Chunk Flag : more chunks of this record follow
+#define NDEF_SR 0x10        // Short Record : 1 byte payload length
+#define NDEF_IL 0x08        // ID Length is present
+#define NDEF_TNF_MASK 0x07
+
+#define TLV_NULL 0x00
+#define TLV_LOCK_CONTROL 0x01
+#define TLV_MEMORY_CONTROL 0x02
+#define TLV_NDEF_MESSAGE 0x03
+#define TLV_PROPRIETARY 0xFD
+#define TLV_TERMINATOR 0xFE
+
+enum class NdefTnf : uint8_t {        // Type Name Format. NFC Forum NDEF Technical Specification, section 3.2.6
+    empty       = 0x00,
+    wellKnown   = 0x01,        // NFC Forum Record Type Definition, eg. "U" or "T"
+    mimeMedia   = 0x02,        // RFC 2046, eg. "text/plain"
+    absoluteUri = 0x03,
+    external    = 0x04,        // eg. "example.com:mytype"
+    unknown     = 0x05,
+    unchanged   = 0x06,        // the second and later chunks of a chunked record
+    reserved    = 0x07
+};
+
+enum class NdefParseResult : uint8_t {
+    record,              // the next record is complete, and in the NdefRecord
+    needMoreData,        // the next record, or TLV, runs beyond the valid part of the buffer
+    end,                 // after the record with ME, or the Terminator TLV
+    error                // not a valid message : the parser stops
+};
+
+class NdefRecord {        // a view on a record in the parser's buffer
+  public:
+    NdefTnf tnf{NdefTnf::empty};
+    bool messageBegin{false};
+    bool messageEnd{false};
+    const uint8_t *type{nullptr};        // of the first chunk, for a chunked record
+    uint8_t typeLength{0};
+    const uint8_t *id{nullptr};          // of the first chunk, for a chunked record
+    uint8_t idLength{0};
+    const uint8_t *payload{nullptr};
+    uint32_t payloadLength{0};
+    uint16_t chunkIndex{0};              // 0 for the first chunk, and for a record which is not chunked
+    bool lastChunk{true};                // false while more chunks of this record follow
+
+    bool hasType(NdefTnf theTnf, const char *theType) const;        // eg. hasType(NdefTnf::wellKnown, "U")
+};
+
+class NdefParser {
+  public:
+    void startMessage(const uint8_t message[], uint32_t messageLength);        // a bare NDEF message
+    void startTlv(const uint8_t dataArea[]);                                   // a Type 2 Tag's Data Area, from page 4 : the message in its NDEF Message TLV
+    NdefParseResult next(NdefRecord &theRecord, uint32_t availableLength);        // the next record, with buffer[0..availableLength) valid so far. needMoreData : call again when more is
+    uint32_t getOffset() const;                                                   // where the next record or TLV starts in the buffer
+    uint32_t getNmbrOfRecords() const;                                            // yielded so far, every chunk counted
+
+  private:
+    enum class State : uint8_t {
+        tlv,            // looking for the NDEF Message TLV
+        records,
+        done,
+        failed
+    };
+    const uint8_t *buffer{nullptr};
+    State theState{State::done};
+    uint32_t offset{0};
+    uint32_t messageEnd{0};               // offset after the last byte of the message
+    uint32_t nmbrOfRecords{0};
+    bool firstRecord{true};
+    bool inChunkedRecord{false};          // the chunks after the first have no type and id of their own
+    uint16_t chunkIndex{0};
+    NdefTnf chunkTnf{NdefTnf::empty};
+    const uint8_t *chunkType{nullptr};
+    uint8_t chunkTypeLength{0};
+    const uint8_t *chunkId{nullptr};
+    uint8_t chunkIdLength{0};
+
+    NdefParseResult findMessage(uint32_t availableLength);
+    NdefParseResult parseRecord(NdefRecord &theRecord, uint32_t availableLength);
+};
+
+class NdefBuilder {
+  public:
+    NdefBuilder(uint8_t buffer[], uint32_t bufferSize);        // the message is built at buffer[0], eg. the one handed to Type2TagWriter::write()
+    bool addRecord(NdefTnf tnf, const char *type, const uint8_t payload[], uint32_t payloadLength, const uint8_t id[] = nullptr, uint8_t idLength = 0);        // false if it does not fit
+    uint8_t *reserve(NdefTnf tnf, const char *type, uint32_t payloadLength, const uint8_t id[] = nullptr, uint8_t idLength = 0);        // adds a record whose payload the application writes in the place returned. nullptr if it does not fit
+    bool addUri(const char *uri);                              // URI record, with the abbreviation of its prefix. NFC Forum URI Record Type Definition
+    bool addText(const char *text, const char *language = "en");        // Text record, UTF-8. NFC Forum Text Record Type Definition
+    void clear();
+    const uint8_t *getMessage() const;
+    uint32_t getLength() const;                                // [bytes] of the message so far
+    uint32_t getNmbrOfRecords() const;
+    bool isOverflow() const;                                   // a record did not fit, and was left out
+
+  private:
+    uint8_t *buffer;
+    uint32_t bufferSize;
+    uint32_t length{0};
+    uint32_t lastHeader{0};        // offset of the last record's header, whose ME moves on to the next one
+    uint32_t nmbrOfRecords{0};
+    bool overflow{false};
+};
@@ -11,6 +11,10 @@
 
 #include "PN7150Interface.h"									// NCI protocol runs over a hardware interface, in this case an I2C with 2 extra handshaking signals
 
+#if defined(ARDUINO)
+
+PN7150Interface* PN7150Interface::theInstance = nullptr;
+constexpr uint32_t PN7150Interface::maxRequestLength;
 
 PN7150Interface::PN7150Interface(uint8_t IRQ, uint8_t VEN) : IRQ(IRQ), VEN(VEN), I2Caddress(0x28)
     {
@@ -22,31 +26,54 @@ PN7150Interface::PN7150Interface(uint8_t IRQ, uint8_t VEN, uint8_t I2Caddress) :
     // Constructor, initializing IRQ and VEN and initializing I2Caddress to a custom value
     }
 
-void PN7150Interface::initialize(void)
+void PN7150Interface::beginReset(void)
     {
     pinMode(IRQ, INPUT);												// IRQ goes from PN7150 to DeviceHost, so is an input
     pinMode(VEN, OUTPUT);											// VEN controls the PN7150's mode, so is an output
 
     // PN7150 Reset procedure : see PN7150 datasheet 12.6.1, 12.6.2.2, Fig 18 and 16.2.2
-    digitalWrite(VEN, LOW);											// drive VEN LOW...
-    delay(1);															// ...for at least 10us
-    digitalWrite(VEN, HIGH);											// then VEN HIGH again, and wait for 2.5 ms for the device to boot and allow communication
-    delay(3);
+    digitalWrite(VEN, LOW);											// drive VEN LOW, until endReset()
+    irqPending = false;
 
     Wire.begin();														// Start I2C interface
     }
 
-bool PN7150Interface::hasMessage() const
+void PN7150Interface::endReset(void)
+    {
+    digitalWrite(VEN, HIGH);											// then VEN HIGH again : the device boots, and allows communication after bootTime
+    }
+
+bool PN7150Interface::isIrqHigh() const
     {
     return (HIGH == digitalRead(IRQ));								// PN7150 indicates it has data by driving IRQ signal HIGH
     }
 
-uint8_t PN7150Interface::write(uint8_t txBuffer[], uint32_t txBufferLevel) const
+void PN7150Interface::enableInterrupt()
+    {
+    // Call this after initialize(), as beginReset() configures the IRQ pin
+    theInstance = this;
+    attachInterrupt(digitalPinToInterrupt(IRQ), isr, RISING);
+    NciTransport::enableInterrupt();									// after attaching, so an edge in between is not lost
+    }
+
+void PN7150Interface::isr()
+    {
+    if (theInstance)
+        {
+        theInstance->irqHandler();
+        }
+    }
+
+uint8_t PN7150Interface::writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength)
     {
     Wire.beginTransmission(I2Caddress);									// Setup I2C to transmit
     uint32_t nmbrBytesWritten = 0;
-    nmbrBytesWritten = Wire.write(txBuffer, txBufferLevel);				// Copy the data into the I2C transmit buffer
-    if (nmbrBytesWritten == txBufferLevel)								// If this worked..
+    nmbrBytesWritten = Wire.write(header, headerLength);					// Copy the data into the I2C transmit buffer, directly from the caller's buffers
+    if (payloadLength > 0)
+        {
+        nmbrBytesWritten += Wire.write(payload, payloadLength);
+        }
+    if (nmbrBytesWritten == (headerLength + payloadLength))				// If this worked..
         {
         uint8_t resultCode;
         resultCode = Wire.endTransmission();							// .. transmit the buffer, while checking for any errors
@@ -58,36 +85,33 @@ uint8_t PN7150Interface::write(uint8_t txBuffer[], uint32_t txBufferLevel) const
         }
     }
 
-uint32_t PN7150Interface::read(uint8_t rxBuffer[]) const
+uint32_t PN7150Interface::readTransaction(uint8_t rxBuffer[], uint32_t rxLength)
     {
-    uint32_t bytesReceived;												// keeps track of how many bytes we actually received
-    if (hasMessage())													// only try to read something if the PN7150 indicates it has something
-        {
-        // using 'Split mode' I2C read. See UM10936 section 3.5
-        bytesReceived = Wire.requestFrom((int)I2Caddress, 3);			// first reading the header, as this contains how long the payload will be
-
-        rxBuffer[0] = Wire.read();
-        rxBuffer[1] = Wire.read();
-        rxBuffer[2] = Wire.read();
-        uint8_t payloadLength = rxBuffer[2];
-        if (payloadLength > 0)
-            {
-            bytesReceived += Wire.requestFrom(I2Caddress, payloadLength);		// then reading the payload, if any
-            uint32_t index = 3;
-            while (index < bytesReceived)
-                {
-                rxBuffer[index] = Wire.read();
-                index++;
-                }
-            }
-        }
-    else
+    uint32_t bytesReceived = Wire.requestFrom(I2Caddress, (uint8_t)rxLength);		// the PN7150 continues the packet where the previous transaction stopped. rxLength <= maxRequestLength, see getMaxTransactionLength()
+    uint32_t index = 0;
+    while (index < bytesReceived)
         {
-        bytesReceived = 0;
+        rxBuffer[index] = Wire.read();
+        index++;
         }
     return bytesReceived;
     }
 
+uint32_t PN7150Interface::getMaxTransactionLength() const
+    {
+#if defined(TEENSYDUINO) && defined(KINETISK)
+    uint32_t bufferLength = I2C_RX_BUFFER_LENGTH;						// i2c_t3 : 259 by default
+#elif defined(I2C_BUFFER_LENGTH)
+    uint32_t bufferLength = I2C_BUFFER_LENGTH;							// ESP32, ESP8266 and others
+#elif defined(BUFFER_LENGTH)
+    uint32_t bufferLength = BUFFER_LENGTH;								// AVR Wire
+#else
+    uint32_t bufferLength = 32;											// most Wire implementations
+#endif
+    return (bufferLength < maxRequestLength) ? bufferLength : maxRequestLength;
+    }
+#endif
+
 // void PN7150Interface::test001()
 // // is the VEN signal being properly controlled ? Measure with a multimeter and verify the 2 second high + second low square wave
 //     {
@@ -22,8 +22,11 @@
 //   * read() : Read message from PN7150 over I2C
 //   * write() : Write message to PN7150 over I2C
 //   * hasMessage() : Check if PN7150 has message waiting for MCU
+//   * enableInterrupt() : Optionally, let an ISR on the IRQ edge latch the pending message, so hasMessage() no longer needs to read the pin
 
+#if defined(ARDUINO)                                 // This implementation is for Arduino targets. See PN7150LinuxInterface.h for Linux and PN7150Simulator.h for host testing
 #include <stdint.h>                                  // Gives us access to uint8_t types etc.
+#include "NciTransport.h"                            // The interface the NCI talks to
                                                      // The HW interface between The PN7150 and the DeviceHost is I2C, so we need the I2C library.library
 #if defined(TEENSYDUINO) && defined(KINETISK)        // Teensy 3.0, 3.1, 3.2, 3.5, 3.6 :  Special, more optimized I2C library for Teensy boards
 #include <i2c_t3.h>                                  // Credits Brian "nox771" : see https://forum.pjrc.com/threads/21680-New-I2C-library-for-Teensy3
@@ -33,20 +36,29 @@
                          //			See : https://github.com/Strooom/PN7150/issues/7
 #endif
 
-class PN7150Interface {
+class PN7150Interface : public NciTransport {
   public:
-    PN7150Interface(uint8_t IRQ, uint8_t VEN);                            // Constructor with default I2C address
-    PN7150Interface(uint8_t IRQ, uint8_t VEN, uint8_t I2Caddress);        // Constructor with custom I2C address
-    void initialize(void);                                                // Initialize the HW interface at the Device Host
-    uint8_t write(uint8_t data[], uint32_t dataLength) const;             // write data from DeviceHost to PN7150. Returns success (0) or Fail (> 0)
-    uint32_t read(uint8_t data[]) const;                                  // read data from PN7150, returns the amount of bytes read
-    bool hasMessage() const;                                              // does the PN7150 indicate it has data for the DeviceHost to be read
+    PN7150Interface(uint8_t IRQ, uint8_t VEN);                              // Constructor with default I2C address
+    PN7150Interface(uint8_t IRQ, uint8_t VEN, uint8_t I2Caddress);          // Constructor with custom I2C address
+    void beginReset(void) override;                                         // Initialize the HW interface at the Device Host, and drive VEN LOW
+    void endReset(void) override;                                           // VEN HIGH, the PN7150 boots
+    void enableInterrupt() override;                                        // switch from polling the IRQ pin to interrupt-driven reception
+
+  protected:
+    uint8_t writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength) override;        // write data from DeviceHost to PN7150. Returns success (0) or Fail (> 0)
+    uint32_t readTransaction(uint8_t data[], uint32_t dataLength) override;              // read dataLength bytes from PN7150, returns the amount of bytes read
+    uint32_t getMaxTransactionLength() const override;                                   // size of the I2C library buffer, at most maxRequestLength
+    bool isIrqHigh() const override;                                                     // PN7150 indicates it has data by driving IRQ signal HIGH
 
   private:
+    static constexpr uint32_t maxRequestLength = 255;        // the portable Wire::requestFrom() takes a uint8_t length, so i2c_t3's 259 byte buffer can not be used to the end
     uint8_t IRQ;               // MCU pin to which IRQ is connected
     uint8_t VEN;               // MCU pin to which VEN is connected
     uint8_t I2Caddress;        // I2C Address at which the PN7150 is found. Default is 0x28, but can be adjusted by setting to pins at the device
 
+    static PN7150Interface *theInstance;        // attachInterrupt() takes a plain function without arguments, so the ISR needs to find the object this way
+    static void isr();                          // the actual ISR, forwarding to irqHandler()
+
     // public:
     //     void test001();											// testing VEN output on the HW
     //     void test002();											// testing IRQ input on the HW
@@ -54,3 +66,4 @@ class PN7150Interface {
     //     void test004();											// testing the notification of data from the PN7150 by rising IRQ
     //     void test005();											// sending CORE_RESET_CMD and checking if the PN7150 responds with CORE_RESET_RSP
 };
+#endif
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "PN7150LinuxInterface.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+PN7150LinuxInterface::PN7150LinuxInterface(const char *i2cDevice, const char *gpioChip, uint32_t IRQ, uint32_t VEN) : i2cDevice(i2cDevice), gpioChip(gpioChip), IRQ(IRQ), VEN(VEN), I2Caddress(0x28) {
+}
+
+PN7150LinuxInterface::PN7150LinuxInterface(const char *i2cDevice, const char *gpioChip, uint32_t IRQ, uint32_t VEN, uint8_t I2Caddress) : i2cDevice(i2cDevice), gpioChip(gpioChip), IRQ(IRQ), VEN(VEN), I2Caddress(I2Caddress) {
+}
+
+PN7150LinuxInterface::~PN7150LinuxInterface() {
+    closeDevices();
+}
+
+void PN7150LinuxInterface::beginReset() {
+    if (!isOpen()) {
+        closeDevices();        // whatever did open the last time, so a retry starts clean
+        openDevices();
+    }
+
+    // PN7150 Reset procedure : see PN7150 datasheet 12.6.1, 12.6.2.2, Fig 18 and 16.2.2
+    setVen(false);        // drive VEN LOW, until endReset()
+    irqPending = false;
+}
+
+void PN7150LinuxInterface::endReset() {
+    setVen(true);        // then VEN HIGH again : the device boots, and allows communication after bootTime
+}
+
+void PN7150LinuxInterface::openDevices() {
+    unsigned long functionality = 0;
+    lastError                   = 0;
+    lastErrorSource             = nullptr;
+    i2cFd                       = open(i2cDevice, O_RDWR);
+    if (i2cFd < 0) {
+        openFailed(i2cDevice);        // eg. ENOENT : wrong bus number, or i2c-dev not loaded
+    } else if (ioctl(i2cFd, I2C_FUNCS, &functionality) == 0) {
+        noStartSupported = (0 != (functionality & I2C_FUNC_NOSTART));
+    } else {
+        openFailed("I2C_FUNCS");        // eg. ENOTTY : not an i2c-dev device
+    }
+
+    int chipFd = open(gpioChip, O_RDWR);
+    if (chipFd < 0) {
+        openFailed(gpioChip);
+        return;
+    }
+
+    struct gpiohandle_request venRequest;
+    memset(&venRequest, 0, sizeof(venRequest));
+    venRequest.lineoffsets[0]    = VEN;
+    venRequest.lines             = 1;
+    venRequest.flags             = GPIOHANDLE_REQUEST_OUTPUT;
+    venRequest.default_values[0] = 1;
+    strncpy(venRequest.consumer_label, "PN7150 VEN", sizeof(venRequest.consumer_label) - 1);
+    if (ioctl(chipFd, GPIO_GET_LINEHANDLE_IOCTL, &venRequest) == 0) {
+        venFd = venRequest.fd;
+    } else {
+        openFailed("GPIO_GET_LINEHANDLE_IOCTL");        // eg. EINVAL : no such line, EBUSY : the line is used by someone else
+    }
+
+    struct gpioevent_request irqRequest;
+    memset(&irqRequest, 0, sizeof(irqRequest));
+    irqRequest.lineoffset  = IRQ;
+    irqRequest.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    irqRequest.eventflags  = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(irqRequest.consumer_label, "PN7150 IRQ", sizeof(irqRequest.consumer_label) - 1);
+    if (ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &irqRequest) == 0) {
+        irqFd = irqRequest.fd;
+    } else {
+        openFailed("GPIO_GET_LINEEVENT_IOCTL");
+    }
+
+    close(chipFd);        // the line handles remain valid after closing the chip
+}
+
+void PN7150LinuxInterface::openFailed(const char *source) {
+    if (0 == lastError) {
+        lastError       = errno;
+        lastErrorSource = source;
+    }
+}
+
+bool PN7150LinuxInterface::isOpen() const {
+    return (i2cFd >= 0) && (venFd >= 0) && (irqFd >= 0);
+}
+
+int PN7150LinuxInterface::getLastError() const {
+    return lastError;
+}
+
+const char *PN7150LinuxInterface::getLastErrorSource() const {
+    return lastErrorSource;
+}
+
+void PN7150LinuxInterface::closeDevices() {
+    if (watchingIrq) {
+        watchingIrq = false;
+        irqThread.join();
+    }
+    if (irqFd >= 0) {
+        close(irqFd);
+        irqFd = -1;
+    }
+    if (venFd >= 0) {
+        close(venFd);
+        venFd = -1;
+    }
+    if (i2cFd >= 0) {
+        close(i2cFd);
+        i2cFd = -1;
+    }
+}
+
+void PN7150LinuxInterface::setVen(bool high) const {
+    struct gpiohandle_data data;
+    memset(&data, 0, sizeof(data));
+    data.values[0] = high ? 1 : 0;
+    (void)ioctl(venFd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+}
+
+bool PN7150LinuxInterface::isIrqHigh() const {
+    struct gpiohandle_data data;
+    memset(&data, 0, sizeof(data));
+    if (ioctl(irqFd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+        return false;
+    }
+    return (1 == data.values[0]);        // PN7150 indicates it has data by driving IRQ signal HIGH
+}
+
+bool PN7150LinuxInterface::waitForMessage(unsigned long maxWaitTime) {
+    if (interruptMode) {
+        std::unique_lock<std::mutex> lock(irqMutex);
+        return irqCondition.wait_for(lock, std::chrono::milliseconds(maxWaitTime), [this] { return irqPending.load(); });
+    }
+    if (isIrqHigh()) {
+        return true;
+    }
+    struct pollfd irqPoll;
+    irqPoll.fd      = irqFd;
+    irqPoll.events  = POLLIN | POLLPRI;
+    irqPoll.revents = 0;
+    int timeout     = (maxWaitTime > 0x7FFFFFFF) ? -1 : static_cast<int>(maxWaitTime);
+    if (poll(&irqPoll, 1, timeout) > 0) {
+        struct gpioevent_data event;
+        (void)::read(irqFd, &event, sizeof(event));        // consume the edge event, the level tells us the rest
+        irqHandler();
+    }
+    return isIrqHigh();
+}
+
+void PN7150LinuxInterface::enableInterrupt() {
+    if (!watchingIrq && (irqFd >= 0)) {
+        watchingIrq = true;
+        irqThread   = std::thread(&PN7150LinuxInterface::watchIrq, this);
+    }
+    NciTransport::enableInterrupt();        // after the thread is watching, so an edge in between is not lost
+}
+
+void PN7150LinuxInterface::watchIrq() {
+    struct pollfd irqPoll;
+    irqPoll.fd     = irqFd;
+    irqPoll.events = POLLIN | POLLPRI;
+    while (watchingIrq) {
+        irqPoll.revents = 0;
+        if (poll(&irqPoll, 1, 100) > 0) {        // wakes up now and then, to see if it has to stop
+            struct gpioevent_data event;
+            (void)::read(irqFd, &event, sizeof(event));
+            if (isIrqHigh()) {        // the edge of a message which is read already, after the latch re-armed itself on the level, does not latch again
+                std::lock_guard<std::mutex> lock(irqMutex);
+                irqHandler();
+            }
+            irqCondition.notify_all();
+        }
+    }
+}
+
+uint32_t PN7150LinuxInterface::transfer(uint8_t data[], uint32_t dataLength, bool isRead) const {
+    struct i2c_msg message;
+    message.addr  = I2Caddress;
+    message.flags = isRead ? I2C_M_RD : 0;
+    message.len   = static_cast<uint16_t>(dataLength);
+    message.buf   = data;
+
+    struct i2c_rdwr_ioctl_data transaction;
+    transaction.msgs  = &message;
+    transaction.nmsgs = 1;
+    if (ioctl(i2cFd, I2C_RDWR, &transaction) < 0) {
+        return 0;
+    }
+    return dataLength;
+}
+
+uint8_t PN7150LinuxInterface::writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength) {
+    // i2c_msg has no const buffer, but the kernel does not write into it for a write message
+    struct i2c_msg messages[2];
+    messages[0].addr  = I2Caddress;
+    messages[0].flags = 0;
+    messages[0].len   = static_cast<uint16_t>(headerLength);
+    messages[0].buf   = const_cast<uint8_t *>(header);
+
+    struct i2c_rdwr_ioctl_data transaction;
+    transaction.msgs  = messages;
+    transaction.nmsgs = 1;
+
+    uint8_t packet[3 + 255];        // only used when the adapter can not continue a message from a second buffer
+    if (payloadLength > 0) {
+        if (noStartSupported) {
+            messages[1].addr  = I2Caddress;
+            messages[1].flags = I2C_M_NOSTART;        // no START and address, so on the bus this is one single write
+            messages[1].len   = static_cast<uint16_t>(payloadLength);
+            messages[1].buf   = const_cast<uint8_t *>(payload);
+            transaction.nmsgs = 2;
+        } else if ((headerLength + payloadLength) <= sizeof(packet)) {
+            memcpy(packet, header, headerLength);
+            memcpy(packet + headerLength, payload, payloadLength);
+            messages[0].len = static_cast<uint16_t>(headerLength + payloadLength);
+            messages[0].buf = packet;
+        } else {
+            return 1;        // data too long
+        }
+    }
+    if (ioctl(i2cFd, I2C_RDWR, &transaction) < 0) {
+        return 4;        // same code as the Arduino implementation uses for 'other error'
+    }
+    return 0;
+}
+
+uint32_t PN7150LinuxInterface::readTransaction(uint8_t data[], uint32_t dataLength) {
+    return transfer(data, dataLength, true);
+}
+
+uint32_t PN7150LinuxInterface::getMaxTransactionLength() const {
+    return 8192;
+}
+#endif
@@ -0,0 +1,73 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Hardware interface for a PN7150 connected to a Linux board (Raspberry Pi and alike)
+//     I2C : through the i2c-dev driver, eg. /dev/i2c-1. Every transfer is a single I2C_RDWR ioctl.
+//           When writing, header and payload are sent from the caller's buffers as one message, using I2C_M_NOSTART for the payload part if the adapter supports it
+//     IRQ and VEN : through the GPIO character device, eg. /dev/gpiochip0. IRQ is requested with rising edge events, so waitForMessage() can sleep in poll()
+//     After enableInterrupt(), a thread waits for those edge events and latches them, the way the ISR does on Arduino
+
+#if defined(__linux__) && !defined(ARDUINO)
+#include <stdint.h>               // Gives us access to uint8_t types etc.
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "NciTransport.h"        // The interface the NCI talks to
+
+class PN7150LinuxInterface : public NciTransport {
+  public:
+    PN7150LinuxInterface(const char *i2cDevice, const char *gpioChip, uint32_t IRQ, uint32_t VEN);                            // Constructor with default I2C address
+    PN7150LinuxInterface(const char *i2cDevice, const char *gpioChip, uint32_t IRQ, uint32_t VEN, uint8_t I2Caddress);        // Constructor with custom I2C address
+    ~PN7150LinuxInterface();
+    void beginReset() override;                                     // Open the devices and drive VEN LOW
+    void endReset() override;                                       // VEN HIGH, the PN7150 boots
+    bool waitForMessage(unsigned long maxWaitTime) override;        // sleeps in poll() on the IRQ edge events, or until the latch is set in interrupt mode
+    void enableInterrupt() override;                                // starts the thread latching the IRQ edge events
+    bool isOpen() const;                                            // the i2c-dev and both GPIO lines were opened by the last beginReset()
+    int getLastError() const;                                       // errno of the first open() or ioctl() which failed opening them, 0 if none
+    const char *getLastErrorSource() const;                         // which one that was, eg. "GPIO_GET_LINEEVENT_IOCTL", nullptr if none
+
+  protected:
+    uint8_t writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength) override;        // write data from DeviceHost to PN7150. Returns success (0) or Fail (> 0)
+    uint32_t readTransaction(uint8_t data[], uint32_t dataLength) override;              // read dataLength bytes from PN7150, returns the amount of bytes read
+    uint32_t getMaxTransactionLength() const override;                                   // i2c-dev limits a single message to 8192 bytes
+    bool isIrqHigh() const override;                                                     // PN7150 indicates it has data by driving IRQ signal HIGH
+
+  private:
+    const char *i2cDevice;        // eg. "/dev/i2c-1"
+    const char *gpioChip;         // eg. "/dev/gpiochip0"
+    uint32_t IRQ;                 // GPIO line offset to which IRQ is connected
+    uint32_t VEN;                 // GPIO line offset to which VEN is connected
+    uint8_t I2Caddress;           // I2C Address at which the PN7150 is found. Default is 0x28
+
+    int i2cFd{-1};        // file descriptor of the opened i2c-dev
+    int venFd{-1};        // file descriptor of the GPIO line handle for VEN
+    int irqFd{-1};        // file descriptor of the GPIO line event request for IRQ
+    int lastError{0};
+    const char *lastErrorSource{nullptr};
+    bool noStartSupported{false};        // can the adapter continue a message without repeated START (I2C_M_NOSTART), so header and payload go out from separate buffers
+    std::thread irqThread;
+    std::atomic<bool> watchingIrq{false};
+    std::mutex irqMutex;                          // guards the latch between irqThread and waitForMessage()
+    std::condition_variable irqCondition;         // wakes up waitForMessage() when irqThread latches an edge
+
+    void openDevices();
+    void openFailed(const char *source);        // keep errno of the first failure
+    void closeDevices();
+    void watchIrq();        // body of irqThread
+    void setVen(bool high) const;
+    uint32_t transfer(uint8_t data[], uint32_t dataLength, bool isRead) const;        // single message I2C_RDWR, returns amount of bytes transferred
+};
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   The driver uses the Arduino timing functions. When building for a host (Linux), this provides them, so the rest of the code does not need to know
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+unsigned long millis();                         // milliseconds since start of the program
+unsigned long micros();                         // microseconds since start of the program
+void delay(unsigned long ms);                   // blocking wait in milliseconds
+void delayMicroseconds(unsigned int us);        // blocking wait in microseconds
+#endif
@@ -0,0 +1,1035 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "PN7150Simulator.h"
+
+#if !defined(ARDUINO)
+#include <algorithm>
+#include <chrono>
+
+SimulatedTag SimulatedTag::ntag216() {
+    SimulatedTag theTag;
+    theTag.version = {0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x13, 0x03};
+    theTag.memory.assign(231 * 4, 0x00);
+    for (uint32_t index = 0; index < 3; index++) {
+        theTag.memory[index] = theTag.uniqueId[index];        // UID0..2, BCC0, UID3..6, BCC1 : the check bytes are not simulated
+    }
+    for (uint32_t index = 3; index < 7; index++) {
+        theTag.memory[index + 1] = theTag.uniqueId[index];
+    }
+    const uint8_t capabilityContainer[] = {0xE1, 0x10, 0x6D, 0x00, 0x03, 0x00, 0xFE};        // page 3 : NDEF, 872 bytes. page 4 : empty NDEF Message TLV, Terminator TLV
+    std::copy(capabilityContainer, capabilityContainer + sizeof(capabilityContainer), theTag.memory.begin() + 12);
+    return theTag;
+}
+
+SimulatedTag SimulatedTag::isoDepCard() {
+    SimulatedTag theTag;
+    theTag.protocol       = PROTOCOL_ISO_DEP;
+    theTag.selRes         = 0x20;        // ISO/IEC 14443-4 compliant
+    theTag.sensRes[0]     = 0x04;
+    theTag.uniqueIdLength = 4;
+    theTag.uniqueId[0]    = 0x08;        // random UID, as payment cards and passports have
+    theTag.memory.resize(4096);
+    for (uint32_t index = 0; index < theTag.memory.size(); index++) {
+        theTag.memory[index] = static_cast<uint8_t>(index);
+    }
+    return theTag;
+}
+
+PN7150Simulator::PN7150Simulator() {
+    deliveryThread = std::thread(&PN7150Simulator::deliver, this);
+}
+
+PN7150Simulator::~PN7150Simulator() {
+    {
+        std::lock_guard<std::mutex> lock(theMutex);
+        stopping = true;
+    }
+    theCondition.notify_all();
+    deliveryThread.join();
+}
+
+void PN7150Simulator::beginReset() {
+    std::lock_guard<std::mutex> lock(theMutex);
+    scheduledPackets.clear();
+    readyPackets.clear();
+    readOffset            = 0;
+    irqPending            = false;
+    nmbrOfUnreadResponses = 0;
+    theRfState            = RfState::Idle;
+    poweredDown           = true;
+    booting               = false;
+    commandSegments.clear();
+    theConnections.clear();
+    hanging = false;
+    if (!configRetention) {
+        configParameters.clear();
+        standbyEnabled = false;
+        configLost     = true;
+    }
+}
+
+void PN7150Simulator::endReset() {
+    std::lock_guard<std::mutex> lock(theMutex);
+    poweredDown   = false;
+    booting       = true;
+    bootStartTime = micros();
+    nmbrOfPowerUps++;
+}
+
+void PN7150Simulator::deliver() {
+    std::unique_lock<std::mutex> lock(theMutex);
+    while (!stopping) {
+        deliverDuePackets();
+        if (scheduledPackets.empty()) {
+            theCondition.wait(lock);
+        } else {
+            long untilDue = static_cast<long>(scheduledPackets.front().dueTime - micros());
+            if (untilDue > 0) {
+                theCondition.wait_for(lock, std::chrono::microseconds(untilDue));
+            }
+        }
+    }
+}
+
+void PN7150Simulator::deliverDuePackets() {
+    unsigned long now = micros();
+    bool isDelivered  = false;
+    while (!scheduledPackets.empty() && (static_cast<long>(now - scheduledPackets.front().dueTime) >= 0)) {
+        const std::vector<uint8_t> &due = scheduledPackets.front().data;
+        if ((due.size() >= 6) && ((MsgTypeNotification | GroupIdCore) == due[0]) && (CORE_CONN_CREDITS_NTF == due[1])) {
+            Connection *theConnection = findConnection(due[4]);        // the credit is the DeviceHost's from the moment it can read the notification
+            if (nullptr != theConnection) {
+                theConnection->credits += due[5];
+            }
+        }
+        bool wasLow = readyPackets.empty();
+        readyPackets.push_back(scheduledPackets.front());
+        scheduledPackets.pop_front();
+        if (wasLow) {
+            nmbrOfIrqEdges++;
+            irqHandler();        // this is the simulated rising edge of IRQ. When it was HIGH already there is no edge : the DeviceHost re-arms its latch by reading the line
+        }
+        isDelivered = true;
+    }
+    if (isDelivered) {
+        theCondition.notify_all();
+    }
+}
+
+uint8_t PN7150Simulator::writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength) {
+    uint8_t data[MsgHeaderSize + MaxPayloadSize];        // the simulated NFCC receives the bytes in its own buffer, just like the real one
+    uint32_t dataLength = headerLength + payloadLength;
+    if (dataLength > sizeof(data)) {
+        return 1;
+    }
+    for (uint32_t index = 0; index < headerLength; index++) {
+        data[index] = header[index];
+    }
+    for (uint32_t index = 0; index < payloadLength; index++) {
+        data[headerLength + index] = payload[index];
+    }
+    if ((dataLength < MsgHeaderSize) || (dataLength != (MsgHeaderSize + static_cast<uint32_t>(data[2])))) {
+        return 4;        // the real device would NACK or ignore this, the DH will run into a timeOut
+    }
+    std::lock_guard<std::mutex> lock(theMutex);
+    if (booting && ((micros() - bootStartTime) < bootLatency)) {
+        nmbrOfEarlyWrites++;
+        return 2;        // still booting, the PN7150 NACKs its address
+    }
+    booting = false;
+    if (poweredDown) {
+        return 2;        // NACK on the address, a powered down PN7150 is not on the bus
+    }
+    bool isLastSegment = (PacketBoundaryFlagLastSegment == (data[0] & PacketBoundaryFlagNotLastSegment));
+    if (MsgTypeCommand == (data[0] & 0xE0)) {
+        commandSegments.insert(commandSegments.end(), data + MsgHeaderSize, data + dataLength);
+        if (isLastSegment) {
+            nmbrOfCommands++;
+            if (nmbrOfUnreadResponses > 0) {
+                nmbrOfOverlappingCommands++;
+            }
+            std::vector<uint8_t> command;
+            command.swap(commandSegments);
+            handleCommand(data[0] & 0x0F, data[1] & 0x3F, command.data(), static_cast<uint32_t>(command.size()));
+        }
+    } else if (MsgTypeData == (data[0] & 0xE0)) {
+        uint8_t connectionId      = data[0] & 0x0F;
+        Connection *theConnection = findConnection(connectionId);
+        if (nullptr != theConnection) {
+            if (NciConnection::noFlowControl != theConnection->credits) {
+                if (0 == theConnection->credits) {
+                    nmbrOfCreditViolations++;        // the real NFCC would drop the packet, or worse..
+                    return 0;
+                }
+                theConnection->credits--;
+                schedule(dataLatency, MsgTypeNotification, GroupIdCore, CORE_CONN_CREDITS_NTF, {1, connectionId, 1});
+            }
+            theConnection->dataSegments.insert(theConnection->dataSegments.end(), data + MsgHeaderSize, data + dataLength);
+            if (isLastSegment) {
+                std::vector<uint8_t> frame;
+                frame.swap(theConnection->dataSegments);
+                handleData(connectionId, frame);
+            }
+        }
+    }
+    return 0;
+}
+
+uint32_t PN7150Simulator::readTransaction(uint8_t data[], uint32_t dataLength) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    if (readyPackets.empty() || (dataLength > maxTransactionLength)) {
+        return 0;        // NACK
+    }
+    const std::vector<uint8_t> &packet = readyPackets.front().data;
+    for (uint32_t index = 0; index < dataLength; index++) {
+        data[index] = ((readOffset + index) < packet.size()) ? packet[readOffset + index] : 0xFF;
+    }
+    readOffset += dataLength;
+    if (readOffset >= packet.size()) {        // packet completely read, IRQ goes LOW unless the next packet is ready
+        if ((MsgTypeResponse == (packet[0] & 0xE0)) && (nmbrOfUnreadResponses > 0)) {
+            nmbrOfUnreadResponses--;
+        }
+        readyPackets.pop_front();
+        readOffset = 0;
+    }
+    return dataLength;
+}
+
+bool PN7150Simulator::isIrqHigh() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    const_cast<PN7150Simulator *>(this)->deliverDuePackets();        // the level follows the time, not when the deliveryThread gets the CPU
+    return !readyPackets.empty();
+}
+
+uint32_t PN7150Simulator::getMaxTransactionLength() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return maxTransactionLength;
+}
+
+void PN7150Simulator::setMaxTransactionLength(uint32_t length) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    maxTransactionLength = length;
+}
+
+bool PN7150Simulator::waitForMessage(unsigned long maxWaitTime) {
+    std::unique_lock<std::mutex> lock(theMutex);
+    if (theCondition.wait_for(lock, std::chrono::milliseconds(maxWaitTime), [this] { return interruptMode ? irqPending.load() : !readyPackets.empty(); })) {
+        return true;
+    }
+    deliverDuePackets();        // when the host did not get the CPU for a while, neither did the deliveryThread : the real NFCC would have raised IRQ for what is due by now
+    return interruptMode ? irqPending.load() : !readyPackets.empty();
+}
+
+uint32_t PN7150Simulator::getNmbrOfIrqEdges() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfIrqEdges;
+}
+
+void PN7150Simulator::setResponseLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    responseLatency = latency;
+}
+
+void PN7150Simulator::setSlowResponseLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    slowResponseLatency = latency;
+}
+
+void PN7150Simulator::setDataCredits(uint8_t credits) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    dataCredits = credits;
+}
+
+void PN7150Simulator::setDataLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    dataLatency = latency;
+}
+
+uint32_t PN7150Simulator::getNmbrOfCreditViolations() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfCreditViolations;
+}
+
+std::vector<uint8_t> PN7150Simulator::getConfigParameter(uint16_t parameterId) const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    std::map<uint16_t, std::vector<uint8_t>>::const_iterator position = configParameters.find(parameterId);
+    return (position == configParameters.end()) ? std::vector<uint8_t>() : position->second;
+}
+
+uint32_t PN7150Simulator::getNmbrOfConfigWrites(uint16_t parameterId) const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    std::map<uint16_t, uint32_t>::const_iterator position = nmbrOfConfigWrites.find(parameterId);
+    return (position == nmbrOfConfigWrites.end()) ? 0 : position->second;
+}
+
+bool PN7150Simulator::isPoweredDown() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return poweredDown;
+}
+
+bool PN7150Simulator::isStandbyEnabled() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return standbyEnabled;
+}
+
+void PN7150Simulator::setMaxControlPayloadSize(uint8_t size) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    maxControlPayloadSize = size;
+}
+
+void PN7150Simulator::setBootLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    bootLatency = latency;
+}
+
+void PN7150Simulator::setConfigRetention(bool retain) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    configRetention = retain;
+}
+
+void PN7150Simulator::setCoreResetNotification(bool enable) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    coreResetNotification = enable;
+}
+
+uint32_t PN7150Simulator::getNmbrOfEarlyWrites() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfEarlyWrites;
+}
+
+uint32_t PN7150Simulator::getNmbrOfPowerUps() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfPowerUps;
+}
+
+uint32_t PN7150Simulator::getNmbrOfDiscoveries() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfDiscoveries;
+}
+
+void PN7150Simulator::setDiscoveryLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    discoveryLatency = latency;
+}
+
+void PN7150Simulator::setActivationLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    activationLatency = latency;
+}
+
+void PN7150Simulator::setRfByteTime(unsigned long time) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    rfByteTime = time;
+}
+
+void PN7150Simulator::setTagWriteTime(unsigned long time) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    tagWriteTime = time;
+}
+
+std::vector<uint8_t> PN7150Simulator::getTagMemory(uint8_t index) const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return (index < theTags.size()) ? theTags[index].memory : std::vector<uint8_t>();
+}
+
+void PN7150Simulator::setIsoDepActivationLatency(unsigned long latency) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    isoDepActivationLatency = latency;
+}
+
+uint32_t PN7150Simulator::getNmbrOfSelects() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfSelects;
+}
+
+void PN7150Simulator::addTag(const SimulatedTag &aTag) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    theTags.push_back(aTag);
+    startDiscovery();
+}
+
+void PN7150Simulator::removeTag(uint8_t index) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    if (index < theTags.size()) {
+        theTags.erase(theTags.begin() + index);
+    }
+}
+
+void PN7150Simulator::removeAllTags() {
+    std::lock_guard<std::mutex> lock(theMutex);
+    theTags.clear();
+}
+
+uint8_t PN7150Simulator::getNmbrOfTags() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return static_cast<uint8_t>(theTags.size());
+}
+
+uint32_t PN7150Simulator::getNmbrOfCommands() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfCommands;
+}
+
+uint32_t PN7150Simulator::getNmbrOfOverlappingCommands() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfOverlappingCommands;
+}
+
+void PN7150Simulator::schedule(unsigned long delay, uint8_t messageType, uint8_t groupId, uint8_t opcodeId, const std::vector<uint8_t> &payload) {
+    Packet thePacket;
+    thePacket.dueTime = micros() + delay;
+    thePacket.data.push_back(messageType | groupId);
+    thePacket.data.push_back(opcodeId);
+    thePacket.data.push_back(static_cast<uint8_t>(payload.size()));
+    thePacket.data.insert(thePacket.data.end(), payload.begin(), payload.end());
+    if (MsgTypeResponse == messageType) {
+        nmbrOfUnreadResponses++;
+    }
+
+    // keep the scheduled packets sorted by dueTime, packets with the same dueTime stay in the order they were scheduled
+    std::deque<Packet>::iterator position = scheduledPackets.end();
+    while ((position != scheduledPackets.begin()) && (static_cast<long>((position - 1)->dueTime - thePacket.dueTime) > 0)) {
+        --position;
+    }
+    scheduledPackets.insert(position, thePacket);
+    theCondition.notify_all();
+}
+
+void PN7150Simulator::respond(uint8_t groupId, uint8_t opcodeId, const std::vector<uint8_t> &payload) {
+    for (std::vector<InjectedFault>::iterator position = injectedFaults.begin(); position != injectedFaults.end(); ++position) {
+        if ((groupId != position->groupId) || (opcodeId != position->opcodeId)) {
+            continue;
+        }
+        SimulatedFault theFault = position->theFault;
+        if (0 == --position->count) {
+            injectedFaults.erase(position);
+        }
+        nmbrOfInjectedFaults++;
+        switch (theFault) {
+            case SimulatedFault::dropResponse:
+                break;
+
+            case SimulatedFault::corruptResponse:
+                schedule(responseLatency, MsgTypeResponse, groupId, static_cast<uint8_t>(opcodeId ^ 0x08), payload);
+                break;
+
+            case SimulatedFault::slowResponse:
+                schedule(slowResponseLatency, MsgTypeResponse, groupId, opcodeId, payload);
+                break;
+
+            case SimulatedFault::failResponse: {
+                std::vector<uint8_t> failed = payload;
+                if (!failed.empty()) {
+                    failed[0] = STATUS_FAILED;
+                }
+                schedule(responseLatency, MsgTypeResponse, groupId, opcodeId, failed);
+            } break;
+
+            default:
+                hanging      = true;
+                hangingUntil = theFault;
+                break;
+        }
+        return;
+    }
+    schedule(responseLatency, MsgTypeResponse, groupId, opcodeId, payload);
+}
+
+void PN7150Simulator::injectFault(uint8_t groupId, uint8_t opcodeId, SimulatedFault theFault, uint32_t count) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    if (count > 0) {
+        injectedFaults.push_back(InjectedFault{groupId, opcodeId, theFault, count});
+    }
+}
+
+void PN7150Simulator::truncateDiscoverNotifications(uint32_t count) {
+    std::lock_guard<std::mutex> lock(theMutex);
+    nmbrToTruncate = count;
+}
+
+uint32_t PN7150Simulator::getNmbrOfInjectedFaults() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return nmbrOfInjectedFaults;
+}
+
+bool PN7150Simulator::isHanging() const {
+    std::lock_guard<std::mutex> lock(theMutex);
+    return hanging;
+}
+
+PN7150Simulator::Connection *PN7150Simulator::findConnection(uint8_t connectionId) {
+    for (Connection &theConnection : theConnections) {
+        if (connectionId == theConnection.connectionId) {
+            return &theConnection;
+        }
+    }
+    return nullptr;
+}
+
+void PN7150Simulator::openConnection(uint8_t connectionId) {
+    closeConnection(connectionId);
+    theConnections.push_back(Connection{connectionId, dataCredits, {}});
+}
+
+void PN7150Simulator::closeConnection(uint8_t connectionId) {
+    for (std::vector<Connection>::iterator position = theConnections.begin(); position != theConnections.end(); ++position) {
+        if (connectionId == position->connectionId) {
+            theConnections.erase(position);
+            return;
+        }
+    }
+}
+
+bool PN7150Simulator::isActiveTagPresent() const {
+    for (const SimulatedTag &theTag : theTags) {
+        if ((theTag.uniqueIdLength == activeTag.uniqueIdLength) && std::equal(theTag.uniqueId, theTag.uniqueId + theTag.uniqueIdLength, activeTag.uniqueId)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PN7150Simulator::handleData(uint8_t connectionId, const std::vector<uint8_t> &frame) {
+    if (NciConnection::staticRfConnection != connectionId) {
+        scheduleData(dataLatency, connectionId, frame);        // loop-back
+        return;
+    }
+    if (!isActiveTagPresent()) {
+        schedule(dataLatency, MsgTypeNotification, GroupIdCore, CORE_INTERFACE_ERROR_NTF, {RF_TIMEOUT_ERROR, connectionId});
+        return;
+    }
+    std::vector<uint8_t> answer;
+    unsigned long latency = dataLatency;
+    if ((PROTOCOL_T2T == activeTag.protocol) && (2 == frame.size()) && (0x30 == frame[0])) {
+        for (uint32_t index = 0; index < 16; index++) {        // READ returns 4 blocks, NFC Forum Type 2 Tag Operation specification, section 5.1
+            uint32_t address = (frame[1] * 4U) + index;
+            answer.push_back((address < activeTag.memory.size()) ? activeTag.memory[address] : 0x00);
+        }
+    } else if ((PROTOCOL_T2T == activeTag.protocol) && !frame.empty() && ((0x60 == frame[0]) || (0x3A == frame[0])) && activeTag.version.empty()) {
+        schedule(dataLatency, MsgTypeNotification, GroupIdCore, CORE_INTERFACE_ERROR_NTF, {RF_TIMEOUT_ERROR, connectionId});        // an older tag does not answer GET_VERSION or FAST_READ
+        return;
+    } else if ((PROTOCOL_T2T == activeTag.protocol) && (1 == frame.size()) && (0x60 == frame[0])) {
+        answer = activeTag.version;        // GET_VERSION, NTAG213/215/216 datasheet, section 10.1
+    } else if ((PROTOCOL_T2T == activeTag.protocol) && (3 == frame.size()) && (0x3A == frame[0])) {
+        if ((frame[1] > frame[2]) || (((frame[2] + 1U) * 4U) > activeTag.memory.size())) {
+            answer.push_back(0x00);        // NAK : invalid address
+        } else {
+            answer.assign(activeTag.memory.begin() + (frame[1] * 4U), activeTag.memory.begin() + ((frame[2] + 1U) * 4U));        // FAST_READ, section 10.3
+        }
+    } else if ((PROTOCOL_T2T == activeTag.protocol) && (6 == frame.size()) && (0xA2 == frame[0])) {
+        if ((frame[1] < 4) || (((frame[1] + 1U) * 4U) > activeTag.memory.size())) {
+            answer.push_back(0x00);        // NAK : writing UID, lock bytes and Capability Container is not simulated
+        } else {
+            std::copy(frame.begin() + 2, frame.end(), activeTag.memory.begin() + (frame[1] * 4U));        // WRITE, NFC Forum Type 2 Tag Operation specification, section 5.2
+            for (SimulatedTag &theTag : theTags) {
+                if ((theTag.uniqueIdLength == activeTag.uniqueIdLength) && std::equal(theTag.uniqueId, theTag.uniqueId + theTag.uniqueIdLength, activeTag.uniqueId)) {
+                    theTag.memory = activeTag.memory;        // it keeps what was written when it leaves the field
+                }
+            }
+            answer.push_back(0x0A);        // ACK
+            latency += tagWriteTime;
+        }
+    } else if ((PROTOCOL_ISO_DEP == activeTag.protocol) && !activeTag.memory.empty()) {
+        answer = handleApdu(frame);
+    } else {
+        answer = frame;        // echo
+    }
+    if (PROTOCOL_ISO_DEP != activeTag.protocol) {
+        answer.push_back(STATUS_OK);        // the Frame RF Interface adds a status byte to every received frame
+    }
+    unsigned long now = micros();
+    if (static_cast<long>(rfFreeTime - now) > 0) {
+        latency += rfFreeTime - now;        // a frame queued in the NFCC, behind the one the tag is still answering
+    }
+    latency += (frame.size() + answer.size()) * rfByteTime;
+    rfFreeTime = now + latency;
+    scheduleData(latency, connectionId, answer);
+}
+
+std::vector<uint8_t> PN7150Simulator::handleApdu(const std::vector<uint8_t> &command) {
+    // ISO/IEC 7816-4 : the case of the APDU from its length, ISO/IEC 7816-3, section 12.1
+    if (command.size() < 4) {
+        return {0x67, 0x00};
+    }
+    uint32_t dataOffset     = 0;
+    uint32_t dataLength     = 0;
+    uint32_t expectedLength = 0;
+    bool extended           = false;
+    bool valid              = true;
+    if (5 == command.size()) {
+        expectedLength = (0 == command[4]) ? 0x100 : command[4];
+    } else if ((command.size() > 5) && (0 != command[4]) && ((command.size() == (5U + command[4])) || (command.size() == (6U + command[4])))) {
+        dataOffset = 5;
+        dataLength = command[4];
+        if (command.size() == (6U + command[4])) {
+            expectedLength = (0 == command.back()) ? 0x100 : command.back();
+        }
+    } else if ((command.size() >= 7) && (0 == command[4])) {
+        extended       = true;
+        uint32_t value = (static_cast<uint32_t>(command[5]) << 8) | command[6];
+        if (7 == command.size()) {
+            expectedLength = (0 == value) ? 0x10000 : value;
+        } else if ((0 != value) && ((command.size() == (7 + value)) || (command.size() == (9 + value)))) {
+            dataOffset = 7;
+            dataLength = value;
+            if (command.size() == (9 + value)) {
+                value          = (static_cast<uint32_t>(command[command.size() - 2]) << 8) | command.back();
+                expectedLength = (0 == value) ? 0x10000 : value;
+            }
+        } else {
+            valid = false;
+        }
+    } else if (4 != command.size()) {
+        valid = false;
+    }
+    if (!valid || (extended && !activeTag.extendedLength)) {
+        chainedData.clear();
+        return {0x67, 0x00};        // wrong length
+    }
+    uint8_t instruction = command[1];
+    if (0xC0 == instruction) {        // GET RESPONSE
+        if (pendingResponse.empty()) {
+            return {0x69, 0x85};        // conditions of use not satisfied
+        }
+    } else {
+        pendingResponse.clear();
+        chainedData.insert(chainedData.end(), command.begin() + dataOffset, command.begin() + dataOffset + dataLength);
+        if (0 != (command[0] & 0x10)) {
+            return {0x90, 0x00};        // command chaining : more of it follows
+        }
+    }
+    std::vector<uint8_t> data;
+    data.swap(chainedData);
+    uint32_t offset = (static_cast<uint32_t>(command[2] & 0x7F) << 8) | command[3];
+    switch (instruction) {
+        case 0xC0:
+            break;
+
+        case 0xA4:        // SELECT
+            break;
+
+        case 0xB0:        // READ BINARY
+            if (offset >= activeTag.memory.size()) {
+                return {0x6B, 0x00};        // wrong parameters P1-P2
+            }
+            if ((offset + expectedLength) > activeTag.memory.size()) {
+                if (!extended && (expectedLength <= 0x100) && (0 != expectedLength)) {
+                    return {0x6C, static_cast<uint8_t>(activeTag.memory.size() - offset)};        // wrong Le, SW2 has the right one
+                }
+                expectedLength = static_cast<uint32_t>(activeTag.memory.size() - offset);
+            }
+            pendingResponse.assign(activeTag.memory.begin() + offset, activeTag.memory.begin() + offset + expectedLength);
+            break;
+
+        case 0xD6:        // UPDATE BINARY
+            if ((offset + data.size()) > activeTag.memory.size()) {
+                return {0x6B, 0x00};
+            }
+            std::copy(data.begin(), data.end(), activeTag.memory.begin() + offset);
+            for (SimulatedTag &theTag : theTags) {
+                if ((theTag.uniqueIdLength == activeTag.uniqueIdLength) && std::equal(theTag.uniqueId, theTag.uniqueId + theTag.uniqueIdLength, activeTag.uniqueId)) {
+                    theTag.memory = activeTag.memory;
+                }
+            }
+            break;
+
+        case 0xCA:        // GET DATA
+            pendingResponse.assign(activeTag.uniqueId, activeTag.uniqueId + activeTag.uniqueIdLength);
+            break;
+
+        default:
+            return {0x6D, 0x00};        // instruction not supported
+    }
+    uint32_t limit = ((0 == expectedLength) || (expectedLength > activeTag.responseLimit)) ? activeTag.responseLimit : expectedLength;
+    if (extended) {
+        limit = expectedLength;        // the card sends as much as an extended Le asks for at once
+    }
+    if (limit > pendingResponse.size()) {
+        limit = static_cast<uint32_t>(pendingResponse.size());
+    }
+    std::vector<uint8_t> answer(pendingResponse.begin(), pendingResponse.begin() + limit);
+    pendingResponse.erase(pendingResponse.begin(), pendingResponse.begin() + limit);
+    if (pendingResponse.empty()) {
+        answer.push_back(0x90);
+        answer.push_back(0x00);
+    } else {
+        answer.push_back(0x61);
+        answer.push_back((pendingResponse.size() > 0xFF) ? 0x00 : static_cast<uint8_t>(pendingResponse.size()));        // 0x00 : 256 or more
+    }
+    return answer;
+}
+
+void PN7150Simulator::scheduleData(unsigned long delay, uint8_t connectionId, const std::vector<uint8_t> &frame) {
+    size_t offset = 0;
+    do {
+        size_t segmentLength = frame.size() - offset;
+        uint8_t firstByte    = MsgTypeData | connectionId;
+        if (segmentLength > maxDataPayloadSize) {
+            segmentLength = maxDataPayloadSize;
+            firstByte |= PacketBoundaryFlagNotLastSegment;
+        }
+        schedule(delay, firstByte, 0x00, 0x00, std::vector<uint8_t>(frame.begin() + offset, frame.begin() + offset + segmentLength));
+        offset += segmentLength;
+    } while (offset < frame.size());
+}
+
+void PN7150Simulator::handleCommand(uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint32_t payloadLength) {
+    if (hanging) {
+        if ((SimulatedFault::hangUntilVenReset == hangingUntil) || (GroupIdCore != groupId) || (CORE_RESET_CMD != opcodeId)) {
+            return;        // a hanging NFCC does not answer
+        }
+        hanging = false;
+    }
+    switch (groupId) {
+        case GroupIdCore:
+            switch (opcodeId) {
+                case CORE_RESET_CMD: {
+                    bool keepConfig = (payloadLength > 0) && (ResetKeepConfig == payload[0]);
+                    if (!keepConfig) {
+                        configParameters.clear();
+                        standbyEnabled = false;
+                    }
+                    uint8_t configStatus = (keepConfig && !configLost) ? 0x00 : 0x01;        // NCI Specification V1.0 - Table 7
+                    configLost           = false;
+                    theRfState           = RfState::Idle;
+                    theConnections.clear();
+                    if (coreResetNotification) {
+                        respond(GroupIdCore, CORE_RESET_RSP, {STATUS_OK});
+                        schedule(2 * responseLatency, MsgTypeNotification, GroupIdCore, CORE_RESET_NTF, {0x02, configStatus, 0x20, 0x04, 0x00});        // Reset Trigger : CORE_RESET_CMD, NCI Version 2.0, Manufacturer ID NXP. NCI Specification V2.0 - Table 5
+                    } else {
+                        respond(GroupIdCore, CORE_RESET_RSP, {STATUS_OK, 0x10, configStatus});
+                    }
+                } break;
+
+                case CORE_CONN_CREATE_CMD:
+                    if ((payloadLength > 0) && (DestinationNfccLoopback == payload[0])) {
+                        uint8_t connectionId = 1;
+                        while (nullptr != findConnection(connectionId)) {
+                            connectionId++;
+                        }
+                        openConnection(connectionId);
+                        respond(GroupIdCore, CORE_CONN_CREATE_RSP, {STATUS_OK, maxDataPayloadSize, dataCredits, connectionId});
+                    } else {
+                        respond(GroupIdCore, CORE_CONN_CREATE_RSP, {STATUS_REJECTED});        // only the loop-back is simulated
+                    }
+                    break;
+
+                case CORE_CONN_CLOSE_CMD:
+                    if ((payloadLength > 0) && (NciConnection::staticRfConnection != payload[0]) && (nullptr != findConnection(payload[0]))) {
+                        closeConnection(payload[0]);
+                        respond(GroupIdCore, CORE_CONN_CLOSE_RSP, {STATUS_OK});
+                    } else {
+                        respond(GroupIdCore, CORE_CONN_CLOSE_RSP, {STATUS_REJECTED});
+                    }
+                    break;
+
+                case CORE_SET_CONFIG_CMD: {
+                    // Number of Parameters, then ID, Length, Value for each. NCI Specification V1.0 - Table 8
+                    uint32_t offset = 1;
+                    for (uint32_t index = 0; (payloadLength > 0) && (index < payload[0]) && ((offset + 1) < payloadLength); index++) {
+                        uint16_t parameterId = payload[offset];
+                        if (ProprietaryConfigPrefix == parameterId) {        // 2-byte proprietary Parameter ID
+                            offset++;
+                            parameterId = static_cast<uint16_t>((parameterId << 8) | payload[offset]);
+                        }
+                        if ((offset + 1) >= payloadLength) {
+                            break;
+                        }
+                        uint8_t length = payload[offset + 1];
+                        if ((offset + 2 + length) > payloadLength) {
+                            break;
+                        }
+                        configParameters[parameterId].assign(payload + offset + 2, payload + offset + 2 + length);
+                        nmbrOfConfigWrites[parameterId]++;
+                        offset += 2U + length;
+                    }
+                    respond(GroupIdCore, CORE_SET_CONFIG_RSP, {(offset == payloadLength) ? static_cast<uint8_t>(STATUS_OK) : static_cast<uint8_t>(STATUS_SYNTAX_ERROR), 0x00});
+                } break;
+
+                case CORE_GET_CONFIG_CMD: {
+                    // Number of Parameters, then the IDs. Parameters which were never set are unknown : STATUS_INVALID_PARAM lists them. NCI Specification V1.0 - Table 10 and 11
+                    std::vector<uint8_t> known{STATUS_OK, 0x00};
+                    std::vector<uint8_t> unknown{STATUS_INVALID_PARAM, 0x00};
+                    uint32_t offset = 1;
+                    for (uint32_t index = 0; (payloadLength > 0) && (index < payload[0]) && (offset < payloadLength); index++) {
+                        uint16_t parameterId = payload[offset++];
+                        if ((ProprietaryConfigPrefix == parameterId) && (offset < payloadLength)) {
+                            parameterId = static_cast<uint16_t>((parameterId << 8) | payload[offset++]);
+                        }
+                        std::map<uint16_t, std::vector<uint8_t>>::const_iterator position = configParameters.find(parameterId);
+                        std::vector<uint8_t> &answer                                      = (position == configParameters.end()) ? unknown : known;
+                        if (parameterId > 0xFF) {
+                            answer.push_back(static_cast<uint8_t>(parameterId >> 8));
+                        }
+                        answer.push_back(static_cast<uint8_t>(parameterId & 0xFF));
+                        if (position == configParameters.end()) {
+                            answer.push_back(0x00);
+                        } else {
+                            answer.push_back(static_cast<uint8_t>(position->second.size()));
+                            answer.insert(answer.end(), position->second.begin(), position->second.end());
+                        }
+                        answer[1]++;
+                    }
+                    respond(GroupIdCore, CORE_GET_CONFIG_RSP, (unknown[1] > 0) ? unknown : known);
+                } break;
+
+                case CORE_INIT_CMD:
+                    // Status, NFCC Features (4), Nmbr of RF Interfaces + list, Max Logical Connections, Max Routing Table Size (2),
+                    // Max Control Packet Payload Size, Max Size for Large Parameters (2), Manufacturer ID, Manufacturer Specific Information (4)
+                    respond(GroupIdCore, CORE_INIT_RSP, {STATUS_OK, 0x03, 0x1E, 0x03, 0x00, 0x04, NFCEE_Direct_RF_Interface, Frame_RF_interface, ISO_DEP_RF_interface, NFC_DEP_RF_interface, 0x01, 0x00, 0x02, maxControlPayloadSize, 0x00, 0x01, 0x04, 0x08, 0x01, 0x08, 0x00});
+                    pollInterfaces.clear();        // back to the default mapping
+                    break;
+
+                default:
+                    respond(groupId, opcodeId, {STATUS_SYNTAX_ERROR});
+                    break;
+            }
+            break;
+
+        case GroupIdRfManagement:
+            switch (opcodeId) {
+                case RF_DISCOVER_MAP_CMD:
+                    // Number of Mapping Configurations, and for each : RF Protocol, Mode, RF Interface. NCI Specification V1.0 - Table 42
+                    if ((RfState::Idle == theRfState) && (payloadLength > 0) && (payloadLength == (1U + (3U * payload[0])))) {
+                        for (uint32_t index = 0; index < payload[0]; index++) {
+                            if (payload[2 + (3 * index)] & 0x01) {        // Poll Mode
+                                pollInterfaces[payload[1 + (3 * index)]] = payload[3 + (3 * index)];
+                            }
+                        }
+                        respond(GroupIdRfManagement, RF_DISCOVER_MAP_RSP, {STATUS_OK});
+                    } else {
+                        respond(GroupIdRfManagement, RF_DISCOVER_MAP_RSP, {STATUS_SEMANTIC_ERROR});
+                    }
+                    break;
+
+                case RF_DISCOVER_CMD:
+                    if ((RfState::Idle == theRfState) && (payloadLength > 0) && (payloadLength == (1U + (2U * payload[0]))) && (payload[0] > 0)) {
+                        pollTechnologies.clear();
+                        for (uint32_t index = 0; index < payload[0]; index++) {
+                            pollTechnologies.push_back(payload[1 + (2 * index)]);
+                        }
+                        nmbrOfDiscoveries++;
+                        respond(GroupIdRfManagement, RF_DISCOVER_RSP, {STATUS_OK});
+                        theRfState = RfState::Discovery;
+                        startDiscovery();
+                    } else {
+                        respond(GroupIdRfManagement, RF_DISCOVER_RSP, {STATUS_SEMANTIC_ERROR});
+                    }
+                    break;
+
+                case RF_DISCOVER_SELECT_CMD:
+                    // RF Discovery ID, RF Protocol, RF Interface
+                    if ((RfState::WaitForHostSelect == theRfState) && (3 == payloadLength) && (payload[0] > 0) && (payload[0] <= discoveredTags.size()) && (discoveredTags[payload[0] - 1].protocol == payload[1])) {
+                        respond(GroupIdRfManagement, RF_DISCOVER_SELECT_RSP, {STATUS_OK});
+                        const SimulatedTag &theTag = discoveredTags[payload[0] - 1];
+                        activeTag                  = theTag;
+                        if (isActiveTagPresent()) {
+                            nmbrOfSelects++;
+                            activate(responseLatency + activationLatency, theTag, payload[0], payload[2]);
+                        } else {
+                            schedule(responseLatency + activationLatency, MsgTypeNotification, GroupIdCore, CORE_GENERIC_ERROR_NTF, {DISCOVERY_TARGET_ACTIVATION_FAILED});        // stays in WaitForHostSelect
+                        }
+                    } else {
+                        respond(GroupIdRfManagement, RF_DISCOVER_SELECT_RSP, {STATUS_SEMANTIC_ERROR});
+                    }
+                    break;
+
+                case RF_DEACTIVATE_CMD: {
+                    uint8_t theMode = (payloadLength > 0) ? payload[0] : static_cast<uint8_t>(NciRfDeAcivationMode::IdleMode);
+                    switch (theRfState) {
+                        case RfState::PollActive:
+                            respond(GroupIdRfManagement, RF_DEACTIVATE_RSP, {STATUS_OK});
+                            schedule(responseLatency, MsgTypeNotification, GroupIdRfManagement, RF_DEACTIVATE_NTF, {theMode, DH_Request});
+                            if (static_cast<uint8_t>(NciRfDeAcivationMode::Discovery) == theMode) {
+                                theRfState = RfState::Discovery;
+                                startDiscovery();        // with the same technologies
+                            } else if ((static_cast<uint8_t>(NciRfDeAcivationMode::SleepMode) == theMode) || (static_cast<uint8_t>(NciRfDeAcivationMode::Sleep_AFMode) == theMode)) {
+                                theRfState = RfState::WaitForHostSelect;
+                            } else {
+                                theRfState = RfState::Idle;
+                            }
+                            closeConnection(NciConnection::staticRfConnection);
+                            break;
+
+                        case RfState::Discovery:
+                        case RfState::WaitForHostSelect:
+                            respond(GroupIdRfManagement, RF_DEACTIVATE_RSP, {STATUS_OK});        // no notification when deactivating from these states
+                            theRfState = RfState::Idle;
+                            break;
+
+                        default:
+                            respond(GroupIdRfManagement, RF_DEACTIVATE_RSP, {STATUS_SEMANTIC_ERROR});
+                            break;
+                    }
+                } break;
+
+                default:
+                    respond(groupId, opcodeId, {STATUS_SYNTAX_ERROR});
+                    break;
+            }
+            break;
+
+        case GroupIdProprietary:
+            switch (opcodeId) {
+                case NCI_PROPRIETARY_ACT_CMD:
+                    respond(GroupIdProprietary, NCI_PROPRIETARY_ACT_RSP, {STATUS_OK, 0x08, 0x01, 0x08, 0x00});        // Status + FW version, PN7150 Datasheet Table 24
+                    break;
+
+                case NCI_PROPRIETARY_STANDBY_CMD:
+                    if (payloadLength > 0) {
+                        standbyEnabled = (0x01 == payload[0]);
+                        respond(GroupIdProprietary, NCI_PROPRIETARY_STANDBY_RSP, {STATUS_OK});
+                    } else {
+                        respond(GroupIdProprietary, NCI_PROPRIETARY_STANDBY_RSP, {STATUS_SYNTAX_ERROR});
+                    }
+                    break;
+
+                case NCI_PROPRIETARY_PRESENCE_CHECK_CMD:
+                    if ((RfState::PollActive == theRfState) && (PROTOCOL_ISO_DEP == activeTag.protocol)) {
+                        respond(GroupIdProprietary, NCI_PROPRIETARY_PRESENCE_CHECK_RSP, {STATUS_OK});
+                        schedule(dataLatency, MsgTypeNotification, GroupIdProprietary, NCI_PROPRIETARY_PRESENCE_CHECK_NTF, {static_cast<uint8_t>(isActiveTagPresent() ? STATUS_OK : STATUS_FAILED)});
+                    } else {
+                        respond(GroupIdProprietary, NCI_PROPRIETARY_PRESENCE_CHECK_RSP, {STATUS_SEMANTIC_ERROR});
+                    }
+                    break;
+
+                default:
+                    respond(groupId, opcodeId, {STATUS_SYNTAX_ERROR});
+                    break;
+            }
+            break;
+
+        default:
+            respond(groupId, opcodeId, {STATUS_SYNTAX_ERROR});
+            break;
+    }
+}
+
+void PN7150Simulator::activate(unsigned long delay, const SimulatedTag &aTag, uint8_t discoveryId, uint8_t theInterface) {
+    // NCI Specification V1.0 - Table 61
+    if (ISO_DEP_RF_interface == theInterface) {
+        delay += isoDepActivationLatency;        // RATS and ATS, before the NFCC notifies
+    }
+    std::vector<uint8_t> parameters   = technologyParameters(aTag);
+    std::vector<uint8_t> notification = {discoveryId, theInterface, aTag.protocol, aTag.technology, maxDataPayloadSize, dataCredits, static_cast<uint8_t>(parameters.size())};
+    notification.insert(notification.end(), parameters.begin(), parameters.end());
+    notification.push_back(aTag.technology);          // Data Exchange RF Technology and Mode
+    notification.push_back(NFC_BIT_RATE_106);         // Data Exchange Transmit Bit Rate
+    notification.push_back(NFC_BIT_RATE_106);         // Data Exchange Receive Bit Rate
+    if ((ISO_DEP_RF_interface == theInterface) && (NFC_A_PASSIVE_POLL_MODE == aTag.technology)) {
+        notification.push_back(static_cast<uint8_t>(aTag.ats.size() + 1));        // Length of Activation Parameters : RATS Response Length and RATS Response, NCI Specification V1.0 - Table 75
+        notification.push_back(static_cast<uint8_t>(aTag.ats.size()));
+        notification.insert(notification.end(), aTag.ats.begin(), aTag.ats.end());
+    } else {
+        notification.push_back(0);        // Length of Activation Parameters
+    }
+    schedule(delay, MsgTypeNotification, GroupIdRfManagement, RF_INTF_ACTIVATED_NTF, notification);
+    theRfState = RfState::PollActive;
+    activeTag  = aTag;
+    chainedData.clear();
+    pendingResponse.clear();
+    openConnection(NciConnection::staticRfConnection);
+}
+
+std::vector<uint8_t> PN7150Simulator::technologyParameters(const SimulatedTag &aTag) const {
+    std::vector<uint8_t> parameters;
+    switch (aTag.technology) {
+        case NFC_B_PASSIVE_POLL_MODE:        // NCI Specification V1.0 - Table 56 : SENSB_RES with NFCID0, Application Data and Protocol Info
+            parameters = {11, aTag.uniqueId[0], aTag.uniqueId[1], aTag.uniqueId[2], aTag.uniqueId[3], 0x00, 0x00, 0x00, 0x00, 0x80, 0x81, 0xC1};
+            break;
+
+        case NFC_F_PASSIVE_POLL_MODE:        // NCI Specification V1.0 - Table 58 : Bit Rate, SENSF_RES with NFCID2 and PMm
+            parameters = {NFC_BIT_RATE_212, 16};
+            parameters.insert(parameters.end(), aTag.uniqueId, aTag.uniqueId + 8);
+            parameters.insert(parameters.end(), {0x00, 0xF0, 0x00, 0x00, 0x02, 0x06, 0x03, 0x00});
+            break;
+
+        case NFC_15693_PASSIVE_POLL_MODE:        // NCI Specification V2.0 - Table 68 : RES_FLAG, DSFID, UID
+            parameters = {0x00, 0x00};
+            parameters.insert(parameters.end(), aTag.uniqueId, aTag.uniqueId + 8);
+            break;
+
+        default:        // NCI Specification V1.0 - Table 54
+            parameters.push_back(aTag.sensRes[0]);
+            parameters.push_back(aTag.sensRes[1]);
+            parameters.push_back(aTag.uniqueIdLength);
+            parameters.insert(parameters.end(), aTag.uniqueId, aTag.uniqueId + aTag.uniqueIdLength);
+            parameters.push_back(1);        // SEL_RES Response length
+            parameters.push_back(aTag.selRes);
+            break;
+    }
+    return parameters;
+}
+
+uint8_t PN7150Simulator::pollInterface(uint8_t protocol) const {
+    std::map<uint8_t, uint8_t>::const_iterator mapping = pollInterfaces.find(protocol);
+    if (mapping != pollInterfaces.end()) {
+        return mapping->second;
+    }
+    return (PROTOCOL_ISO_DEP == protocol) ? ISO_DEP_RF_interface : Frame_RF_interface;
+}
+
+void PN7150Simulator::startDiscovery() {
+    if ((RfState::Discovery != theRfState) || hanging) {
+        return;        // nothing to discover (yet)
+    }
+
+    // only tags of a polled technology are found, after polling all technologies up to theirs
+    std::vector<const SimulatedTag *> foundTags;
+    uint32_t lastPosition = 0;
+    for (const SimulatedTag &theTag : theTags) {
+        std::vector<uint8_t>::const_iterator position = std::find(pollTechnologies.begin(), pollTechnologies.end(), theTag.technology);
+        if (position != pollTechnologies.end()) {
+            foundTags.push_back(&theTag);
+            lastPosition = std::max(lastPosition, static_cast<uint32_t>(position - pollTechnologies.begin()));
+        }
+    }
+    if (foundTags.empty()) {
+        return;
+    }
+    unsigned long latency = discoveryLatency * (lastPosition + 1);
+
+    if (1 == foundTags.size()) {
+        // Single tag : the NFCC activates it right away
+        const SimulatedTag &theTag = *foundTags[0];
+        activate(latency, theTag, 1, pollInterface(theTag.protocol));
+    } else {
+        // Multiple tags : the NFCC notifies them all, and waits for the DH to select one. NCI Specification V1.0 - Table 52
+        static constexpr uint8_t nfccLimit = 3;
+        uint8_t nmbrToNotify               = (foundTags.size() > nfccLimit) ? nfccLimit : static_cast<uint8_t>(foundTags.size());
+        discoveredTags.clear();
+        for (uint8_t index = 0; index < nmbrToNotify; index++) {
+            discoveredTags.push_back(*foundTags[index]);
+            const SimulatedTag &theTag        = *foundTags[index];
+            std::vector<uint8_t> parameters   = technologyParameters(theTag);
+            std::vector<uint8_t> notification = {static_cast<uint8_t>(index + 1), theTag.protocol, theTag.technology, static_cast<uint8_t>(parameters.size())};
+            notification.insert(notification.end(), parameters.begin(), parameters.end());
+            notificationType theType;
+            if (index + 1 < nmbrToNotify) {
+                theType = notificationType::moreNotification;
+            } else if (foundTags.size() > nfccLimit) {
+                theType = notificationType::lastNotificationNfccLimit;
+            } else {
+                theType = notificationType::lastNotification;
+            }
+            if (nmbrToTruncate > 0) {
+                nmbrToTruncate--;
+                nmbrOfInjectedFaults++;
+            } else {
+                notification.push_back(static_cast<uint8_t>(theType));
+            }
+            schedule(latency, MsgTypeNotification, GroupIdRfManagement, RF_DISCOVER_NTF, notification);
+        }
+        theRfState = RfState::WaitForHostSelect;
+    }
+}
+#endif
@@ -0,0 +1,225 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   In-process simulation of a PN7150, for running the NCI stateMachine on a host (Linux) for regression testing and benchmarking.
+//   It answers the NCI commands the driver uses, with a configurable latency, and delivers its packets from a separate thread which raises the 'IRQ',
+//   just like the real device does. After enableInterrupt(), each rising edge latches it, as the ISR does on target. Tags can be put in and taken out of the simulated RF field at any time.
+//   Segmented packets are reassembled as the NFCC would. Data sent to an activated tag, or over a loop-back connection, is echoed back, segmented to the
+//   Max Data Packet Payload Size. Each Data packet takes a credit, which is returned with CORE_CONN_CREDITS_NTF once the packet is processed.
+//   An activated Type 2 Tag answers READ commands (from its memory, padded with 0x00) and WRITEs, which stay in its memory when it leaves the field. An activated ISO-DEP tag answers the proprietary presence
+//   check. One with memory is an APDU card : SELECT, READ BINARY and UPDATE BINARY of that file, GET DATA of its UID, command chaining, extended length
+//   if it takes it, and responses beyond its limit in parts with 0x61XX and GET RESPONSE. Other ISO-DEP tags echo. Once the activated tag is removed from the field, data to it results in CORE_INTERFACE_ERROR_NTF with RF_TIMEOUT_ERROR.
+//   Discovery only finds tags of the technologies in RF_DISCOVER_CMD, and polling each technology takes the discovery latency, in the order they are listed.
+//   Multiple tags wait for RF_DISCOVER_SELECT_CMD, and go back to waiting for it when deactivated to sleep. Activating a tag takes the activation latency.
+//   After VEN HIGH, writes are NACKed until the boot latency has passed. Configuration survives a VEN reset, unless configuration retention is turned off.
+//   CORE_RESET reports whether it did in CORE_RESET_RSP as NCI 1.0 does, or in CORE_RESET_NTF as NCI 2.0 does.
+//   CORE_GET_CONFIG answers the values set with CORE_SET_CONFIG, parameters which were never set are reported as unknown.
+//   Faults can be injected in the responses to a given command, and RF_DISCOVER_NTFs can be truncated, to exercise the driver's recovery from Error.
+//   Commands which come before the DeviceHost read the response to the one before are counted : NCI allows only one command at a time.
+//
+//   Only available on host builds, as it needs threads.
+
+#if !defined(ARDUINO)
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "NciTransport.h"        // The interface the NCI talks to
+#include "NCI.h"                 // NCI constants
+
+class SimulatedTag {
+  public:
+    uint8_t technology{NFC_A_PASSIVE_POLL_MODE};                // RF Technology and Mode in which the tag answers
+    uint8_t protocol{PROTOCOL_T2T};                             // RF Protocol of the tag
+    uint8_t sensRes[2]{0x44, 0x00};                             // NFC-A SENS_RES (ATQA)
+    uint8_t selRes{0x00};                                       // NFC-A SEL_RES (SAK)
+    uint8_t uniqueIdLength{7};                                  // Length of NFCID1 : 4, 7 or 10. NFC-B uses the first 4 bytes as NFCID0, NFC-F and ISO 15693 the first 8
+    uint8_t uniqueId[Tag::maxUniqueIdLength]{0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};        // NFCID1
+    std::vector<uint8_t> ats{0x75, 0x77, 0x81, 0x02, 0x80};     // ATS from T0 on, sent when activated on the ISO-DEP interface
+    std::vector<uint8_t> memory;                                // Type 2 Tag memory, 4 bytes per block. ISO-DEP : the file an APDU card reads and updates, empty for a tag which echoes
+    std::vector<uint8_t> version;                               // answer to GET_VERSION. Empty : the tag knows neither GET_VERSION nor FAST_READ
+    bool extendedLength{false};                                 // the APDU card takes extended length APDUs, otherwise it answers them with 0x6700
+    uint32_t responseLimit{256};                                // [bytes] of response data the APDU card sends at once, the rest after 0x61XX and GET RESPONSE
+
+    static SimulatedTag ntag216();                              // 231 pages, with the Capability Container and an empty NDEF message
+    static SimulatedTag isoDepCard();                           // ISO-DEP APDU card with a 4 KB file
+};
+
+enum class SimulatedFault : uint8_t {
+    dropResponse,              // the command is executed, but its response is lost
+    corruptResponse,           // the response comes with a wrong Opcode Identifier, as if bits flipped on the bus
+    failResponse,              // the response has STATUS_FAILED, the command is executed anyway
+    slowResponse,              // the response comes after the slow response latency instead of the response latency
+    hangUntilCoreReset,        // the NFCC answers nothing from this command on, until CORE_RESET_CMD
+    hangUntilVenReset          // the NFCC answers nothing from this command on, not even CORE_RESET_CMD, until a VEN reset
+};
+
+class PN7150Simulator : public NciTransport {
+  public:
+    PN7150Simulator();
+    ~PN7150Simulator();
+    void beginReset() override;                                     // Simulated VEN LOW : drops all pending packets and the RF state, nothing is answered until endReset()
+    void endReset() override;                                       // Simulated VEN HIGH : writes are NACKed until the boot latency has passed
+    bool waitForMessage(unsigned long maxWaitTime) override;        // sleeps until the delivery thread raises the IRQ, or latches it in interrupt mode
+
+    // Scripting the simulation
+    void setResponseLatency(unsigned long latency);            // time [us] between receiving a command and making the response available
+    void setSlowResponseLatency(unsigned long latency);        // same, for responses with the slowResponse fault. Default 6 ms
+    void setDiscoveryLatency(unsigned long latency);           // time [us] to poll one technology. A tag is notified after polling all technologies up to and including its own
+    void setActivationLatency(unsigned long latency);          // time [us] from RF_DISCOVER_SELECT_RSP until RF_INTF_ACTIVATED_NTF
+    void setIsoDepActivationLatency(unsigned long latency);    // time [us] an activation on the ISO-DEP RF Interface takes longer, for RATS and ATS
+    uint32_t getNmbrOfSelects() const;                         // RF_DISCOVER_SELECT_CMDs which activated a tag
+    void addTag(const SimulatedTag &aTag);                     // a tag enters the RF field
+    void removeTag(uint8_t index);                             // a tag leaves the RF field
+    void removeAllTags();                                      // all tags leave the RF field
+    uint8_t getNmbrOfTags() const;                             // how many tags are in the RF field
+    uint32_t getNmbrOfCommands() const;                        // how many commands the simulated NFCC has received since construction
+    uint32_t getNmbrOfOverlappingCommands() const;             // commands received while the DeviceHost had not read the response to the one before. NCI allows only one
+    void setMaxTransactionLength(uint32_t length);             // simulate the buffer size of the I2C library, eg. 32 for AVR Wire
+    void setDataCredits(uint8_t credits);                      // Initial Number of Credits the simulated NFCC gives to new connections
+    void setDataLatency(unsigned long latency);                // time [us] the simulated NFCC needs to process a Data packet and return its credit
+    void setRfByteTime(unsigned long time);                    // time [us] each byte of a frame and of the tag's answer takes on the RF, eg. 85 at 106 kbit/s. Default 0
+    void setTagWriteTime(unsigned long time);                  // time [us] a Type 2 Tag takes to program a page before it ACKs a WRITE, eg. 4100 for NTAG21x. Default 0
+    std::vector<uint8_t> getTagMemory(uint8_t index) const;    // memory of a tag in the RF field, with what was written to it
+    uint32_t getNmbrOfCreditViolations() const;                // Data packets the DeviceHost sent without having a credit
+    uint32_t getNmbrOfIrqEdges() const;                        // rising edges of IRQ. A packet which is ready while the one before is being read gives none
+    std::vector<uint8_t> getConfigParameter(uint16_t parameterId) const;       // value last set with CORE_SET_CONFIG_CMD, empty if never set. IDs above 0xFF are the 2-byte proprietary ones
+    uint32_t getNmbrOfConfigWrites(uint16_t parameterId) const;               // how many times CORE_SET_CONFIG_CMD set this parameter, since construction
+    uint32_t getNmbrOfDiscoveries() const;                     // how many times RF_DISCOVER_CMD started discovery
+    bool isPoweredDown() const;
+    bool isStandbyEnabled() const;                             // set with the proprietary standby command
+    uint32_t getNmbrOfPowerUps() const;                        // how many times endReset() booted the simulated NFCC
+    void setBootLatency(unsigned long latency);                // time [us] after VEN HIGH before the simulated NFCC accepts writes
+    void setConfigRetention(bool retain);                      // false : configuration is lost at VEN LOW, and CORE_RESET_RSP reports it was reset. Default true, like the PN7150's EEPROM
+    void setCoreResetNotification(bool enable);                // true : CORE_RESET_RSP has only the Status, the Configuration Status follows in CORE_RESET_NTF, as NCI 2.0 NFCCs do. Default false
+    uint32_t getNmbrOfEarlyWrites() const;                     // writes NACKed because the simulated NFCC was still booting
+    void setMaxControlPayloadSize(uint8_t size);               // Max Control Packet Payload Size reported in CORE_INIT_RSP
+    void injectFault(uint8_t groupId, uint8_t opcodeId, SimulatedFault theFault, uint32_t count = 1);        // the next count responses to this command have this fault
+    void truncateDiscoverNotifications(uint32_t count);        // the next count RF_DISCOVER_NTFs lose their Notification Type, as if cut short. Counted as injected faults
+    uint32_t getNmbrOfInjectedFaults() const;                  // faults which actually happened
+    bool isHanging() const;
+
+  protected:
+    uint8_t writeTransaction(const uint8_t header[], uint32_t headerLength, const uint8_t payload[], uint32_t payloadLength) override;        // the simulated NFCC receives a packet, and schedules its answer(s)
+    uint32_t readTransaction(uint8_t data[], uint32_t dataLength) override;              // continues reading the current packet, beyond its end the bus reads 0xFF
+    uint32_t getMaxTransactionLength() const override;
+    bool isIrqHigh() const override;
+
+  private:
+    enum class RfState : uint8_t {
+        Idle,
+        Discovery,
+        WaitForHostSelect,
+        PollActive
+    };
+
+    class Packet {
+      public:
+        unsigned long dueTime;            // micros() at which the packet becomes available to the DeviceHost
+        std::vector<uint8_t> data;        // header + payload
+    };
+
+    mutable std::mutex theMutex;                 // protects everything below, as the delivery thread runs in parallel
+    std::condition_variable theCondition;        // wakes up the delivery thread and waitForMessage()
+    std::thread deliveryThread;                  // moves scheduled packets to the ready queue at their due time, and raises the IRQ
+    bool stopping{false};
+
+    std::deque<Packet> scheduledPackets;        // answers which are not yet due, sorted by dueTime
+    std::deque<Packet> readyPackets;            // answers which the DeviceHost can read. IRQ is HIGH as long as this is not empty
+    uint32_t readOffset{0};                     // how far the DeviceHost has read the first of the readyPackets
+    uint32_t nmbrOfIrqEdges{0};
+    uint32_t maxTransactionLength{259};         // i2c_t3 buffer size by default
+
+    unsigned long responseLatency{500};            // [us]. The real PN7150 answers CORE_INIT in about 0.5 ms
+    unsigned long slowResponseLatency{6000};       // [us]
+    uint32_t nmbrOfUnreadResponses{0};             // scheduled, and not completely read by the DeviceHost yet
+    uint32_t nmbrOfOverlappingCommands{0};
+    unsigned long discoveryLatency{20000};         // [us]
+    RfState theRfState{RfState::Idle};
+    std::vector<SimulatedTag> theTags;             // tags in the RF field
+    std::vector<uint8_t> pollTechnologies;         // RF Technology and Mode of each entry in the last RF_DISCOVER_CMD
+    std::map<uint16_t, std::vector<uint8_t>> configParameters;        // CORE_SET_CONFIG values, by Parameter ID
+    std::map<uint16_t, uint32_t> nmbrOfConfigWrites;                  // CORE_SET_CONFIG writes, by Parameter ID. Survives a VEN reset, unlike the values
+    uint32_t nmbrOfDiscoveries{0};
+    uint8_t maxControlPayloadSize{0xFF};
+    bool poweredDown{false};
+    bool booting{false};
+    unsigned long bootStartTime{0};                // micros() of the last VEN HIGH
+    unsigned long bootLatency{2500};               // [us] PN7150 datasheet 16.2.2
+    uint32_t nmbrOfEarlyWrites{0};
+    bool configRetention{true};
+    bool configLost{false};                        // configuration was lost at the last VEN LOW, until CORE_RESET_RSP reported it
+    bool coreResetNotification{false};
+    bool standbyEnabled{false};
+    uint32_t nmbrOfPowerUps{0};
+
+    class InjectedFault {
+      public:
+        uint8_t groupId;
+        uint8_t opcodeId;
+        SimulatedFault theFault;
+        uint32_t count;        // responses still to have the fault
+    };
+    std::vector<InjectedFault> injectedFaults;
+    uint32_t nmbrOfInjectedFaults{0};
+    uint32_t nmbrToTruncate{0};                    // RF_DISCOVER_NTFs still to lose their Notification Type
+    bool hanging{false};
+    SimulatedFault hangingUntil{SimulatedFault::hangUntilCoreReset};
+    SimulatedTag activeTag;                        // the tag in PollActive
+    std::vector<SimulatedTag> discoveredTags;      // notified with RF_DISCOVER_NTF, RF Discovery ID is the index + 1
+    unsigned long activationLatency{2000};         // [us]
+    unsigned long isoDepActivationLatency{3000};   // [us]
+    std::map<uint8_t, uint8_t> pollInterfaces;     // RF Interface by RF Protocol, from RF_DISCOVER_MAP_CMD. Others use the default
+    uint32_t nmbrOfSelects{0};
+    bool isActiveTagPresent() const;               // is the activated tag still in the RF field
+    uint32_t nmbrOfCommands{0};
+    std::vector<uint8_t> commandSegments;          // payload of a segmented command, until its last segment arrives
+    static constexpr uint8_t maxDataPayloadSize{0xFF};        // Max Data Packet Payload Size, as reported in RF_INTF_ACTIVATED_NTF and CORE_CONN_CREATE_RSP
+
+    class Connection {
+      public:
+        uint8_t connectionId;
+        uint8_t credits;                        // credits the DeviceHost has
+        std::vector<uint8_t> dataSegments;        // payload of a segmented Data message, until its last segment arrives
+    };
+    std::vector<Connection> theConnections;        // the Static RF Connection while a tag is activated, and loop-back connections
+    uint8_t dataCredits{1};
+    unsigned long dataLatency{1000};               // [us]
+    unsigned long rfByteTime{0};                   // [us]
+    unsigned long tagWriteTime{0};                 // [us]
+    unsigned long rfFreeTime{0};                   // [us] when the tag has answered the frames before : the NFCC exchanges one frame at a time
+    std::vector<uint8_t> chainedData;              // command data of the APDU card's chain so far
+    std::vector<uint8_t> pendingResponse;          // response data the APDU card still has for GET RESPONSE
+    uint32_t nmbrOfCreditViolations{0};
+    Connection *findConnection(uint8_t connectionId);
+    void openConnection(uint8_t connectionId);
+    void closeConnection(uint8_t connectionId);
+
+    void deliver();                                                                                             // body of the deliveryThread
+    void deliverDuePackets();                                                                                   // makes the packets whose dueTime passed ready, raising IRQ. With theMutex locked
+    void schedule(unsigned long delay, uint8_t messageType, uint8_t groupId, uint8_t opcodeId, const std::vector<uint8_t> &payload);
+    void respond(uint8_t groupId, uint8_t opcodeId, const std::vector<uint8_t> &payload);        // schedule a response after responseLatency, unless an injected fault hits it
+    void handleCommand(uint8_t groupId, uint8_t opcodeId, const uint8_t payload[], uint32_t payloadLength);
+    void handleData(uint8_t connectionId, const std::vector<uint8_t> &frame);                                   // the activated tag, or the loop-back, answers a frame
+    std::vector<uint8_t> handleApdu(const std::vector<uint8_t> &command);                                       // the activated APDU card answers a command APDU
+    void scheduleData(unsigned long delay, uint8_t connectionId, const std::vector<uint8_t> &frame);            // segments a Data message
+    void startDiscovery();                                                                                     // if there are tags in the field, schedule the notifications about them
+    uint8_t pollInterface(uint8_t protocol) const;                                                             // RF Interface a tag of this protocol is activated on
+    std::vector<uint8_t> technologyParameters(const SimulatedTag &aTag) const;                                 // RF Technology Specific Parameters, NCI Specification V1.0 - Table 54
+    void activate(unsigned long delay, const SimulatedTag &aTag, uint8_t discoveryId, uint8_t theInterface);    // schedule RF_INTF_ACTIVATED_NTF, and go to PollActive
+};
+#endif
@@ -9,7 +9,8 @@
 // ###                                                                       ###
 // #############################################################################
 
-#include "tag.h"
+#include "Tag.h"
+#include "NCI.h"        // RF Technologies and Protocols
 
 
 // void Tag::print() const {
@@ -36,13 +37,34 @@ uint8_t Tag::getID(uint8_t index) const {
     return value;
 }
 
-void Tag::clear() {
-    uniqueIdLength = 0;
-    for (int i = 0; i < maxUniqueIdLength; i++) {
-        uniqueId[i] = 0;
+TagType Tag::getType() const {
+    switch (protocol) {
+        case PROTOCOL_T1T:
+            return TagType::type1;
+        case PROTOCOL_T2T:
+            if ((NFC_A_PASSIVE_POLL_MODE == technology) && (nfcA.selRes & 0x08)) {
+                return TagType::mifareClassic;        // SAK 0x08 : MIFARE Classic, which the NFCC reports as Type 2 when it is not mapped to the MIFARE interface
+            }
+            return TagType::type2;
+        case PROTOCOL_MIFARE:
+            return TagType::mifareClassic;
+        case PROTOCOL_T3T:
+            return TagType::type3;
+        case PROTOCOL_ISO_DEP:
+            return TagType::isoDep;
+        case PROTOCOL_NFC_DEP:
+            return TagType::nfcDep;
+        case PROTOCOL_T5T:
+            return TagType::type5;
+        default:
+            return TagType::unknown;
     }
 }
 
+void Tag::clear() {
+    *this = Tag();
+}
+
 bool Tag::isSame(Tag *otherTag) const {
     // First compare the length of both UIDs to see if they are the same length
     if (uniqueIdLength == otherTag->uniqueIdLength) {
@@ -58,6 +80,131 @@ bool Tag::isSame(Tag *otherTag) const {
     }
 }
 
+bool Tag::parseDiscoverNotification(const uint8_t payload[], uint32_t payloadLength) {
+    // NCI Specification V1.0 - Table 52 : RF Discovery ID, RF Protocol, RF Technology and Mode, Length of RF Technology Specific Parameters, RF Technology Specific Parameters, Notification Type
+    if (payloadLength < 4) {
+        return false;
+    }
+    discoveryId = payload[0];
+    protocol    = payload[1];
+    technology  = payload[2];
+    if ((4U + payload[3]) > payloadLength) {
+        return false;
+    }
+    return parseTechnologyParameters(payload + 4, payload[3]);
+}
+
+bool Tag::parseActivatedNotification(const uint8_t payload[], uint32_t payloadLength) {
+    // NCI Specification V1.0 - Table 61 : RF Discovery ID, RF Interface, RF Protocol, Activation RF Technology and Mode, Max Data Packet Payload Size, Initial Number of Credits,
+    // Length of RF Technology Specific Parameters, RF Technology Specific Parameters, Data Exchange RF Technology and Mode, Data Exchange Transmit Bit Rate, Data Exchange Receive Bit Rate,
+    // Length of Activation Parameters, Activation Parameters
+    if (payloadLength < 7) {
+        return false;
+    }
+    discoveryId     = payload[0];
+    protocol        = payload[2];
+    technology      = payload[3];
+    uint32_t offset = 7U + payload[6];
+    if ((offset > payloadLength) || !parseTechnologyParameters(payload + 7, payload[6])) {
+        return false;
+    }
+    if ((offset + 4) > payloadLength) {
+        return false;
+    }
+    transmitBitRate = payload[offset + 1];
+    receiveBitRate  = payload[offset + 2];
+    uint32_t length = payload[offset + 3];
+    offset += 4;
+    if ((offset + length) > payloadLength) {
+        return false;
+    }
+    return parseActivationParameters(payload + offset, length);
+}
+
+bool Tag::parseTechnologyParameters(const uint8_t parameters[], uint32_t length) {
+    switch (technology) {
+        case NFC_A_PASSIVE_POLL_MODE: {
+            // SENS_RES (2), NFCID1 Length, NFCID1, SEL_RES Response Length, SEL_RES
+            if ((length < 4) || ((4U + parameters[2]) > length) || (parameters[2] > maxUniqueIdLength)) {
+                return false;
+            }
+            nfcA.sensRes[0]  = parameters[0];
+            nfcA.sensRes[1]  = parameters[1];
+            setUniqueId(parameters + 3, parameters[2]);
+            uint32_t offset  = 3U + parameters[2];
+            nfcA.selRes      = 0;
+            if (parameters[offset] > 0) {
+                if ((offset + 2) > length) {
+                    return false;
+                }
+                nfcA.selRes = parameters[offset + 1];
+            }
+            return true;
+        }
+
+        case NFC_B_PASSIVE_POLL_MODE:
+            // SENSB_RES Response Length (11 or 12), SENSB_RES from its byte 2 : NFCID0 (4), Application Data (4), Protocol Info (3 or 4)
+            if ((length < 12) || (parameters[0] < 11) || (parameters[0] > 12) || ((1U + parameters[0]) > length)) {
+                return false;
+            }
+            setUniqueId(parameters + 1, 4);
+            for (uint32_t index = 0; index < 4; index++) {
+                nfcB.applicationData[index] = parameters[5 + index];
+                nfcB.protocolInfo[index]    = (index < (parameters[0] - 8U)) ? parameters[9 + index] : 0;
+            }
+            return true;
+
+        case NFC_F_PASSIVE_POLL_MODE:
+            // Bit Rate, SENSF_RES Response Length (16 or 18), SENSF_RES from its byte 2 : NFCID2 (8), PAD0 (2), PAD1 (3), MRTI (2), PAD2 (1), Request Data (2)
+            if ((length < 18) || (parameters[1] < 16) || ((2U + parameters[1]) > length)) {
+                return false;
+            }
+            nfcF.bitRate = parameters[0];
+            setUniqueId(parameters + 2, 8);
+            for (uint32_t index = 0; index < 8; index++) {
+                nfcF.pad[index] = parameters[10 + index];
+            }
+            return true;
+
+        case NFC_15693_PASSIVE_POLL_MODE:
+            // RES_FLAG, DSFID, UID (8)
+            if (length < 10) {
+                return false;
+            }
+            iso15693.flags = parameters[0];
+            iso15693.dsfid = parameters[1];
+            setUniqueId(parameters + 2, 8);
+            return true;
+
+        default:
+            return true;        // Active and Listen Modes : nothing to keep about a tag
+    }
+}
+
+bool Tag::parseActivationParameters(const uint8_t parameters[], uint32_t length) {
+    // Poll Modes : the length of the activation response, and the response. NCI Specification V1.0 - Tables 75 and 81
+    activationParametersLength = 0;
+    if (0 == length) {
+        return true;        // Frame RF Interface
+    }
+    if ((1U + parameters[0]) > length) {
+        return false;
+    }
+    uint32_t copyLength = (parameters[0] > maxActivationParametersLength) ? maxActivationParametersLength : parameters[0];
+    for (uint32_t index = 0; index < copyLength; index++) {
+        activationParameters[index] = parameters[1 + index];
+    }
+    activationParametersLength = copyLength;
+    return true;
+}
+
+void Tag::setUniqueId(const uint8_t theId[], uint32_t length) {
+    uniqueIdLength = length;
+    for (uint32_t index = 0; index < maxUniqueIdLength; index++) {
+        uniqueId[index] = (index < length) ? theId[index] : 0;
+    }
+}
+
 // void Tag::dump() const {
 //     char textLine[69] = "uniqueID =";
 //     char textPart[8];
@@ -65,4 +212,4 @@ bool Tag::isSame(Tag *otherTag) const {
 //         snprintf(textPart, 8, " 0x%02X", uniqueId[i]);
 //         strcat(textLine, textPart);
 //     }
-// }
\ No newline at end of file
+// }
@@ -19,18 +19,81 @@
 
 // Todo : upgrade everything to uint32 io uint8 as this is faster on 32-bit MCUs
 
+// The properties of a tag, as far as the NFCC reports them in RF_DISCOVER_NTF and RF_INTF_ACTIVATED_NTF. The RF Technology Specific Parameters have a
+// different layout per technology, only the one the tag was found with is valid. All fields are bytes after the timestamp, so there is no padding.
+
+class NfcAParameters {        // NFC-A Poll Mode. NCI Specification V1.0 - Table 54
+  public:
+    uint8_t sensRes[2];        // SENS_RES (ATQA)
+    uint8_t selRes;            // SEL_RES (SAK), 0 when the tag did not send one (Type 1 Tag)
+};
+
+class NfcBParameters {        // NFC-B Poll Mode. NCI Specification V1.0 - Table 56. NFCID0 is the uniqueId
+  public:
+    uint8_t applicationData[4];        // from SENSB_RES (ATQB)
+    uint8_t protocolInfo[4];           // 3 or 4 bytes, the 4th is 0 when absent
+};
+
+class NfcFParameters {        // NFC-F Poll Mode. NCI Specification V1.0 - Table 58. NFCID2 is the uniqueId
+  public:
+    uint8_t bitRate;        // NFC_BIT_RATE_212 or NFC_BIT_RATE_424
+    uint8_t pad[8];         // PAD0, PAD1, MRTI and PAD2 from SENSF_RES (PMm)
+};
+
+class Iso15693Parameters {        // ISO 15693 Poll Mode. NCI Specification V2.0 - Table 68. The UID is the uniqueId, least significant byte first
+  public:
+    uint8_t flags;        // response flags of the INVENTORY
+    uint8_t dsfid;        // Data Storage Format Identifier
+};
+
+enum class TagType : uint8_t {
+    unknown,
+    type1,                // Topaz
+    type2,                // MIFARE Ultralight, NTAG, .. : GET_VERSION tells which
+    mifareClassic,        // needs the MIFARE interface of the PN7150 to be read
+    type3,                // FeliCa
+    isoDep,               // Type 4 Tag, MIFARE DESFire, bank cards, phones, ..
+    nfcDep,               // peer to peer
+    type5                 // ISO 15693, eg. ICODE
+};
+
 class Tag {
   public:
-    static constexpr uint32_t maxUniqueIdLength{10U};        //
-    uint8_t uniqueIdLength{0};                               // How long is the NFCID1 of the tag. Can be 4, 7 or 10 bytes. Typically 4 or 7.
-    uint8_t uniqueId[maxUniqueIdLength]{0};                  // array to store the NFCID1. Maximum length is 10 bytes at this time..
-    unsigned long detectionTimestamp;                        // remembers the time at which the tag was detected
+    static constexpr uint32_t maxUniqueIdLength{10U};                     //
+    static constexpr uint32_t maxActivationParametersLength{18U};        // an ATS with up to 14 historical bytes. Longer ones are truncated
+    unsigned long detectionTimestamp{0};                                  // remembers the time at which the tag was detected
+    uint8_t uniqueIdLength{0};                                            // How long is the uniqueId : 4, 7 or 10 for NFCID1 (NFC-A), 4 for NFCID0 (NFC-B), 8 for NFCID2 (NFC-F) or the ISO 15693 UID
+    uint8_t uniqueId[maxUniqueIdLength]{0};                               // array to store the uniqueId. Maximum length is 10 bytes at this time..
+    uint8_t discoveryId{0};                                               // RF Discovery ID the NFCC gave it, to select it with RF_DISCOVER_SELECT_CMD
+    uint8_t protocol{0};                                                  // RF Protocol, eg. PROTOCOL_T2T
+    uint8_t technology{0};                                                // RF Technology and Mode it was found with, eg. NFC_A_PASSIVE_POLL_MODE. Tells which of the parameters below is valid
+    uint8_t transmitBitRate{0};                                           // Data Exchange bit rates, eg. NFC_BIT_RATE_106. Only known once activated
+    uint8_t receiveBitRate{0};                                            //
+    union {
+        NfcAParameters nfcA{};
+        NfcBParameters nfcB;
+        NfcFParameters nfcF;
+        Iso15693Parameters iso15693;
+    };
+    uint8_t activationParametersLength{0};                                         // 0 until activated, and for the Frame RF Interface
+    uint8_t activationParameters[maxActivationParametersLength]{0};                // ATS from T0 on for ISO-DEP over NFC-A, ATTRIB Response for ISO-DEP over NFC-B, ATR_RES for NFC-DEP
 
   public:
     // void print() const;                        // prints all properties of the tag to Serial
     uint8_t getLength() const;                 // returns the length of the UID
     uint8_t getID(uint8_t index) const;        // get the UID value at a certain index
+    TagType getType() const;                   // classifies it from the protocol and SEL_RES, without talking to it
     void clear();                              // resets the datafields to their defaults
     bool isSame(Tag *otherTag) const;          // compares this tag to another tag to see if they are identical
     //v void dump() const;                         // send tag data to logging
+
+    // Both fill the fields the Notification has, from its payload. They never read beyond payloadLength, and return false if the Notification is
+    // malformed : the fields up to the error are filled, the others keep their value.
+    bool parseDiscoverNotification(const uint8_t payload[], uint32_t payloadLength);         // RF_DISCOVER_NTF
+    bool parseActivatedNotification(const uint8_t payload[], uint32_t payloadLength);        // RF_INTF_ACTIVATED_NTF
+
+  private:
+    bool parseTechnologyParameters(const uint8_t parameters[], uint32_t length);
+    bool parseActivationParameters(const uint8_t parameters[], uint32_t length);
+    void setUniqueId(const uint8_t theId[], uint32_t length);
 };
@@ -0,0 +1,497 @@
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+#include "Type2Tag.h"
+
+constexpr uint32_t Type2TagReader::pageSize;
+constexpr uint32_t Type2TagReader::readPages;
+constexpr uint32_t Type2TagReader::versionLength;
+
+unsigned long Type2TagStatistics::getBytesPerSecond() const {
+    if (0 == readTime) {
+        return 0;
+    }
+    return static_cast<unsigned long>((static_cast<uint64_t>(nmbrOfBytes) * 1000000U) / readTime);
+}
+
+Type2TagReader::Type2TagReader(NCI &aNci) : theNci(aNci) {}
+
+bool Type2TagReader::read(uint8_t theBuffer[], uint8_t theFirstPage, uint16_t theNmbrOfPages) {
+    if (isRunning() && !isBusy()) {
+        finish(false);        // its tag left, or its operation timed out, before it completed
+    }
+    if (isBusy() || (nullptr == theBuffer) || (0 == theNmbrOfPages) || ((theFirstPage + theNmbrOfPages) > 256U) || !theNci.getRfConnection().isOpen()) {
+        return false;        // pages beyond 255 are in the next sector, which needs SECTOR_SELECT
+    }
+    const Tag *theTag = theNci.getTag(theNci.getActiveTagIndex());
+    if ((nullptr == theTag) || (PROTOCOL_T2T != theTag->protocol)) {
+        return false;
+    }
+    buffer        = theBuffer;
+    firstPage     = theFirstPage;
+    nmbrOfPages   = theNmbrOfPages;
+    pagesRead     = 0;
+    versionKnown  = false;
+    fastRead      = false;
+    readStartTime = micros();
+    activation    = theNci.getRfConnection().getNmbrOfOpens();
+    if (detectVersion) {
+        command[0] = getVersionCommand;
+        theState   = State::getVersion;
+        if (!send(1, versionAnswer, versionLength)) {
+            finish(false);
+        }
+    } else {
+        theState = State::reading;
+        if (!sendRequest()) {
+            finish(false);
+        }
+    }
+    return true;
+}
+
+bool Type2TagReader::run() {
+    if (!isRunning()) {
+        return true;
+    }
+    const NciConnection &theConnection = theNci.getRfConnection();
+    if (!isBusy()) {
+        finish(false);        // the connection was closed, and maybe opened again for another tag
+        return true;
+    }
+    if (theConnection.isMessageReceived()) {
+        if (State::getVersion == theState) {
+            versionReceived();
+            theState = State::reading;
+        } else if (!isAnswerOk()) {
+            finish(false);        // NAK, or a broken frame
+            return true;
+        } else {
+            pagesRead = static_cast<uint16_t>(pagesRead + (answerLength / pageSize));
+            if (pagesRead >= nmbrOfPages) {
+                finish(true);
+                return true;
+            }
+        }
+        if (!sendRequest()) {
+            finish(false);
+            return true;
+        }
+        return false;
+    }
+    bool noAnswer = (theNci.getNmbrOfInterfaceErrors() != interfaceErrors) || ((millis() - requestStartTime) >= requestTimeOut);
+    if (!theConnection.isOpen()) {
+        finish(false);        // the tag left
+        return true;
+    }
+    if (noAnswer) {
+        if (State::getVersion == theState) {
+            theState = State::reading;        // an older tag without GET_VERSION : read it with READ
+            if (sendRequest()) {
+                return false;
+            }
+        }
+        finish(false);
+        return true;
+    }
+    return false;
+}
+
+bool Type2TagReader::isBusy() const {
+    return isRunning() && (activation == theNci.getRfConnection().getNmbrOfOpens());
+}
+
+bool Type2TagReader::isRunning() const {
+    return (State::getVersion == theState) || (State::reading == theState);
+}
+
+bool Type2TagReader::isOk() const {
+    return (State::done == theState);
+}
+
+uint32_t Type2TagReader::getNmbrOfBytesRead() const {
+    return pagesRead * pageSize;
+}
+
+void Type2TagReader::setDetectVersion(bool enable) {
+    detectVersion = enable;
+}
+
+bool Type2TagReader::hasVersion() const {
+    return versionKnown;
+}
+
+const Type2TagVersion &Type2TagReader::getVersion() const {
+    return theVersion;
+}
+
+uint16_t Type2TagReader::getNmbrOfPages() const {
+    if (!versionKnown || (0x04 != theVersion.vendorId)) {
+        return 0;
+    }
+    switch (theVersion.storageSize) {        // the same codes for NTAG21x and Ultralight EV1
+        case 0x0B:
+            return 20;        // NTAG210, MF0UL11
+        case 0x0E:
+            return 41;        // NTAG212, MF0UL21
+        case 0x0F:
+            return 45;        // NTAG213
+        case 0x11:
+            return 135;        // NTAG215
+        case 0x13:
+            return 231;        // NTAG216
+        default:
+            return 0;
+    }
+}
+
+const Type2TagStatistics &Type2TagReader::getStatistics() const {
+    return theStatistics;
+}
+
+void Type2TagReader::resetStatistics() {
+    theStatistics = Type2TagStatistics();
+}
+
+bool Type2TagReader::sendRequest() {
+    uint32_t remaining = nmbrOfPages - pagesRead;
+    if (fastRead) {
+        uint32_t maxPages = (theNci.getRfConnection().getMaxPayloadSize() - 1U) / pageSize;        // the answer and its status byte fit in one Data packet
+        if (0 == maxPages) {
+            maxPages = 1;
+        }
+        uint32_t pages = (remaining < maxPages) ? remaining : maxPages;
+        command[0]     = fastReadCommand;
+        command[1]     = static_cast<uint8_t>(firstPage + pagesRead);
+        command[2]     = static_cast<uint8_t>(firstPage + pagesRead + pages - 1);        // end page is included
+        return send(3, buffer + (pagesRead * pageSize), pages * pageSize);
+    }
+    if (remaining < readPages) {
+        pagesRead = (nmbrOfPages > readPages) ? static_cast<uint16_t>(nmbrOfPages - readPages) : 0;        // the last READ overlaps what was read, so its 16 bytes stay in the buffer. Fewer than 4 pages : the buffer has room for one READ
+    }
+    command[0] = readCommand;
+    command[1] = static_cast<uint8_t>(firstPage + pagesRead);
+    return send(2, buffer + (pagesRead * pageSize), readPages * pageSize);
+}
+
+bool Type2TagReader::send(uint32_t commandLength, uint8_t theAnswer[], uint32_t theAnswerLength) {
+    answer       = theAnswer;
+    answerLength = theAnswerLength;
+    theNci.setDataReceiveBuffer(answer, answerLength + 1);
+    interfaceErrors  = theNci.getNmbrOfInterfaceErrors();
+    requestStartTime = millis();
+    requestTimeOut   = 20 + (answerLength / 8);        // [ms] the tag answers at 106 kbit/s, about 0.1 ms per byte. A silent tag is reported sooner, by CORE_INTERFACE_ERROR_NTF
+    theStatistics.nmbrOfRequests++;
+    return theNci.sendData(command, commandLength);
+}
+
+bool Type2TagReader::isAnswerOk() const {
+    const NciConnection &theConnection = theNci.getRfConnection();
+    return !theConnection.isOverflow() && ((answerLength + 1) == theConnection.getReceivedLength()) && (STATUS_OK == answer[answerLength]);
+}
+
+void Type2TagReader::versionReceived() {
+    if (!isAnswerOk()) {
+        return;        // read with READ
+    }
+    theVersion.vendorId       = versionAnswer[1];        // versionAnswer[0] is a fixed header
+    theVersion.productType    = versionAnswer[2];
+    theVersion.productSubtype = versionAnswer[3];
+    theVersion.majorVersion   = versionAnswer[4];
+    theVersion.minorVersion   = versionAnswer[5];
+    theVersion.storageSize    = versionAnswer[6];
+    theVersion.protocolType   = versionAnswer[7];
+    versionKnown              = true;
+    fastRead                  = (0x04 == theVersion.vendorId) && ((0x03 == theVersion.productType) || (0x04 == theVersion.productType));
+}
+
+void Type2TagReader::finish(bool isOk) {
+    theNci.setDataReceiveBuffer(nullptr, 0);        // the buffer is the application's again
+    if (isOk) {
+        theState = State::done;
+        theStatistics.nmbrOfReads++;
+        theStatistics.nmbrOfBytes += nmbrOfPages * pageSize;
+        theStatistics.readTime += micros() - readStartTime;
+    } else {
+        theState = State::failed;
+        theStatistics.nmbrOfFailures++;
+    }
+}
+
+constexpr uint32_t Type2TagWriter::maxBatchSize;
+constexpr uint32_t Type2TagWriter::controlLength;
+constexpr uint32_t Type2TagWriter::writeLength;
+constexpr uint32_t Type2TagWriter::answerLength;
+
+Type2TagWriter::Type2TagWriter(NCI &aNci) : theNci(aNci), theReader(aNci) {}
+
+bool Type2TagWriter::write(uint8_t theBuffer[], const uint8_t theMessage[], uint16_t theMessageLength) {
+    if (isRunning() && !isBusy()) {
+        finish(false);        // its tag left, or its operation timed out, before it completed
+    }
+    readRequests = theReader.getStatistics().nmbrOfRequests;
+    if (isBusy() || ((nullptr == theMessage) && (theMessageLength > 0)) || !theReader.read(theBuffer, firstPage, static_cast<uint16_t>(getNmbrOfPagesToRead(theMessageLength)))) {
+        return false;
+    }
+    image          = theBuffer;
+    message        = theMessage;
+    messageLength  = theMessageLength;
+    nmbrOfWrites   = 0;
+    activation     = theNci.getRfConnection().getNmbrOfOpens();
+    writeStartTime = micros();
+    theState       = State::reading;
+    return true;
+}
+
+bool Type2TagWriter::run() {
+    if (!isRunning()) {
+        return true;
+    }
+    const NciConnection &theConnection = theNci.getRfConnection();
+    if (!isBusy()) {
+        finish(false);        // the connection was closed, and maybe opened again for another tag
+        return true;
+    }
+    if (State::reading == theState) {
+        if (!theReader.run()) {
+            return false;
+        }
+        theStatistics.nmbrOfReadRequests += theReader.getStatistics().nmbrOfRequests - readRequests;
+        if (!theReader.isOk() || !plan()) {
+            finish(false);
+            return true;
+        }
+        theState = invalidate ? State::invalidating : State::writing;
+        if (!invalidate || !startBatch()) {
+            advance();
+        }
+        return !isRunning();
+    }
+    if (theConnection.isMessageReceived()) {
+        if (!areAnswersOk()) {
+            finish(false);        // NAK : the tag does not allow writing this page
+            return true;
+        }
+        nmbrOfWrites += batchSize;
+        theStatistics.nmbrOfWrites += batchSize;
+        advance();
+        return !isRunning();
+    }
+    if (!theConnection.isOpen() || (theNci.getNmbrOfInterfaceErrors() != interfaceErrors) || ((millis() - batchStartTime) >= batchTimeOut)) {
+        finish(false);        // the tag left, or did not answer
+        return true;
+    }
+    queueWrites();        // the NCI takes the next WRITE as soon as it has room for it
+    return false;
+}
+
+bool Type2TagWriter::isBusy() const {
+    return isRunning() && (activation == theNci.getRfConnection().getNmbrOfOpens());
+}
+
+bool Type2TagWriter::isRunning() const {
+    return (State::idle != theState) && (State::done != theState) && (State::failed != theState);
+}
+
+bool Type2TagWriter::isOk() const {
+    return (State::done == theState);
+}
+
+Type2TagReader &Type2TagWriter::getReader() {
+    return theReader;
+}
+
+const Type2TagWriterStatistics &Type2TagWriter::getStatistics() const {
+    return theStatistics;
+}
+
+void Type2TagWriter::resetStatistics() {
+    theStatistics = Type2TagWriterStatistics();
+}
+
+bool Type2TagWriter::plan() {
+    // Capability Container : NDEF magic number, and write access. NFC Forum Type 2 Tag Operation specification, section 6.1
+    if ((0xE1 != image[0]) || (0x00 != (image[3] & 0xF0))) {
+        return false;
+    }
+    uint32_t readLength = getNmbrOfPagesToRead(messageLength) * Type2TagReader::pageSize;
+    uint32_t dataEnd    = 4 + (image[2] * 8U);        // in image, the Data Area starts at page 4
+    uint32_t offset     = 4;
+    ndefFound           = false;
+    while (offset < readLength) {
+        uint8_t type = image[offset];
+        if (0x03 == type) {        // NDEF Message TLV
+            ndefFound = true;
+            break;
+        }
+        if (0xFE == type) {        // Terminator TLV : no message yet, the new one goes here
+            break;
+        }
+        if (0x00 == type) {        // NULL TLV
+            offset++;
+        } else if ((offset + 3) < readLength) {        // Lock Control, Memory Control or proprietary TLV : skip it
+            offset += (0xFF == image[offset + 1]) ? (4U + ((image[offset + 2] << 8) | image[offset + 3])) : (2U + image[offset + 1]);
+        } else {
+            return false;
+        }
+    }
+    uint32_t tlvLength = 1 + ((messageLength < 0xFF) ? 1 : 3) + messageLength;
+    if ((offset >= readLength) || ((offset + tlvLength) > dataEnd)) {
+        return false;        // no room for the message
+    }
+    if ((offset + tlvLength) < dataEnd) {
+        tlvLength++;        // Terminator TLV, only when the message does not fill the Data Area
+    }
+    if ((offset + tlvLength) > readLength) {
+        return false;        // more than controlLength bytes of TLVs before it : the new NDEF TLV ends beyond the buffer, so its pages can not be compared
+    }
+    tlvOffset  = static_cast<uint16_t>(offset);
+    tlvEnd     = static_cast<uint16_t>(offset + tlvLength);
+    lengthPage = static_cast<uint8_t>(firstPage + ((ndefFound ? (offset + 1) : offset) / Type2TagReader::pageSize));        // the Terminator TLV keeps everything behind it invalid until the NDEF TLV's type replaces it
+    lastPage   = static_cast<uint8_t>(firstPage + ((tlvEnd - 1) / Type2TagReader::pageSize));
+    nextPage   = static_cast<uint8_t>(firstPage + (offset / Type2TagReader::pageSize));
+    invalidate = false;
+    uint32_t nmbrOfPages = 0;
+    for (uint8_t page = nextPage; page <= lastPage; page++) {
+        if (isPageChanged(page)) {
+            nmbrOfPages++;
+        } else {
+            theStatistics.nmbrOfPagesUnchanged++;
+        }
+    }
+    if (ndefFound && (0x00 != image[offset + 1])) {
+        invalidate = (nmbrOfPages > (isPageChanged(lengthPage) ? 1U : 0U));        // a single page is written at once, the old message stays valid until then
+    }
+    return true;
+}
+
+uint8_t Type2TagWriter::getNewByte(uint32_t offset) const {
+    if ((offset < tlvOffset) || (offset >= tlvEnd)) {
+        return image[offset];
+    }
+    uint32_t index = offset - tlvOffset;
+    if (0 == index) {
+        return 0x03;
+    }
+    if (messageLength < 0xFF) {
+        index -= 1;
+    } else if (1 == index) {
+        return 0xFF;        // 3 byte length format
+    } else if (2 == index) {
+        return static_cast<uint8_t>(messageLength >> 8);
+    } else if (3 == index) {
+        return static_cast<uint8_t>(messageLength);
+    } else {
+        index -= 3;
+    }
+    if (0 == index) {
+        return static_cast<uint8_t>(messageLength);
+    }
+    index--;
+    return (index < messageLength) ? message[index] : 0xFE;
+}
+
+bool Type2TagWriter::isPageChanged(uint8_t page) const {
+    uint32_t offset = (page - firstPage) * Type2TagReader::pageSize;
+    for (uint32_t index = 0; index < Type2TagReader::pageSize; index++) {
+        if (getNewByte(offset + index) != image[offset + index]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Type2TagWriter::addWrite(uint8_t page) {
+    uint8_t *command = commands[batchSize++];
+    uint32_t offset  = (page - firstPage) * Type2TagReader::pageSize;
+    command[0]       = writeCommand;
+    command[1]       = page;
+    for (uint32_t index = 0; index < Type2TagReader::pageSize; index++) {
+        command[2 + index] = getNewByte(offset + index);
+    }
+    if (State::invalidating == theState) {
+        command[2 + (tlvOffset + 1 - offset)] = 0x00;        // length 0 : an empty message, whatever the other pages hold
+    }
+}
+
+bool Type2TagWriter::startBatch() {
+    batchSize = 0;
+    if (State::writing == theState) {
+        while ((batchSize < maxBatchSize) && (nextPage <= lastPage)) {
+            uint8_t page = nextPage++;
+            if ((lengthPage != page) && isPageChanged(page)) {
+                addWrite(page);
+            }
+        }
+    } else if (invalidate || isPageChanged(lengthPage)) {
+        addWrite(lengthPage);
+    }
+    if (0 == batchSize) {
+        return false;
+    }
+    theNci.setDataReceiveBuffer(answers, batchSize * answerLength, batchSize);
+    nmbrOfQueued    = 0;
+    interfaceErrors = theNci.getNmbrOfInterfaceErrors();
+    batchStartTime  = millis();
+    batchTimeOut    = 20 + (batchSize * writeTimeOut);
+    queueWrites();
+    return true;
+}
+
+void Type2TagWriter::queueWrites() {
+    while ((nmbrOfQueued < batchSize) && theNci.sendData(commands[nmbrOfQueued], writeLength)) {
+        nmbrOfQueued++;
+    }
+}
+
+bool Type2TagWriter::areAnswersOk() const {
+    const NciConnection &theConnection = theNci.getRfConnection();
+    if (theConnection.isOverflow() || ((batchSize * answerLength) != theConnection.getReceivedLength())) {
+        return false;
+    }
+    for (uint32_t index = 0; index < batchSize; index++) {
+        if ((ack != answers[index * answerLength]) || (STATUS_OK != answers[(index * answerLength) + 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Type2TagWriter::advance() {
+    if (State::invalidating == theState) {
+        theState = State::writing;
+    }
+    if (State::writing == theState) {
+        if (startBatch()) {
+            return;
+        }
+        theState = State::committing;
+        if (startBatch()) {
+            return;
+        }
+    }
+    finish(true);
+}
+
+void Type2TagWriter::finish(bool isOk) {
+    theNci.setDataReceiveBuffer(nullptr, 0);
+    if (isOk) {
+        unsigned long duration = micros() - writeStartTime;
+        theState               = State::done;
+        theStatistics.nmbrOfTags++;
+        theStatistics.writeTime += duration;
+        theStatistics.lastNmbrOfWrites = nmbrOfWrites;
+        theStatistics.lastWriteTime    = duration;
+    } else {
+        theState = State::failed;
+        theStatistics.nmbrOfFailures++;
+    }
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+// SPDX-License-Identifier: CC-BY-NC-SA-4.0 OR GPL-3.0-or-later
+// #############################################################################
+// ###                                                                       ###
+// ### NXP PN7150 Driver                                                     ###
+// ###                                                                       ###
+// ### https://github.com/Strooom/PN7150                                     ###
+// ### Author(s) : Pascal Roobrouck - @strooom                               ###
+// ### License : CC-BY-NC-SA-4.0 OR GPL-3.0-or-later                         ###
+// ###                                                                       ###
+// #############################################################################
+
+// Summary :
+//   Reading the memory of NFC Forum Type 2 Tags : NTAG, MIFARE Ultralight, .. They are activated on the Frame RF Interface, so each command is one
+//   Data message to the tag, and its answer comes back with a status byte added by the NFCC.
+//
+//   The reader first asks GET_VERSION. NXP tags which answer it, NTAG21x and Ultralight EV1, also know FAST_READ, which reads any range of pages in
+//   one exchange : each request asks as many pages as fit in one Data packet of the NFCC (Max Data Packet Payload Size, minus the status byte).
+//   Other tags are read with READ, 4 pages per exchange. Tags which do not know GET_VERSION (MIFARE Ultralight, NTAG203, ..) stop answering after it
+//   until they are activated again : for those, setDetectVersion(false).
+//
+//   Answers are reassembled straight into the application's buffer, without a copy. The status byte of each answer lands on the first byte of the
+//   next one, so the buffer needs getBufferSize() bytes : one more than the pages read, and at least one READ.
+//
+//   Nothing blocks : read() starts, and run() advances it after every NCI::run(). Simplest is to run it as the NciTagOperation, so the tag stays
+//   activated, and no presence check uses the connection, until the read is done :
+//
+//       bool readTag(NCI &theNci, uint8_t tagIndex, void *context) {
+//           Type2TagReader &reader = *static_cast<Type2TagReader *>(context);
+//           if (!reader.isBusy() && !reader.read(memory, 0, 231)) {
+//               return true;        // no Type 2 Tag
+//           }
+//           return reader.run();
+//       }
+//       nfc.setTagOperation(readTag, &reader, 500);
+//
+//   Writing an NDEF message, Type2TagWriter, first reads the tag's current contents, and then only WRITEs the pages which change. A provisioning
+//   line which writes a new serial number into an otherwise identical URI so needs a few WRITEs instead of one per 4 bytes. The WRITEs are queued
+//   in batches : the next one goes to the NFCC as soon as it has a credit for it, and all their ACKs are collected in one receive buffer.
+//   The tag is never left with an invalid message, following the NDEF write procedure of the NFC Forum Type 2 Tag Operation specification :
+//   when more than one page changes, the NDEF TLV's length is first set to 0, then the other pages are written, and the length is written last.
+//   Interrupted, the tag holds its old message, or an empty one.
+
+#include <stdint.h>        // Gives us access to uint8_t types etc
+#include "NCI.h"
+
+class Type2TagVersion {        // answer to GET_VERSION. NTAG213/215/216 datasheet, section 10.1
+  public:
+    uint8_t vendorId;              // 0x04 : NXP
+    uint8_t productType;           // 0x03 : MIFARE Ultralight, 0x04 : NTAG
+    uint8_t productSubtype;        //
+    uint8_t majorVersion;          //
+    uint8_t minorVersion;          //
+    uint8_t storageSize;           // 0x0F : NTAG213, 0x11 : NTAG215, 0x13 : NTAG216
+    uint8_t protocolType;          // 0x03 : ISO/IEC 14443-3 compliant
+};
+
+class Type2TagStatistics {
+  public:
+    uint32_t nmbrOfReads{0};           // read()s which completed
+    uint32_t nmbrOfFailures{0};        // read()s which did not : the tag left, did not answer, or answered a NAK
+    uint32_t nmbrOfRequests{0};        // exchanges with the tag, GET_VERSION included : the RF round trips
+    uint32_t nmbrOfBytes{0};           // tag memory read by the completed read()s
+    unsigned long readTime{0};         // [us] summed over the completed read()s
+
+    unsigned long getBytesPerSecond() const;
+};
+
+class Type2TagReader {
+  public:
+    static constexpr uint32_t pageSize  = 4;        // [bytes]
+    static constexpr uint32_t readPages = 4;        // READ always answers 4 pages
+    static constexpr uint32_t getBufferSize(uint32_t nmbrOfPages) {
+        return (((nmbrOfPages < readPages) ? readPages : nmbrOfPages) * pageSize) + 1;
+    }
+
+    explicit Type2TagReader(NCI &theNci);
+    bool read(uint8_t buffer[], uint8_t firstPage, uint16_t nmbrOfPages);        // starts reading into buffer, of getBufferSize(nmbrOfPages). false if busy, or no Type 2 Tag is activated
+    bool run();                                                                   // call after NCI::run() : true once the read completed or failed
+    bool isBusy() const;                                                          // a read() runs on the activated tag. One on an earlier activation is abandoned by the next read()
+    bool isOk() const;                                                            // the last read() completed
+    uint32_t getNmbrOfBytesRead() const;                                          // buffer[0..n) holds the tag's contents already, also while the read() runs, eg. for NdefParser
+    void setDetectVersion(bool enable);                                           // false : no GET_VERSION, always READ. Default true
+    bool hasVersion() const;                                                      // the tag answered GET_VERSION in the last read()
+    const Type2TagVersion &getVersion() const;
+    uint16_t getNmbrOfPages() const;                                              // of the whole tag, from GET_VERSION. 0 if unknown
+    const Type2TagStatistics &getStatistics() const;
+    void resetStatistics();
+
+  private:
+    enum class State : uint8_t {
+        idle,
+        getVersion,        // waiting for the answer to GET_VERSION
+        reading,           // waiting for the answer to READ or FAST_READ
+        done,
+        failed
+    };
+    static constexpr uint8_t getVersionCommand = 0x60;
+    static constexpr uint8_t readCommand       = 0x30;
+    static constexpr uint8_t fastReadCommand   = 0x3A;
+    static constexpr uint32_t versionLength    = 8;        // [bytes] answer to GET_VERSION
+
+    NCI &theNci;
+    State theState{State::idle};
+    bool detectVersion{true};
+    bool versionKnown{false};
+    bool fastRead{false};                                 // the tag knows FAST_READ
+    Type2TagVersion theVersion{};
+    uint8_t *buffer{nullptr};
+    uint8_t firstPage{0};
+    uint16_t nmbrOfPages{0};
+    uint16_t pagesRead{0};
+    uint8_t command[3];                                   // the request in flight, it must stay valid until sent
+    uint8_t versionAnswer[versionLength + 1];             // + status byte
+    uint8_t *answer{nullptr};                             // where the answer in flight goes
+    uint32_t answerLength{0};                             // [bytes] expected, without the status byte
+    uint32_t interfaceErrors{0};                          // NCI's count when the request was sent : a new one means the tag did not answer
+    uint32_t activation{0};                               // getNmbrOfOpens() of the Static RF Connection the read() started on
+    unsigned long requestStartTime{0};                    // [ms]
+    unsigned long requestTimeOut{0};                      // [ms]
+    unsigned long readStartTime{0};                       // [us]
+    Type2TagStatistics theStatistics;
+
+    bool isRunning() const;                                                                          // waiting for an answer, maybe from a tag which already left
+    bool sendRequest();                                                                              // the next READ or FAST_READ
+    bool send(uint32_t commandLength, uint8_t theAnswer[], uint32_t theAnswerLength);
+    bool isAnswerOk() const;
+    void versionReceived();
+    void finish(bool isOk);
+};
+
+class Type2TagWriterStatistics {
+  public:
+    uint32_t nmbrOfTags{0};                // write()s which completed : the tag holds the new message
+    uint32_t nmbrOfFailures{0};            // write()s which did not : the tag holds its old message, or an empty one
+    uint32_t nmbrOfWrites{0};              // WRITEs the tag ACKed : the RF round trips spent writing
+    uint32_t nmbrOfPagesUnchanged{0};      // pages of the new NDEF TLV which already held it, so were not written
+    uint32_t nmbrOfReadRequests{0};        // the RF round trips spent reading the current contents
+    unsigned long writeTime{0};            // [us] summed over the completed write()s, reading the current contents included
+    uint32_t lastNmbrOfWrites{0};          // WRITEs of the last completed write()
+    unsigned long lastWriteTime{0};        // [us] of the last completed write()
+};
+
+class Type2TagWriter {
+  public:
+    static constexpr uint32_t maxBatchSize  = 8;         // WRITEs queued before their ACKs are checked
+    static constexpr uint32_t controlLength = 12;        // [bytes] room for Lock and Memory Control TLVs before the NDEF TLV. A tag with more fails the write()
+    static constexpr uint32_t getNmbrOfPagesToRead(uint32_t messageLength) {
+        return 1 + ((controlLength + 4 + messageLength + 1 + 3) / Type2TagReader::pageSize);        // the Capability Container, the NDEF TLV with a 3 byte length and the Terminator TLV
+    }
+    static constexpr uint32_t getBufferSize(uint32_t messageLength) {
+        return Type2TagReader::getBufferSize(getNmbrOfPagesToRead(messageLength));
+    }
+
+    explicit Type2TagWriter(NCI &theNci);
+    bool write(uint8_t buffer[], const uint8_t message[], uint16_t messageLength);        // starts writing message, which stays valid until done. buffer, of getBufferSize(messageLength), takes the current contents. false if busy, or no Type 2 Tag is activated
+    bool run();                                                                           // call after NCI::run() : true once the write completed or failed
+    bool isBusy() const;                                                                  // a write() runs on the activated tag. One on an earlier activation is abandoned by the next write()
+    bool isOk() const;                                                                    // the last write() completed
+    Type2TagReader &getReader();                                                          // which reads the current contents, eg. to setDetectVersion()
+    const Type2TagWriterStatistics &getStatistics() const;
+    void resetStatistics();
+
+  private:
+    enum class State : uint8_t {
+        idle,
+        reading,             // reading the current contents
+        invalidating,        // writing the NDEF TLV's length as 0
+        writing,             // writing the changed pages, except the one with the length
+        committing,          // writing the page with the length
+        done,
+        failed
+    };
+    static constexpr uint8_t writeCommand        = 0xA2;
+    static constexpr uint8_t ack                 = 0x0A;        // 4 bit ACK, passed on by the NFCC as one byte
+    static constexpr uint32_t writeLength        = 6;           // [bytes] WRITE, page and 4 bytes
+    static constexpr uint32_t answerLength       = 2;           // [bytes] ACK or NAK, and the status byte
+    static constexpr uint8_t firstPage           = 3;           // buffer[0] is the Capability Container
+    static constexpr unsigned long writeTimeOut  = 10;          // [ms] per WRITE : NTAG21x take 4.1 ms to program a page
+
+    NCI &theNci;
+    Type2TagReader theReader;
+    State theState{State::idle};
+    uint8_t *image{nullptr};                              // the current contents, from page 3
+    const uint8_t *message{nullptr};
+    uint16_t messageLength{0};
+    uint16_t tlvOffset{0};                                // in image : where the NDEF TLV goes
+    uint16_t tlvEnd{0};                                   // in image : after the new NDEF TLV and Terminator TLV
+    uint8_t lengthPage{0};                                // the page written last, which makes the new message valid
+    uint8_t lastPage{0};                                  // the last page of the new NDEF TLV
+    uint8_t nextPage{0};                                  // the next page to compare, and maybe write
+    bool ndefFound{false};                                // the tag has an NDEF TLV already, otherwise it goes where the Terminator TLV is
+    bool invalidate{false};
+    uint8_t commands[maxBatchSize][writeLength];          // the batch in flight, they must stay valid until sent
+    uint8_t answers[maxBatchSize * answerLength];
+    uint32_t batchSize{0};
+    uint32_t nmbrOfQueued{0};                             // of the batch, handed to the NCI so far
+    uint32_t nmbrOfWrites{0};                             // of this write()
+    uint32_t readRequests{0};                             // the reader's count when the read started
+    uint32_t interfaceErrors{0};
+    uint32_t activation{0};
+    unsigned long batchStartTime{0};                      // [ms]
+    unsigned long batchTimeOut{0};                        // [ms]
+    unsigned long writeStartTime{0};                      // [us]
+    Type2TagWriterStatistics theStatistics;
+
+    bool isRunning() const;
+    bool plan();                                                        // find the NDEF TLV in the current contents, false if the new one does not fit
+    uint8_t getNewByte(uint32_t offset) const;                          // the tag's contents after the write, offset in image
+    bool isPageChanged(uint8_t page) const;
+    void addWrite(uint8_t page);
+    bool startBatch();                                                  // queue the next WRITEs of theState, false if there are none
+    void queueWrites();
+    bool areAnswersOk() const;
+    void advance();                                                     // the batch was ACKed : on to the next one, or the next state
+    void finish(bool isOk);
+};